@@ -187,14 +187,64 @@ namespace Mono.Xaml
 		protected override void HydrateInternal (object value, Stream xaml, bool createNamescope, bool validateTemplates, bool import_default_xmlns)
 		{
 			string xaml_str;
+			byte [] data;
 
-			using (StreamReader reader = new StreamReader (xaml)) {
+			using (MemoryStream ms = new MemoryStream ()) {
+				byte [] buffer = new byte [4096];
+				int n;
+
+				while ((n = xaml.Read (buffer, 0, buffer.Length)) > 0)
+					ms.Write (buffer, 0, n);
+				data = ms.ToArray ();
+			}
+
+			// tokenized with mxamlc, or maybe compiled in the background (see Deployment.PrecompileXaml)
+			if (IsBinaryXaml (data) || (Deployment.Current.PrecompilingXaml && !IsUtf16 (data))) {
+				HydrateBinary (value, data, createNamescope, validateTemplates, import_default_xmlns);
+				return;
+			}
+
+			using (StreamReader reader = new StreamReader (new MemoryStream (data))) {
 				xaml_str = reader.ReadToEnd ();
 			}
 
 			HydrateInternal (value, xaml_str, createNamescope, validateTemplates, import_default_xmlns);
 		}
 
+		static bool IsBinaryXaml (byte [] data)
+		{
+			// XAML_BINARY_MAGIC in xaml-binary.h
+			return data.Length >= 4 && data [0] == 'M' && data [1] == 'X' && data [2] == 'B' && data [3] == 'F';
+		}
+
+		// the native loader only reads UTF-8
+		internal static bool IsUtf16 (byte [] data)
+		{
+			return data.Length >= 2 && ((data [0] == 0xff && data [1] == 0xfe) || (data [0] == 0xfe && data [1] == 0xff));
+		}
+
+		void HydrateBinary (object value, byte [] data, bool createNamescope, bool validateTemplates, bool import_default_xmlns)
+		{
+			Value v = Value.FromObject (value);
+			try {
+				Kind k;
+				CreateNativeLoader ();
+
+				XamlLoaderFlags flags = 0;
+				if (validateTemplates)
+					flags |= XamlLoaderFlags.ValidateTemplates;
+				if (import_default_xmlns)
+					flags |= XamlLoaderFlags.ImportDefaultXmlns;
+				IntPtr ret = NativeMethods.xaml_loader_hydrate_from_binary (NativeLoader, data, data.Length, ref v, createNamescope, out k, (int) flags);
+				if (ret == IntPtr.Zero)
+					throw new XamlParseException ("Invalid XAML file");
+			}
+			finally {
+				v.Dispose ();
+				FreeNativeLoader ();
+			}
+		}
+
 		protected override void HydrateInternal (object value, string xaml, bool createNamescope, bool validateTemplates, bool import_default_xmlns)
 		{
 			Value v = Value.FromObject (value);
@@ -77,6 +77,16 @@ namespace Mono.Xaml {
 			return new ManagedXamlLoader (assembly, resourceBase, surface, plugin);
 		}
 
+		// false if CreateLoader returns the managed (SL4) parser
+		public static bool UsesNativeParser {
+			get {
+				if (use_managed == null)
+					UseManaged (ShouldUseManagedParser ());
+
+				return use_managed != true;
+			}
+		}
+
 		public static XamlLoader CreateLoader ()
 		{
 			return CreateLoader (Deployment.Current.EntryAssembly, null, Deployment.Current.Surface.Native, PluginHost.Handle);
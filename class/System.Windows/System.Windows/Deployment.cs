@@ -27,11 +27,13 @@
 //
 
 using System;
+using System.Collections;
 using System.Globalization;
 using System.IO;
 using System.Net;
 using System.Net.Browser;
 using System.Reflection;
+using System.Resources;
 using System.Security;
 using System.Threading;
 using System.Collections.Generic;
@@ -57,6 +59,7 @@ namespace System.Windows {
 		string xap_dir;
 		Types types;
 		Stack<Uri> parse_uri_stack;
+		bool precompiling_xaml;
 
 		static bool is_shutting_down;
 
@@ -193,6 +196,13 @@ namespace System.Windows {
 			}
 		}
 
+		// true if some of the application's xaml is being compiled in the background
+		internal bool PrecompilingXaml {
+			get {
+				return precompiling_xaml;
+			}
+		}
+
 		internal string XapDir {
 			get {
 				return xap_dir;
@@ -669,6 +679,46 @@ namespace System.Windows {
 			}
 		}
 
+		// Hands the xaml documents embedded in the application's assemblies to
+		// the native XamlPrecompiler, which tokenizes them on worker threads
+		// while App.xaml (which is loaded right away) and the first page are
+		// being created.
+		void PrecompileXaml ()
+		{
+			if (!XamlLoaderFactory.UsesNativeParser || Environment.GetEnvironmentVariable ("MOONLIGHT_NO_XAML_PRECOMPILER") != null)
+				return;
+
+			foreach (Assembly a in Assemblies) {
+				string assembly_name = a.GetName ().Name;
+				ResourceSet set;
+
+				try {
+					var manager = new ResourceManager (assembly_name + ".g", a);
+					set = manager.GetResourceSet (CultureInfo.InvariantCulture, true, false);
+				} catch {
+					continue;
+				}
+
+				if (set == null)
+					continue;
+
+				foreach (DictionaryEntry entry in set) {
+					string name = entry.Key as string;
+					Stream stream = entry.Value as Stream;
+
+					if (name == null || stream == null || name == "app.xaml" || !name.EndsWith (".xaml", StringComparison.OrdinalIgnoreCase))
+						continue;
+
+					byte [] data = new byte [stream.Length];
+					if (stream.Read (data, 0, data.Length) != data.Length || ManagedXamlLoader.IsUtf16 (data))
+						continue;
+
+					NativeMethods.deployment_precompile_xaml (native, assembly_name + ";component/" + name, data, data.Length);
+					precompiling_xaml = true;
+				}
+			}
+		}
+
 		// will be called when all assemblies are loaded (can be async for downloading)
 		// which means we need to report errors to the plugin, since it won't get it from calling managed code
 		internal bool CreateApplication ()
@@ -711,6 +761,8 @@ namespace System.Windows {
 			foreach (Assembly a in Assemblies)
 				Application.LoadXmlnsDefinitionMappings (a);
 
+			PrecompileXaml ();
+
 			Application instance = null;
 
 			try {
@@ -127,7 +127,7 @@ namespace System.Windows {
 
 		private new void Initialize ()
 		{
-			int c = Count;
+			int c = NativeMethods.collection_get_count (native);
 			for (int i = 0; i < c; i ++) {
 				// FIXME
 			}
@@ -136,12 +136,32 @@ namespace System.Windows {
 			Events.AddHandler (this, EventIds.ResourceDictionary_ChangedEvent, resource_dictionary_changed);
 		}
 
+		// entries parsed from xaml may not have been created yet,
+		// create them before exposing the whole dictionary
+		void RealizeDeferred ()
+		{
+			NativeMethods.resource_dictionary_realize_deferred (native);
+		}
+
+		// creates the entry for @key if it hasn't been created yet,
+		// returns whether it did
+		bool RealizeDeferred (object key)
+		{
+			var str_key = key as string;
+			if (str_key == null)
+				return false;
+			return NativeMethods.resource_dictionary_realize_deferred_key (native, str_key);
+		}
+
 		//
 		// Properties
 		//
 		
 		public int Count {
-			get { return NativeMethods.collection_get_count (native); }
+			get {
+				RealizeDeferred ();
+				return NativeMethods.collection_get_count (native);
+			}
 		}
 		
 		public bool IsReadOnly {
@@ -154,6 +174,7 @@ namespace System.Windows {
 		
 		public ICollection Keys {
 			get {
+				RealizeDeferred ();
 				if (managedDict == null)
 					managedDict = new Dictionary<object, object> ();
 				return managedDict.Keys;
@@ -162,6 +183,7 @@ namespace System.Windows {
 
 		public ICollection Values {
 			get {
+				RealizeDeferred ();
 				if (managedDict == null)
 					managedDict = new Dictionary<object, object> ();
 				return managedDict.Values;
@@ -177,6 +199,11 @@ namespace System.Windows {
 				if (managedDict != null && managedDict.ContainsKey (key))
 					return managedDict[key];
 
+				// entries parsed from xaml are only created the first time
+				// they're looked up, creating one puts it in our cache
+				if (RealizeDeferred (key) && managedDict != null && managedDict.ContainsKey (key))
+					return managedDict[key];
+
 				// now iterate over the merged dictionaries
 				PresentationFrameworkCollection<ResourceDictionary> col = MergedDictionaries;
 				for (int i = col.Count - 1; i >= 0; i --) {
@@ -399,6 +426,8 @@ namespace System.Windows {
 
 			if (managedDict != null && managedDict.ContainsKey (key))
 				return true;
+			if (RealizeDeferred (key) && managedDict != null && managedDict.ContainsKey (key))
+				return true;
 			PresentationFrameworkCollection<ResourceDictionary> col = MergedDictionaries;
 			for (int i = col.Count - 1; i >= 0; i --) {
 				ResourceDictionary rd = col[i];
@@ -426,6 +455,7 @@ namespace System.Windows {
 		
 		public IDictionaryEnumerator GetEnumerator ()
 		{
+			RealizeDeferred ();
 			if (managedDict == null)
 				managedDict = new Dictionary<object, object> ();
 			return ((IDictionary)managedDict).GetEnumerator ();
@@ -568,6 +598,7 @@ namespace System.Windows {
 		
 		IEnumerator<KeyValuePair<object, object>> IEnumerable<KeyValuePair<object, object>>.GetEnumerator ()
 		{
+			RealizeDeferred ();
 			if (managedDict == null)
 				managedDict = new Dictionary<object, object> ();
 			return managedDict.GetEnumerator();
@@ -2921,12 +2921,136 @@ class Generator {
 
 		text.AppendLine ();
 
+		GenerateNativeTypeHash (all, text);
+
 		text.AppendLine ("};");
 		text.AppendLine ();
 
 		Helper.WriteAllText ("src/type-generated.cpp", text.ToString ());
 	}
 
+	// Must match Types::HashName in type.cpp: FNV-1a over the ascii
+	// lowercased name, starting from the offset basis xor'ed with @seed
+	static uint HashName (string name, uint seed)
+	{
+		uint hash = 2166136261 ^ seed;
+
+		unchecked {
+			foreach (char c in name) {
+				hash ^= (uint) Char.ToLowerInvariant (c);
+				hash *= 16777619;
+			}
+		}
+
+		return hash;
+	}
+
+	static uint NextPowerOfTwo (int n)
+	{
+		uint result = 1;
+
+		while (result < n)
+			result <<= 1;
+
+		return result;
+	}
+
+	// Generates a collision free ("hash and displace") table of the
+	// native type names, so Types::Find (name) is one lookup and one string
+	// comparison instead of a scan over all the types.
+	//
+	// The names are split into buckets by HashName (name, 0); each bucket
+	// gets the first seed which puts all its names into free slots of the
+	// table (biggest buckets first).
+	static void GenerateNativeTypeHash (GlobalInfo all, StringBuilder text)
+	{
+		Dictionary<string, string> kinds = new Dictionary<string, string> ();
+
+		kinds.Add ("enum", "ENUM");
+		kinds.Add ("datetime", "DATETIME");
+
+		foreach (TypeInfo type in all.Children.SortedTypesByKind) {
+			if (!type.Annotations.ContainsKey ("IncludeInKinds"))
+				continue;
+
+			string key = type.Name.ToLowerInvariant ();
+			if (kinds.ContainsKey (key))
+				throw new Exception (string.Format ("The native types {0} and {1} only differ by case, Types::Find (name) can't tell them apart", kinds [key], type.KindName));
+			kinds.Add (key, type.KindName);
+		}
+
+		uint bucket_count = NextPowerOfTwo (Math.Max (kinds.Count / 4, 1));
+		uint slot_count = NextPowerOfTwo (kinds.Count * 2);
+		List<string> [] buckets = new List<string> [bucket_count];
+		uint [] seeds = new uint [bucket_count];
+		string [] slots = new string [slot_count];
+
+		for (int i = 0; i < bucket_count; i++)
+			buckets [i] = new List<string> ();
+
+		foreach (string key in kinds.Keys)
+			buckets [HashName (key, 0) & (bucket_count - 1)].Add (key);
+
+		List<int> order = new List<int> ();
+		for (int i = 0; i < bucket_count; i++)
+			order.Add (i);
+		order.Sort (delegate (int a, int b) { return buckets [b].Count != buckets [a].Count ? buckets [b].Count - buckets [a].Count : a - b; });
+
+		foreach (int b in order) {
+			List<uint> taken = new List<uint> ();
+			uint seed;
+
+			if (buckets [b].Count == 0)
+				break;
+
+			for (seed = 1; ; seed++) {
+				taken.Clear ();
+
+				foreach (string key in buckets [b]) {
+					uint slot = HashName (key, seed) & (slot_count - 1);
+					if (slots [slot] != null || taken.Contains (slot))
+						break;
+					taken.Add (slot);
+				}
+
+				if (taken.Count == buckets [b].Count)
+					break;
+
+				if (seed == 1000000)
+					throw new Exception ("Could not generate the native type name hash table");
+			}
+
+			seeds [b] = seed;
+			for (int i = 0; i < taken.Count; i++)
+				slots [taken [i]] = kinds [buckets [b][i]];
+		}
+
+		text.AppendFormat ("const guint32 Types::native_type_hash_bucket_mask = {0};\n", bucket_count - 1);
+		text.AppendFormat ("const guint32 Types::native_type_hash_slot_mask = {0};\n", slot_count - 1);
+		text.AppendLine ();
+
+		text.Append ("const guint32 Types::native_type_hash_seeds [] = {");
+		for (int i = 0; i < bucket_count; i++) {
+			if (i % 16 == 0)
+				text.Append ("\n\t");
+			text.Append (seeds [i]);
+			text.Append (", ");
+		}
+		text.AppendLine ("\n};");
+		text.AppendLine ();
+
+		text.Append ("const guint16 Types::native_type_hash_slots [] = {");
+		for (int i = 0; i < slot_count; i++) {
+			if (i % 4 == 0)
+				text.Append ("\n\t");
+			text.Append ("Type::");
+			text.Append (slots [i] == null ? "INVALID" : slots [i]);
+			text.Append (", ");
+		}
+		text.AppendLine ("\n};");
+		text.AppendLine ();
+	}
+
 	static void GenerateTypeH (GlobalInfo all)
 	{
 		const string file = "src/type.h";
@@ -212,7 +212,7 @@ AnimationStorage::ApplyCurrentValue ()
 			applier = clock->GetTimeManager ()->GetApplier ();
 		
 		if (applier)
-			applier->AddPropertyChange (targetobj, targetprop, new Value (*current_value), APPLIER_PRECEDENCE_ANIMATION);
+			applier->AddPropertyChange (targetobj, targetprop, current_value, APPLIER_PRECEDENCE_ANIMATION);
 	}
 }
 
@@ -243,9 +243,7 @@ AnimationStorage::ResetPropertyValue ()
 		applier = clock->GetTimeManager()->GetApplier ();
 
 	if (applier)
-		applier->AddPropertyChange (targetobj, targetprop,
-			    stopValue ? new Value (*stopValue) : NULL,
-			    APPLIER_PRECEDENCE_ANIMATION_RESET);
+		applier->AddPropertyChange (targetobj, targetprop, stopValue, APPLIER_PRECEDENCE_ANIMATION_RESET);
 }
 
 void
@@ -11,64 +11,47 @@
 
 #include <config.h>
 #include "applier.h"
+#include "color.h"
+#include "frame-profiler.h"
 
 namespace Moonlight {
 
-typedef struct {
-	DependencyObject *object;
-	GList *properties_list;
-} object_indexer;
-
-typedef struct {
-	DependencyProperty *property;
-	GList *values_list;
-} property_indexer;
-
-typedef struct {
-	int precedence;
-	Value *v;
-} value_indexer;
-
 Applier::Applier ()
 {
 	readonly = false;
-	objects = NULL;
+	changes = g_array_new (false, false, sizeof (Change));
+	objects = g_hash_table_new (g_direct_hash, g_direct_equal);
+	sequence = 0;
 }
 
 Applier::~Applier ()
 {
-	if (objects) {
-		readonly = true;
-		Flush ();
-	}
+	readonly = true;
+	Flush ();
+	g_array_free (changes, true);
+	g_hash_table_destroy (objects);
 }
 
-static gint
-property_indexer_compare_func (property_indexer *a, property_indexer *b)
+DependencyObject **
+Applier::GetWeakRef (DependencyObject *object)
 {
-	if (a->property == b->property)
-		return 0;
-	else
-		return -1;
-}
+	DependencyObject **weak = (DependencyObject **) g_hash_table_lookup (objects, object);
 
-static gint
-value_indexer_compare_func (value_indexer *a, value_indexer *b)
-{
-	if (a->precedence < b->precedence)
-		return -1;
-	else if (a->precedence > b->precedence)
-		return 1;
-	else
-		return 0;
+	if (weak == NULL) {
+		weak = g_new (DependencyObject *, 1);
+		*weak = object;
+		object->AddHandler (EventObject::DestroyedEvent, EventObject::ClearWeakRef, weak);
+		g_hash_table_insert (objects, object, weak);
+	}
+
+	return weak;
 }
 
 void
-Applier::AddPropertyChange (DependencyObject *object, DependencyProperty *property, Value *v, int precedence)
+Applier::AddPropertyChange (DependencyObject *object, DependencyProperty *property, const Value *v, int precedence)
 {
 	if (readonly) {
 		g_warning ("Applier::AddPropertyChange is being called during shutdown");
-		delete v;
 		return;
 	}
 
@@ -77,122 +60,147 @@ Applier::AddPropertyChange (DependencyObject *object, DependencyProperty *proper
 			object->SetValue (property, v);
 		else
 			object->ClearValue (property);
-		delete v;
 		return;
 	}
 
-	value_indexer *v_indexer = NULL;
-	property_indexer *p_indexer = NULL;
-	object_indexer *o_indexer = NULL;
-
-	if (!objects)
-		objects = g_hash_table_new (g_direct_hash, g_direct_equal);
-	else
-		o_indexer = (object_indexer *) g_hash_table_lookup (objects, object);
-
-	if (o_indexer == NULL) {
-		o_indexer = g_new (object_indexer, 1);
-		o_indexer->object = object;
-		object->AddHandler (EventObject::DestroyedEvent, EventObject::ClearWeakRef, &o_indexer->object);
-		o_indexer->properties_list = NULL;
-		g_hash_table_insert (objects, object, o_indexer);
+	Change change;
+
+	change.object = object;
+	change.weak = GetWeakRef (object);
+	change.property = property;
+	change.precedence = precedence;
+	change.sequence = sequence++;
+
+	if (v == NULL) {
+		change.kind = ChangeClear;
+	} else if (v->GetIsNull ()) {
+		change.kind = ChangeValue;
+		change.u.value = new Value (*v);
+	} else {
+		switch (v->GetKind ()) {
+		case Type::DOUBLE:
+			change.kind = ChangeDouble;
+			change.u.d = v->AsDouble ();
+			break;
+		case Type::COLOR: {
+			Color *color = v->AsColor ();
+			change.kind = ChangeColor;
+			change.u.color.r = color->r;
+			change.u.color.g = color->g;
+			change.u.color.b = color->b;
+			change.u.color.a = color->a;
+			break;
+		}
+		case Type::POINT: {
+			Point *point = v->AsPoint ();
+			change.kind = ChangePoint;
+			change.u.point.x = point->x;
+			change.u.point.y = point->y;
+			break;
+		}
+		default:
+			change.kind = ChangeValue;
+			change.u.value = new Value (*v);
+			break;
+		}
 	}
 
-	GList *list_item = g_list_find_custom (o_indexer->properties_list, property, (GCompareFunc) property_indexer_compare_func);
+	g_array_append_val (changes, change);
+}
 
-	if (list_item != NULL)
-		p_indexer = (property_indexer *) list_item->data;
+int
+Applier::CompareChanges (gconstpointer a, gconstpointer b)
+{
+	const Change *ca = (const Change *) a;
+	const Change *cb = (const Change *) b;
+
+	if (ca->object != cb->object)
+		return ca->object < cb->object ? -1 : 1;
+	if (ca->property != cb->property)
+		return ca->property < cb->property ? -1 : 1;
+	if (ca->precedence != cb->precedence)
+		return ca->precedence < cb->precedence ? -1 : 1;
+	// the most recently added change wins among equal precedences
+	if (ca->sequence != cb->sequence)
+		return ca->sequence > cb->sequence ? -1 : 1;
+	return 0;
+}
 
-	if (p_indexer == NULL) {
-		p_indexer = g_new (property_indexer, 1);
-		p_indexer->property = property;
-		p_indexer->values_list = NULL;
-		o_indexer->properties_list = g_list_append (o_indexer->properties_list, p_indexer);
-	}
+void 
+Applier::Apply ()
+{
+	DependencyObject *object = NULL;
+	DependencyProperty *property = NULL;
+	guint count = changes->len;
 
-	v_indexer = g_new (value_indexer, 1);
-	v_indexer->precedence = precedence;
-	v_indexer->v = v;
+	if (count == 0)
+		return;
 
-	p_indexer->values_list = g_list_insert_sorted (p_indexer->values_list, v_indexer, (GCompareFunc) value_indexer_compare_func);
-}
+	g_array_sort (changes, CompareChanges);
 
-static void
-destroy_value_func (value_indexer *v_indexer, gpointer unused)
-{
-	g_return_if_fail (v_indexer != NULL);
-	g_return_if_fail (v_indexer->v != NULL);
+	// property changed handlers may add changes (and reallocate the array),
+	// those are dropped in the next Flush like they used to be
+	for (guint i = 0; i < count; i++) {
+		Change *change = &g_array_index (changes, Change, i);
 
-	delete v_indexer->v;
-	v_indexer->v = NULL;
-	g_free (v_indexer);
-}
+		// only the first change of each (object, property) run is applied
+		if (change->object == object && change->property == property)
+			continue;
 
-static void
-destroy_property_func (property_indexer *p_indexer, gpointer unused)
-{
-	g_return_if_fail (p_indexer != NULL);
-	g_return_if_fail (p_indexer->values_list != NULL);
-
-	g_list_foreach (p_indexer->values_list, (GFunc) destroy_value_func, NULL);
-	g_list_free (p_indexer->values_list);
-	p_indexer->property = NULL;
-	p_indexer->values_list = NULL;
-	g_free (p_indexer);
-}
+		object = change->object;
+		property = change->property;
 
-static void
-destroy_object_func (DependencyObject *object, object_indexer *o_indexer, gpointer unused)
-{
-	g_return_if_fail (object != NULL);
-	g_return_if_fail (o_indexer != NULL);
-
-	g_list_foreach (o_indexer->properties_list, (GFunc) destroy_property_func, NULL);
-	g_list_free (o_indexer->properties_list);
-	if (o_indexer->object)
-		object->RemoveHandler (EventObject::DestroyedEvent, EventObject::ClearWeakRef, &o_indexer->object);
-	g_free (o_indexer);
-}
+		// the object has been destroyed
+		if (*change->weak == NULL)
+			continue;
 
-static void
-apply_property_func (property_indexer *p_indexer, DependencyObject *object)
-{
-	g_return_if_fail (p_indexer->property != NULL);
-	g_return_if_fail (p_indexer->values_list != NULL);
-
-	value_indexer *v_indexer = (value_indexer *) p_indexer->values_list->data;
-	if (v_indexer->v)
-		object->SetValue (p_indexer->property, v_indexer->v);
-	else
-		object->ClearValue (p_indexer->property);
+		switch (change->kind) {
+		case ChangeClear:
+			object->ClearValue (property);
+			break;
+		case ChangeDouble:
+			object->SetAnimatedValue (property, Value (change->u.d));
+			break;
+		case ChangeColor:
+			object->SetAnimatedValue (property, Value (Color (change->u.color.r, change->u.color.g, change->u.color.b, change->u.color.a)));
+			break;
+		case ChangePoint:
+			object->SetAnimatedValue (property, Value (Point (change->u.point.x, change->u.point.y)));
+			break;
+		case ChangeValue:
+			object->SetAnimatedValue (property, change->u.value);
+			break;
+		}
+
+		PROFILE_COUNT (FrameProfilerAnimatedValues);
+	}
 }
 
-static void
-apply_object_func (DependencyObject *object, object_indexer *o_indexer, gpointer unused)
+void
+Applier::Flush ()
 {
-	g_return_if_fail (o_indexer != NULL);
-	if (o_indexer->object == NULL) {
-		// the object has been collected
-		return;
+	for (guint i = 0; i < changes->len; i++) {
+		Change *change = &g_array_index (changes, Change, i);
+
+		if (change->kind == ChangeValue)
+			delete change->u.value;
 	}
-	g_list_foreach (o_indexer->properties_list, (GFunc) apply_property_func, object);
-}
 
-void 
-Applier::Apply ()
-{
-	if (objects)
-		g_hash_table_foreach (objects, (GHFunc) apply_object_func, NULL);
+	g_hash_table_foreach (objects, DestroyWeakRef, NULL);
+	g_hash_table_remove_all (objects);
+
+	// keep the storage around for the next tick
+	g_array_set_size (changes, 0);
 }
 
 void
-Applier::Flush ()
+Applier::DestroyWeakRef (gpointer key, gpointer value, gpointer user_data)
 {
-	if (objects) {
-		g_hash_table_foreach (objects, (GHFunc) destroy_object_func, NULL);
-		g_hash_table_destroy (objects);
-		objects = NULL;
-	}
+	DependencyObject **weak = (DependencyObject **) value;
+
+	if (*weak)
+		(*weak)->RemoveHandler (EventObject::DestroyedEvent, EventObject::ClearWeakRef, weak);
+	g_free (weak);
 }
 
 };
@@ -25,19 +25,68 @@
 
 namespace Moonlight {
 
-class Applier {
-
- private:
-	GHashTable *objects;
-	bool readonly;
+/*
+ * Applier
+ *   Collects the values animations produce during a tick and applies them
+ *   in one go. The changes are kept in a flat array which is reused from
+ *   tick to tick; doubles, colors and points (which is what nearly every
+ *   animation produces) are stored unboxed. Apply sorts the batch by
+ *   object and property, so each object is visited once, and for each
+ *   property applies the value with the lowest precedence (the most
+ *   recently added one if several share it).
+ *
+ *   The values are set with DependencyObject::SetAnimatedValue, which
+ *   skips the type check for values of the property's own type (what
+ *   the unboxed changes always are).
+ *
+ *   Objects are tracked with a weak reference, taken the first time
+ *   an object is added in a tick, in case they're destroyed before the
+ *   tick is over.
+ */
 
+class Applier {
  public:
 	Applier ();
 	~Applier ();
 
-	void AddPropertyChange (DependencyObject *object, DependencyProperty *property, Value *v, int precedence);
+	/* the value is copied, @v may be NULL to clear the property */
+	void AddPropertyChange (DependencyObject *object, DependencyProperty *property, const Value *v, int precedence);
 	void Apply ();
 	void Flush ();
+
+ private:
+	enum ChangeKind {
+		ChangeClear,
+		ChangeDouble,
+		ChangeColor,
+		ChangePoint,
+		ChangeValue,
+	};
+
+	struct Change {
+		DependencyObject *object; // only compared, it may be gone
+		DependencyObject **weak; // NULL once the object is destroyed
+		DependencyProperty *property;
+		int precedence;
+		guint32 sequence;
+		ChangeKind kind;
+		union {
+			double d;
+			struct { double r, g, b, a; } color;
+			struct { double x, y; } point;
+			Value *value;
+		} u;
+	};
+
+	GArray *changes;
+	GHashTable *objects; // object -> weak reference, until the next Flush
+	guint32 sequence;
+	bool readonly;
+
+	DependencyObject **GetWeakRef (DependencyObject *object);
+
+	static int CompareChanges (gconstpointer a, gconstpointer b);
+	static void DestroyWeakRef (gpointer key, gpointer value, gpointer user_data);
 };
 
 };
@@ -0,0 +1,480 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * audio-converter.cpp: sample format conversion and resampling for the audio sources
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#include <config.h>
+
+#include <glib.h>
+#include <math.h>
+#include <string.h>
+
+#if HAVE_SSE2 && defined (__SSE2__)
+#define USE_SSE2_AUDIO 1
+#include <emmintrin.h>
+#endif
+
+#include "audio-converter.h"
+#include "audio.h"
+#include "cpu.h"
+
+namespace Moonlight {
+
+/*
+ * Scalar kernels
+ *
+ * Every input sample is first expanded to a full scale 32 bit value,
+ * then scaled by the volume and narrowed to the output size.
+ */
+
+static inline gint32
+read_sample (const guint8 *src, guint32 bytes)
+{
+	gint32 value = 0;
+
+	switch (bytes) {
+	case 1:
+		// 8bit audio is unsigned
+		return ((gint32) *src - 128) << 24;
+	case 2:
+		return ((gint32) *(const gint16 *) src) << 16;
+	case 3:
+		((guint8 *) &value) [1] = src [0];
+		((guint8 *) &value) [2] = src [1];
+		((guint8 *) &value) [3] = src [2];
+		return value;
+	case 4:
+		return *(const gint32 *) src;
+	default:
+		return 0;
+	}
+}
+
+static inline void
+write_sample (guint8 *dest, guint32 bytes, gint32 value, gint32 volume)
+{
+	gint64 scaled;
+
+	switch (bytes) {
+	case 2:
+		scaled = ((value >> 16) * (gint64) volume) >> AUDIO_VOLUME_SHIFT;
+		*(gint16 *) dest = (gint16) CLAMP (scaled, G_MININT16, G_MAXINT16);
+		break;
+	case 4:
+		scaled = (value * (gint64) volume) >> AUDIO_VOLUME_SHIFT;
+		*(gint32 *) dest = (gint32) CLAMP (scaled, G_MININT32, G_MAXINT32);
+		break;
+	}
+}
+
+template <guint32 input_bytes, guint32 output_bytes>
+static void
+convert_scalar (guint32 channels, const guint8 *src, guint32 frames, const gint32 *volumes, AudioData **channel_data, guint8 **write_ptr)
+{
+	for (guint32 i = 0; i < frames; i++) {
+		for (guint32 channel = 0; channel < channels; channel++) {
+			write_sample (write_ptr [channel], output_bytes, read_sample (src, input_bytes), volumes [channel]);
+			write_ptr [channel] += channel_data [channel]->distance;
+			src += input_bytes;
+		}
+	}
+}
+
+#if USE_SSE2_AUDIO
+
+/*
+ * SSE2 kernels
+ *
+ * These only handle interleaved 16 bit output where the channel count
+ * divides 8, so that a volume vector can be built which lines up with
+ * the channels in every 8 sample block. The tail is left to the scalar kernels.
+ */
+
+static inline __m128i
+apply_volume_sse2 (__m128i samples, __m128i volumes)
+{
+	__m128i lo = _mm_mullo_epi16 (samples, volumes);
+	__m128i hi = _mm_mulhi_epi16 (samples, volumes);
+	__m128i p0 = _mm_srai_epi32 (_mm_unpacklo_epi16 (lo, hi), AUDIO_VOLUME_SHIFT);
+	__m128i p1 = _mm_srai_epi32 (_mm_unpackhi_epi16 (lo, hi), AUDIO_VOLUME_SHIFT);
+
+	return _mm_packs_epi32 (p0, p1);
+}
+
+// Returns the number of samples converted
+static guint32
+convert_s16_to_s16_sse2 (const gint16 *src, gint16 *dest, guint32 samples, __m128i volumes)
+{
+	guint32 i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		__m128i s = _mm_loadu_si128 ((const __m128i *) (src + i));
+		_mm_storeu_si128 ((__m128i *) (dest + i), apply_volume_sse2 (s, volumes));
+	}
+
+	return i;
+}
+
+// Returns the number of samples converted
+static guint32
+convert_u8_to_s16_sse2 (const guint8 *src, gint16 *dest, guint32 samples, __m128i volumes)
+{
+	const __m128i zero = _mm_setzero_si128 ();
+	const __m128i bias = _mm_set1_epi16 (128);
+	guint32 i;
+
+	for (i = 0; i + 16 <= samples; i += 16) {
+		__m128i s = _mm_loadu_si128 ((const __m128i *) (src + i));
+		__m128i lo = _mm_slli_epi16 (_mm_sub_epi16 (_mm_unpacklo_epi8 (s, zero), bias), 8);
+		__m128i hi = _mm_slli_epi16 (_mm_sub_epi16 (_mm_unpackhi_epi8 (s, zero), bias), 8);
+		_mm_storeu_si128 ((__m128i *) (dest + i), apply_volume_sse2 (lo, volumes));
+		_mm_storeu_si128 ((__m128i *) (dest + i + 8), apply_volume_sse2 (hi, volumes));
+	}
+
+	return i;
+}
+
+static bool
+is_interleaved (guint32 channels, guint32 output_bytes_per_sample, AudioData **channel_data, guint8 **write_ptr)
+{
+	for (guint32 channel = 0; channel < channels; channel++) {
+		if (channel_data [channel]->distance != (gint32) (channels * output_bytes_per_sample))
+			return false;
+		if (write_ptr [channel] != write_ptr [0] + channel * output_bytes_per_sample)
+			return false;
+	}
+	return true;
+}
+
+static bool
+convert_sse2 (guint32 input_bytes_per_sample, guint32 output_bytes_per_sample, guint32 channels,
+	      const guint8 **src, guint32 *frames, const gint32 *volumes, AudioData **channel_data, guint8 **write_ptr)
+{
+	gint16 lanes [8];
+	guint32 samples = *frames * channels;
+	guint32 done;
+
+	if (output_bytes_per_sample != 2 || (input_bytes_per_sample != 1 && input_bytes_per_sample != 2))
+		return false;
+	if (channels == 0 || 8 % channels != 0)
+		return false;
+	if (!is_interleaved (channels, output_bytes_per_sample, channel_data, write_ptr))
+		return false;
+
+	for (guint32 i = 0; i < 8; i++) {
+		// The volume is multiplied as a signed 16 bit value
+		if (volumes [i % channels] > G_MAXINT16 || volumes [i % channels] < 0)
+			return false;
+		lanes [i] = (gint16) volumes [i % channels];
+	}
+
+	__m128i v = _mm_setr_epi16 (lanes [0], lanes [1], lanes [2], lanes [3], lanes [4], lanes [5], lanes [6], lanes [7]);
+
+	if (input_bytes_per_sample == 1) {
+		done = convert_u8_to_s16_sse2 (*src, (gint16 *) write_ptr [0], samples, v);
+	} else {
+		done = convert_s16_to_s16_sse2 ((const gint16 *) *src, (gint16 *) write_ptr [0], samples, v);
+	}
+
+	// done is always a multiple of 8, and therefore of channels
+	for (guint32 channel = 0; channel < channels; channel++)
+		write_ptr [channel] += done * output_bytes_per_sample;
+	*src += done * input_bytes_per_sample;
+	*frames -= done / channels;
+
+	return true;
+}
+
+#endif /* USE_SSE2_AUDIO */
+
+/*
+ * AudioConverter
+ */
+
+bool
+AudioConverter::Supports (guint32 input_bytes_per_sample, guint32 output_bytes_per_sample)
+{
+	if (input_bytes_per_sample < 1 || input_bytes_per_sample > 4)
+		return false;
+
+	return output_bytes_per_sample == 2 || output_bytes_per_sample == 4;
+}
+
+bool
+AudioConverter::Convert (guint32 input_bytes_per_sample, guint32 output_bytes_per_sample, guint32 channels,
+			 const guint8 *src, guint32 frames, const gint32 *volumes,
+			 AudioData **channel_data, guint8 **write_ptr)
+{
+	if (!Supports (input_bytes_per_sample, output_bytes_per_sample))
+		return false;
+
+#if USE_SSE2_AUDIO
+	if (CPU::HaveSSE2 ())
+		convert_sse2 (input_bytes_per_sample, output_bytes_per_sample, channels, &src, &frames, volumes, channel_data, write_ptr);
+#endif
+
+	if (frames == 0)
+		return true;
+
+	// Instantiate a loop per combination so that the
+	// per sample switches are resolved at compile time.
+	switch (input_bytes_per_sample * 10 + output_bytes_per_sample) {
+	case 12: convert_scalar<1, 2> (channels, src, frames, volumes, channel_data, write_ptr); break;
+	case 14: convert_scalar<1, 4> (channels, src, frames, volumes, channel_data, write_ptr); break;
+	case 22: convert_scalar<2, 2> (channels, src, frames, volumes, channel_data, write_ptr); break;
+	case 24: convert_scalar<2, 4> (channels, src, frames, volumes, channel_data, write_ptr); break;
+	case 32: convert_scalar<3, 2> (channels, src, frames, volumes, channel_data, write_ptr); break;
+	case 34: convert_scalar<3, 4> (channels, src, frames, volumes, channel_data, write_ptr); break;
+	case 42: convert_scalar<4, 2> (channels, src, frames, volumes, channel_data, write_ptr); break;
+	case 44: convert_scalar<4, 4> (channels, src, frames, volumes, channel_data, write_ptr); break;
+	default:
+		return false;
+	}
+
+	return true;
+}
+
+void
+AudioConverter::Accumulate (const gint16 *src, guint32 channels, gint32 *dest, guint32 dest_channels, guint32 frames)
+{
+	if (channels == dest_channels) {
+		guint32 samples = frames * channels;
+		guint32 i = 0;
+#if USE_SSE2_AUDIO
+		if (CPU::HaveSSE2 ()) {
+			for (; i + 8 <= samples; i += 8) {
+				__m128i s = _mm_loadu_si128 ((const __m128i *) (src + i));
+				__m128i lo = _mm_srai_epi32 (_mm_unpacklo_epi16 (s, s), 16);
+				__m128i hi = _mm_srai_epi32 (_mm_unpackhi_epi16 (s, s), 16);
+				__m128i *d = (__m128i *) (dest + i);
+				_mm_storeu_si128 (d, _mm_add_epi32 (_mm_loadu_si128 (d), lo));
+				_mm_storeu_si128 (d + 1, _mm_add_epi32 (_mm_loadu_si128 (d + 1), hi));
+			}
+		}
+#endif
+		for (; i < samples; i++)
+			dest [i] += src [i];
+	} else if (dest_channels == 1) {
+		// downmix everything to mono
+		for (guint32 i = 0; i < frames; i++) {
+			gint32 sum = 0;
+			for (guint32 c = 0; c < channels; c++)
+				sum += *src++;
+			*dest++ += sum / (gint32) channels;
+		}
+	} else {
+		// mono is duplicated into every channel, otherwise extra
+		// source channels are dropped and missing ones repeated.
+		for (guint32 i = 0; i < frames; i++) {
+			for (guint32 c = 0; c < dest_channels; c++)
+				dest [c] += src [c % channels];
+			src += channels;
+			dest += dest_channels;
+		}
+	}
+}
+
+void
+AudioConverter::Saturate (const gint32 *src, gint16 *dest, guint32 samples)
+{
+	guint32 i = 0;
+
+#if USE_SSE2_AUDIO
+	if (CPU::HaveSSE2 ()) {
+		for (; i + 8 <= samples; i += 8) {
+			__m128i lo = _mm_loadu_si128 ((const __m128i *) (src + i));
+			__m128i hi = _mm_loadu_si128 ((const __m128i *) (src + i + 4));
+			_mm_storeu_si128 ((__m128i *) (dest + i), _mm_packs_epi32 (lo, hi));
+		}
+	}
+#endif
+
+	for (; i < samples; i++)
+		dest [i] = (gint16) CLAMP (src [i], G_MININT16, G_MAXINT16);
+}
+
+/*
+ * AudioResampler
+ */
+
+AudioResampler::AudioResampler (guint32 channels, guint32 input_rate, guint32 output_rate)
+{
+	this->channels = channels;
+	this->input_rate = input_rate;
+	this->output_rate = output_rate;
+
+	step = (double) input_rate / (double) output_rate;
+	filter = NULL;
+	buffer = NULL;
+	buffer_size = 0;
+
+	CreateFilter ();
+	Reset ();
+}
+
+AudioResampler::~AudioResampler ()
+{
+	g_free (filter);
+	g_free (buffer);
+}
+
+void
+AudioResampler::CreateFilter ()
+{
+	// When downsampling the cutoff has to move down to the output nyquist
+	// frequency, leave a bit of room for the transition band as well.
+	double cutoff = MIN (1.0, (double) output_rate / (double) input_rate) * 0.91;
+	const double half = FILTER_TAPS / 2;
+
+	filter = (float *) g_malloc (sizeof (float) * (FILTER_PHASES + 1) * FILTER_TAPS);
+
+	for (int phase = 0; phase <= FILTER_PHASES; phase++) {
+		float *row = filter + phase * FILTER_TAPS;
+		double fraction = (double) phase / FILTER_PHASES;
+		double sum = 0.0;
+
+		for (int k = 0; k < FILTER_TAPS; k++) {
+			// distance between this tap and the (fractional) output position
+			double x = k - (half - 1) - fraction;
+			double sinc = x == 0.0 ? 1.0 : sin (M_PI * cutoff * x) / (M_PI * cutoff * x);
+			// Blackman window centered on the output position
+			double w = 0.42 + 0.5 * cos (M_PI * x / half) + 0.08 * cos (2 * M_PI * x / half);
+
+			if (fabs (x) >= half)
+				w = 0.0;
+
+			row [k] = (float) (sinc * w);
+			sum += row [k];
+		}
+
+		// normalize for unity gain at DC
+		for (int k = 0; k < FILTER_TAPS; k++)
+			row [k] = (float) (row [k] / sum);
+	}
+}
+
+void
+AudioResampler::EnsureBuffer (guint32 frames)
+{
+	if (frames <= buffer_size)
+		return;
+
+	buffer_size = MAX (frames, buffer_size * 2);
+	buffer = (float *) g_realloc (buffer, sizeof (float) * channels * buffer_size);
+}
+
+void
+AudioResampler::Reset ()
+{
+	// Start with half a filter of silence so that the
+	// first input frame can be at the center of the filter
+	buffered = FILTER_TAPS / 2 - 1;
+	position = buffered;
+	EnsureBuffer (FILTER_TAPS);
+	memset (buffer, 0, sizeof (float) * channels * buffered);
+}
+
+guint32
+AudioResampler::GetInputFramesNeeded (guint32 frames)
+{
+	double last;
+	guint32 needed;
+
+	if (frames == 0)
+		return 0;
+
+	last = position + (frames - 1) * step;
+	needed = (guint32) last + FILTER_TAPS / 2 + 1;
+
+	return needed > buffered ? needed - buffered : 0;
+}
+
+void
+AudioResampler::Push (const gint16 *input, guint32 frames)
+{
+	float *dest;
+
+	EnsureBuffer (buffered + frames);
+
+	dest = buffer + buffered * channels;
+	for (guint32 i = 0; i < frames * channels; i++)
+		dest [i] = input [i];
+
+	buffered += frames;
+}
+
+guint32
+AudioResampler::Pull (gint32 *dest, guint32 dest_channels, guint32 frames)
+{
+	float *out = (float *) g_alloca (sizeof (float) * channels);
+	guint32 produced = 0;
+	guint32 consumed;
+
+	while (produced < frames) {
+		guint32 index = (guint32) position;
+		double fraction;
+		float weight;
+		const float *row0, *row1;
+		const float *in;
+		int phase;
+
+		if (index + FILTER_TAPS / 2 >= buffered)
+			break;
+
+		fraction = (position - index) * FILTER_PHASES;
+		phase = (int) fraction;
+		weight = (float) (fraction - phase);
+		row0 = filter + phase * FILTER_TAPS;
+		row1 = row0 + FILTER_TAPS;
+		in = buffer + (index - (FILTER_TAPS / 2 - 1)) * channels;
+
+		for (guint32 c = 0; c < channels; c++)
+			out [c] = 0.0f;
+
+		for (int k = 0; k < FILTER_TAPS; k++) {
+			// interpolate between the two closest phases
+			float coefficient = row0 [k] + (row1 [k] - row0 [k]) * weight;
+			for (guint32 c = 0; c < channels; c++)
+				out [c] += in [c] * coefficient;
+			in += channels;
+		}
+
+		if (dest_channels == channels) {
+			for (guint32 c = 0; c < channels; c++)
+				dest [c] += (gint32) lrintf (out [c]);
+		} else if (dest_channels == 1) {
+			float sum = 0.0f;
+			for (guint32 c = 0; c < channels; c++)
+				sum += out [c];
+			dest [0] += (gint32) lrintf (sum / channels);
+		} else {
+			for (guint32 c = 0; c < dest_channels; c++)
+				dest [c] += (gint32) lrintf (out [c % channels]);
+		}
+
+		dest += dest_channels;
+		position += step;
+		produced++;
+	}
+
+	// Drop the input frames which are no longer within reach of the filter
+	consumed = (guint32) position;
+	if (consumed > FILTER_TAPS / 2 - 1) {
+		consumed -= FILTER_TAPS / 2 - 1;
+		consumed = MIN (consumed, buffered);
+		memmove (buffer, buffer + consumed * channels, sizeof (float) * channels * (buffered - consumed));
+		buffered -= consumed;
+		position -= consumed;
+	}
+
+	return produced;
+}
+
+};
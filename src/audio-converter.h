@@ -0,0 +1,99 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * audio-converter.h: sample format conversion and resampling for the audio sources
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#ifndef __MOON_AUDIO_CONVERTER_H__
+#define __MOON_AUDIO_CONVERTER_H__
+
+#include <glib.h>
+
+namespace Moonlight {
+
+struct AudioData;
+
+/*
+ * Volumes are fixed point values where 8192 (1 << 13) is unity gain,
+ * this is what AudioSource::WriteFull has always used.
+ */
+#define AUDIO_VOLUME_SHIFT 13
+#define AUDIO_VOLUME_UNITY (1 << AUDIO_VOLUME_SHIFT)
+
+class AudioConverter {
+ public:
+	// Converts 'frames' frames of interleaved input samples of input_bytes_per_sample (1, 2, 3 or 4)
+	// bytes each into the channel destinations described by channel_data (16 or 32 bit output),
+	// applying the per-channel volume. write_ptr contains the current write position for each
+	// channel and is advanced past the written samples.
+	// Returns false if the input/output combination isn't supported.
+	static bool Convert (guint32 input_bytes_per_sample, guint32 output_bytes_per_sample, guint32 channels,
+			     const guint8 *src, guint32 frames, const gint32 *volumes,
+			     AudioData **channel_data, guint8 **write_ptr);
+
+	// Adds 'frames' frames of interleaved 16 bit samples to the 32 bit mixing accumulator,
+	// upmixing/downmixing from channels to dest_channels.
+	static void Accumulate (const gint16 *src, guint32 channels, gint32 *dest, guint32 dest_channels, guint32 frames);
+
+	// Clamps the 32 bit mixing accumulator into signed 16 bit samples.
+	static void Saturate (const gint32 *src, gint16 *dest, guint32 samples);
+
+	static bool Supports (guint32 input_bytes_per_sample, guint32 output_bytes_per_sample);
+};
+
+/*
+ * A windowed sinc resampler. Input is interleaved signed 16 bit audio,
+ * output is accumulated into a 32 bit mixing buffer (so that several
+ * resamplers can write into the same buffer).
+ */
+class AudioResampler {
+	guint32 channels;
+	guint32 input_rate;
+	guint32 output_rate;
+
+	double step; // input frames per output frame
+	double position; // the read position (in input frames) relative to the start of the buffer
+
+	float *filter; // FILTER_PHASES + 1 rows of FILTER_TAPS coefficients
+	float *buffer; // interleaved input frames
+	guint32 buffer_size; // in frames
+	guint32 buffered; // the number of frames in buffer
+
+	void CreateFilter ();
+	void EnsureBuffer (guint32 frames);
+
+ public:
+	enum {
+		FILTER_TAPS = 16, // the number of input frames each output frame depends on
+		FILTER_PHASES = 128, // the number of subsample positions we have coefficients for
+	};
+
+	AudioResampler (guint32 channels, guint32 input_rate, guint32 output_rate);
+	~AudioResampler ();
+
+	guint32 GetInputRate () { return input_rate; }
+	guint32 GetOutputRate () { return output_rate; }
+
+	// Returns the number of input frames which must be pushed
+	// before 'frames' output frames can be pulled.
+	guint32 GetInputFramesNeeded (guint32 frames);
+
+	void Push (const gint16 *input, guint32 frames);
+
+	// Accumulates up to 'frames' frames into dest (which has dest_channels channels),
+	// returns the number of frames produced.
+	guint32 Pull (gint32 *dest, guint32 dest_channels, guint32 frames);
+
+	// Drops all buffered input, used when seeking/stopping.
+	void Reset ();
+};
+
+};
+
+#endif /* __MOON_AUDIO_CONVERTER_H__ */
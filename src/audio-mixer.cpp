@@ -0,0 +1,197 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * audio-mixer.cpp: in-process mixing of all the audio sources into one device stream
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#include <config.h>
+
+#include "audio-mixer.h"
+#include "runtime.h"
+#include "debug.h"
+
+namespace Moonlight {
+
+/*
+ * MixerSource
+ */
+
+MixerSource::MixerSource (AudioPlayer *player, MediaPlayer *mplayer, AudioStream *stream)
+	: AudioSource (Type::MIXERSOURCE, player, mplayer, stream)
+{
+	LOG_AUDIO ("MixerSource::MixerSource ()\n");
+
+	this->player = player;
+	resampler = NULL;
+	scratch = NULL;
+	scratch_frames = 0;
+}
+
+MixerSource::~MixerSource ()
+{
+	delete resampler;
+	g_free (scratch);
+}
+
+bool
+MixerSource::InitializeInternal ()
+{
+	// The mixer works on 16 bit samples, whatever the input is
+	SetOutputBytesPerSample (2);
+
+	if (!AudioConverter::Supports (GetInputBytesPerSample (), GetOutputBytesPerSample ())) {
+		LOG_AUDIO ("MixerSource::InitializeInternal (): Invalid bytes per sample: %i\n", GetInputBytesPerSample ());
+		return false;
+	}
+
+	return true;
+}
+
+void
+MixerSource::CloseInternal ()
+{
+	Stopped ();
+}
+
+void
+MixerSource::Played ()
+{
+	LOG_AUDIO ("MixerSource::Played ()\n");
+
+	player->MixerSourcePlayed (this);
+}
+
+void
+MixerSource::Stopped ()
+{
+	LOG_AUDIO ("MixerSource::Stopped ()\n");
+
+	// Any buffered samples belong to the old position
+	mutex.Lock ();
+	if (resampler != NULL)
+		resampler->Reset ();
+	mutex.Unlock ();
+}
+
+guint64
+MixerSource::GetDelayInternal ()
+{
+	// Our samples were written to the device stream together with every
+	// other source's samples, so the device latency applies to all of us.
+	return player->GetMixerDelay ();
+}
+
+guint32
+MixerSource::MixInto (gint32 *dest, guint32 dest_rate, guint32 dest_channels, guint32 frames)
+{
+	guint32 needed;
+	guint32 written;
+	guint32 result;
+	bool underflowed;
+
+	mutex.Lock ();
+
+	if (GetSampleRate () != dest_rate && (resampler == NULL || resampler->GetOutputRate () != dest_rate)) {
+		LOG_AUDIO ("MixerSource::MixInto (): resampling from %u Hz to %u Hz\n", GetSampleRate (), dest_rate);
+		delete resampler;
+		resampler = new AudioResampler (GetChannels (), GetSampleRate (), dest_rate);
+	}
+
+	needed = resampler != NULL ? resampler->GetInputFramesNeeded (frames) : frames;
+
+	if (needed > scratch_frames) {
+		scratch_frames = needed;
+		scratch = (gint16 *) g_realloc (scratch, GetOutputBytesPerFrame () * scratch_frames);
+	}
+
+	written = needed > 0 ? Write (scratch, needed) : 0;
+
+	if (resampler != NULL) {
+		resampler->Push (scratch, written);
+		result = resampler->Pull (dest, dest_channels, frames);
+	} else {
+		AudioConverter::Accumulate (scratch, GetChannels (), dest, dest_channels, written);
+		result = written;
+	}
+
+	underflowed = result < frames && written < needed;
+
+	mutex.Unlock ();
+
+	// There is no device stream of our own to tell us when the last of our
+	// samples has been played, so report the underflow as soon as we run dry.
+	if (underflowed)
+		Underflowed ();
+
+	return result;
+}
+
+/*
+ * AudioMixer
+ */
+
+AudioMixer::AudioMixer (guint32 sample_rate, guint32 channels)
+{
+	this->sample_rate = sample_rate;
+	this->channels = channels;
+
+	accumulator = NULL;
+	accumulator_frames = 0;
+
+	mix_count = 0;
+	frames_mixed = 0;
+	source_frames_mixed = 0;
+	max_sources = 0;
+}
+
+AudioMixer::~AudioMixer ()
+{
+	LOG_AUDIO ("AudioMixer::~AudioMixer (): mixed %" G_GUINT64_FORMAT " frames from %" G_GUINT64_FORMAT " source frames in %" G_GUINT64_FORMAT " writes, at most %u sources at a time\n",
+		frames_mixed, source_frames_mixed, mix_count, max_sources);
+
+	g_free (accumulator);
+}
+
+guint32
+AudioMixer::Mix (AudioSources *sources, gint16 *dest, guint32 frames)
+{
+	AudioSource *source;
+	guint32 samples = frames * channels;
+	guint32 active = 0;
+	guint32 mixed;
+
+	if (frames > accumulator_frames) {
+		accumulator_frames = frames;
+		accumulator = (gint32 *) g_realloc (accumulator, sizeof (gint32) * channels * accumulator_frames);
+	}
+
+	memset (accumulator, 0, sizeof (gint32) * samples);
+
+	sources->StartEnumeration ();
+	while ((source = sources->GetNext (true)) != NULL) {
+		mixed = ((MixerSource *) source)->MixInto (accumulator, sample_rate, channels, frames);
+		if (mixed > 0) {
+			active++;
+			source_frames_mixed += mixed;
+		}
+		source->unref ();
+	}
+
+	AudioConverter::Saturate (accumulator, dest, samples);
+
+	mix_count++;
+	frames_mixed += frames;
+	max_sources = MAX (max_sources, active);
+
+	LOG_AUDIO_EX ("AudioMixer::Mix (%u): mixed %u sources\n", frames, active);
+
+	return active;
+}
+
+};
@@ -0,0 +1,90 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * audio-mixer.h: in-process mixing of all the audio sources into one device stream
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#ifndef __MOON_AUDIO_MIXER_H__
+#define __MOON_AUDIO_MIXER_H__
+
+#include "audio.h"
+#include "audio-converter.h"
+
+namespace Moonlight {
+
+/*
+ * An AudioSource which doesn't own a device stream, the AudioPlayer's
+ * AudioMixer pulls samples from it and mixes them with all the other
+ * playing MixerSources into a single device stream.
+ */
+class MixerSource : public AudioSource {
+	AudioPlayer *player;
+	AudioResampler *resampler;
+	gint16 *scratch; // the source samples converted to 16 bit, before resampling
+	guint32 scratch_frames;
+	MoonMutex mutex; // protects the resampler and scratch buffer
+
+ protected:
+	virtual ~MixerSource ();
+
+	virtual void Played ();
+	virtual void Stopped ();
+	virtual guint64 GetDelayInternal ();
+	virtual bool InitializeInternal ();
+	virtual void CloseInternal ();
+
+ public:
+	/* @SkipFactories */
+	MixerSource (AudioPlayer *player, MediaPlayer *mplayer, AudioStream *stream);
+
+	// Adds up to 'frames' frames, converted to the given rate and channel count,
+	// to the mixing buffer. Returns the number of frames added.
+	// Must only be called from the audio thread.
+	guint32 MixInto (gint32 *dest, guint32 dest_rate, guint32 dest_channels, guint32 frames);
+};
+
+class AudioMixer {
+	guint32 sample_rate;
+	guint32 channels;
+
+	gint32 *accumulator;
+	guint32 accumulator_frames;
+
+	// statistics
+	guint64 mix_count;
+	guint64 frames_mixed;
+	guint64 source_frames_mixed;
+	guint32 max_sources;
+
+ public:
+	AudioMixer (guint32 sample_rate, guint32 channels);
+	~AudioMixer ();
+
+	// The format of the device stream (always signed 16 bit, interleaved)
+	guint32 GetSampleRate () { return sample_rate; }
+	guint32 GetChannels () { return channels; }
+	guint32 GetBytesPerFrame () { return channels * sizeof (gint16); }
+
+	// Mixes all playing sources into 'frames' frames of dest, padding with silence.
+	// Returns the number of sources which contributed any samples.
+	// Must only be called from the audio thread.
+	guint32 Mix (AudioSources *sources, gint16 *dest, guint32 frames);
+
+	// The number of device frames written and the number of
+	// frames written by sources (which are the ones a mixer-less
+	// setup would have sent to the device individually).
+	guint64 GetFramesMixed () { return frames_mixed; }
+	guint64 GetSourceFramesMixed () { return source_frames_mixed; }
+	guint64 GetMixCount () { return mix_count; }
+	guint32 GetMaxSources () { return max_sources; }
+};
+
+};
+
+#endif /* __MOON_AUDIO_MIXER_H__ */
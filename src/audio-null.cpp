@@ -0,0 +1,657 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * audio-null.cpp: an audio backend without any audio hardware
+ *
+ * Audio is consumed at a simulated device clock, which can run in real
+ * time or faster (MOONLIGHT_NULL_AUDIO=speed=N, speed=0 runs as fast as
+ * the sources can produce samples). This makes it possible to exercise
+ * (and benchmark) audio driven playback on machines without any sound
+ * server or sound card.
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "audio-null.h"
+#include "audio-mixer.h"
+#include "runtime.h"
+#include "clock.h"
+#include "debug.h"
+#include "timesource.h"
+
+namespace Moonlight {
+
+// The device clock advances in steps of this many milliseconds
+#define NULL_AUDIO_PERIOD_MS 10
+
+/*
+ * NullAudioDevice
+ */
+
+NullAudioDevice::NullAudioDevice (guint32 sample_rate, guint32 channels, guint32 bytes_per_sample, guint32 buffer_ms, const char *wav_path)
+{
+	this->sample_rate = sample_rate;
+	this->channels = channels;
+	this->bytes_per_sample = bytes_per_sample;
+	this->buffer_frames = MAX (1, (guint64) sample_rate * buffer_ms / 1000);
+
+	buffered = 0;
+	remainder = 0;
+	starved = true;
+
+	frames_played = 0;
+	frames_written = 0;
+	underflows = 0;
+	writes = 0;
+	delay_sum = 0;
+	delay_min = G_MAXUINT64;
+	delay_max = 0;
+	write_time_sum = 0;
+	write_time_max = 0;
+
+	wav = NULL;
+	wav_bytes = 0;
+	this->wav_path = g_strdup (wav_path);
+
+	if (wav_path != NULL) {
+		wav = fopen (wav_path, "wb");
+		if (wav == NULL) {
+			printf ("Moonlight: could not open '%s' to dump audio: %s\n", wav_path, strerror (errno));
+		} else {
+			WriteWavHeader ();
+		}
+	}
+}
+
+NullAudioDevice::~NullAudioDevice ()
+{
+	if (wav != NULL) {
+		// Now that we know the size, rewrite the header
+		fseek (wav, 0, SEEK_SET);
+		WriteWavHeader ();
+		fclose (wav);
+	}
+	g_free (wav_path);
+}
+
+static void
+write_le32 (FILE *f, guint32 value)
+{
+	guint8 b [4] = { (guint8) value, (guint8) (value >> 8), (guint8) (value >> 16), (guint8) (value >> 24) };
+	fwrite (b, 1, 4, f);
+}
+
+static void
+write_le16 (FILE *f, guint16 value)
+{
+	guint8 b [2] = { (guint8) value, (guint8) (value >> 8) };
+	fwrite (b, 1, 2, f);
+}
+
+void
+NullAudioDevice::WriteWavHeader ()
+{
+	fwrite ("RIFF", 1, 4, wav);
+	write_le32 (wav, 36 + wav_bytes);
+	fwrite ("WAVEfmt ", 1, 8, wav);
+	write_le32 (wav, 16);
+	write_le16 (wav, 1); // PCM
+	write_le16 (wav, channels);
+	write_le32 (wav, sample_rate);
+	write_le32 (wav, sample_rate * channels * bytes_per_sample);
+	write_le16 (wav, channels * bytes_per_sample);
+	write_le16 (wav, bytes_per_sample * 8);
+	fwrite ("data", 1, 4, wav);
+	write_le32 (wav, wav_bytes);
+}
+
+guint32
+NullAudioDevice::Consume (TimeSpan elapsed)
+{
+	guint64 frames;
+	guint32 result;
+
+	mutex.Lock ();
+
+	remainder += (guint64) elapsed * sample_rate;
+	frames = remainder / TIMESPANTICKS_IN_SECOND;
+	remainder %= TIMESPANTICKS_IN_SECOND;
+
+	if (frames > buffered) {
+		// The device wanted more than we had. Only count it once
+		// per starvation, and not before anything has been written.
+		if (!starved && frames_written > 0)
+			underflows++;
+		frames_played += buffered;
+		buffered = 0;
+		starved = true;
+	} else {
+		frames_played += frames;
+		buffered -= frames;
+	}
+
+	result = buffer_frames - buffered;
+
+	mutex.Unlock ();
+
+	return result;
+}
+
+void
+NullAudioDevice::Commit (const void *data, guint32 frames, TimeSpan write_time)
+{
+	mutex.Lock ();
+
+	if (frames > 0) {
+		buffered += frames;
+		frames_written += frames;
+		starved = false;
+
+		if (wav != NULL) {
+			fwrite (data, channels * bytes_per_sample, frames, wav);
+			wav_bytes += frames * channels * bytes_per_sample;
+		}
+	}
+
+	writes++;
+	delay_sum += buffered;
+	delay_min = MIN (delay_min, buffered);
+	delay_max = MAX (delay_max, buffered);
+	write_time_sum += write_time;
+	write_time_max = MAX (write_time_max, write_time);
+
+	mutex.Unlock ();
+}
+
+void
+NullAudioDevice::Flush ()
+{
+	mutex.Lock ();
+	buffered = 0;
+	remainder = 0;
+	starved = true;
+	mutex.Unlock ();
+}
+
+bool
+NullAudioDevice::IsStarved ()
+{
+	bool result;
+
+	mutex.Lock ();
+	result = starved;
+	mutex.Unlock ();
+
+	return result;
+}
+
+guint64
+NullAudioDevice::GetDelay ()
+{
+	guint64 result;
+
+	mutex.Lock ();
+	result = (guint64) TIMESPANTICKS_IN_SECOND * buffered / sample_rate;
+	mutex.Unlock ();
+
+	return result;
+}
+
+void
+NullAudioDevice::PrintStatistics (const char *name)
+{
+	mutex.Lock ();
+	printf ("%s: %u Hz, %u channels, %u bit: played %.3f seconds of audio (%" G_GUINT64_FORMAT " frames) in %u writes, %u underflows, "
+		"latency min/avg/max: %.1f/%.1f/%.1f ms, time spent writing avg/max: %.3f/%.3f ms%s%s\n",
+		name, sample_rate, channels, bytes_per_sample * 8,
+		(double) frames_played / sample_rate, frames_played, writes, underflows,
+		delay_min == G_MAXUINT64 ? 0.0 : 1000.0 * delay_min / sample_rate,
+		writes == 0 ? 0.0 : 1000.0 * delay_sum / writes / sample_rate,
+		1000.0 * delay_max / sample_rate,
+		writes == 0 ? 0.0 : (double) write_time_sum / writes / 10000.0,
+		(double) write_time_max / 10000.0,
+		wav != NULL ? ", dumped to " : "", wav != NULL ? wav_path : "");
+	mutex.Unlock ();
+}
+
+/*
+ * NullAudioSource
+ */
+
+NullAudioSource::NullAudioSource (NullAudioPlayer *player, MediaPlayer *mplayer, AudioStream *stream)
+	: AudioSource (Type::NULLAUDIOSOURCE, player, mplayer, stream)
+{
+	LOG_AUDIO ("NullAudioSource::NullAudioSource ()\n");
+
+	this->player = player;
+	device = NULL;
+	scratch = NULL;
+	scratch_frames = 0;
+}
+
+NullAudioSource::~NullAudioSource ()
+{
+	Close ();
+	g_free (scratch);
+}
+
+bool
+NullAudioSource::InitializeInternal ()
+{
+	char *wav_path;
+
+	switch (GetInputBytesPerSample ()) {
+	case 1:
+	case 2:
+		SetOutputBytesPerSample (2);
+		break;
+	case 3:
+	case 4:
+		SetOutputBytesPerSample (4);
+		break;
+	default:
+		LOG_AUDIO ("NullAudioSource::InitializeInternal (): Invalid bytes per sample: %i (expected 1, 2, 3 or 4)\n", GetInputBytesPerSample ());
+		return false;
+	}
+
+	wav_path = player->CreateWavPath ();
+	mutex.Lock ();
+	device = new NullAudioDevice (GetSampleRate (), GetChannels (), GetOutputBytesPerSample (), player->GetBufferMilliseconds (), wav_path);
+	mutex.Unlock ();
+	g_free (wav_path);
+
+	return true;
+}
+
+void
+NullAudioSource::CloseInternal ()
+{
+	NullAudioDevice *device;
+
+	mutex.Lock ();
+	device = this->device;
+	this->device = NULL;
+	mutex.Unlock ();
+
+	if (device != NULL) {
+		device->PrintStatistics ("NullAudioSource");
+		delete device;
+	}
+}
+
+void
+NullAudioSource::Played ()
+{
+	LOG_AUDIO ("NullAudioSource::Played ()\n");
+
+	player->WakeUp ();
+}
+
+void
+NullAudioSource::Stopped ()
+{
+	LOG_AUDIO ("NullAudioSource::Stopped ()\n");
+
+	mutex.Lock ();
+	if (device != NULL)
+		device->Flush ();
+	mutex.Unlock ();
+}
+
+guint64
+NullAudioSource::GetDelayInternal ()
+{
+	guint64 result = G_MAXUINT64;
+
+	mutex.Lock ();
+	if (device != NULL)
+		result = device->GetDelay ();
+	mutex.Unlock ();
+
+	return result;
+}
+
+bool
+NullAudioSource::Tick (TimeSpan elapsed)
+{
+	guint32 available;
+	guint32 frames = 0;
+	TimeSpan start;
+	TimeSpan write_time = 0;
+	bool starved;
+
+	if (GetState () != AudioPlaying)
+		return false;
+
+	mutex.Lock ();
+
+	if (device == NULL) {
+		mutex.Unlock ();
+		return false;
+	}
+
+	available = device->Consume (elapsed);
+
+	if (available > 0) {
+		if (available > scratch_frames) {
+			scratch_frames = available;
+			scratch = (guint8 *) g_realloc (scratch, scratch_frames * GetOutputBytesPerFrame ());
+		}
+
+		start = get_now ();
+		frames = Write (scratch, available);
+		write_time = get_now () - start;
+	}
+
+	device->Commit (scratch, frames, write_time);
+	starved = device->IsStarved ();
+
+	mutex.Unlock ();
+
+	// Everything written has been played
+	if (starved)
+		Underflowed ();
+
+	return true;
+}
+
+/*
+ * NullAudioPlayer
+ */
+
+NullAudioPlayer::NullAudioPlayer ()
+{
+	LOG_AUDIO ("NullAudioPlayer::NullAudioPlayer ()\n");
+
+	audio_thread = NULL;
+	shutdown = false;
+	play_pending = false;
+
+	speed = 1.0;
+	buffer_ms = 100;
+	mixer_rate = 44100;
+	wav_path = NULL;
+	wav_count = 0;
+
+	mixer_device = NULL;
+	mixer_buffer = NULL;
+	mixer_buffer_frames = 0;
+}
+
+NullAudioPlayer::~NullAudioPlayer ()
+{
+	LOG_AUDIO ("NullAudioPlayer::~NullAudioPlayer ()\n");
+
+	g_free (wav_path);
+	g_free (mixer_buffer);
+}
+
+void
+NullAudioPlayer::ParseOptions ()
+{
+	const char *env;
+	char **options;
+
+	// MOONLIGHT_NULL_AUDIO=speed=<factor>,buffer=<ms>,rate=<mixer sample rate>,wav=<path>
+	if (!(env = g_getenv ("MOONLIGHT_NULL_AUDIO")))
+		return;
+
+	options = g_strsplit (env, ",", -1);
+	for (int i = 0; options [i] != NULL; i++) {
+		const char *option = options [i];
+		const char *value = strchr (option, '=');
+
+		if (value == NULL) {
+			printf ("Moonlight: invalid MOONLIGHT_NULL_AUDIO option: '%s'\n", option);
+			continue;
+		}
+		value++;
+
+		if (!strncmp (option, "speed=", 6)) {
+			speed = MAX (0.0, g_ascii_strtod (value, NULL));
+		} else if (!strncmp (option, "buffer=", 7)) {
+			buffer_ms = MAX (NULL_AUDIO_PERIOD_MS, atoi (value));
+		} else if (!strncmp (option, "rate=", 5)) {
+			mixer_rate = MAX (8000, atoi (value));
+		} else if (!strncmp (option, "wav=", 4)) {
+			g_free (wav_path);
+			wav_path = g_strdup (value);
+		} else {
+			printf ("Moonlight: unknown MOONLIGHT_NULL_AUDIO option: '%s'\n", option);
+		}
+	}
+	g_strfreev (options);
+}
+
+bool
+NullAudioPlayer::Initialize ()
+{
+	int result;
+
+	LOG_AUDIO ("NullAudioPlayer::Initialize ()\n");
+
+	ParseOptions ();
+
+	CreateMixer (mixer_rate, 2);
+	if (mixer != NULL) {
+		char *path = CreateWavPath ();
+		mixer_device = new NullAudioDevice (mixer->GetSampleRate (), mixer->GetChannels (), sizeof (gint16), buffer_ms, path);
+		g_free (path);
+	}
+
+	result = MoonThread::Start (&audio_thread, Loop, this);
+	if (result != 0) {
+		LOG_AUDIO ("NullAudioPlayer::Initialize (): could not create audio thread (error code: %i = '%s').\n", result, strerror (result));
+		return false;
+	}
+
+	if (speed == 0.0) {
+		printf ("NullAudioPlayer: device clock runs at full speed, %u ms buffer%s%s.\n",
+			buffer_ms, wav_path ? ", dumping to " : "", wav_path ? wav_path : "");
+	} else {
+		printf ("NullAudioPlayer: device clock runs at %.2fx real time, %u ms buffer%s%s.\n",
+			speed, buffer_ms, wav_path ? ", dumping to " : "", wav_path ? wav_path : "");
+	}
+
+	return true;
+}
+
+char *
+NullAudioPlayer::CreateWavPath ()
+{
+	char *result;
+
+	if (wav_path == NULL)
+		return NULL;
+
+	mutex.Lock ();
+	if (wav_count++ == 0) {
+		result = g_strdup (wav_path);
+	} else {
+		// one file per device
+		result = g_strdup_printf ("%s.%i", wav_path, wav_count);
+	}
+	mutex.Unlock ();
+
+	return result;
+}
+
+AudioSource *
+NullAudioPlayer::CreateNode (MediaPlayer *mplayer, AudioStream *stream)
+{
+	return new NullAudioSource (this, mplayer, stream);
+}
+
+void
+NullAudioPlayer::AddInternal (AudioSource *node)
+{
+	LOG_AUDIO ("NullAudioPlayer::AddInternal (%p)\n", node);
+}
+
+void
+NullAudioPlayer::RemoveInternal (AudioSource *node)
+{
+	LOG_AUDIO ("NullAudioPlayer::RemoveInternal (%p)\n", node);
+}
+
+void
+NullAudioPlayer::WakeUp ()
+{
+	mutex.Lock ();
+	play_pending = true;
+	cond.Signal ();
+	mutex.Unlock ();
+}
+
+void
+NullAudioPlayer::MixerSourcePlayed (MixerSource *source)
+{
+	WakeUp ();
+}
+
+guint64
+NullAudioPlayer::GetMixerDelay ()
+{
+	return mixer_device != NULL ? mixer_device->GetDelay () : G_MAXUINT64;
+}
+
+void
+NullAudioPlayer::PrepareShutdownInternal ()
+{
+	int result;
+
+	LOG_AUDIO ("NullAudioPlayer::PrepareShutdownInternal ()\n");
+
+	mutex.Lock ();
+	shutdown = true;
+	cond.Signal ();
+	mutex.Unlock ();
+
+	if (audio_thread != NULL) {
+		result = audio_thread->Join ();
+		if (result != 0)
+			LOG_AUDIO ("NullAudioPlayer::PrepareShutdownInternal (): failed to join the audio thread (error code: %i).\n", result);
+		audio_thread = NULL;
+	}
+}
+
+void
+NullAudioPlayer::FinishShutdownInternal ()
+{
+	LOG_AUDIO ("NullAudioPlayer::FinishShutdownInternal ()\n");
+
+	if (mixer_device != NULL) {
+		mixer_device->PrintStatistics ("NullAudioPlayer (mixer)");
+		delete mixer_device;
+		mixer_device = NULL;
+	}
+}
+
+bool
+NullAudioPlayer::TickMixer (TimeSpan elapsed)
+{
+	guint32 available;
+	guint32 active = 0;
+	TimeSpan start;
+	TimeSpan write_time = 0;
+
+	available = mixer_device->Consume (elapsed);
+
+	if (available > 0) {
+		if (available > mixer_buffer_frames) {
+			mixer_buffer_frames = available;
+			mixer_buffer = (gint16 *) g_realloc (mixer_buffer, mixer_buffer_frames * mixer->GetBytesPerFrame ());
+		}
+
+		start = get_now ();
+		active = mixer->Mix (&sources, mixer_buffer, available);
+		write_time = get_now () - start;
+		mixer_device->Commit (mixer_buffer, available, write_time);
+	}
+
+	// Keep the clock running until the tail of the last sound has been played
+	return active > 0 || !mixer_device->IsStarved ();
+}
+
+void *
+NullAudioPlayer::Loop (void *data)
+{
+	((NullAudioPlayer *) data)->Loop ();
+	return NULL;
+}
+
+void
+NullAudioPlayer::Loop ()
+{
+	const TimeSpan period = MilliSeconds_ToPts (NULL_AUDIO_PERIOD_MS);
+	NullAudioSource *source;
+	TimeSpan start = get_now ();
+	TimeSpan device_clock = 0; // how much time the simulated device has played
+	bool playing;
+
+	LOG_AUDIO ("NullAudioPlayer: entering audio loop.\n");
+
+	while (true) {
+		mutex.Lock ();
+		if (speed > 0.0 && !shutdown && !play_pending) {
+			// Sleep until the simulated device needs more data
+			TimeSpan wakeup = start + (TimeSpan) (device_clock / speed);
+			TimeSpan now = get_now ();
+			if (wakeup > now) {
+				timespec ts;
+				clock_gettime (CLOCK_REALTIME, &ts);
+				ts.tv_nsec += (wakeup - now) * 100;
+				ts.tv_sec += ts.tv_nsec / 1000000000;
+				ts.tv_nsec %= 1000000000;
+				cond.TimedWait (mutex, &ts);
+			}
+		}
+		play_pending = false;
+		mutex.Unlock ();
+
+		if (shutdown)
+			break;
+
+		if (mixer != NULL) {
+			playing = TickMixer (period);
+		} else {
+			playing = false;
+			sources.StartEnumeration ();
+			while ((source = (NullAudioSource *) sources.GetNext (false)) != NULL) {
+				if (source->Tick (period))
+					playing = true;
+				source->unref ();
+			}
+		}
+
+		device_clock += period;
+
+		if (playing)
+			continue;
+
+		// Nothing is playing, wait until something starts playing
+		// and don't count the time we waited as device time.
+		mutex.Lock ();
+		while (!shutdown && !play_pending)
+			cond.Wait (mutex);
+		mutex.Unlock ();
+
+		start = get_now ();
+		device_clock = 0;
+	}
+
+	LOG_AUDIO ("NullAudioPlayer: exiting audio loop.\n");
+}
+
+};
@@ -0,0 +1,152 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * audio-null.h: an audio backend without any audio hardware
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#ifndef __AUDIO_NULL_H__
+#define __AUDIO_NULL_H__
+
+#include <stdio.h>
+
+#include "audio.h"
+
+namespace Moonlight {
+
+class NullAudioPlayer;
+
+/*
+ * Simulates the buffer of an audio device: samples are written into it,
+ * and the device clock drains it. Optionally dumps everything written to
+ * a wav file.
+ */
+class NullAudioDevice {
+	MoonMutex mutex;
+
+	guint32 sample_rate;
+	guint32 channels;
+	guint32 bytes_per_sample;
+	guint32 buffer_frames; // the size of the simulated hw buffer
+
+	guint64 buffered; // frames written but not played yet
+	guint64 remainder; // sub-frame part of the device clock (in frames * TIMESPANTICKS_IN_SECOND)
+	bool starved;
+
+	FILE *wav;
+	char *wav_path;
+	guint32 wav_bytes;
+
+	// statistics
+	guint64 frames_played;
+	guint64 frames_written;
+	guint32 underflows;
+	guint32 writes;
+	guint64 delay_sum; // in frames, sampled after every write
+	guint64 delay_min;
+	guint64 delay_max;
+	TimeSpan write_time_sum; // the time spent producing samples
+	TimeSpan write_time_max;
+
+	void WriteWavHeader ();
+
+ public:
+	NullAudioDevice (guint32 sample_rate, guint32 channels, guint32 bytes_per_sample, guint32 buffer_ms, const char *wav_path);
+	~NullAudioDevice ();
+
+	// Advances the device clock by 'elapsed', playing buffered frames.
+	// Returns the number of frames which can be written.
+	guint32 Consume (TimeSpan elapsed);
+	void Commit (const void *data, guint32 frames, TimeSpan write_time);
+	// Drops everything which hasn't been played yet.
+	void Flush ();
+
+	// Returns true if the device has played everything which was written.
+	bool IsStarved ();
+	// The time it will take until the last written sample is played (in pts).
+	guint64 GetDelay ();
+
+	void PrintStatistics (const char *name);
+};
+
+class NullAudioSource : public AudioSource {
+	NullAudioPlayer *player;
+	NullAudioDevice *device;
+	guint8 *scratch;
+	guint32 scratch_frames;
+	MoonMutex mutex; // protects device
+
+ protected:
+	virtual ~NullAudioSource ();
+
+	virtual void Played ();
+	virtual void Stopped ();
+	virtual guint64 GetDelayInternal ();
+	virtual bool InitializeInternal ();
+	virtual void CloseInternal ();
+
+ public:
+	/* @SkipFactories */
+	NullAudioSource (NullAudioPlayer *player, MediaPlayer *mplayer, AudioStream *stream);
+
+	// Called on the audio thread, advances the device clock and refills the device.
+	// Returns false if the source isn't playing.
+	bool Tick (TimeSpan elapsed);
+};
+
+class NullAudioPlayer : public AudioPlayer {
+	MoonThread *audio_thread;
+	MoonMutex mutex;
+	MoonCond cond;
+	bool shutdown;
+	bool play_pending; // a source started playing since the audio thread last checked
+
+	// Configuration, from MOONLIGHT_NULL_AUDIO
+	double speed; // how fast the device clock runs compared to real time, 0 = as fast as possible
+	guint32 buffer_ms;
+	guint32 mixer_rate;
+	char *wav_path;
+	int wav_count;
+
+	// The simulated device used when mixing
+	NullAudioDevice *mixer_device;
+	gint16 *mixer_buffer;
+	guint32 mixer_buffer_frames;
+
+	bool TickMixer (TimeSpan elapsed);
+	void Loop ();
+	static void *Loop (void *data);
+	void ParseOptions ();
+
+ protected:
+	virtual ~NullAudioPlayer ();
+
+	virtual void AddInternal (AudioSource *node);
+	virtual void RemoveInternal (AudioSource *node);
+	virtual void PrepareShutdownInternal ();
+	virtual void FinishShutdownInternal ();
+	virtual bool Initialize ();
+	virtual AudioSource *CreateNode (MediaPlayer *mplayer, AudioStream *stream);
+
+ public:
+	NullAudioPlayer ();
+
+	virtual void MixerSourcePlayed (MixerSource *source);
+	virtual guint64 GetMixerDelay ();
+
+	// Wakes up the audio thread if it's waiting for something to play.
+	void WakeUp ();
+
+	guint32 GetBufferMilliseconds () { return buffer_ms; }
+	// Returns a new wav path for a device (or NULL if we're not dumping), the caller must free it.
+	char *CreateWavPath ();
+};
+
+};
+
+#endif /* __AUDIO_NULL_H__ */
@@ -15,6 +15,7 @@
 #include <dlfcn.h>
 
 #include "audio-pulse.h"
+#include "audio-mixer.h"
 #include "runtime.h"
 #include "clock.h"
 #include "debug.h"
@@ -593,6 +594,10 @@ PulsePlayer::PulsePlayer ()
 	context = NULL;
 	connected = ConnectionUnknown;
 	fetching_recording_devices = false;
+	mixer_stream = NULL;
+	mixer_ready = false;
+	mixer_corked = false;
+	mixer_silent_frames = 0;
 }
 
 PulsePlayer::~PulsePlayer ()
@@ -812,6 +817,11 @@ PulsePlayer::AddInternal (AudioSource *source)
 {
 	LOG_PULSE ("PulsePlayer::AddInternal (%p)\n", source);
 	
+	if (mixer != NULL) {
+		// MixerSources don't have a pulse stream
+		return;
+	}
+	
 	((PulseSource *) source)->Initialize ();
 }
 
@@ -820,9 +830,222 @@ PulsePlayer::RemoveInternal (AudioSource *source)
 {
 	LOG_PULSE ("PulsePlayer::RemoveInternal (%p)\n", source);
 	
+	if (mixer != NULL)
+		return;
+	
 	((PulseSource *) source)->Close ();
 }
 
+/*
+ * PulsePlayer mixer stream
+ */
+
+bool
+PulsePlayer::InitializeMixerStream ()
+{
+	pa_sample_spec format;
+	pa_channel_map channel_map;
+	pa_buffer_attr attr;
+	int err;
+	
+	LOG_PULSE ("PulsePlayer::InitializeMixerStream ()\n");
+	
+	if (mixer_stream != NULL)
+		return true;
+	
+	if (GetPAState () != PA_CONTEXT_READY) {
+		LOG_PULSE ("PulsePlayer::InitializeMixerStream (), PA isn't in the ready state.\n");
+		return false;
+	}
+	
+	format.format = PA_SAMPLE_S16NE;
+	format.rate = mixer->GetSampleRate ();
+	format.channels = mixer->GetChannels ();
+	pa_channel_map_init_auto (&channel_map, format.channels, PA_CHANNEL_MAP_DEFAULT);
+	
+	mixer_stream = pa_stream_new (context, "Moonlight", &format, &channel_map);
+	if (mixer_stream == NULL) {
+		LOG_AUDIO ("PulsePlayer::InitializeMixerStream (): Stream creation failed: %s\n", pa_strerror (pa_context_errno (context)));
+		return false;
+	}
+	
+	pa_stream_set_state_callback (mixer_stream, OnMixerStateChanged, this);
+	pa_stream_set_write_callback (mixer_stream, OnMixerWrite, this);
+	
+	// Ask for a short buffer (200ms), the default (2s) would make every
+	// change in the set of playing sources take that long to be heard.
+	attr.maxlength = (guint32) -1;
+	attr.tlength = mixer->GetSampleRate () * mixer->GetBytesPerFrame () / 5;
+	attr.prebuf = (guint32) -1;
+	attr.minreq = (guint32) -1;
+	attr.fragsize = (guint32) -1;
+	
+	err = pa_stream_connect_playback (mixer_stream, NULL, &attr, (pa_stream_flags_t) (PA_STREAM_INTERPOLATE_TIMING | PA_STREAM_AUTO_TIMING_UPDATE | PA_STREAM_ADJUST_LATENCY), NULL, NULL);
+	if (err < 0) {
+		LOG_AUDIO ("PulsePlayer::InitializeMixerStream (): failed to connect stream: %s.\n", pa_strerror (pa_context_errno (context)));
+		pa_stream_set_state_callback (mixer_stream, NULL, NULL);
+		pa_stream_set_write_callback (mixer_stream, NULL, NULL);
+		pa_stream_unref (mixer_stream);
+		mixer_stream = NULL;
+		return false;
+	}
+	
+	mixer_corked = false;
+	mixer_silent_frames = 0;
+	
+	return true;
+}
+
+void
+PulsePlayer::CloseMixerStream ()
+{
+	LOG_PULSE ("PulsePlayer::CloseMixerStream ()\n");
+	
+	if (mixer_stream == NULL)
+		return;
+	
+	LockLoop ();
+	mixer_ready = false;
+	pa_stream_set_state_callback (mixer_stream, NULL, NULL);
+	pa_stream_set_write_callback (mixer_stream, NULL, NULL);
+	pa_stream_disconnect (mixer_stream);
+	pa_stream_unref (mixer_stream);
+	mixer_stream = NULL;
+	UnlockLoop ();
+}
+
+void
+PulsePlayer::OnMixerStateChanged (pa_stream *pulse_stream, void *userdata)
+{
+	((PulsePlayer *) userdata)->OnMixerStateChanged ();
+}
+
+void
+PulsePlayer::OnMixerStateChanged ()
+{
+	pa_stream_state_t state;
+	
+	if (mixer_stream == NULL)
+		return;
+	
+	state = pa_stream_get_state (mixer_stream);
+	
+	LOG_PULSE ("PulsePlayer::OnMixerStateChanged (): %s (%i)\n", get_pa_stream_state_name (state), state);
+	
+	switch (state) {
+	case PA_STREAM_READY:
+		mixer_ready = true;
+		break;
+	case PA_STREAM_CREATING:
+	case PA_STREAM_TERMINATED:
+		mixer_ready = false;
+		break;
+	case PA_STREAM_FAILED:
+	default: {
+		AudioSource *source;
+		
+		mixer_ready = false;
+		LOG_AUDIO ("PulsePlayer::OnMixerStateChanged (): Stream error: %s\n", pa_strerror (pa_context_errno (context)));
+		
+		// Nothing will be played, tell every source
+		sources.StartEnumeration ();
+		while ((source = sources.GetNext (false)) != NULL) {
+			source->SetState (AudioError);
+			source->unref ();
+		}
+		break;
+	}
+	}
+}
+
+void
+PulsePlayer::OnMixerWrite (pa_stream *pulse_stream, size_t length, void *userdata)
+{
+	((PulsePlayer *) userdata)->OnMixerWrite (length);
+}
+
+void
+PulsePlayer::OnMixerWrite (size_t length)
+{
+	gint16 *buffer;
+	guint32 frames;
+	guint32 active;
+	int err;
+	
+	LOG_PULSE_EX ("PulsePlayer::OnMixerWrite (%" G_GINT64_FORMAT ")\n", (gint64) length);
+	
+	if (mixer_stream == NULL || mixer_corked)
+		return;
+	
+	frames = length / mixer->GetBytesPerFrame ();
+	if (frames == 0)
+		return;
+	
+	buffer = (gint16 *) g_malloc (frames * mixer->GetBytesPerFrame ());
+	active = mixer->Mix (&sources, buffer, frames);
+	
+	// There is no need to lock here, if in a callback, the caller will have locked
+	// if called from MixerSourcePlayed, that method has locked
+	err = pa_stream_write (mixer_stream, buffer, frames * mixer->GetBytesPerFrame (), (pa_free_cb_t) g_free, 0, PA_SEEK_RELATIVE);
+	if (err < 0)
+		LOG_AUDIO ("PulsePlayer::OnMixerWrite (): Write error: %s\n", pa_strerror (pa_context_errno (context)));
+	
+	if (active > 0) {
+		mixer_silent_frames = 0;
+	} else {
+		mixer_silent_frames += frames;
+		// Once the tail of the last sound has been played, stop
+		// waking up for nothing until a source starts playing again.
+		if (mixer_silent_frames >= mixer->GetSampleRate () / 5) {
+			LOG_PULSE ("PulsePlayer::OnMixerWrite (): nothing is playing, corking the mixer stream.\n");
+			pa_operation_unref (pa_stream_cork (mixer_stream, 1, NULL, this));
+			mixer_corked = true;
+		}
+	}
+}
+
+void
+PulsePlayer::MixerSourcePlayed (MixerSource *source)
+{
+	size_t available;
+	
+	LOG_PULSE ("PulsePlayer::MixerSourcePlayed (%p)\n", source);
+	
+	LockLoop ();
+	if (InitializeMixerStream () && mixer_ready) {
+		mixer_silent_frames = 0;
+		if (mixer_corked) {
+			mixer_corked = false;
+			pa_operation_unref (pa_stream_cork (mixer_stream, 0, NULL, this));
+		}
+		available = pa_stream_writable_size (mixer_stream);
+		if (available != (size_t) -1)
+			OnMixerWrite (available);
+		pa_operation_unref (pa_stream_trigger (mixer_stream, NULL, this));
+	}
+	UnlockLoop ();
+}
+
+guint64
+PulsePlayer::GetMixerDelay ()
+{
+	pa_usec_t latency = 0;
+	int negative = 0;
+	guint64 result = G_MAXUINT64;
+	
+	LockLoop ();
+	if (mixer_stream != NULL && mixer_ready) {
+		if (pa_stream_get_latency (mixer_stream, &latency, &negative) < 0) {
+			LOG_AUDIO ("PulsePlayer::GetMixerDelay (): Error: %s\n", pa_strerror (pa_context_errno (context)));
+		} else {
+			result = MilliSeconds_ToPts (latency / 1000);
+		}
+	}
+	UnlockLoop ();
+	
+	return result;
+}
+
 void
 PulsePlayer::OnSourceInfoCallback (pa_context *context, const pa_source_info *i, int eol, void *userdata)
 {
@@ -956,12 +1179,18 @@ PulsePlayer::Initialize ()
 		pa_threaded_mainloop_start (loop);
 	}
 	
+	// Pulse resamples to the device rate anyway, so use the most
+	// common media rate to avoid resampling twice in most cases.
+	CreateMixer (44100, 2);
+	
 	return true;
 }
 
 void
 PulsePlayer::PrepareShutdownInternal ()
 {
+	// Stop pulling samples from the sources before they're removed
+	CloseMixerStream ();
 }
 
 void
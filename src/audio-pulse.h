@@ -150,6 +150,20 @@ class PulsePlayer : public AudioPlayer {
 
 	ConnectedState connected; // 0 = don't know, 1 = failed to connect, 2 = connected
 	
+	// The single device stream all sources are written to when mixing.
+	pa_stream *mixer_stream;
+	bool mixer_ready;
+	bool mixer_corked;
+	guint32 mixer_silent_frames; // frames of silence written since the last time anything played
+	
+	bool InitializeMixerStream ();
+	void CloseMixerStream ();
+	void OnMixerStateChanged ();
+	void OnMixerWrite (size_t length);
+	
+	static void OnMixerStateChanged (pa_stream *pulse_stream, void *userdata);
+	static void OnMixerWrite (pa_stream *pulse_stream, size_t length, void *userdata);
+	
 	static void OnContextStateChanged (pa_context *context, void *userdata);
 	static void OnSourceInfoCallback (pa_context *context, const pa_source_info *i, int eol, void *userdata);
 	void OnContextStateChanged ();
@@ -168,6 +182,9 @@ class PulsePlayer : public AudioPlayer {
 	PulsePlayer ();
 	virtual ~PulsePlayer ();
 	
+	virtual void MixerSourcePlayed (MixerSource *source);
+	virtual guint64 GetMixerDelay ();
+	
 	pa_context *GetPAContext () { return context; }
 	pa_threaded_mainloop *GetPALoop () { return loop; }
 	pa_mainloop_api *GetPAApi () { return api; }
@@ -13,9 +13,12 @@
 #include <config.h>
 
 #include "audio.h"
+#include "audio-converter.h"
+#include "audio-mixer.h"
 #include "audio-alsa.h"
 #include "audio-pulse.h"
 #include "audio-opensles.h"
+#include "audio-null.h"
 #include "pipeline.h"
 #include "runtime.h"
 #include "clock.h"
@@ -561,26 +564,17 @@ guint32
 AudioSource::Write (void *dest, guint32 samples)
 {
 	AudioData **data = (AudioData **) g_alloca (sizeof (AudioData *) * (channels + 1));
-	guint32 result = 0;
-	
-	for (unsigned int i = 0; i < channels; i++)
-		data [i] = (AudioData *) g_malloc (sizeof (AudioData));
+	AudioData *channel_data = (AudioData *) g_alloca (sizeof (AudioData) * channels);
 	
-	data [0]->dest = dest;
-	data [0]->distance = GetOutputBytesPerFrame ();
 	// Interleaved multi-channel audio data
-	for (unsigned int i = 1; i < channels; i++) {
+	for (unsigned int i = 0; i < channels; i++) {
+		data [i] = &channel_data [i];
 		data [i]->dest = ((char *) dest) + output_bytes_per_sample * i;
-		data [i]->distance = data [0]->distance;
+		data [i]->distance = GetOutputBytesPerFrame ();
 	}
 	data [channels] = NULL;
-	result = WriteFull (data, samples);
-	
-	for (int i = 0; data [i] != NULL; i++) {
-		g_free (data [i]);
-	}
 	
-	return result;
+	return WriteFull (data, samples);
 }
 
 guint32
@@ -591,13 +585,12 @@ AudioSource::WriteFull (AudioData **channel_data, guint32 samples)
 	gint32 volume;
 	double balance;
 	bool muted;
-	gint16 **write_ptr = (gint16 **) g_alloca (sizeof (gint16 *) * channels);
+	guint8 **write_ptr = (guint8 **) g_alloca (sizeof (guint8 *) * channels);
 	guint32 result = 0;
 	guint32 bytes_per_frame = input_bytes_per_sample * channels;
 	guint32 frames_to_write;
 	guint32 bytes_available;
 	guint32 bytes_written;
-	gint32 value;
 	guint64 last_frame_pts = 0; // The pts of the last frame which was used to write samples
 	guint64 last_frame_samples = 0; // Samples written from the last frame
 	IMediaStream *stream;
@@ -629,7 +622,7 @@ AudioSource::WriteFull (AudioData **channel_data, guint32 samples)
 	
 	Lock ();
 	
-	volume = this->volume * 8192;
+	volume = this->volume * AUDIO_VOLUME_UNITY;
 	balance = this->balance;
 	muted = false; //this->muted;
 	
@@ -663,8 +656,14 @@ AudioSource::WriteFull (AudioData **channel_data, guint32 samples)
 		goto cleanup;
 	}
 	
+	if (!AudioConverter::Supports (input_bytes_per_sample, output_bytes_per_sample)) {
+		LOG_AUDIO ("AudioSource::WriteFull (): Can't convert from %u to %u bytes per sample\n", input_bytes_per_sample, output_bytes_per_sample);
+		SetState (AudioError);
+		goto cleanup;
+	}
+	
 	for (guint32 i = 0; i < channels; i++)
-		write_ptr [i] = (gint16 *) channel_data [i]->dest;
+		write_ptr [i] = (guint8 *) channel_data [i]->dest;
 	
 	while (GetState () == AudioPlaying) {
 		if (current_frame == NULL) {
@@ -714,113 +713,9 @@ AudioSource::WriteFull (AudioData **channel_data, guint32 samples)
 		fwrite ((((char *) current_frame->frame->buffer) + current_frame->bytes_used), 1, bytes_written, dump_fd);	
 #endif
 
-		switch (this->input_bytes_per_sample) {
-		case 1: {
-			switch (this->output_bytes_per_sample) {
-			case 2: {
-				// 8bit audio -> 16bit audio
-				// note that 8bit audio is unsigned, and we need to conver to signed 16bit
-				guint8 *read_ptr = ((guint8 *) current_frame->frame->GetBuffer ()) + current_frame->bytes_used;
-				memcpy (write_ptr [0], read_ptr, frames_to_write);
-
-				for (guint32 i = 0; i < frames_to_write; i++) {
-					for (guint32 channel = 0; channel < channels; channel++) {
-						value = (((gint16) (*read_ptr)) - 128) << 8;
-						value = (value * volumes [channel]) >> 13;
-						*(write_ptr [channel]) = (gint16) CLAMP (value, -32768, 32767);
-						write_ptr [channel] = (gint16 *) (((char *) write_ptr [channel]) + channel_data [channel]->distance);
-						read_ptr++;
-					}
-				}
-				break;
-			}
-			default: // implement others as needed
-				LOG_AUDIO ("AudioSource::Write (): Invalid output_bytes_per_sample, expected 1, got: %i\n", this->output_bytes_per_sample);
-				break;
-			}
-			break;
-		}
-		case 2: {
-			switch (this->output_bytes_per_sample) {
-			case 2: {
-				// 16bit audio -> 16bit audio
-				gint16 *read_ptr = (gint16 *) (((char *) current_frame->frame->GetBuffer ()) + current_frame->bytes_used);
-				
-				for (guint32 i = 0; i < frames_to_write; i++) {
-					for (guint32 channel = 0; channel < channels; channel++) {
-						value = ((*read_ptr) * volumes [channel]) >> 13;
-						*(write_ptr [channel]) = (gint16) CLAMP (value, -32768, 32767);
-						write_ptr [channel] = (gint16 *) (((char *) write_ptr [channel]) + channel_data [channel]->distance);
-						read_ptr++;
-					}
-				}
-				break;
-			}
-			default: // implement others as needed
-				LOG_AUDIO ("AudioSource::Write (): Invalid output_bytes_per_sample, expected 2, got: %i\n", this->output_bytes_per_sample);
-				break;
-			}
-			break;
-		}
-		case 3: {
-			switch (this->output_bytes_per_sample) {
-			case 2: {
-				// 24bit audio -> 16bit audio
-				gint16 *read_ptr = (gint16 *) (((char *) current_frame->frame->GetBuffer ()) + current_frame->bytes_used);
-				
-				for (guint32 i = 0; i < frames_to_write; i++) {
-					for (guint32 channel = 0; channel < channels; channel++) {
-						read_ptr = (gint16 *) (((gint8 *) read_ptr) + 1); // +1 byte
-						value = *read_ptr;
-						value = (gint16) CLAMP (((value * volumes [channel]) >> 13), -32768, 32767);
-						*write_ptr [channel] = value;
-						write_ptr [channel] = (gint16 *) (((char *) write_ptr [channel]) + channel_data [channel]->distance);
-						read_ptr += 1; // +2 bytes
-					}
-				}
-				break;
-			}
-			// case 3: // 24bit audio -> 24bit audio, this is painful to both read and write.
-			case 4: {
-				// 24bit audio -> 32bit audio
-				gint32 *read_ptr = (gint32 *) (((char *) current_frame->frame->GetBuffer ()) + current_frame->bytes_used);
-				
-				for (guint32 i = 0; i < frames_to_write; i++) {
-					for (guint32 channel = 0; channel < channels; channel++) {
-						if (false && i > 0) {
-							// can overread before, mask out the upper bits.
-							value = * (gint32 *) (((gint8 *) read_ptr) - 1);
-							value &= 0xFFFFFF00;
-						} else {
-							// can't overread before, use byte pointers
-							value = 0;
-							((guint8 *) &value) [1] = (((guint8 *) read_ptr) [0]);
-							((guint8 *) &value) [2] = (((guint8 *) read_ptr) [1]);
-							((guint8 *) &value) [3] = (((guint8 *) read_ptr) [2]);
-						}
-						// not sure how to calculate volume here, this shifts down 13 bits
-						// and then multiply with volume. This loses the lowest 5 bits of information 
-						// from the 24 bit sample. Not quite sure how to do this with 32bit math without
-						// losing information though.
-						value = (value >> 13) * (volumes [channel]);
-						*((gint32 *) write_ptr [channel]) = value;
-						write_ptr [channel] = (gint16 *) (((char *) write_ptr [channel]) + channel_data [channel]->distance);
-						read_ptr = (gint32 *) (((gint8 *) read_ptr) + 3); // += input_bytes_per_sample;
-					}
-				}
-				break;
-			}
-			default: // implement others as needed
-				LOG_AUDIO ("AudioSource::Write (): Invalid output_bytes_per_sample, expected 2 or 4, got: %i\n", this->output_bytes_per_sample);
-				break;
-			}
-			break;
-		}
-		default:
-			LOG_AUDIO ("AudioSource::Write (): Invalid input_bytes_per_sample, can only be 2 or 3, but got: %i\n", this->input_bytes_per_sample);
-			SetState (AudioError);
-			break;
-		}
+		AudioConverter::Convert (input_bytes_per_sample, output_bytes_per_sample, channels,
+					 ((guint8 *) current_frame->frame->GetBuffer ()) + current_frame->bytes_used,
+					 frames_to_write, volumes, channel_data, write_ptr);
 		
 		result += frames_to_write;
 		current_frame->bytes_used += bytes_written;
@@ -1031,6 +926,20 @@ MoonMutex AudioPlayer::instance_mutex;
 AudioPlayer::AudioPlayer ()
 {
 	refcount = 1;
+	mixer = NULL;
+}
+
+void
+AudioPlayer::CreateMixer (guint32 sample_rate, guint32 channels)
+{
+	if (!(moonlight_flags & RUNTIME_INIT_AUDIO_MIXER)) {
+		LOG_AUDIO ("AudioPlayer::CreateMixer (): mixing is disabled.\n");
+		return;
+	}
+	
+	LOG_AUDIO ("AudioPlayer::CreateMixer (%u Hz, %u channels)\n", sample_rate, channels);
+	
+	mixer = new AudioMixer (sample_rate, channels);
 }
 
 void
@@ -1172,6 +1081,19 @@ AudioPlayer::CreatePlayer ()
 	
 	overridden  = moonlight_flags & (RUNTIME_INIT_AUDIO_PULSE | RUNTIME_INIT_AUDIO_ALSA | RUNTIME_INIT_AUDIO_OPENSLES | RUNTIME_INIT_AUDIO_ALSA_RW);
 
+	// The null backend is never picked automatically, only when explicitly asked for
+	if (moonlight_flags & RUNTIME_INIT_AUDIO_NULL) {
+		printf ("AudioPlayer: Using the null audio backend.\n");
+		result = new NullAudioPlayer ();
+		if (!result->Initialize ()) {
+			LOG_AUDIO ("AudioPlayer: Failed initialization.\n");
+			result->unref ();
+			result = NULL;
+		} else {
+			return result;
+		}
+	}
+
 #if INCLUDE_OPENSLES
 	if (result != NULL) {
 		LOG_AUDIO ("AudioPlayer: Not checking for OpenSLES support, we already found support for another configuration.\n");
@@ -1251,7 +1173,13 @@ AudioPlayer::CreatePlayer ()
 AudioSource *
 AudioPlayer::AddImpl (MediaPlayer *mplayer, AudioStream *stream)
 {
-	AudioSource *result = CreateNode (mplayer, stream);
+	AudioSource *result;
+	
+	if (mixer != NULL) {
+		result = new MixerSource (this, mplayer, stream);
+	} else {
+		result = CreateNode (mplayer, stream);
+	}
 
 	if (result->Initialize ()) {
 		sources.Add (result);		
@@ -1295,6 +1223,9 @@ AudioPlayer::ShutdownImpl ()
 	}
 
 	FinishShutdownInternal ();
+	
+	delete mixer;
+	mixer = NULL;
 }
 
 /*
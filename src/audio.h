@@ -24,6 +24,8 @@ class AudioSource;
 class AudioSources;
 class AudioPlayer;
 class AudioRecorder;
+class AudioMixer;
+class MixerSource;
 
 };
 
@@ -293,6 +295,13 @@ class AudioPlayer {
 	// derived classes must not add/remove sources.
 	AudioSources sources;
 	
+	// If not NULL all sources are MixerSources, and the derived class
+	// writes the output of the mixer to a single device stream.
+	// Derived classes which support mixing should call CreateMixer
+	// from Initialize.
+	AudioMixer *mixer;
+	void CreateMixer (guint32 sample_rate, guint32 channels);
+	
 	AudioPlayer ();
 	virtual ~AudioPlayer () {}
 	virtual void Dispose ();
@@ -316,6 +325,14 @@ class AudioPlayer {
 	virtual guint32 CreateRecordersInternal (AudioRecorder **recorders, guint32 size) { return 0; }
 	
  public:
+	// The following two methods are only called if mixing is enabled.
+	// Called (on any thread) when a MixerSource starts playing, the derived class
+	// must ensure its mixer device stream is running.
+	virtual void MixerSourcePlayed (MixerSource *source) {}
+	// Must return the latency of the mixer device stream (in pts), or G_MAXUINT64 on errors.
+	virtual guint64 GetMixerDelay () { return G_MAXUINT64; }
+	
+
 	// Creates a audio source from the MediaPlayer and AudioStream.
 	// Returns NULL if there were any errors.
 	// Note: Actually returning an object doesn't mean audio will be played.
@@ -14,6 +14,7 @@
 #include <config.h>
 
 #include <stdio.h>
+#include <math.h>
 
 #include "application.h"
 #include "bitmapsource.h"
@@ -21,16 +22,82 @@
 
 namespace Moonlight {
 
+//
+// BitmapMipLevel
+//
+
+void
+BitmapMipSurfaceCache::Uploaded (gint64 size)
+{
+	if (uploaded != 0 || !entry->IsResident ())
+		return;
+
+	uploaded = size;
+	entry->Add (entry->GetSize () + size);
+}
+
+void
+BitmapMipSurfaceCache::Unused ()
+{
+	// the entry is gone already when the levels are being cleared
+	if (uploaded != 0 && entry->IsResident ())
+		entry->Resize (entry->GetSize () - uploaded);
+
+	uploaded = 0;
+	Context::Cache::Unused ();
+}
+
+BitmapMipLevel::BitmapMipLevel (RenderCache::Entry *entry, int width, int height)
+	: cache (entry)
+{
+	this->width = width;
+	this->height = height;
+	data = (guint32 *) g_try_malloc ((gsize) width * height * 4);
+	image_surface = NULL;
+
+	if (data)
+		image_surface = cairo_image_surface_create_for_data ((unsigned char *) data, CAIRO_FORMAT_ARGB32,
+								     width, height, width * 4);
+}
+
+BitmapMipLevel::~BitmapMipLevel ()
+{
+	cache.Release ();
+
+	if (image_surface)
+		cairo_surface_destroy (image_surface);
+
+	g_free (data);
+}
+
+void
+BitmapMipCacheEntry::Evict ()
+{
+	source->ClearMipLevels ();
+}
+
+//
+// BitmapSource
+//
+
 BitmapSource::BitmapSource ()
+	: mip_cache_entry (this), cache (RenderCacheImage, RENDER_CACHE_COST_LOW)
 {
 	SetObjectType (Type::BITMAPSOURCE);
 	image_surface = NULL;
 	data = NULL;
 	own_data = true;
+	opaque_checked = false;
+	opaque = false;
+
+	for (int i = 0; i < BITMAP_SOURCE_MAX_MIP_LEVELS; i++)
+		mip_levels [i] = NULL;
 }
 
 BitmapSource::~BitmapSource ()
 {
+	ClearMipLevels ();
+
 	if (image_surface)
 		cairo_surface_destroy (image_surface);
 
@@ -70,6 +137,8 @@ BitmapSource::SetBitmapData (gpointer data, bool own_data)
 		g_free (this->data);
 	this->own_data = own_data;
 	this->data = data;
+	opaque_checked = false;
+	ClearMipLevels ();
 }
 
 void
@@ -85,9 +154,33 @@ BitmapSource::Invalidate ()
 		GetPixelWidth (), GetPixelHeight (), GetPixelWidth () * 4);
 
 	cache.Release ();
+	opaque_checked = false;
+	ClearMipLevels ();
 	Emit (BitmapSource::PixelDataChangedEvent);
 }
 
+bool
+BitmapSource::IsOpaque ()
+{
+	if (!opaque_checked) {
+		guint32 *pixels = (guint32 *) GetBitmapData ();
+		gint64 count = (gint64) GetPixelWidth () * GetPixelHeight ();
+
+		// the decoders don't tell us whether there was an alpha
+		// channel, but the first translucent pixel settles it
+		// for most images which have one.
+		opaque = pixels != NULL && count > 0;
+		for (gint64 i = 0; opaque && i < count; i++) {
+			if ((pixels [i] & 0xff000000) != 0xff000000)
+				opaque = false;
+		}
+
+		opaque_checked = true;
+	}
+
+	return opaque;
+}
+
 MoonSurface *
 BitmapSource::GetSurface (Context *ctx)
 {
@@ -104,9 +197,203 @@ BitmapSource::GetSurface (Context *ctx)
 	ctx->Blit ((unsigned char *) GetBitmapData (), GetPixelWidth () * 4);
 	ctx->Pop (&surface);
 	ctx->Replace (&cache, surface);
+	cache.Add ((gint64) GetPixelWidth () * GetPixelHeight () * 4);
 	surface->unref ();
 
 	return ctx->Lookup (&cache);
 }
 
+void
+BitmapSource::ClearMipLevels ()
+{
+	mip_cache_entry.Remove ();
+
+	for (int i = 1; i < BITMAP_SOURCE_MAX_MIP_LEVELS; i++) {
+		delete mip_levels [i];
+		mip_levels [i] = NULL;
+	}
+}
+
+// Averages each 2x2 block of @src into a pixel of @dest. The channels
+// of a pixel are averaged together, two bits of each byte at a time so
+// the sums don't carry into the next channel. Premultiplied pixels stay
+// premultiplied since colors and alpha are rounded the same way.
+static void
+downscale_box_2x2 (const guint32 *src, int src_width, int src_height, guint32 *dest, int dest_width, int dest_height)
+{
+	for (int y = 0; y < dest_height; y++) {
+		const guint32 *row0 = src + (gsize) MIN (y * 2, src_height - 1) * src_width;
+		const guint32 *row1 = src + (gsize) MIN (y * 2 + 1, src_height - 1) * src_width;
+		guint32 *out = dest + (gsize) y * dest_width;
+
+		for (int x = 0; x < dest_width; x++) {
+			int x0 = MIN (x * 2, src_width - 1);
+			int x1 = MIN (x * 2 + 1, src_width - 1);
+			guint32 p0 = row0 [x0], p1 = row0 [x1], p2 = row1 [x0], p3 = row1 [x1];
+			guint32 high, low;
+
+			high = ((p0 & 0xfcfcfcfc) >> 2) + ((p1 & 0xfcfcfcfc) >> 2) +
+			       ((p2 & 0xfcfcfcfc) >> 2) + ((p3 & 0xfcfcfcfc) >> 2);
+			low = (p0 & 0x03030303) + (p1 & 0x03030303) +
+			      (p2 & 0x03030303) + (p3 & 0x03030303);
+
+			out [x] = high + (((low + 0x02020202) >> 2) & 0x03030303);
+		}
+	}
+}
+
+BitmapMipLevel *
+BitmapSource::BuildMipLevel (int level)
+{
+	const guint32 *src;
+	int src_width, src_height;
+	BitmapMipLevel *mip;
+
+	if (mip_levels [level])
+		return mip_levels [level];
+
+	if (level == 1) {
+		src = (const guint32 *) GetBitmapData ();
+		src_width = GetPixelWidth ();
+		src_height = GetPixelHeight ();
+	}
+	else {
+		BitmapMipLevel *parent = BuildMipLevel (level - 1);
+
+		if (!parent)
+			return NULL;
+
+		src = parent->data;
+		src_width = parent->width;
+		src_height = parent->height;
+	}
+
+	if (!src)
+		return NULL;
+
+	mip = new BitmapMipLevel (&mip_cache_entry, MAX (src_width / 2, 1), MAX (src_height / 2, 1));
+	if (!mip->image_surface || cairo_surface_status (mip->image_surface) != CAIRO_STATUS_SUCCESS) {
+		delete mip;
+		return NULL;
+	}
+
+	downscale_box_2x2 (src, src_width, src_height, mip->data, mip->width, mip->height);
+	mip_levels [level] = mip;
+
+	mip_cache_entry.Add (mip_cache_entry.GetSize () + (gint64) mip->width * mip->height * 4);
+
+	return mip;
+}
+
+int
+BitmapSource::GetMipLevel (double downscale)
+{
+	int width = GetPixelWidth ();
+	int height = GetPixelHeight ();
+	int level;
+
+	if (downscale < 2.0 || GetBitmapData () == NULL)
+		return 0;
+
+	level = MIN ((int) floor (log2 (downscale)), BITMAP_SOURCE_MAX_MIP_LEVELS - 1);
+
+	// there's nothing to gain past a single pixel
+	while (level > 0 && (width >> level) < 1 && (height >> level) < 1)
+		level--;
+
+	if (level == 0 || !BuildMipLevel (level))
+		return 0;
+
+	mip_cache_entry.Touch ();
+
+	return level;
+}
+
+void
+BitmapSource::GetMipLevelSize (int level, int *width, int *height)
+{
+	if (level == 0) {
+		*width = GetPixelWidth ();
+		*height = GetPixelHeight ();
+	}
+	else {
+		*width = mip_levels [level]->width;
+		*height = mip_levels [level]->height;
+	}
+}
+
+cairo_surface_t *
+BitmapSource::GetMipImageSurface (int level)
+{
+	if (level == 0)
+		return GetImageSurface ();
+
+	return mip_levels [level]->image_surface;
+}
+
+MoonSurface *
+BitmapSource::GetMipSurface (Context *ctx, int level)
+{
+	BitmapMipLevel *mip;
+	MoonSurface *surface;
+
+	if (level == 0)
+		return GetSurface (ctx);
+
+	mip = mip_levels [level];
+
+	surface = ctx->Lookup (&mip->cache);
+	if (surface)
+		return surface;
+
+	ctx->Push (Context::Group (Rect (0, 0, mip->width, mip->height)));
+	ctx->Blit ((unsigned char *) mip->data, mip->width * 4);
+	ctx->Pop (&surface);
+	ctx->Replace (&mip->cache, surface);
+	mip->cache.Uploaded ((gint64) mip->width * mip->height * 4);
+	surface->unref ();
+
+	return ctx->Lookup (&mip->cache);
+}
+
+cairo_surface_t *
+BitmapSource::GetPatternSurface (cairo_t *cr, cairo_matrix_t *matrix)
+{
+	cairo_matrix_t device, scale;
+	int level, width, height;
+
+	// the pattern matrix maps user space to the bitmap, we need the
+	// bitmap to device space
+	device = *matrix;
+	if (cairo_matrix_invert (&device) != CAIRO_STATUS_SUCCESS)
+		return GetImageSurface ();
+
+	cairo_get_matrix (cr, &scale);
+	cairo_matrix_multiply (&device, &device, &scale);
+
+	level = GetMipLevel (GetDownscale (&device));
+	if (level == 0)
+		return GetImageSurface ();
+
+	GetMipLevelSize (level, &width, &height);
+	cairo_matrix_init_scale (&scale, (double) width / GetPixelWidth (), (double) height / GetPixelHeight ());
+	cairo_matrix_multiply (matrix, matrix, &scale);
+
+	return GetMipImageSurface (level);
+}
+
+double
+BitmapSource::GetDownscale (const cairo_matrix_t *matrix)
+{
+	// how far one pixel of the bitmap goes on the device along each axis
+	double sx = sqrt (matrix->xx * matrix->xx + matrix->yx * matrix->yx);
+	double sy = sqrt (matrix->xy * matrix->xy + matrix->yy * matrix->yy);
+	double scale = MAX (sx, sy);
+
+	if (scale <= 0.0)
+		return 1.0;
+
+	return 1.0 / scale;
+}
+
 };
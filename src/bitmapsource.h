@@ -22,11 +22,77 @@
 
 namespace Moonlight {
 
+class BitmapSource;
+
+#define BITMAP_SOURCE_MAX_MIP_LEVELS 16
+
+//
+// BitmapMipSurfaceCache: the native surfaces of a mip level. Never added
+// to the RenderCache itself, the surfaces are accounted for (and evicted)
+// in the mip levels' entry, once while any context holds one.
+//
+class BitmapMipSurfaceCache : public Context::Cache {
+ public:
+	BitmapMipSurfaceCache (RenderCache::Entry *entry) : Context::Cache (RenderCacheImage, RENDER_CACHE_COST_MEDIUM), entry (entry), uploaded (0) {}
+
+	// a context now holds a surface of @size bytes
+	void Uploaded (gint64 size);
+
+ protected:
+	virtual void Unused ();
+
+ private:
+	RenderCache::Entry *entry;
+	gint64 uploaded;
+};
+
+//
+// BitmapMipLevel: a copy of a BitmapSource at half the size of the
+// level before it, for painting the bitmap much smaller than it is
+//
+class BitmapMipLevel {
+ public:
+	BitmapMipLevel (RenderCache::Entry *entry, int width, int height);
+	~BitmapMipLevel ();
+
+	int width;
+	int height;
+	guint32 *data;
+	cairo_surface_t *image_surface;
+	BitmapMipSurfaceCache cache;
+};
+
+//
+// BitmapMipCacheEntry: accounts for the mip levels of a BitmapSource,
+// both their pixels and the surfaces they're uploaded to
+//
+class BitmapMipCacheEntry : public RenderCache::Entry {
+ public:
+	BitmapMipCacheEntry (BitmapSource *source) : RenderCache::Entry (RenderCacheImage, RENDER_CACHE_COST_MEDIUM), source (source) {}
+
+ protected:
+	virtual void Evict ();
+
+ private:
+	BitmapSource *source;
+};
+
 /* @Namespace=System.Windows.Media.Imaging */
 class BitmapSource : public ImageSource {
  private:
 	gpointer data;
 	bool own_data; // if true, we free in the dtor.
+	bool opaque_checked; // the pixels have been checked for alpha since they last changed
+	bool opaque;
+
+	// built when needed, [0] is unused since level 0 is the bitmap itself
+	BitmapMipLevel *mip_levels [BITMAP_SOURCE_MAX_MIP_LEVELS];
+	BitmapMipCacheEntry mip_cache_entry;
+
+	void ClearMipLevels ();
+	BitmapMipLevel *BuildMipLevel (int level);
+
+	friend class BitmapMipCacheEntry;
  protected:
 	cairo_surface_t *image_surface;
 	Context::Cache cache;
@@ -63,6 +129,23 @@ class BitmapSource : public ImageSource {
 
 	virtual cairo_surface_t *GetImageSurface () { return image_surface; }
 	MoonSurface *GetSurface (Context *ctx);
+	virtual bool IsOpaque ();
+
+	// The mip level to paint with when one device pixel covers
+	// @downscale pixels of the bitmap, building it if needed.
+	// Level 0 (the bitmap itself) if it isn't downscaled enough
+	// or the level couldn't be built.
+	int GetMipLevel (double downscale);
+	void GetMipLevelSize (int level, int *width, int *height);
+	cairo_surface_t *GetMipImageSurface (int level);
+	MoonSurface *GetMipSurface (Context *ctx, int level);
+	// The image surface to paint on @cr with a pattern matrix of
+	// @matrix, which is adjusted to the size of the level chosen
+	cairo_surface_t *GetPatternSurface (cairo_t *cr, cairo_matrix_t *matrix);
+
+	// how many pixels of the bitmap one device pixel covers (along the
+	// axis where it covers fewer) when @matrix maps the bitmap to the device
+	static double GetDownscale (const cairo_matrix_t *matrix);
 	virtual void OnIsAttachedChanged (bool value);
 };
 
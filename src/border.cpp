@@ -113,6 +113,29 @@ Border::Render (Context *ctx, Region *region)
 	}
 }
 
+Rect
+Border::GetCoverageBounds ()
+{
+	Brush        *background = GetBackground ();
+	CornerRadius *radius = GetCornerRadius ();
+	Thickness    thickness = *GetBorderThickness ();
+	Rect         covered;
+	double       r;
+
+	if (!background || !background->IsOpaque () || HasLayoutClip ())
+		return Rect ();
+
+	// only the background counts, the seam between it and the border
+	// may be translucent. Stay clear of the rounded corners too.
+	r = MAX (MAX (radius->topLeft, radius->topRight), MAX (radius->bottomRight, radius->bottomLeft));
+	covered = extents.GrowBy (-thickness).GrowBy (-r);
+
+	if (covered.IsEmpty ())
+		return Rect ();
+
+	return covered.Transform (&absolute_xform).Intersection (bounds);
+}
+
 void 
 Border::Render (cairo_t *cr, Region *region, bool path_only)
 {
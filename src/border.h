@@ -59,6 +59,7 @@ public:
 
 	virtual bool InsideObject (cairo_t *cr, double x, double y);
 	virtual bool CanFindElement () { return GetBackground () || GetBorderBrush (); }
+	virtual Rect GetCoverageBounds ();
 	// property accessors
 
 	Brush *GetBackground ();
@@ -717,8 +717,17 @@ ImageBrush::OnPropertyChanged (PropertyChangedEventArgs *args, MoonError *error)
 bool
 ImageBrush::IsOpaque ()
 {
-	// XXX punt for now and return false here.
-	return false;
+	ImageSource *source = GetImageSource ();
+	bool opaque;
+
+	if (!source || !Brush::IsOpaque () || !FillsArea ())
+		return false;
+
+	source->Lock ();
+	opaque = source->GetPixelWidth () > 0 && source->GetPixelHeight () > 0 && source->IsOpaque ();
+	source->Unlock ();
+
+	return opaque;
 }
 
 cairo_surface_t *
@@ -876,10 +885,13 @@ ImageBrush::SetupBrush (cairo_t *cr, const Rect &area)
 	transform = GetTransform ();
 	relative_transform = GetRelativeTransform ();
 
-	pattern = cairo_pattern_create_for_surface (surface);
-
 	image_brush_compute_pattern_matrix (&matrix, area.width, area.height, source->GetPixelWidth (), source->GetPixelHeight (), stretch, ax, ay, transform, relative_transform);
 	cairo_matrix_translate (&matrix, -area.x, -area.y);
+
+	if (source->Is (Type::BITMAPSOURCE))
+		surface = ((BitmapSource *) source)->GetPatternSurface (cr, &matrix);
+
+	pattern = cairo_pattern_create_for_surface (surface);
 	cairo_pattern_set_matrix (pattern, &matrix);
 
 	if (cairo_pattern_status (pattern) == CAIRO_STATUS_SUCCESS)
@@ -906,6 +918,31 @@ TileBrush::~TileBrush ()
 {
 }
 
+static bool
+transform_is_identity (Transform *transform)
+{
+	cairo_matrix_t matrix;
+
+	if (transform == NULL)
+		return true;
+
+	transform->GetTransform (&matrix);
+
+	return matrix.xx == 1.0 && matrix.yx == 0.0 && matrix.xy == 0.0 && matrix.yy == 1.0
+		&& matrix.x0 == 0.0 && matrix.y0 == 0.0;
+}
+
+bool
+TileBrush::FillsArea ()
+{
+	Stretch stretch = GetStretch ();
+
+	if (stretch != StretchFill && stretch != StretchUniformToFill)
+		return false;
+
+	return transform_is_identity (GetTransform ()) && transform_is_identity (GetRelativeTransform ());
+}
+
 void
 TileBrush::Fill (cairo_t *cr, bool preserve)
 {
@@ -1225,8 +1262,16 @@ VideoBrush::SetSource (DependencyObject *source)
 bool
 VideoBrush::IsOpaque ()
 {
-	// XXX punt for now and return false here.
-	return false;
+	MediaPlayer *mplayer;
+
+	if (!source || !source->Is (Type::MEDIAELEMENT) || !Brush::IsOpaque () || !FillsArea ())
+		return false;
+
+	// decoded video frames don't have an alpha channel, but until
+	// the first one is rendered the brush paints nothing
+	mplayer = ((MediaElement *) (DependencyObject *) source)->GetMediaPlayer ();
+
+	return mplayer && mplayer->HasRenderedFrame ();
 }
 
 bool
@@ -301,6 +301,10 @@ class TileBrush : public Brush {
 	
 	virtual void Fill (cairo_t *cr, bool preserve);
 	virtual void Stroke (cairo_t *cr, bool preserve);
+
+	// returns true if the tile is stretched over all of the area
+	// the brush paints
+	bool FillsArea ();
 	
 	//
 	// Property Accessors
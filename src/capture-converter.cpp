@@ -0,0 +1,213 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * capture-converter.cpp: conversion of captured video frames to BGRA
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <unistd.h>
+
+#include "capture-converter.h"
+#include "yuv-converter.h"
+#include "debug.h"
+
+namespace Moonlight {
+
+/* Frames smaller than this aren't worth waking up the workers for */
+#define CAPTURE_CONVERTER_MIN_THREADED_PIXELS (640 * 480)
+#define CAPTURE_CONVERTER_MAX_THREADS 3
+
+CaptureFrameConverter::CaptureFrameConverter ()
+{
+	thread_count = -1;
+	threads = NULL;
+	bands = NULL;
+	generation = 0;
+	pending = 0;
+	shutting_down = false;
+
+	format = CaptureFrameYUYV;
+	src = NULL;
+	src_stride = 0;
+	width = 0;
+	dest = NULL;
+	dst_stride = 0;
+	height = 0;
+}
+
+CaptureFrameConverter::~CaptureFrameConverter ()
+{
+	mutex.Lock ();
+	shutting_down = true;
+	work_cond.Broadcast ();
+	mutex.Unlock ();
+
+	for (int i = 0; i < thread_count; i++)
+		threads [i]->Join ();
+
+	g_free (threads);
+	g_free (bands);
+}
+
+void
+CaptureFrameConverter::StartThreads ()
+{
+	long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+	int count = CLAMP (cpus - 1, 0, CAPTURE_CONVERTER_MAX_THREADS);
+	int result;
+
+	threads = g_new0 (MoonThread *, count);
+	// band 0 is converted by the calling thread
+	bands = g_new0 (Band, count + 1);
+	thread_count = 0;
+
+	for (int i = 0; i < count; i++) {
+		bands [i + 1].converter = this;
+
+		if ((result = MoonThread::StartJoinable (&threads [i], WorkerLoop, &bands [i + 1])) != 0) {
+			g_warning ("Moonlight: could not create capture conversion thread: %s (%i)\n", strerror (result), result);
+			break;
+		}
+
+		thread_count++;
+	}
+
+	LOG_CAPTURE ("CaptureFrameConverter::StartThreads (): converting with %i worker thread(s)\n", thread_count);
+}
+
+gpointer
+CaptureFrameConverter::WorkerLoop (gpointer data)
+{
+	Band *band = (Band *) data;
+	CaptureFrameConverter *converter = band->converter;
+	guint32 seen = 0;
+	int first_row, rows;
+
+	converter->mutex.Lock ();
+	while (true) {
+		while (!converter->shutting_down && converter->generation == seen)
+			converter->work_cond.Wait (converter->mutex);
+
+		if (converter->shutting_down)
+			break;
+
+		seen = converter->generation;
+		first_row = band->first_row;
+		rows = band->rows;
+
+		converter->mutex.Unlock ();
+		converter->ConvertRows (first_row, rows);
+		converter->mutex.Lock ();
+
+		if (--converter->pending == 0)
+			converter->done_cond.Signal ();
+	}
+	converter->mutex.Unlock ();
+
+	return NULL;
+}
+
+guint32
+CaptureFrameConverter::GetFrameSize (CaptureFrameFormat format, int srcStride, int height)
+{
+	switch (format) {
+	case CaptureFrameI420:
+	case CaptureFrameYV12:
+		return srcStride * height + 2 * (srcStride / 2) * ((height + 1) / 2);
+	default:
+		return srcStride * height;
+	}
+}
+
+void
+CaptureFrameConverter::ConvertRows (int first_row, int rows)
+{
+	guint8 *planes [3];
+	int strides [3];
+
+	if (rows <= 0)
+		return;
+
+	switch (format) {
+	case CaptureFrameYUYV:
+	case CaptureFrameUYVY:
+		YUVConverter::PackedToBGRA (src + first_row * src_stride, src_stride, width, rows,
+					    dest + first_row * dst_stride, dst_stride, format == CaptureFrameUYVY);
+		break;
+	case CaptureFrameI420:
+	case CaptureFrameYV12:
+		strides [0] = src_stride;
+		strides [1] = strides [2] = src_stride / 2;
+
+		planes [0] = src;
+		planes [1] = src + src_stride * height;
+		planes [2] = planes [1] + strides [1] * ((height + 1) / 2);
+
+		if (format == CaptureFrameYV12) {
+			guint8 *v = planes [1];
+			planes [1] = planes [2];
+			planes [2] = v;
+		}
+
+		// bands start on even rows, so they start on a chroma row too
+		planes [0] += first_row * strides [0];
+		planes [1] += (first_row / 2) * strides [1];
+		planes [2] += (first_row / 2) * strides [2];
+
+		YUVConverter::PlanarToBGRA (planes, strides, width, rows, dest + first_row * dst_stride, dst_stride);
+		break;
+	}
+}
+
+void
+CaptureFrameConverter::Convert (CaptureFrameFormat format, guint8 *src, int srcStride, int width, int height, guint8 *dest, int dstStride)
+{
+	int band_rows;
+
+	this->format = format;
+	this->src = src;
+	this->src_stride = srcStride;
+	this->width = width;
+	this->dest = dest;
+	this->dst_stride = dstStride;
+	this->height = height;
+
+	if (width * height >= CAPTURE_CONVERTER_MIN_THREADED_PIXELS && thread_count == -1)
+		StartThreads ();
+
+	if (width * height < CAPTURE_CONVERTER_MIN_THREADED_PIXELS || thread_count <= 0) {
+		ConvertRows (0, height);
+		return;
+	}
+
+	// an even number of rows per band
+	band_rows = ((height + thread_count) / (thread_count + 1) + 1) & ~1;
+
+	for (int i = 0, row = 0; i <= thread_count; i++, row += band_rows) {
+		bands [i].first_row = MIN (row, height);
+		bands [i].rows = MIN (band_rows, height - bands [i].first_row);
+	}
+
+	mutex.Lock ();
+	pending = thread_count;
+	generation++;
+	work_cond.Broadcast ();
+	mutex.Unlock ();
+
+	ConvertRows (bands [0].first_row, bands [0].rows);
+
+	mutex.Lock ();
+	while (pending > 0)
+		done_cond.Wait (mutex);
+	mutex.Unlock ();
+}
+
+};
@@ -0,0 +1,84 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * capture-converter.h: conversion of captured video frames to BGRA
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#ifndef __MOON_CAPTURE_CONVERTER_H__
+#define __MOON_CAPTURE_CONVERTER_H__
+
+#include <glib.h>
+
+#include "pal.h"
+
+namespace Moonlight {
+
+enum CaptureFrameFormat {
+	CaptureFrameYUYV,
+	CaptureFrameUYVY,
+	CaptureFrameI420, /* Y, U, V planes */
+	CaptureFrameYV12, /* Y, V, U planes */
+};
+
+/*
+ * CaptureFrameConverter
+ *   Converts the frames of a capture device to BGRA with the YUVConverter
+ *   kernels. Big frames are split into bands of rows which are converted
+ *   in parallel by a few worker threads (started on first use) and the
+ *   calling thread, which waits for all of them to finish.
+ *
+ *   Convert may only be called from one thread at a time.
+ */
+
+class CaptureFrameConverter {
+public:
+	CaptureFrameConverter ();
+	~CaptureFrameConverter ();
+
+	/* srcStride is the stride of the Y plane for the planar formats, the chroma planes follow it */
+	void Convert (CaptureFrameFormat format, guint8 *src, int srcStride, int width, int height, guint8 *dest, int dstStride);
+
+	/* The size of a frame in the given format */
+	static guint32 GetFrameSize (CaptureFrameFormat format, int srcStride, int height);
+
+private:
+	struct Band {
+		CaptureFrameConverter *converter;
+		int first_row;
+		int rows;
+	};
+
+	MoonMutex mutex;
+	MoonCond work_cond;
+	MoonCond done_cond;
+
+	int thread_count;
+	MoonThread **threads;
+	Band *bands;
+	guint32 generation; /* bumped for every frame handed to the workers */
+	int pending; /* bands not finished yet */
+	bool shutting_down;
+
+	/* the frame being converted */
+	CaptureFrameFormat format;
+	guint8 *src;
+	int src_stride;
+	int width;
+	guint8 *dest;
+	int dst_stride;
+	int height;
+
+	void StartThreads ();
+	void ConvertRows (int first_row, int rows);
+
+	static gpointer WorkerLoop (gpointer data);
+};
+
+};
+#endif /* __MOON_CAPTURE_CONVERTER_H__ */
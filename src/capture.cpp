@@ -22,6 +22,9 @@
 #include "timesource.h"
 #include "consent.h"
 
+/* The video samples waiting for the main thread, older frames are dropped beyond this */
+#define CAPTURE_MAX_PENDING_VIDEO_SAMPLES 3
+
 namespace Moonlight {
 
 /*
@@ -257,6 +260,9 @@ CaptureDevice::CaptureDevice (Type::Kind object_type)
 	audio_buffer_size = 0;
 	audio_buffer_used = 0;
 	audio_position = 0;
+	pending_video_samples = 0;
+	free_video_samples = g_ptr_array_new ();
+	free_video_sample_size = 0;
 }
 
 void
@@ -272,6 +278,10 @@ CaptureDevice::~CaptureDevice ()
 {
 	g_free (audio_buffer);
 	audio_buffer = NULL;
+
+	for (guint i = 0; i < free_video_samples->len; i++)
+		g_free (free_video_samples->pdata [i]);
+	g_ptr_array_free (free_video_samples, true);
 }
 
 void
@@ -306,8 +316,11 @@ CaptureDevice::EmitEvent ()
 
 	events_mutex.Lock ();
 	data = (EventData *) events.First ();
-	if (data != NULL)
+	if (data != NULL) {
 		events.Unlink (data);
+		if (data->event == CaptureDevice::SampleReadyEvent && data->vformat != NULL)
+			pending_video_samples--;
+	}
 	events_mutex.Unlock ();
 
 	if (data == NULL)
@@ -350,6 +363,11 @@ CaptureDevice::EmitEvent ()
 			gint64 frameDuration = 10000000000ULL / data->vformat->framesPerSecond;
 			LOG_CAPTURE ("CaptureDevice::EmitEvent () emitting video SampleReadyEvent %ix%i, %p, %i)\n", data->vformat->width, data->vformat->height, data->sampleData, data->sampleDataLength);
 			Emit (CaptureDevice::SampleReadyEvent, new SampleReadyEventArgs (sampleTime, frameDuration, data->sampleData, data->sampleDataLength, data->aformat, data->vformat));
+
+			// nobody keeps the sample data once the event has been emitted
+			events_mutex.Lock ();
+			RecycleVideoSample (data);
+			events_mutex.Unlock ();
 		}
 	} else if (data->event == CaptureDevice::CaptureStartedEvent) {
 		LOG_CAPTURE ("%s::EmitEvent () CaptureStartedEvent\n", GetTypeName ());
@@ -415,18 +433,71 @@ CaptureDevice::EmitAudioSampleReady (AudioFormat *format, void *sampleData, int
 void
 CaptureDevice::EmitVideoSampleReady (VideoFormat *format, void *sampleData, int sampleDataLength)
 {
+	EventData *data;
+
 	LOG_CAPTURE ("CaptureDevice::EmitVideoSampleReady (%ix%i, %p, %i)\n", format->width, format->height, sampleData, sampleDataLength);
 	SetCurrentDeployment (false);
 	events_mutex.Lock ();
-	if (events.Length () < 50) {
-		events.Append (new EventData (CaptureDevice::SampleReadyEvent, new VideoFormat (*format), sampleData, sampleDataLength));
-	} else {
-		g_free (sampleData);
+	if (pending_video_samples >= CAPTURE_MAX_PENDING_VIDEO_SAMPLES) {
+		// the main thread isn't keeping up, drop the oldest frame instead of
+		// queuing up latency (and memory).
+		for (data = (EventData *) events.First (); data != NULL; data = (EventData *) data->next) {
+			if (data->event == CaptureDevice::SampleReadyEvent && data->vformat != NULL)
+				break;
+		}
+
+		if (data != NULL) {
+			LOG_CAPTURE ("CaptureDevice::EmitVideoSampleReady (): dropping a frame\n");
+			events.Unlink (data);
+			pending_video_samples--;
+			RecycleVideoSample (data);
+			delete data;
+		}
 	}
+	events.Append (new EventData (CaptureDevice::SampleReadyEvent, new VideoFormat (*format), sampleData, sampleDataLength));
+	pending_video_samples++;
 	events_mutex.Unlock ();
 	AddTickCall (EmitEventCallback);
 }
 
+void *
+CaptureDevice::GetVideoSampleBuffer (int size)
+{
+	void *buffer = NULL;
+
+	events_mutex.Lock ();
+	if (size == free_video_sample_size && free_video_samples->len > 0)
+		buffer = g_ptr_array_remove_index_fast (free_video_samples, free_video_samples->len - 1);
+	events_mutex.Unlock ();
+
+	if (buffer == NULL)
+		buffer = g_malloc (size);
+
+	return buffer;
+}
+
+void
+CaptureDevice::RecycleVideoSample (EventData *data)
+{
+	if (data->sampleData == NULL)
+		return;
+
+	if (data->sampleDataLength != free_video_sample_size) {
+		// the format changed, the old buffers are useless now
+		for (guint i = 0; i < free_video_samples->len; i++)
+			g_free (free_video_samples->pdata [i]);
+		g_ptr_array_set_size (free_video_samples, 0);
+		free_video_sample_size = data->sampleDataLength;
+	}
+
+	if (free_video_samples->len < CAPTURE_MAX_PENDING_VIDEO_SAMPLES + 1)
+		g_ptr_array_add (free_video_samples, data->sampleData);
+	else
+		g_free (data->sampleData);
+
+	data->sampleData = NULL;
+}
+
 void
 CaptureDevice::Start ()
 {
@@ -443,6 +514,7 @@ CaptureDevice::Stop ()
 	GetPalDevice ()->StopCapturing ();
 	events_mutex.Lock ();
 	events.Clear (true);
+	pending_video_samples = 0;
 	events_mutex.Unlock ();
 }
 
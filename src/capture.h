@@ -242,6 +242,8 @@ public:
 	// the callee is given ownership of the sampleData buffer for both audio and video
 	void EmitAudioSampleReady (AudioFormat *format, void *sampleData, int sampleDataLength); // thread-safe
 	void EmitVideoSampleReady (VideoFormat *format, void *sampleData, int sampleDataLength); // thread-safe
+	// returns a buffer for EmitVideoSampleReady, reusing the buffers of the samples which have been emitted
+	void *GetVideoSampleBuffer (int size); // thread-safe
 	void EmitCaptureStarted (); // thread-safe
 	void EmitVideoFormatChanged (VideoFormat *format); // thread-safe
 	void EmitAudioFormatChanged (AudioFormat *format); // thread-safe
@@ -262,6 +264,10 @@ private:
 	MoonCaptureDevice* pal_device; // main thread only
 	List events; // list of events to be emitted (on the main thread). thread-safe
 	MoonMutex events_mutex;
+	int pending_video_samples; // video samples in events. protected by events_mutex
+
+	GPtrArray *free_video_samples; // protected by events_mutex
+	int free_video_sample_size;
 
 	guint8 *audio_buffer;
 	guint32 audio_buffer_size;
@@ -299,6 +305,7 @@ private:
 
 	static void EmitEventCallback (EventObject *sender);
 	void EmitEvent ();
+	void RecycleVideoSample (EventData *data); // events_mutex must be locked
 };
 
 /* @Namespace=System.Windows.Media */
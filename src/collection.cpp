@@ -71,6 +71,10 @@ Collection::Init ()
 {
 	array = g_ptr_array_new ();
 	generation = 0;
+	use_index_table = false;
+	index_table = NULL;
+	index_table_valid = false;
+	index_scan_cost = 0;
 
 #if EVENT_ARG_REUSE
 	itemChangedEventArgs = NULL;
@@ -96,6 +100,9 @@ Collection::~Collection ()
 {
 	g_ptr_array_free (array, true);
 
+	if (index_table)
+		g_hash_table_destroy (index_table);
+
 #if EVENT_ARG_REUSE
 	if (itemChangedEventArgs)
 		itemChangedEventArgs->unref ();
@@ -115,6 +122,7 @@ Collection::Dispose ()
 		delete value;
 	}
 	g_ptr_array_set_size (array, 0);
+	InvalidateIndexTable ();
 	
 	DependencyObject::Dispose ();
 }
@@ -153,6 +161,7 @@ Collection::Clear ()
 	GPtrArray *old_array = array;
 
 	array = g_ptr_array_new ();
+	InvalidateIndexTable ();
 
 	guint len = old_array->len;
 	Value** vals = (Value**)old_array->pdata;
@@ -182,17 +191,123 @@ Collection::Contains (Value *value)
 int
 Collection::IndexOf (Value *value)
 {
+	gpointer index;
 	Value *v;
 	
+	if (index_table_valid) {
+		// every item is a native dependency object, nothing else can be equal to one
+		if (value->GetIsNull () || value->GetIsManaged () || !value->IsDependencyObject (GetDeployment ()))
+			return -1;
+		
+		if (!g_hash_table_lookup_extended (index_table, value->AsDependencyObject (), NULL, &index))
+			return -1;
+		
+		// the same object boxed as a different type isn't equal, check
+		v = (Value *) array->pdata[GPOINTER_TO_INT (index)];
+		if (*v == *value)
+			return GPOINTER_TO_INT (index);
+	}
+	
 	for (guint i = 0; i < array->len; i++) {
 		v = (Value *) array->pdata[i];
-		if (*v == *value)
+		if (*v == *value) {
+			AddIndexScanCost (i + 1);
 			return i;
+		}
 	}
 	
+	AddIndexScanCost (array->len);
+	
 	return -1;
 }
 
+#define COLLECTION_INDEX_TABLE_MIN_COUNT 32
+
+void
+Collection::AddIndexScanCost (guint cost)
+{
+	if (!use_index_table || index_table_valid)
+		return;
+	
+	index_scan_cost += cost;
+	
+	if (array->len >= COLLECTION_INDEX_TABLE_MIN_COUNT && index_scan_cost >= array->len)
+		BuildIndexTable ();
+}
+
+void
+Collection::BuildIndexTable ()
+{
+	DependencyObject *obj;
+	
+	if (index_table)
+		g_hash_table_remove_all (index_table);
+	else
+		index_table = g_hash_table_new (g_direct_hash, g_direct_equal);
+	
+	for (guint i = 0; i < array->len; i++) {
+		obj = ((Value *) array->pdata[i])->AsDependencyObject ();
+		
+		// IndexOf returns the first one
+		if (!g_hash_table_lookup_extended (index_table, obj, NULL, NULL))
+			g_hash_table_insert (index_table, obj, GINT_TO_POINTER (i));
+	}
+	
+	index_table_valid = true;
+	index_scan_cost = 0;
+}
+
+void
+Collection::InvalidateIndexTable ()
+{
+	if (!index_table_valid)
+		return;
+	
+	// rebuilt when IndexOf has scanned enough again
+	index_table_valid = false;
+	index_scan_cost = 0;
+	g_hash_table_remove_all (index_table);
+}
+
+void
+Collection::IndexTableInserted (Value *value, int index)
+{
+	DependencyObject *obj;
+	
+	if (!index_table_valid)
+		return;
+	
+	// inserting anywhere else moves the items after it
+	if (index != (int) array->len - 1) {
+		InvalidateIndexTable ();
+		return;
+	}
+	
+	obj = value->AsDependencyObject ();
+	if (!g_hash_table_lookup_extended (index_table, obj, NULL, NULL))
+		g_hash_table_insert (index_table, obj, GINT_TO_POINTER (index));
+}
+
+void
+Collection::IndexTableRemoved (Value *value, int index)
+{
+	DependencyObject *obj;
+	gpointer first;
+	
+	if (!index_table_valid)
+		return;
+	
+	// removing anywhere else moves the items after it
+	if (index != (int) array->len) {
+		InvalidateIndexTable ();
+		return;
+	}
+	
+	obj = value->AsDependencyObject ();
+	if (g_hash_table_lookup_extended (index_table, obj, NULL, &first) && GPOINTER_TO_INT (first) == index)
+		g_hash_table_remove (index_table, obj);
+}
+
 int
 Collection::IndexOf (Value value)
 {
@@ -226,6 +341,7 @@ Collection::InsertWithError (int index, Value *value, MoonError *error)
 
 	if (AddedToCollection (added, error)) {
 		g_ptr_array_insert (array, index, added);
+		IndexTableInserted (added, index);
 	
 		SetCount ((int) array->len);
 
@@ -284,6 +400,7 @@ Collection::RemoveAt (int index)
 	value = (Value *) array->pdata[index];
 	
 	g_ptr_array_remove_index (array, index);
+	IndexTableRemoved (value, index);
 	SetCount ((int) array->len);
 	generation++;
 	
@@ -358,6 +475,7 @@ Collection::SetValueAtWithError (int index, Value *value, MoonError *error)
 	
 	if (AddedToCollection (added, error)) {
 		array->pdata[index] = added;
+		InvalidateIndexTable ();
 	
 		RemovedFromCollection (removed, true);
 	
@@ -452,6 +570,7 @@ DependencyObjectCollection::DependencyObjectCollection ()
 {
 	is_secondary_parent = false;
 	sets_parent = true;
+	use_index_table = true;
 }
 
 DependencyObjectCollection::DependencyObjectCollection (bool sets_parent)
@@ -459,6 +578,7 @@ DependencyObjectCollection::DependencyObjectCollection (bool sets_parent)
 {
 	is_secondary_parent = false;
 	this->sets_parent = sets_parent;
+	use_index_table = true;
 }
 
 DependencyObjectCollection::DependencyObjectCollection (Type::Kind object_type)
@@ -466,6 +586,7 @@ DependencyObjectCollection::DependencyObjectCollection (Type::Kind object_type)
 {
 	is_secondary_parent = false;
 	sets_parent = true;
+	use_index_table = true;
 }
 
 DependencyObjectCollection::DependencyObjectCollection (Type::Kind object_type, bool sets_parent)
@@ -473,6 +594,7 @@ DependencyObjectCollection::DependencyObjectCollection (Type::Kind object_type,
 {
 	is_secondary_parent = false;
 	this->sets_parent = sets_parent;
+	use_index_table = true;
 }
 
 DependencyObjectCollection::~DependencyObjectCollection ()
@@ -695,17 +817,40 @@ UIElementCollection::UIElementCollection ()
 	: DependencyObjectCollection (Type::UIELEMENT_COLLECTION)
 {
 	z_sorted = g_ptr_array_new ();
+	z_changed = g_ptr_array_new ();
+	z_sorted_valid = false;
 }
 
 UIElementCollection::UIElementCollection (bool sets_parent)
 	: DependencyObjectCollection (Type::UIELEMENT_COLLECTION, sets_parent)
 {
 	z_sorted = g_ptr_array_new ();
+	z_changed = g_ptr_array_new ();
+	z_sorted_valid = false;
 }
 
 UIElementCollection::~UIElementCollection ()
 {
 	g_ptr_array_free (z_sorted, true);
+	g_ptr_array_free (z_changed, true);
+}
+
+bool
+UIElementCollection::AddedToCollection (Value *value, MoonError *error)
+{
+	z_sorted_valid = false;
+	g_ptr_array_set_size (z_changed, 0);
+	
+	return DependencyObjectCollection::AddedToCollection (value, error);
+}
+
+void
+UIElementCollection::RemovedFromCollection (Value *value, bool is_value_safe)
+{
+	z_sorted_valid = false;
+	g_ptr_array_set_size (z_changed, 0);
+	
+	DependencyObjectCollection::RemovedFromCollection (value, is_value_safe);
 }
 
 static int
@@ -727,10 +872,82 @@ UIElementZIndexComparer (gconstpointer ui1, gconstpointer ui2)
 	return zi1 - zi2;
 }
 
+// the order MergeSort leaves elements in: by ZIndex and Z, and by
+// position in the collection when those are the same
+int
+UIElementCollection::CompareZOrder (UIElement *element1, UIElement *element2)
+{
+	int result = UIElementZIndexComparer (&element1, &element2);
+	
+	if (result != 0)
+		return result;
+	
+	Value value1 (element1);
+	Value value2 (element2);
+	
+	return IndexOf (&value1) - IndexOf (&value2);
+}
+
+#define UIELEMENT_COLLECTION_MAX_Z_CHANGES 32
+
+void
+UIElementCollection::ZIndexChanged (UIElement *element)
+{
+	if (!z_sorted_valid)
+		return;
+	
+	for (guint i = 0; i < z_changed->len; i++) {
+		if (z_changed->pdata[i] == element)
+			return;
+	}
+	
+	// past a point sorting everything is cheaper than moving
+	// the elements one at a time
+	if (z_changed->len >= UIELEMENT_COLLECTION_MAX_Z_CHANGES) {
+		z_sorted_valid = false;
+		g_ptr_array_set_size (z_changed, 0);
+		return;
+	}
+	
+	g_ptr_array_add (z_changed, element);
+}
+
 void
 UIElementCollection::ResortByZIndex ()
 {
+	if (z_sorted_valid && z_sorted->len == array->len) {
+		UIElement *element;
+		guint low, high, mid;
+		
+		// take all the changed elements out first, what's
+		// left is still sorted and each one can be put back
+		// in its place with a binary search
+		for (guint i = 0; i < z_changed->len; i++)
+			g_ptr_array_remove (z_sorted, z_changed->pdata[i]);
+		
+		for (guint i = 0; i < z_changed->len; i++) {
+			element = (UIElement *) z_changed->pdata[i];
+			low = 0;
+			high = z_sorted->len;
+			
+			while (low < high) {
+				mid = (low + high) / 2;
+				if (CompareZOrder ((UIElement *) z_sorted->pdata[mid], element) <= 0)
+					low = mid + 1;
+				else
+					high = mid;
+			}
+			
+			g_ptr_array_insert (z_sorted, low, element);
+		}
+		
+		g_ptr_array_set_size (z_changed, 0);
+		return;
+	}
+	
+	g_ptr_array_set_size (z_changed, 0);
 	g_ptr_array_set_size (z_sorted, array->len);
+	z_sorted_valid = true;
 	
 	if (array->len == 0)
 		return;
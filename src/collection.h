@@ -90,6 +90,16 @@ public:
 protected:
 	GPtrArray *array;
 	int generation;
+
+	// Collections which only hold (native) dependency objects can
+	// look items up in a DependencyObject -> index table instead of
+	// comparing every Value. The table is built once linear scans
+	// would have cost as much as building it, and stays valid while
+	// items are only added or removed at the end.
+	bool use_index_table;
+	GHashTable *index_table;
+	bool index_table_valid;
+	guint index_scan_cost;
 	
 #if EVENT_ARG_REUSE
 	CollectionItemChangedEventArgs *itemChangedEventArgs;
@@ -117,6 +127,12 @@ protected:
 	
 private:
 	void Init ();
+
+	void AddIndexScanCost (guint cost);
+	void BuildIndexTable ();
+	void InvalidateIndexTable ();
+	void IndexTableInserted (Value *value, int index);
+	void IndexTableRemoved (Value *value, int index);
 };
 
 /* @Namespace=System.Windows */
@@ -339,7 +355,20 @@ class UIElementCollection : public DependencyObjectCollection {
 	
 	virtual bool Clear ();
 	
+	// the ZIndex or Z of @element changed, ResortByZIndex only
+	// moves the changed elements when nothing else happened
+	void ZIndexChanged (UIElement *element);
 	void ResortByZIndex ();
+
+ protected:
+	virtual bool AddedToCollection (Value *value, MoonError *error);
+	virtual void RemovedFromCollection (Value *value, bool is_value_safe);
+
+ private:
+	GPtrArray *z_changed; /* UIElement, not reffed, only while z_sorted_valid */
+	bool z_sorted_valid;
+
+	int CompareZOrder (UIElement *element1, UIElement *element2);
 };
 
 /* @Namespace=System.Windows.Controls */
@@ -12,6 +12,7 @@
 
 #define __MOON_GALLIUM__
 
+#include "runtime.h"
 #include "projection.h"
 #include "effect.h"
 #include "context-gallium.h"
@@ -27,9 +28,54 @@
 #include "pipe/p_screen.h"
 #include "tgsi/tgsi_ureg.h"
 #include "tgsi/tgsi_dump.h"
+#include "util/u_debug.h"
+extern "C" {
+#define template templat
+#include "state_tracker/sw_winsys.h"
+#include "softpipe/sp_public.h"
+#ifdef USE_LLVM
+#include "llvmpipe/lp_public.h"
+#endif
+#undef template
+};
 
 namespace Moonlight {
 
+pipe_screen *
+GalliumContext::CreateSoftwareScreen (sw_winsys *ws)
+{
+	const char  *default_driver;
+	const char  *driver;
+	pipe_screen *screen = NULL;
+
+	// llvmpipe runs the same state tracker through jit'ed, threaded
+	// rasterizers, softpipe is only there for reference and for
+	// builds without llvm
+#ifdef USE_LLVM
+	if (moonlight_flags & RUNTIME_INIT_GALLIUM_SOFTPIPE)
+		default_driver = "softpipe";
+	else
+		default_driver = "llvmpipe";
+#else
+	default_driver = "softpipe";
+#endif
+
+	driver = debug_get_option ("GALLIUM_DRIVER", default_driver);
+
+#ifdef USE_LLVM
+	if (strcmp (driver, "llvmpipe") == 0)
+		screen = llvmpipe_create_screen (ws);
+#else
+	if (strcmp (driver, "llvmpipe") == 0)
+		g_warning ("Moonlight: built without llvm, using softpipe instead of llvmpipe");
+#endif
+
+	if (screen == NULL)
+		screen = softpipe_create_screen (ws);
+
+	return screen;
+}
+
 GalliumContext::Target::Target (MoonSurface  *moon,
 				Rect         extents,
 				GalliumPipe  *pipe) :
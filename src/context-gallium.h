@@ -22,6 +22,8 @@
 #include "cso_cache/cso_context.h"
 #include "cso_cache/cso_hash.h"
 
+struct sw_winsys;
+
 namespace Moonlight {
 
 class GalliumContext : public Context {
@@ -42,6 +44,11 @@ public:
 	GalliumContext (GalliumSurface *surface);
 	virtual ~GalliumContext ();
 
+	// The software screen the windowing systems and WriteableBitmap
+	// render with: llvmpipe when built with llvm, softpipe with
+	// gallium=softpipe. GALLIUM_DRIVER wins over both.
+	static pipe_screen *CreateSoftwareScreen (sw_winsys *ws);
+
 	void Push (Group extents);
 	void Push (Group extents, MoonSurface *surface);
 
@@ -651,6 +651,8 @@ Context::Cache::Release ()
 	GList *contexts = this->contexts;
 	this->contexts = NULL;
 
+	Remove ();
+
 	for (GList *l = g_list_first (contexts); l; l = l->next)
 		static_cast<Context *> (l->data)->Remove (this)->unref ();
 
@@ -694,6 +696,8 @@ Context::~Context ()
 		MoonSurface *surface = static_cast<MoonSurface *> (v);
 		
 		key->contexts = g_list_remove (key->contexts, this);
+		if (!key->contexts)
+			key->Unused ();
 		surface->unref ();
 	}
 	g_hash_table_destroy (cache);
@@ -722,6 +726,8 @@ Context::Remove (Cache *key)
 	if (surface) {
 		g_hash_table_remove (cache, key);
 		key->contexts = g_list_remove (key->contexts, this);
+		if (!key->contexts)
+			key->Unused ();
 	}
 
 	return surface;
@@ -730,7 +736,12 @@ Context::Remove (Cache *key)
 MoonSurface *
 Context::Lookup (Cache *key)
 {
-	return static_cast<MoonSurface *> (g_hash_table_lookup (cache, key));
+	MoonSurface *surface = static_cast<MoonSurface *> (g_hash_table_lookup (cache, key));
+
+	if (surface)
+		key->Touch ();
+
+	return surface;
 }
 
 void
@@ -18,6 +18,7 @@
 #include "color.h"
 #include "brush.h"
 #include "surface.h"
+#include "render-cache.h"
 
 namespace Moonlight {
 
@@ -107,13 +108,20 @@ public:
 		cairo_t        *context;
 	};
 
-	class Cache {
+	/* The owner reports the size of the cached surfaces with Add after
+	 * Replace, the surfaces are released if the render cache evicts them */
+	class Cache : public RenderCache::Entry {
 	public:
-		Cache () : contexts (NULL) {}
-		~Cache () { Release (); }
+		Cache (RenderCacheCategory category, int cost) : RenderCache::Entry (category, cost), contexts (NULL) {}
+		virtual ~Cache () { Release (); }
 
 		void Release ();
 
+	protected:
+		virtual void Evict () { Release (); }
+		/* the last context holding a surface for this key dropped it */
+		virtual void Unused () { Remove (); }
+
 	private:
 		GList *contexts;
 
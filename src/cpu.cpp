@@ -18,6 +18,7 @@
 bool CPU::have_sse2 = false;
 bool CPU::have_mmx = false;
 bool CPU::fetched = false;
+bool CPU::simd_disabled = false;
 
 void
 CPU::Fetch ()
@@ -19,12 +19,17 @@ private:
 	static bool have_sse2;
 	static bool have_mmx;
 	static bool fetched;
+	static bool simd_disabled;
 
 	static void Fetch ();
 
 public:
-	static bool HaveMMX () { if (!fetched) Fetch (); return have_mmx; }
-	static bool HaveSSE2 () { if (!fetched) Fetch (); return have_sse2; }
+	static bool HaveMMX () { if (!fetched) Fetch (); return have_mmx && !simd_disabled; }
+	static bool HaveSSE2 () { if (!fetched) Fetch (); return have_sse2 && !simd_disabled; }
+
+	/* Pretends the cpu has neither MMX nor SSE2 while disabled, so that
+	 * the scalar code paths can be compared with the SIMD ones */
+	static void SetSIMDEnabled (bool enabled) { simd_disabled = !enabled; }
 };
 
 #endif /* __MOONLIGHT_CPU_H__ */
@@ -0,0 +1,154 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * damage.cpp: collects the areas of a surface which need to be redrawn
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#include <config.h>
+
+#include "damage.h"
+
+namespace Moonlight {
+
+DamageAccumulator::DamageAccumulator ()
+{
+	count = 0;
+	raw_count = 0;
+	keep_raw = false;
+	raw = NULL;
+}
+
+DamageAccumulator::~DamageAccumulator ()
+{
+	delete raw;
+}
+
+void
+DamageAccumulator::Clear ()
+{
+	count = 0;
+	raw_count = 0;
+	delete raw;
+	raw = NULL;
+}
+
+Region *
+DamageAccumulator::TakeRaw ()
+{
+	Region *result = raw;
+
+	raw = NULL;
+
+	return result;
+}
+
+// the pixels the union of two rectangles covers which neither of them does
+double
+DamageAccumulator::Waste (const Rect &a, const Rect &b)
+{
+	return a.Union (b).Area () - (a.Area () + b.Area () - a.Intersection (b).Area ());
+}
+
+void
+DamageAccumulator::RemoveAt (int index)
+{
+	rects [index] = rects [--count];
+}
+
+void
+DamageAccumulator::MergeInto (int index, Rect r)
+{
+	bool merged;
+
+	rects [index] = rects [index].Union (r);
+
+	// the grown rectangle may be worth merging with others now
+	do {
+		merged = false;
+
+		for (int i = 0; i < count; i++) {
+			if (i == index || Waste (rects [index], rects [i]) > DAMAGE_RECTANGLE_COST)
+				continue;
+
+			rects [index] = rects [index].Union (rects [i]);
+			RemoveAt (i);
+			if (index == count)
+				index = i;
+
+			merged = true;
+			break;
+		}
+	} while (merged);
+}
+
+void
+DamageAccumulator::MergeCheapestPair ()
+{
+	double best_waste = 0.0;
+	int best_a = -1;
+	int best_b = -1;
+
+	for (int a = 0; a < count; a++) {
+		for (int b = a + 1; b < count; b++) {
+			double waste = Waste (rects [a], rects [b]);
+
+			if (best_a == -1 || waste < best_waste) {
+				best_waste = waste;
+				best_a = a;
+				best_b = b;
+			}
+		}
+	}
+
+	if (best_a == -1)
+		return;
+
+	Rect r = rects [best_b];
+	RemoveAt (best_b);
+	MergeInto (best_a, r);
+}
+
+void
+DamageAccumulator::Add (Rect r)
+{
+	double best_waste = 0.0;
+	int best = -1;
+
+	r = r.RoundOut ();
+	if (r.IsEmpty ())
+		return;
+
+	raw_count++;
+	if (keep_raw) {
+		if (!raw)
+			raw = new Region ();
+		raw->Union (r);
+	}
+
+	for (int i = 0; i < count; i++) {
+		double waste = Waste (rects [i], r);
+
+		if (best == -1 || waste < best_waste) {
+			best_waste = waste;
+			best = i;
+		}
+	}
+
+	if (best != -1 && best_waste <= DAMAGE_RECTANGLE_COST) {
+		MergeInto (best, r);
+		return;
+	}
+
+	rects [count++] = r;
+
+	if (count > DAMAGE_MAX_RECTANGLES)
+		MergeCheapestPair ();
+}
+
+};
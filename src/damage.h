@@ -0,0 +1,74 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * damage.h: collects the areas of a surface which need to be redrawn
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#ifndef __MOON_DAMAGE_H__
+#define __MOON_DAMAGE_H__
+
+#include <glib.h>
+
+#include "rect.h"
+#include "region.h"
+
+namespace Moonlight {
+
+/* never hand more rectangles than this to the window */
+#define DAMAGE_MAX_RECTANGLES 16
+/* how many pixels of overdraw an extra rectangle is worth, it costs
+ * a clip, a pass over the render tree and a round trip to the window */
+#define DAMAGE_RECTANGLE_COST (64 * 64)
+
+/*
+ * DamageAccumulator
+ *   Batches the invalidations of a frame. Every rectangle is merged
+ *   into the one it overlaps or sits next to if the pixels the union
+ *   adds cost less than keeping the rectangles apart, and if there are
+ *   too many rectangles the two which waste the fewest pixels when
+ *   merged are merged, so a few hundred small invalidations (particles,
+ *   a scrolling list of items) come out as a handful of rectangles.
+ */
+
+class DamageAccumulator {
+public:
+	DamageAccumulator ();
+	~DamageAccumulator ();
+
+	void Add (Rect r);
+	void Clear ();
+
+	bool IsEmpty () { return count == 0; }
+	int GetRectangleCount () { return count; }
+	Rect GetRectangle (int index) { return rects [index]; }
+
+	/* how many rectangles were added since the last Clear */
+	int GetRawCount () { return raw_count; }
+
+	/* keep a copy of the rectangles as they were added, for debugging */
+	void SetKeepRaw (bool keep_raw) { this->keep_raw = keep_raw; }
+	/* the rectangles added since the last Clear, NULL unless SetKeepRaw was set.
+	 * The caller owns the region */
+	Region *TakeRaw ();
+
+private:
+	Rect rects [DAMAGE_MAX_RECTANGLES + 1];
+	int count;
+	int raw_count;
+	bool keep_raw;
+	Region *raw;
+
+	static double Waste (const Rect &a, const Rect &b);
+	void MergeInto (int index, Rect r);
+	void MergeCheapestPair ();
+	void RemoveAt (int index);
+};
+
+};
+#endif /* __MOON_DAMAGE_H__ */
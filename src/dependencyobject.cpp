@@ -1817,14 +1817,17 @@ DependencyObject::SetValueWithErrorImpl (DependencyProperty *property, const Val
 		Deployment *deployment = GetDeployment ();
 
 		Value *new_value;
+		Value *auto_value = NULL;
 
-		if (current_value)
-			current_value = new Value(*current_value);
-		
-		// remove the old value
-		providers.localvalue->ClearValue (property);
+		// remove the old value, keeping the one we read instead of copying it
+		current_value = providers.localvalue->TakeValue (property);
 		if (property->IsAutoCreated ())
-			providers.autocreate->ClearValue (property);
+			auto_value = providers.autocreate->TakeValue (property);
+
+		if (!current_value)
+			current_value = auto_value;
+		else
+			delete auto_value;
 		
 		if (value && (!property->IsAutoCreated () || !value->IsDependencyObject (deployment) || value->AsDependencyObject () != NULL))
 			new_value = new Value (*value);
@@ -1876,6 +1879,27 @@ DependencyObject::SetValueWithError (DependencyProperty *property, const Value *
 	return ret;
 }
 
+bool
+DependencyObject::SetAnimatedValue (DependencyProperty *property, const Value *value)
+{
+	MoonError err;
+
+	if (value == NULL || value->GetIsNull () || value->GetKind () != property->GetPropertyType () || property->HasCoercer ())
+		return SetValueWithError (property, value, &err);
+
+	// IsValueValid can't fail for a non-null value of the property's own type
+	if (!property->Validate (this, const_cast<Value*>(value), &err))
+		return false;
+
+	return SetValueWithErrorImpl (property, value, &err);
+}
+
+bool
+DependencyObject::SetAnimatedValue (DependencyProperty *property, const Value &value)
+{
+	return SetAnimatedValue (property, &value);
+}
+
 // sets the inherited property source on this object to @source.
 // returns true if this->GetValue(inheritedProperty) is equal to the inherited value (i.e. false if the value is of a higher precedence)
 bool
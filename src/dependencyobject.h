@@ -357,6 +357,12 @@ public:
 	bool SetValueWithError (DependencyProperty *property, const Value *value, MoonError *error);
 	bool SetValueWithError (DependencyProperty *property, const Value &value, MoonError *error);
 
+	// used by the Applier for animation precedence writes: skips the
+	// type check when the value has exactly the property's type, the
+	// coercers and validators still run
+	bool SetAnimatedValue (DependencyProperty *property, const Value *value);
+	bool SetAnimatedValue (DependencyProperty *property, const Value &value);
+
 	bool PropagateInheritedValue (InheritedPropertyValueProvider::Inheritable inheritableProperty,
 				      DependencyObject *source, Value *new_value);
 
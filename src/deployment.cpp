@@ -42,6 +42,7 @@ G_END_DECLS
 #include "network-curl.h"
 #endif
 #include "uri.h"
+#include "xaml-precompiler.h"
 
 #include "pal.h"
 #include <mono/io-layer/atomic.h>
@@ -510,6 +511,7 @@ Deployment::Deployment()
 #endif
 
 	font_manager = NULL;
+	xaml_precompiler = NULL;
 	interned_strings = NULL;
 	types = NULL;
 }
@@ -1094,6 +1096,7 @@ add_keys_to_array (gpointer key, gpointer value, gpointer user_data)
 Deployment::~Deployment()
 {
 	delete font_manager;
+	delete xaml_precompiler;
 	
 	LOG_DEPLOYMENT ("Deployment::~Deployment (): %p\n", this);
 
@@ -1742,6 +1745,15 @@ Deployment::GetFontManager ()
 	return font_manager;
 }
 
+void
+Deployment::PrecompileXaml (const char *name, const void *data, gint32 length)
+{
+	if (xaml_precompiler == NULL)
+		xaml_precompiler = new XamlPrecompiler ();
+
+	xaml_precompiler->Queue (name, data, length);
+}
+
 GlyphTypefaceCollection *
 Deployment::GetSystemTypefaces ()
 {
@@ -62,6 +62,8 @@ typedef _MonoProfiler MonoProfiler;
 
 namespace Moonlight {
 
+class XamlPrecompiler;
+
 /* @CBindingRequisite */
 typedef void (*EnsureManagedPeerCallback)(EventObject *forObj, Type::Kind kind);
 
@@ -386,6 +388,14 @@ public:
 	void SetKeepAlive (EventObject *object, bool value);
 
 	FontManager *GetFontManager ();
+
+	/* The documents queued with PrecompileXaml, NULL if there are none */
+	XamlPrecompiler *GetXamlPrecompiler () { return xaml_precompiler; }
+
+	/* Compiles @data (a xaml document the application is going to load) to
+	 * binary xaml on a worker thread, see xaml-precompiler.h */
+	/* @GeneratePInvoke */
+	void PrecompileXaml (const char *name, /* @MarshalAs=byte[] */ const void *data, gint32 length);
 	
 	bool VerifyDownload (const char *filename);
 
@@ -544,6 +554,7 @@ private:
 	Surface *surface;
 	MoonMutex surface_mutex;
 	FontManager *font_manager;
+	XamlPrecompiler *xaml_precompiler;
 	WeakRef<Application> current_app;
 	MonoDomain *domain;
 	List http_requests;
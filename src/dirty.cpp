@@ -16,6 +16,7 @@
 
 #include "canvas.h"
 #include "timemanager.h"
+#include "timesource.h"
 #include "uielement.h"
 #include "panel.h"
 #include "control.h"
@@ -25,6 +26,7 @@
 #include "list.h"
 #include "window.h"
 #include "deployment.h"
+#include "frame-profiler.h"
 
 namespace Moonlight {
 
@@ -380,6 +382,10 @@ Surface::ProcessUpDirtyElements ()
 
 			el->dirty_flags &= ~DirtyInvalidate;
 
+			// something in the subtree changed, the change
+			// propagates up to all the ancestors from here
+			el->InvalidateDisplayList ();
+
 			Region *dirty = el->dirty_region;
 
 			if (el->GetVisualParent ()) {
@@ -409,6 +415,23 @@ Surface::ProcessUpDirtyElements ()
 		g_warning ("after up dirty pass, up dirty list is not empty");
 }
 
+// MOONLIGHT_LAYOUT_BUDGET=<ms> spreads big layout jobs over several
+// frames: a layout pass stops after that long and the next frame
+// continues where it left off. Off by default, since the frames in
+// between show a partially updated layout.
+static TimeSpan
+get_layout_budget ()
+{
+	static TimeSpan budget = -1;
+
+	if (budget == -1) {
+		const char *env = g_getenv ("MOONLIGHT_LAYOUT_BUDGET");
+		budget = env ? (TimeSpan) MAX (atoi (env), 1) * 10000 : 0;
+	}
+
+	return budget;
+}
+
 bool
 Surface::UpdateLayout (MoonError *error)
 {
@@ -416,12 +439,16 @@ Surface::UpdateLayout (MoonError *error)
 		return false;
 	// Caching layers->GetCount causes a crash in #869 since the # of layers can change while measuring.
 	LayoutPass *pass = new LayoutPass ();
+	TimeSpan start = get_now ();
+	TimeSpan budget = get_layout_budget ();
 	bool dirty = true;
 	pass->updated = true;
-	while (pass->count < LayoutPass::MaxCount && pass->updated) {
+	if (budget)
+		pass->deadline = start + budget;
+	while (pass->count < LayoutPass::MaxCount && pass->updated && !pass->interrupted) {
 		pass->updated = false;
 
-		for (int i = 0; i < layers->GetCount (); i++) {
+		for (int i = 0; i < layers->GetCount () && !pass->interrupted; i++) {
 			UIElement *layer = layers->GetValueAt (i)->AsUIElement ();
 			if (!layer->HasFlag (UIElement::DIRTY_MEASURE_HINT) && !layer->HasFlag (UIElement::DIRTY_ARRANGE_HINT))
 				continue;
@@ -436,12 +463,16 @@ Surface::UpdateLayout (MoonError *error)
 			}
 			
 			// FIXME: Propgate this somewhere?
+			PROFILE_PHASE_START (FrameProfilerLayout);
 			layer->UpdateLayer (pass, error);
+			PROFILE_PHASE_END (FrameProfilerLayout);
 		}
 		
 		dirty |= down_dirty->IsEmpty() || !up_dirty->IsEmpty();
+		PROFILE_PHASE_START (FrameProfilerDirty);
 		ProcessDownDirtyElements ();
 		ProcessUpDirtyElements ();
+		PROFILE_PHASE_END (FrameProfilerDirty);
 		
 		if (pass->updated && dirty) {
 			GetDeployment ()->LayoutUpdated ();		
@@ -454,6 +485,15 @@ Surface::UpdateLayout (MoonError *error)
 		g_warning ("\n************** UpdateLayout Bailing Out after %d Passes *******************\n", pass->count);
 	}
 
+	// the rest of the work is still flagged, do it next frame
+	if (pass->interrupted)
+		time_manager->NeedRedraw ();
+
+	if (pass->count > 0)
+		LOG_LAYOUT ("Surface::UpdateLayout (): %d passes, %d elements visited, %d measured, %d arranged, %d size changes in %.2f ms%s\n",
+			    pass->count, pass->visited, pass->measured, pass->arranged, pass->size_changed,
+			    (get_now () - start) / 10000.0, pass->interrupted ? " (out of time)" : "");
+
 	delete pass;
 	return dirty;
 }
@@ -0,0 +1,295 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * display-list.cpp: retained rendering of static subtrees
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#include <config.h>
+
+#include <math.h>
+#include <string.h>
+
+#include "display-list.h"
+#include "context.h"
+#include "surface-cairo.h"
+
+namespace Moonlight {
+
+#if CAIRO_VERSION >= CAIRO_VERSION_ENCODE(1, 10, 0)
+#define HAVE_RECORDING_SURFACE 1
+#endif
+
+/*
+ * DisplayListSurface
+ *   The target of the recording context.
+ */
+
+class DisplayListSurface : public MoonSurface {
+public:
+	DisplayListSurface (cairo_surface_t *surface)
+	{
+		this->surface = cairo_surface_reference (surface);
+	}
+
+	virtual ~DisplayListSurface ()
+	{
+		cairo_surface_destroy (surface);
+	}
+
+	cairo_surface_t *Cairo ()
+	{
+		return cairo_surface_reference (surface);
+	}
+
+private:
+	cairo_surface_t *surface;
+};
+
+/*
+ * DisplayListContext
+ *   Renders into a recording surface. Groups (opacity, non-rectangular
+ *   clips, bitmaps) are rendered into image surfaces, like the cairo
+ *   context does, and then recorded as images. The operations which
+ *   the hardware accelerated contexts implement differently from the
+ *   cairo context can't be recorded, and fail the recording.
+ */
+
+class DisplayListContext : public Context {
+public:
+	DisplayListContext (DisplayListSurface *surface, cairo_surface_t *recording, cairo_matrix_t *matrix) : Context (surface)
+	{
+		this->recording = cairo_surface_reference (recording);
+		this->matrix = *matrix;
+		failed = false;
+
+		Context::Push (AbsoluteTransform (*matrix));
+	}
+
+	virtual ~DisplayListContext ()
+	{
+		cairo_surface_destroy (recording);
+	}
+
+	void Push (Group extents)
+	{
+		Rect           r = extents.r.RoundOut ();
+		MoonSurface    *surface = new CairoSurface (r.width, r.height);
+		Target         *target = new Target (surface, extents.r);
+		cairo_matrix_t matrix;
+
+		Top ()->GetMatrix (&matrix);
+
+		Stack::Push (new Context::Node (target, &matrix, &extents.r));
+
+		target->unref ();
+		surface->unref ();
+	}
+
+	void Blit (unsigned char *data,
+		   int           stride)
+	{
+		cairo_surface_t *dst = cairo_get_target (Top ()->Cairo ());
+
+		if (cairo_surface_get_type (dst) != CAIRO_SURFACE_TYPE_IMAGE) {
+			/* only groups can be blitted into */
+			Fail ();
+			return;
+		}
+
+		for (int i = 0; i < cairo_image_surface_get_height (dst); i++)
+			memcpy (cairo_image_surface_get_data (dst) +
+				cairo_image_surface_get_stride (dst) * i,
+				data + stride * i,
+				MIN (cairo_image_surface_get_stride (dst), stride));
+
+		cairo_surface_mark_dirty (dst);
+	}
+
+	void BlitVUY2 (unsigned char *data) { Fail (); }
+
+	void Project (MoonSurface  *src,
+		      const double *matrix,
+		      double       alpha,
+		      double       x,
+		      double       y) { Fail (); }
+
+	void Blur (MoonSurface *src,
+		   double      radius,
+		   double      x,
+		   double      y) { Fail (); }
+
+	void DropShadow (MoonSurface *src,
+			 double      dx,
+			 double      dy,
+			 double      radius,
+			 Color       *color,
+			 double      x,
+			 double      y) { Fail (); }
+
+	void ShaderEffect (MoonSurface *src,
+			   PixelShader *shader,
+			   Brush       **sampler,
+			   int         *sampler_mode,
+			   int         n_sampler,
+			   Color       *constant,
+			   int         n_constant,
+			   int         *ddxUvDdyUvPtr,
+			   double      x,
+			   double      y) { Fail (); }
+
+	void Flush () { }
+
+	cairo_surface_t *recording;
+	cairo_matrix_t matrix;
+	bool failed;
+
+private:
+	void Fail ()
+	{
+		failed = true;
+	}
+};
+
+/*
+ * DisplayList
+ */
+
+int DisplayList::recording = 0;
+
+DisplayList::DisplayList (cairo_surface_t *surface, cairo_matrix_t *matrix)
+{
+	this->surface = cairo_surface_reference (surface);
+	this->matrix = *matrix;
+
+#if HAVE_RECORDING_SURFACE
+	double x, y, width, height;
+
+	cairo_recording_surface_ink_extents (surface, &x, &y, &width, &height);
+	extents = Rect (x, y, width, height);
+#endif
+}
+
+DisplayList::~DisplayList ()
+{
+	cairo_surface_destroy (surface);
+}
+
+bool
+DisplayList::IsEnabled ()
+{
+#if HAVE_RECORDING_SURFACE
+	static int enabled = -1;
+
+	if (enabled == -1) {
+		const char *env = g_getenv ("MOONLIGHT_DISPLAY_LISTS");
+
+		enabled = !(env && (!strcmp (env, "no") || !strcmp (env, "0")));
+	}
+
+	return enabled;
+#else
+	return false;
+#endif
+}
+
+Context *
+DisplayList::BeginRecording (cairo_matrix_t *matrix, Rect extents)
+{
+#if HAVE_RECORDING_SURFACE
+	cairo_rectangle_t  r = { extents.x, extents.y, extents.width, extents.height };
+	cairo_surface_t    *target;
+	DisplayListSurface *surface;
+	DisplayListContext *ctx;
+
+	/* A bounded recording surface lets cairo keep the replayed image around
+	 * as a snapshot, which makes replaying the whole list a single blit */
+	target = cairo_recording_surface_create (CAIRO_CONTENT_COLOR_ALPHA, &r);
+	surface = new DisplayListSurface (target);
+	ctx = new DisplayListContext (surface, target, matrix);
+	surface->unref ();
+	cairo_surface_destroy (target);
+
+	recording++;
+
+	return ctx;
+#else
+	g_assert_not_reached ();
+	return NULL;
+#endif
+}
+
+DisplayList *
+DisplayList::EndRecording (Context *ctx)
+{
+	DisplayListContext *rec = (DisplayListContext *) ctx;
+	cairo_surface_t    *surface = cairo_surface_reference (rec->recording);
+	cairo_matrix_t     matrix = rec->matrix;
+	bool               failed = rec->failed;
+	DisplayList        *list = NULL;
+
+	/* this flushes the pending drawing into the recording */
+	delete rec;
+
+	recording--;
+
+	if (!failed && cairo_surface_status (surface) == CAIRO_STATUS_SUCCESS)
+		list = new DisplayList (surface, &matrix);
+
+	cairo_surface_destroy (surface);
+
+	return list;
+}
+
+void
+DisplayList::GetOffset (cairo_matrix_t *ctm, double *dx, double *dy)
+{
+	*dx = ctm->x0 - matrix.x0;
+	*dy = ctm->y0 - matrix.y0;
+}
+
+bool
+DisplayList::CanReplay (Context *ctx)
+{
+	cairo_matrix_t ctm;
+	double         dx, dy;
+
+	ctx->Top ()->GetMatrix (&ctm);
+
+	if (ctm.xx != matrix.xx || ctm.yx != matrix.yx || ctm.xy != matrix.xy || ctm.yy != matrix.yy)
+		return false;
+
+	/* anything but whole pixel offsets would be rasterized differently */
+	GetOffset (&ctm, &dx, &dy);
+
+	return fabs (dx - rint (dx)) < 0.0001 && fabs (dy - rint (dy)) < 0.0001;
+}
+
+void
+DisplayList::Replay (Context *ctx)
+{
+	cairo_matrix_t ctm;
+	double         dx, dy;
+	cairo_t        *cr;
+
+	if (extents.IsEmpty ())
+		return;
+
+	ctx->Top ()->GetMatrix (&ctm);
+	GetOffset (&ctm, &dx, &dy);
+	dx = rint (dx);
+	dy = rint (dy);
+
+	cr = ctx->Push (Context::Cairo (Rect (extents.x + dx, extents.y + dy, extents.width, extents.height)));
+	cairo_identity_matrix (cr);
+	cairo_set_source_surface (cr, surface, dx, dy);
+	cairo_paint (cr);
+	ctx->Pop ();
+}
+
+};
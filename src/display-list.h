@@ -0,0 +1,76 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * display-list.h: retained rendering of static subtrees
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#ifndef __MOON_DISPLAY_LIST_H__
+#define __MOON_DISPLAY_LIST_H__
+
+#include <glib.h>
+#include <cairo.h>
+
+#include "rect.h"
+
+namespace Moonlight {
+
+class Context;
+
+/*
+ * DisplayList
+ *   The drawing operations of a UIElement subtree (with the brushes, paths
+ *   and transforms already resolved), recorded into a cairo recording surface
+ *   so that a subtree which hasn't changed can be drawn again without walking it.
+ *
+ *   A list is recorded in device space, and is only replayed when the device
+ *   transform is the same as when it was recorded, or differs by a whole
+ *   number of pixels (scrolling), so that the output is identical to what
+ *   rendering the subtree would have produced.
+ *
+ *   The owner invalidates the list whenever the subtree is invalidated (see
+ *   Surface::ProcessUpDirtyElements). Subtrees which render with something
+ *   that can't be recorded (effects, projections, some video formats) are
+ *   rejected when the recording ends.
+ *
+ *   Disabled with MOONLIGHT_DISPLAY_LISTS=no.
+ */
+
+class DisplayList {
+public:
+	~DisplayList ();
+
+	/* Starts recording everything rendered into the returned context, 'matrix' is the
+	 * device transform and 'extents' the device space area which will be drawn to */
+	static Context *BeginRecording (cairo_matrix_t *matrix, Rect extents);
+	/* Deletes the context. Returns NULL if the subtree rendered something which can't be recorded. */
+	static DisplayList *EndRecording (Context *ctx);
+
+	static bool IsEnabled ();
+	/* Nested subtrees render normally while a list is being recorded, lists aren't recorded into each other */
+	static bool IsRecording () { return recording > 0; }
+
+	/* Whether the list can be replayed with the current transform of the context */
+	bool CanReplay (Context *ctx);
+	void Replay (Context *ctx);
+
+	Rect GetExtents () { return extents; }
+
+private:
+	cairo_surface_t *surface;
+	cairo_matrix_t matrix;
+	Rect extents; /* device space */
+
+	static int recording;
+
+	DisplayList (cairo_surface_t *surface, cairo_matrix_t *matrix);
+	void GetOffset (cairo_matrix_t *ctm, double *dx, double *dy);
+};
+
+};
+#endif /* __MOON_DISPLAY_LIST_H__ */
@@ -594,6 +594,7 @@ enum MediaFrameState {
 	MediaFrameMarker    = 1 << 5,
 	MediaFramePosixAlloc= 1 << 6,
 	MediaFrameVUY2      = 1 << 7,
+	MediaFramePooled    = 1 << 8,
 };
 
 /* @IncludeInKinds */
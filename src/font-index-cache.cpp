@@ -0,0 +1,369 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * font-index-cache.cpp: a persistent cache of the faces found in font files
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <glib/gstdio.h>
+
+#include "font-index-cache.h"
+#include "runtime.h"
+#include "debug.h"
+
+#define FONT_INDEX_CACHE_VERSION "moonlight-font-cache 1"
+/* Entries which haven't been used for this many seconds are dropped when saving */
+#define FONT_INDEX_CACHE_MAX_AGE (30 * 24 * 60 * 60)
+/* key last_used obfuscated n_faces, followed by the fields of every face */
+#define FONT_INDEX_CACHE_FIELDS 4
+/* index stretch weight style set family */
+#define FONT_INDEX_CACHE_FACE_FIELDS 6
+
+namespace Moonlight {
+
+/*
+ * FontIndexCacheEntry
+ */
+
+FontIndexCacheEntry::FontIndexCacheEntry ()
+{
+	faces = g_ptr_array_new ();
+	last_used = time (NULL);
+	obfuscated = false;
+}
+
+FontIndexCacheEntry::~FontIndexCacheEntry ()
+{
+	FontIndexCacheFace *face;
+
+	for (guint i = 0; i < faces->len; i++) {
+		face = (FontIndexCacheFace *) faces->pdata[i];
+		g_free (face->style.family_name);
+		g_free (face);
+	}
+
+	g_ptr_array_free (faces, true);
+}
+
+void
+FontIndexCacheEntry::AddFace (const FontStyleInfo *style, int index)
+{
+	FontIndexCacheFace *face = g_new (FontIndexCacheFace, 1);
+
+	face->style = *style;
+	face->style.family_name = g_strdup (style->family_name);
+	face->index = index;
+
+	g_ptr_array_add (faces, face);
+}
+
+/*
+ * FontIndexCache
+ */
+
+FontIndexCache *FontIndexCache::instance = NULL;
+bool FontIndexCache::disabled = false;
+
+static void
+delete_entry (gpointer value)
+{
+	delete (FontIndexCacheEntry *) value;
+}
+
+FontIndexCache::FontIndexCache (const char *dir)
+{
+	this->dir = g_strdup (dir);
+	index_path = g_build_filename (dir, "index", NULL);
+	changes = 0;
+
+	entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, delete_entry);
+}
+
+FontIndexCache::~FontIndexCache ()
+{
+	g_hash_table_destroy (entries);
+	g_free (index_path);
+	g_free (dir);
+}
+
+FontIndexCache *
+FontIndexCache::GetInstance ()
+{
+	char *dir = NULL;
+	const char *env;
+
+	VERIFY_MAIN_THREAD;
+
+	if (instance != NULL || disabled)
+		return instance;
+
+	/* MOONLIGHT_FONT_CACHE=no or MOONLIGHT_FONT_CACHE=dir=<path> */
+	if ((env = g_getenv ("MOONLIGHT_FONT_CACHE")) != NULL) {
+		if (!strcmp (env, "no") || !strcmp (env, "0")) {
+			LOG_FONT ("FontIndexCache::GetInstance (): the font index cache is disabled.\n");
+			disabled = true;
+			return NULL;
+		} else if (!strncmp (env, "dir=", 4)) {
+			dir = g_strdup (env + 4);
+		} else {
+			printf ("Moonlight: unknown MOONLIGHT_FONT_CACHE option: '%s'\n", env);
+		}
+	}
+
+	if (dir == NULL)
+		dir = g_build_filename (g_get_user_cache_dir (), "moonlight", "fonts", NULL);
+
+	instance = new FontIndexCache (dir);
+	g_free (dir);
+
+	if (g_mkdir_with_parents (instance->dir, 0700) == -1) {
+		printf ("Moonlight: could not create the font cache directory '%s': %s\n", instance->dir, strerror (errno));
+		delete instance;
+		instance = NULL;
+		disabled = true;
+		return NULL;
+	}
+
+	instance->Load ();
+
+	LOG_FONT ("FontIndexCache::GetInstance (): using %s with %u entries\n", instance->dir, g_hash_table_size (instance->entries));
+
+	return instance;
+}
+
+void
+FontIndexCache::Shutdown ()
+{
+	if (instance == NULL)
+		return;
+
+	instance->Save ();
+
+	delete instance;
+	instance = NULL;
+}
+
+static char *
+checksum_file (const char *path)
+{
+	GChecksum *checksum;
+	guchar buf[8192];
+	char *digest;
+	size_t n;
+	FILE *fp;
+
+	if (!(fp = fopen (path, "rb")))
+		return NULL;
+
+	checksum = g_checksum_new (G_CHECKSUM_SHA1);
+
+	while ((n = fread (buf, 1, sizeof (buf), fp)) > 0)
+		g_checksum_update (checksum, buf, n);
+
+	if (ferror (fp)) {
+		g_checksum_free (checksum);
+		fclose (fp);
+		return NULL;
+	}
+
+	digest = g_strdup (g_checksum_get_string (checksum));
+	g_checksum_free (checksum);
+	fclose (fp);
+
+	return digest;
+}
+
+char *
+FontIndexCache::GetKey (const char *path, bool by_content)
+{
+	struct stat st;
+	char *digest;
+	char *key;
+
+	if (g_stat (path, &st) == -1 || !S_ISREG (st.st_mode))
+		return NULL;
+
+	if (by_content) {
+		if (!(digest = checksum_file (path)))
+			return NULL;
+
+		key = g_strdup_printf ("sha1:%s:%" G_GINT64_FORMAT, digest, (gint64) st.st_size);
+		g_free (digest);
+
+		return key;
+	}
+
+	// the key is a field of a tab-separated line in the index
+	if (strchr (path, '\t') || strchr (path, '\n'))
+		return NULL;
+
+	return g_strdup_printf ("file:%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT, path, (gint64) st.st_size, (gint64) st.st_mtime);
+}
+
+FontIndexCacheEntry *
+FontIndexCache::Lookup (const char *key)
+{
+	FontIndexCacheEntry *entry;
+	gint64 now = time (NULL);
+
+	if (!(entry = (FontIndexCacheEntry *) g_hash_table_lookup (entries, key)))
+		return NULL;
+
+	// don't rewrite the index just to bump the timestamps, once a day is enough
+	if (now - entry->last_used > 24 * 60 * 60)
+		changes++;
+
+	entry->last_used = now;
+
+	return entry;
+}
+
+void
+FontIndexCache::Store (const char *key, FontIndexCacheEntry *entry)
+{
+	FontIndexCacheFace *face;
+
+	for (guint i = 0; i < entry->faces->len; i++) {
+		face = (FontIndexCacheFace *) entry->faces->pdata[i];
+
+		if (!face->style.family_name || strchr (face->style.family_name, '\t') || strchr (face->style.family_name, '\n')) {
+			// can't be written to the index
+			delete entry;
+			return;
+		}
+	}
+
+	entry->last_used = time (NULL);
+	g_hash_table_replace (entries, g_strdup (key), entry);
+	changes++;
+}
+
+void
+FontIndexCache::Remove (const char *key)
+{
+	if (g_hash_table_remove (entries, key))
+		changes++;
+}
+
+void
+FontIndexCache::Load ()
+{
+	FontIndexCacheEntry *entry;
+	FontStyleInfo style;
+	char **lines, **fields;
+	char *contents;
+	guint n_fields;
+	int n_faces;
+
+	if (!g_file_get_contents (index_path, &contents, NULL, NULL))
+		return;
+
+	lines = g_strsplit (contents, "\n", -1);
+	g_free (contents);
+
+	if (lines[0] == NULL || strcmp (lines[0], FONT_INDEX_CACHE_VERSION) != 0) {
+		LOG_FONT ("FontIndexCache::Load (): ignoring index with unknown version\n");
+		g_strfreev (lines);
+		return;
+	}
+
+	for (int i = 1; lines[i] != NULL; i++) {
+		fields = g_strsplit (lines[i], "\t", -1);
+		n_fields = g_strv_length (fields);
+
+		if (n_fields < FONT_INDEX_CACHE_FIELDS) {
+			g_strfreev (fields);
+			continue;
+		}
+
+		n_faces = atoi (fields[3]);
+
+		if (n_faces <= 0 || n_fields != (guint) (FONT_INDEX_CACHE_FIELDS + n_faces * FONT_INDEX_CACHE_FACE_FIELDS)) {
+			g_strfreev (fields);
+			continue;
+		}
+
+		entry = new FontIndexCacheEntry ();
+		entry->last_used = g_ascii_strtoll (fields[1], NULL, 10);
+		entry->obfuscated = atoi (fields[2]) != 0;
+
+		for (int j = 0; j < n_faces; j++) {
+			char **face = fields + FONT_INDEX_CACHE_FIELDS + j * FONT_INDEX_CACHE_FACE_FIELDS;
+
+			style.stretch = (FontStretches) atoi (face[1]);
+			style.weight = (FontWeights) atoi (face[2]);
+			style.style = (FontStyles) atoi (face[3]);
+			style.set = atoi (face[4]);
+			style.family_name = face[5];
+
+			entry->AddFace (&style, atoi (face[0]));
+		}
+
+		g_hash_table_replace (entries, g_strdup (fields[0]), entry);
+		g_strfreev (fields);
+	}
+
+	g_strfreev (lines);
+}
+
+static void
+save_entry (gpointer key, gpointer value, gpointer user_data)
+{
+	FontIndexCacheEntry *entry = (FontIndexCacheEntry *) value;
+	GString *str = (GString *) user_data;
+	FontIndexCacheFace *face;
+
+	if (entry->last_used < time (NULL) - FONT_INDEX_CACHE_MAX_AGE)
+		return;
+
+	g_string_append_printf (str, "%s\t%" G_GINT64_FORMAT "\t%d\t%u", (const char *) key,
+				entry->last_used, entry->obfuscated ? 1 : 0, entry->faces->len);
+
+	for (guint i = 0; i < entry->faces->len; i++) {
+		face = (FontIndexCacheFace *) entry->faces->pdata[i];
+
+		g_string_append_printf (str, "\t%d\t%d\t%d\t%d\t%d\t%s", face->index, (int) face->style.stretch,
+					(int) face->style.weight, (int) face->style.style, face->style.set,
+					face->style.family_name);
+	}
+
+	g_string_append_c (str, '\n');
+}
+
+void
+FontIndexCache::Save ()
+{
+	GError *err = NULL;
+	GString *str;
+
+	if (changes == 0)
+		return;
+
+	str = g_string_new (FONT_INDEX_CACHE_VERSION "\n");
+	g_hash_table_foreach (entries, save_entry, str);
+
+	// g_file_set_contents writes to a temporary file and renames it, so the index is never half-written
+	if (!g_file_set_contents (index_path, str->str, str->len, &err)) {
+		printf ("Moonlight: could not save the font cache index '%s': %s\n", index_path, err->message);
+		g_error_free (err);
+	} else {
+		changes = 0;
+	}
+
+	g_string_free (str, true);
+}
+
+};
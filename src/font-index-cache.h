@@ -0,0 +1,94 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * font-index-cache.h: a persistent cache of the faces found in font files
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#ifndef __MOON_FONT_INDEX_CACHE_H__
+#define __MOON_FONT_INDEX_CACHE_H__
+
+#include <glib.h>
+
+#include "font-utils.h"
+
+namespace Moonlight {
+
+/*
+ * FontIndexCacheEntry
+ *   What the FontManager found in a font file: the family and style of
+ *   every face in it, and whether it is an obfuscated (odttf) font.
+ */
+
+class FontIndexCacheEntry {
+public:
+	GPtrArray *faces; /* FontIndexCacheFace */
+	gint64 last_used; /* seconds since the epoch */
+	bool obfuscated;
+
+	FontIndexCacheEntry ();
+	~FontIndexCacheEntry ();
+
+	void AddFace (const FontStyleInfo *style, int index);
+};
+
+struct FontIndexCacheFace {
+	FontStyleInfo style;
+	int index;
+};
+
+/*
+ * FontIndexCache
+ *   Remembers the faces of the font files indexed by the FontManager
+ *   across runs, so that font resources and directories can be indexed
+ *   without opening every file with FreeType. Files are identified by
+ *   their path, size and modification time, or by the sha1 of their
+ *   contents for files (like the fonts extracted from managed streams)
+ *   which are written to a different path every time. The FontManager
+ *   validates an entry against the font itself the first time it opens
+ *   a face from it.
+ *
+ *   It must only be used from the main thread.
+ *
+ *   Configured with MOONLIGHT_FONT_CACHE=no to disable it, or
+ *   MOONLIGHT_FONT_CACHE=dir=<path>
+ */
+
+class FontIndexCache {
+public:
+	static FontIndexCache *GetInstance ();
+	static void Shutdown ();
+
+	/* Returns NULL if the file can't be read */
+	char *GetKey (const char *path, bool by_content);
+
+	FontIndexCacheEntry *Lookup (const char *key);
+	/* Takes ownership of the entry */
+	void Store (const char *key, FontIndexCacheEntry *entry);
+	void Remove (const char *key);
+
+	void Save ();
+
+private:
+	char *dir;
+	char *index_path;
+	int changes; /* modifications since the index was last saved */
+
+	GHashTable *entries; /* key -> FontIndexCacheEntry */
+
+	static FontIndexCache *instance;
+	static bool disabled;
+
+	FontIndexCache (const char *dir);
+	~FontIndexCache ();
+
+	void Load ();
+};
+
+};
+#endif /* __MOON_FONT_INDEX_CACHE_H__ */
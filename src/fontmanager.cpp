@@ -23,6 +23,7 @@
 #include <ctype.h>
 
 #include "fontmanager.h"
+#include "font-index-cache.h"
 #include "font-utils.h"
 #include "zip/unzip.h"
 #include "factory.h"
@@ -257,8 +258,17 @@ struct FontFile : public List::Node {
 	GPtrArray *faces;
 	char *path, *guid;
 	
+	// set if the faces came from the font index cache and
+	// haven't been checked against the font file yet
+	char *cache_key;
+	
 	FontFile (const char *path, const char *guid);
 	~FontFile ();
+	
+	void ClearFaces ();
+	void IndexFaces (FT_Library libft2, FT_Stream stream, FT_Face face);
+	bool Reindex (FT_Library libft2);
+	void StoreInCache (const char *key);
 };
 
 struct FaceInfo {
@@ -268,21 +278,28 @@ struct FaceInfo {
 	int index;
 	
 	FaceInfo (FontFile *file, FT_Face face, int index);
+	FaceInfo (FontFile *file, const FontStyleInfo *style, int index);
 	~FaceInfo ();
 };
 
-FaceInfo::FaceInfo (FontFile *file, FT_Face face, int index)
+static void
+face_style_info (FontStyleInfo *style, const char *family_name, const char *style_name)
 {
-	LOG_FONT ("      * indexing %s[%d]: family=\"%s\"; style=\"%s\"\n",
-		  path_get_basename (file->path), index, face->family_name, face->style_name);
-	
-	font_style_info_init (&style, NULL);
+	font_style_info_init (style, NULL);
 	
 	// extract whatever little style info we can from the family name
-	font_style_info_parse (&style, face->family_name, true);
+	font_style_info_parse (style, family_name, true);
 	
 	// style info parsed from style_name overrides anything we got from family_name
-	font_style_info_parse (&style, face->style_name, false);
+	font_style_info_parse (style, style_name, false);
+}
+
+FaceInfo::FaceInfo (FontFile *file, FT_Face face, int index)
+{
+	LOG_FONT ("      * indexing %s[%d]: family=\"%s\"; style=\"%s\"\n",
+		  path_get_basename (file->path), index, face->family_name, face->style_name);
+	
+	face_style_info (&style, face->family_name, face->style_name);
 	
 	family_name = style.family_name;
 	
@@ -293,6 +310,19 @@ FaceInfo::FaceInfo (FontFile *file, FT_Face face, int index)
 	this->file = file;
 }
 
+FaceInfo::FaceInfo (FontFile *file, const FontStyleInfo *style, int index)
+{
+	this->style = *style;
+	this->style.family_name = g_strdup (style->family_name);
+	family_name = this->style.family_name;
+	
+	LOG_FONT ("      * cached %s[%d] as %s; %s\n", path_get_basename (file->path), index, family_name,
+		  font_style_info_to_string (style->stretch, style->weight, style->style));
+	
+	this->index = index;
+	this->file = file;
+}
+
 FaceInfo::~FaceInfo ()
 {
 	g_free (family_name);
@@ -307,24 +337,103 @@ FontFile::FontFile (const char *path, const char *guid)
 {
 	this->path = g_strdup (path);
 	this->guid = g_strdup (guid);
-	faces = NULL;
+	faces = g_ptr_array_new ();
+	cache_key = NULL;
 }
 
 FontFile::~FontFile ()
 {
-	if (faces != NULL) {
-		FaceInfo *face;
+	ClearFaces ();
+	g_ptr_array_free (faces, true);
+	
+	g_free (cache_key);
+	g_free (path);
+	g_free (guid);
+}
+
+void
+FontFile::ClearFaces ()
+{
+	for (guint i = 0; i < faces->len; i++)
+		delete (FaceInfo *) faces->pdata[i];
+	
+	g_ptr_array_set_size (faces, 0);
+}
+
+void
+FontFile::IndexFaces (FT_Library libft2, FT_Stream stream, FT_Face face)
+{
+	int i = 0, nfaces = face->num_faces;
+	FT_Open_Args args;
+	FaceInfo *fi;
+	
+	do {
+		args.flags = FT_OPEN_STREAM;
+		args.stream = stream;
 		
-		for (guint i = 0; i < faces->len; i++) {
-			face = (FaceInfo *) faces->pdata[i];
-			delete face;
-		}
+		if (i > 0 && FT_Open_Face (libft2, &args, i, &face) != 0)
+			break;
+		
+		fi = new FaceInfo (this, face, i);
+		g_ptr_array_add (faces, fi);
+		
+		FT_Done_Face (face);
+		
+		font_stream_reset (stream);
 		
-		g_ptr_array_free (faces, true);
+		i++;
+	} while (i < nfaces);
+}
+
+// Indexes the faces of a file loaded from the font index cache with FreeType
+bool
+FontFile::Reindex (FT_Library libft2)
+{
+	FT_Open_Args args;
+	FT_Stream stream;
+	FT_Face face;
+	
+	LOG_FONT ("    * reindexing `%s'...\n", path);
+	
+	ClearFaces ();
+	
+	if (!(stream = font_stream_new (path, guid)))
+		return false;
+	
+	args.flags = FT_OPEN_STREAM;
+	args.stream = stream;
+	
+	if (FT_Open_Face (libft2, &args, 0, &face) != 0) {
+		font_stream_destroy (stream);
+		return false;
 	}
 	
-	g_free (path);
-	g_free (guid);
+	IndexFaces (libft2, stream, face);
+	
+	font_stream_destroy (stream);
+	
+	return faces->len > 0;
+}
+
+void
+FontFile::StoreInCache (const char *key)
+{
+	FontIndexCache *cache = FontIndexCache::GetInstance ();
+	FontIndexCacheEntry *entry;
+	FaceInfo *fi;
+	
+	if (cache == NULL || key == NULL || faces->len == 0)
+		return;
+	
+	entry = new FontIndexCacheEntry ();
+	entry->obfuscated = guid != NULL;
+	
+	for (guint i = 0; i < faces->len; i++) {
+		fi = (FaceInfo *) faces->pdata[i];
+		entry->AddFace (&fi->style, fi->index);
+	}
+	
+	cache->Store (key, entry);
 }
 
 
@@ -340,7 +449,8 @@ struct FontIndex {
 	FontIndex (const char *name);
 	~FontIndex ();
 	
-	void CacheFontInfo (FT_Library libft2, const char *filename, FT_Stream stream, FT_Face face, const char *guid);
+	void CacheFontInfo (FT_Library libft2, const char *filename, FT_Stream stream, FT_Face face, const char *guid, const char *key);
+	void LoadCachedFontInfo (const char *filename, FontIndexCacheEntry *entry, const char *guid, const char *key);
 };
 
 FontIndex::FontIndex (const char *name)
@@ -358,34 +468,34 @@ FontIndex::~FontIndex ()
 }
 
 void
-FontIndex::CacheFontInfo (FT_Library libft2, const char *filename, FT_Stream stream, FT_Face face, const char *guid)
+FontIndex::CacheFontInfo (FT_Library libft2, const char *filename, FT_Stream stream, FT_Face face, const char *guid, const char *key)
 {
-	int i = 0, nfaces = face->num_faces;
-	FT_Open_Args args;
 	FontFile *file;
-	FaceInfo *fi;
 	
 	LOG_FONT ("    * caching font info for `%s'...\n", filename);
 	
 	file = new FontFile (filename, guid);
-	file->faces = g_ptr_array_new ();
+	file->IndexFaces (libft2, stream, face);
+	file->StoreInCache (key);
 	
-	do {
-		args.flags = FT_OPEN_STREAM;
-		args.stream = stream;
-		
-		if (i > 0 && FT_Open_Face (libft2, &args, i, &face) != 0)
-			break;
-		
-		fi = new FaceInfo (file, face, i);
-		g_ptr_array_add (file->faces, fi);
-		
-		FT_Done_Face (face);
-		
-		font_stream_reset (stream);
-		
-		i++;
-	} while (i < nfaces);
+	fonts->Append (file);
+}
+
+void
+FontIndex::LoadCachedFontInfo (const char *filename, FontIndexCacheEntry *entry, const char *guid, const char *key)
+{
+	FontIndexCacheFace *face;
+	FontFile *file;
+	
+	LOG_FONT ("    * loading cached font info for `%s'...\n", filename);
+	
+	file = new FontFile (filename, entry->obfuscated ? guid : NULL);
+	file->cache_key = g_strdup (key);
+	
+	for (guint i = 0; i < entry->faces->len; i++) {
+		face = (FontIndexCacheFace *) entry->faces->pdata[i];
+		g_ptr_array_add (file->faces, new FaceInfo (file, &face->style, face->index));
+	}
 	
 	fonts->Append (file);
 }
@@ -1043,11 +1153,14 @@ FontManager::~FontManager ()
 }
 
 static bool
-IndexFontSubdirectory (FT_Library libft2, const char *name, GString *path, FontIndex **out)
+IndexFontSubdirectory (FT_Library libft2, const char *name, GString *path, bool by_content, FontIndex **out)
 {
+	FontIndexCache *cache = FontIndexCache::GetInstance ();
+	FontIndexCacheEntry *entry;
 	FontIndex *fontdir = *out;
 	const gchar *dirname;
 	FT_Open_Args args;
+	char *key = NULL;
 	FT_Stream stream;
 	bool obfuscated;
 	struct stat st;
@@ -1074,7 +1187,15 @@ IndexFontSubdirectory (FT_Library libft2, const char *name, GString *path, FontI
 			goto next;
 		
 		if (S_ISDIR (st.st_mode)) {
-			IndexFontSubdirectory (libft2, name, path, &fontdir);
+			IndexFontSubdirectory (libft2, name, path, by_content, &fontdir);
+			goto next;
+		}
+		
+		if (cache && (key = cache->GetKey (path->str, by_content)) && (entry = cache->Lookup (key))) {
+			if (fontdir == NULL)
+				fontdir = new FontIndex (name);
+			
+			fontdir->LoadCachedFontInfo (path->str, entry, dirname, key);
 			goto next;
 		}
 		
@@ -1110,12 +1231,14 @@ IndexFontSubdirectory (FT_Library libft2, const char *name, GString *path, FontI
 			fontdir = new FontIndex (name);
 		
 		// cache font info
-		fontdir->CacheFontInfo (libft2, path->str, stream, face, obfuscated ? dirname : NULL);
+		fontdir->CacheFontInfo (libft2, path->str, stream, face, obfuscated ? dirname : NULL, key);
 		
 		font_stream_destroy (stream);
 		
 	 next:
 		g_string_truncate (path, len);
+		g_free (key);
+		key = NULL;
 	}
 	
 	g_dir_close (dir);
@@ -1126,7 +1249,7 @@ IndexFontSubdirectory (FT_Library libft2, const char *name, GString *path, FontI
 }
 
 static FontIndex *
-IndexFontDirectory (FT_Library libft2, const char *name, const char *dirname)
+IndexFontDirectory (FT_Library libft2, const char *name, const char *dirname, bool by_content)
 {
 	FontIndex *fontdir = NULL;
 	GString *path;
@@ -1135,7 +1258,7 @@ IndexFontDirectory (FT_Library libft2, const char *name, const char *dirname)
 	path = g_string_new (dirname);
 	len = path->len;
 	
-	if (!IndexFontSubdirectory (libft2, name, path, &fontdir)) {
+	if (!IndexFontSubdirectory (libft2, name, path, by_content, &fontdir)) {
 		g_string_free (path, true);
 		return NULL;
 	}
@@ -1149,19 +1272,33 @@ IndexFontDirectory (FT_Library libft2, const char *name, const char *dirname)
 }
 
 static FontIndex *
-IndexFontFile (FT_Library libft2, const char *name, const char *path)
+IndexFontFile (FT_Library libft2, const char *name, const char *path, bool by_content)
 {
+	FontIndexCache *cache = FontIndexCache::GetInstance ();
 	const char *filename = path_get_basename (name);
+	FontIndexCacheEntry *entry;
 	FontIndex *index = NULL;
 	FT_Open_Args args;
+	char *key = NULL;
 	FT_Stream stream;
 	bool obfuscated;
 	FT_Face face;
 	
 	LOG_FONT ("  * indexing font file `%s'...\n", path);
 	
-	if (!(stream = font_stream_new (path, NULL)))
+	if (cache && (key = cache->GetKey (path, by_content)) && (entry = cache->Lookup (key))) {
+		index = new FontIndex (name);
+		index->path = g_strdup (path);
+		index->LoadCachedFontInfo (path, entry, filename, key);
+		g_free (key);
+		
+		return index;
+	}
+	
+	if (!(stream = font_stream_new (path, NULL))) {
+		g_free (key);
 		return NULL;
+	}
 	
 	args.flags = FT_OPEN_STREAM;
 	args.stream = stream;
@@ -1172,6 +1309,7 @@ IndexFontFile (FT_Library libft2, const char *name, const char *path)
 		// not a valid font file... is it maybe an obfuscated font?
 		if (!is_odttf (filename) || !font_stream_set_guid (stream, filename)) {
 			font_stream_destroy (stream);
+			g_free (key);
 			return NULL;
 		}
 		
@@ -1182,6 +1320,7 @@ IndexFontFile (FT_Library libft2, const char *name, const char *path)
 		
 		if (FT_Open_Face (libft2, &args, 0, &face) != 0) {
 			font_stream_destroy (stream);
+			g_free (key);
 			return NULL;
 		}
 		
@@ -1192,9 +1331,10 @@ IndexFontFile (FT_Library libft2, const char *name, const char *path)
 	index->path = g_strdup (path);
 	
 	// cache font info
-	index->CacheFontInfo (libft2, path, stream, face, obfuscated ? filename : NULL);
+	index->CacheFontInfo (libft2, path, stream, face, obfuscated ? filename : NULL, key);
 	
 	font_stream_destroy (stream);
+	g_free (key);
 	
 	return index;
 }
@@ -1203,7 +1343,9 @@ void
 FontManager::AddResource (const char *resource_id, const char *path)
 {
 	FT_Library libft2 = Runtime::GetFontService ()->libft2;
+	FontIndexCache *cache;
 	FontIndex *index;
+	bool by_content;
 	struct stat st;
 	
 	LOG_FONT ("Adding font resource '%s' at %s\n", resource_id, path);
@@ -1214,15 +1356,22 @@ FontManager::AddResource (const char *resource_id, const char *path)
 	if (stat (path, &st) == -1)
 		return;
 	
+	// the fonts extracted from managed streams are written to a new
+	// temporary directory every time, so they are cached by content
+	by_content = root != NULL && g_str_has_prefix (path, root);
+	
 	if (S_ISDIR (st.st_mode))
-		index = IndexFontDirectory (libft2, resource_id, path);
+		index = IndexFontDirectory (libft2, resource_id, path, by_content);
 	else if (S_ISREG (st.st_mode))
-		index = IndexFontFile (libft2, resource_id, path);
+		index = IndexFontFile (libft2, resource_id, path, by_content);
 	else
 		return;
 	
 	if (index)
 		g_hash_table_insert (resources, index->name, index);
+	
+	if ((cache = FontIndexCache::GetInstance ()))
+		cache->Save ();
 }
 
 FontResource *
@@ -1402,9 +1551,27 @@ FontManager::OpenFontFace (const char *filename, const char *guid, int index)
 	return new FontFace (this, face, key);
 }
 
+static bool
+cached_face_matches (FaceInfo *fi, FontFace *face)
+{
+	FontStyleInfo style;
+	bool matches;
+	
+	face_style_info (&style, face->GetFamilyName (), face->GetStyleName ());
+	
+	matches = style.family_name != NULL && !g_ascii_strcasecmp (style.family_name, fi->family_name) &&
+		style.stretch == fi->style.stretch && style.weight == fi->style.weight &&
+		style.style == fi->style.style;
+	
+	g_free (style.family_name);
+	
+	return matches;
+}
+
 FontFace *
 FontManager::OpenFontResource (const char *resource, const char *family, int idx, FontStretches stretch, FontWeights weight, FontStyles style)
 {
+	FontIndexCache *cache;
 	FontIndex *index;
 	FontFile *file;
 	FontFace *face;
@@ -1438,7 +1605,33 @@ FontManager::OpenFontResource (const char *resource, const char *family, int idx
 		return NULL;
 	}
 	
-	if (!(face = OpenFontFace (fi->file->path, fi->file->guid, fi->index)))
+	face = OpenFontFace (fi->file->path, fi->file->guid, fi->index);
+	
+	if ((file = fi->file)->cache_key != NULL) {
+		// the faces of this file came from the font index cache, make sure they are still right
+		if (face != NULL && cached_face_matches (fi, face)) {
+			g_free (file->cache_key);
+			file->cache_key = NULL;
+		} else {
+			LOG_FONT ("  * font index cache entry for `%s' is stale\n", file->path);
+			
+			if (face != NULL)
+				face->unref ();
+			
+			if ((cache = FontIndexCache::GetInstance ()))
+				cache->Remove (file->cache_key);
+			
+			if (file->Reindex (Runtime::GetFontService ()->libft2))
+				file->StoreInCache (file->cache_key);
+			
+			g_free (file->cache_key);
+			file->cache_key = NULL;
+			
+			return OpenFontResource (resource, family, idx, stretch, weight, style);
+		}
+	}
+	
+	if (face == NULL)
 		return NULL;
 	
 	LOG_FONT ("  * opened %s; %s\n", face->GetFamilyName (), face->GetStyleName ());
@@ -0,0 +1,348 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * frame-profiler.cpp: per-frame timings of the TimeManager phases
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "frame-profiler.h"
+#include "clock.h"
+#include "debug.h"
+
+namespace Moonlight {
+
+/* Don't let a forgotten trace eat all the memory: ~24MB */
+#define FRAME_PROFILER_MAX_TRACE_EVENTS (1024 * 1024)
+
+/* The graph: one bar per frame, GRAPH_SCALE pixels per millisecond */
+#define GRAPH_BAR_WIDTH 2
+#define GRAPH_SCALE 2.0
+#define GRAPH_MAX_MS 50
+
+static const char *phase_names [] = {
+	"TickCalls",
+	"Clocks",
+	"Applier",
+	"Input",
+	"Layout",
+	"Dirty",
+	"Paint",
+	"Present",
+};
+
+static const char *counter_names [] = {
+	"measured",
+	"arranged",
+	"rendered",
+	"cache-hits",
+	"cache-misses",
+	"display-list-records",
+	"display-list-replays",
+	"animated-values",
+	"rendered-front-to-back",
+	"occluders",
+};
+
+static const double phase_colors [][3] = {
+	{ 0.60, 0.60, 0.60 }, /* tick calls: grey */
+	{ 0.20, 0.60, 1.00 }, /* clocks: blue */
+	{ 0.00, 0.80, 0.80 }, /* applier: cyan */
+	{ 1.00, 1.00, 0.40 }, /* input: yellow */
+	{ 0.80, 0.40, 1.00 }, /* layout: purple */
+	{ 1.00, 0.60, 0.20 }, /* dirty: orange */
+	{ 0.30, 0.90, 0.30 }, /* paint: green */
+	{ 1.00, 0.30, 0.30 }, /* present: red */
+};
+
+FrameProfiler *FrameProfiler::active = NULL;
+
+FrameProfiler::FrameProfiler ()
+{
+	static int trace_count = 0;
+	const char *path;
+
+	enabled = false;
+	frame_count = 0;
+	in_frame = false;
+	depth = 0;
+	memset (&current, 0, sizeof (current));
+	memset (frames, 0, sizeof (frames));
+
+	trace = NULL;
+	trace_counters = NULL;
+	trace_path = NULL;
+
+	if ((path = g_getenv ("MOONLIGHT_FRAME_TRACE")) != NULL && path [0] != 0) {
+		/* There's a TimeManager per surface, don't let them overwrite each other's traces */
+		if (trace_count++ == 0)
+			trace_path = g_strdup (path);
+		else
+			trace_path = g_strdup_printf ("%s.%i", path, trace_count);
+		trace = g_array_new (false, false, sizeof (TraceEvent));
+		trace_counters = g_array_new (false, false, sizeof (Frame));
+	}
+}
+
+FrameProfiler::~FrameProfiler ()
+{
+	if (active == this)
+		active = NULL;
+
+	if (trace != NULL)
+		g_array_free (trace, true);
+	if (trace_counters != NULL)
+		g_array_free (trace_counters, true);
+	g_free (trace_path);
+}
+
+void
+FrameProfiler::SetEnabled (bool value)
+{
+	enabled = value;
+}
+
+void
+FrameProfiler::StartFrame ()
+{
+	if (!IsEnabled ())
+		return;
+
+	memset (&current, 0, sizeof (current));
+	current.start = get_now ();
+	depth = 0;
+	in_frame = true;
+	active = this;
+}
+
+void
+FrameProfiler::EndFrame ()
+{
+	if (!in_frame)
+		return;
+
+	current.duration = get_now () - current.start;
+	in_frame = false;
+	if (active == this)
+		active = NULL;
+
+	frames [frame_count % FRAME_PROFILER_FRAMES] = current;
+	frame_count++;
+
+	if (trace != NULL && trace->len < FRAME_PROFILER_MAX_TRACE_EVENTS) {
+		TraceEvent ev;
+		ev.start = current.start;
+		ev.duration = current.duration;
+		ev.phase = -1;
+		g_array_append_val (trace, ev);
+		g_array_append_val (trace_counters, current);
+	}
+}
+
+void
+FrameProfiler::StartPhase (FrameProfilerPhase phase)
+{
+	if (depth >= FRAME_PROFILER_MAX_DEPTH) {
+		/* Too deep, the phase will be attributed to its parent */
+		depth++;
+		return;
+	}
+
+	stack [depth].phase = phase;
+	stack [depth].start = get_now ();
+	stack [depth].children = 0;
+	depth++;
+}
+
+void
+FrameProfiler::EndPhase (FrameProfilerPhase phase)
+{
+	TimeSpan duration;
+	PhaseState *state;
+
+	if (depth == 0)
+		return;
+
+	depth--;
+	if (depth >= FRAME_PROFILER_MAX_DEPTH)
+		return;
+
+	state = &stack [depth];
+	if (state->phase != phase) {
+		/* Unbalanced start/end, drop the stack rather than recording garbage */
+		g_warning ("FrameProfiler: ending phase %s while in phase %s", GetPhaseName (phase), GetPhaseName (state->phase));
+		depth = 0;
+		return;
+	}
+
+	duration = get_now () - state->start;
+	current.phases [phase] += duration - state->children;
+	if (depth > 0)
+		stack [depth - 1].children += duration;
+
+	if (trace != NULL && trace->len < FRAME_PROFILER_MAX_TRACE_EVENTS) {
+		TraceEvent ev;
+		ev.start = state->start;
+		ev.duration = duration;
+		ev.phase = phase;
+		g_array_append_val (trace, ev);
+	}
+}
+
+FrameProfiler::Frame *
+FrameProfiler::GetFrame (int age)
+{
+	if (age < 0 || age >= GetFrameCount ())
+		return NULL;
+
+	return &frames [(frame_count - 1 - age) % FRAME_PROFILER_FRAMES];
+}
+
+TimeSpan
+FrameProfiler::GetAveragePhaseTime (FrameProfilerPhase phase)
+{
+	int count = GetFrameCount ();
+	TimeSpan total = 0;
+
+	if (count == 0)
+		return 0;
+
+	for (int i = 0; i < count; i++)
+		total += frames [i].phases [phase];
+
+	return total / count;
+}
+
+const char *
+FrameProfiler::GetPhaseName (FrameProfilerPhase phase)
+{
+	return phase_names [phase];
+}
+
+const char *
+FrameProfiler::GetCounterName (FrameProfilerCounter counter)
+{
+	return counter_names [counter];
+}
+
+void
+FrameProfiler::GetGraphSize (double *width, double *height)
+{
+	*width = FRAME_PROFILER_FRAMES * GRAPH_BAR_WIDTH;
+	*height = GRAPH_MAX_MS * GRAPH_SCALE;
+}
+
+void
+FrameProfiler::DrawGraph (cairo_t *cr, double x, double y)
+{
+	double width, height;
+	int count = GetFrameCount ();
+
+	GetGraphSize (&width, &height);
+
+	cairo_save (cr);
+	cairo_identity_matrix (cr);
+	cairo_new_path (cr);
+
+	cairo_rectangle (cr, x, y, width, height);
+	cairo_set_source_rgba (cr, 0.0, 0.0, 0.0, 0.6);
+	cairo_fill (cr);
+
+	/* Newest frame on the right */
+	for (int age = 0; age < count; age++) {
+		Frame *frame = GetFrame (age);
+		double bx = x + width - (age + 1) * GRAPH_BAR_WIDTH;
+		double by = y + height;
+		double accounted = 0;
+
+		for (int p = 0; p < FrameProfilerPhaseCount && by > y; p++) {
+			double h = frame->phases [p] / 10000.0 * GRAPH_SCALE;
+			if (h <= 0)
+				continue;
+			h = MIN (h, by - y);
+			accounted += frame->phases [p];
+			cairo_rectangle (cr, bx, by - h, GRAPH_BAR_WIDTH, h);
+			cairo_set_source_rgb (cr, phase_colors [p][0], phase_colors [p][1], phase_colors [p][2]);
+			cairo_fill (cr);
+			by -= h;
+		}
+
+		/* Whatever isn't in any phase (event handlers, the main loop) in white */
+		if (by > y && frame->duration > accounted) {
+			double h = MIN ((frame->duration - accounted) / 10000.0 * GRAPH_SCALE, by - y);
+			cairo_rectangle (cr, bx, by - h, GRAPH_BAR_WIDTH, h);
+			cairo_set_source_rgba (cr, 1.0, 1.0, 1.0, 0.5);
+			cairo_fill (cr);
+		}
+	}
+
+	/* The 60 and 30 fps budgets */
+	cairo_set_line_width (cr, 1.0);
+	cairo_set_source_rgba (cr, 1.0, 1.0, 1.0, 0.8);
+	cairo_move_to (cr, x, y + height - (1000.0 / 60.0) * GRAPH_SCALE + 0.5);
+	cairo_rel_line_to (cr, width, 0);
+	cairo_move_to (cr, x, y + height - (1000.0 / 30.0) * GRAPH_SCALE + 0.5);
+	cairo_rel_line_to (cr, width, 0);
+	cairo_stroke (cr);
+
+	cairo_restore (cr);
+}
+
+bool
+FrameProfiler::WriteTrace (const char *path)
+{
+	FILE *f;
+	int pid = getpid ();
+	guint frame = 0;
+
+	if (trace == NULL)
+		return false;
+
+	if ((f = fopen (path, "w")) == NULL) {
+		printf ("Moonlight: could not write frame trace to '%s': %s\n", path, strerror (errno));
+		return false;
+	}
+
+	fprintf (f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf (f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%i,\"tid\":1,\"args\":{\"name\":\"main\"}}", pid);
+
+	/* Timestamps are in microseconds, TimeSpans are in 100ns */
+	for (guint i = 0; i < trace->len; i++) {
+		TraceEvent *ev = &g_array_index (trace, TraceEvent, i);
+
+		fprintf (f, ",\n{\"name\":\"%s\",\"cat\":\"moonlight\",\"ph\":\"X\",\"pid\":%i,\"tid\":1,\"ts\":%.1f,\"dur\":%.1f",
+			ev->phase == -1 ? "Frame" : phase_names [ev->phase], pid, ev->start / 10.0, ev->duration / 10.0);
+
+		if (ev->phase == -1 && frame < trace_counters->len) {
+			Frame *counters = &g_array_index (trace_counters, Frame, frame++);
+
+			fprintf (f, "},\n{\"name\":\"counters\",\"cat\":\"moonlight\",\"ph\":\"C\",\"pid\":%i,\"tid\":1,\"ts\":%.1f,\"args\":{", pid, ev->start / 10.0);
+			for (int c = 0; c < FrameProfilerCounterCount; c++)
+				fprintf (f, "%s\"%s\":%u", c == 0 ? "" : ",", counter_names [c], counters->counters [c]);
+			fprintf (f, "}");
+		}
+
+		fprintf (f, "}");
+	}
+
+	fprintf (f, "\n]}\n");
+	fclose (f);
+
+	printf ("Moonlight: wrote %u trace events to '%s'%s\n", trace->len, path,
+		trace->len >= FRAME_PROFILER_MAX_TRACE_EVENTS ? " (the trace is full, later frames were dropped)" : "");
+
+	return true;
+}
+
+};
@@ -0,0 +1,142 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * frame-profiler.h: per-frame timings of the TimeManager phases
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#ifndef __MOON_FRAME_PROFILER_H__
+#define __MOON_FRAME_PROFILER_H__
+
+#include <glib.h>
+#include <cairo.h>
+
+#include "timesource.h"
+
+namespace Moonlight {
+
+enum FrameProfilerPhase {
+	FrameProfilerTickCalls,
+	FrameProfilerClocks,
+	FrameProfilerApplier,
+	FrameProfilerInput,
+	FrameProfilerLayout,
+	FrameProfilerDirty,
+	FrameProfilerPaint,
+	FrameProfilerPresent,
+	FrameProfilerPhaseCount
+};
+
+enum FrameProfilerCounter {
+	FrameProfilerMeasured,
+	FrameProfilerArranged,
+	FrameProfilerRendered,
+	FrameProfilerCacheHits,
+	FrameProfilerCacheMisses,
+	FrameProfilerDisplayListRecords,
+	FrameProfilerDisplayListReplays,
+	FrameProfilerAnimatedValues,
+	FrameProfilerRenderedFrontToBack, /* rendered by the occlusion culling pass, counted in FrameProfilerRendered too */
+	FrameProfilerOccluders, /* elements which hid what's beneath them from the occlusion culling pass */
+	FrameProfilerCounterCount
+};
+
+/*
+ * The profiler of the TimeManager which is currently ticking is the active
+ * one, and these record into it. They cost a single branch when profiling is off.
+ */
+#define PROFILE_PHASE_START(phase) if (G_UNLIKELY (FrameProfiler::active != NULL)) FrameProfiler::active->StartPhase (phase)
+#define PROFILE_PHASE_END(phase) if (G_UNLIKELY (FrameProfiler::active != NULL)) FrameProfiler::active->EndPhase (phase)
+#define PROFILE_COUNT(counter) if (G_UNLIKELY (FrameProfiler::active != NULL)) FrameProfiler::active->Count (counter)
+
+/*
+ * FrameProfiler
+ *   Keeps the self time of every phase (time spent in nested phases is
+ *   attributed to the nested phase) and the counters for the last
+ *   FRAME_PROFILER_FRAMES frames, and optionally a trace of every phase
+ *   which can be written out in the Chrome trace event format
+ *   (chrome://tracing).
+ *
+ *   Enabled together with the frame rate counter (which then also draws
+ *   a graph of the frame times), or with MOONLIGHT_FRAME_TRACE=<path>, in
+ *   which case the trace is written to <path> when the TimeManager shuts down.
+ */
+
+#define FRAME_PROFILER_FRAMES 128
+#define FRAME_PROFILER_MAX_DEPTH 8
+
+class FrameProfiler {
+public:
+	struct Frame {
+		TimeSpan start;
+		TimeSpan duration;
+		TimeSpan phases [FrameProfilerPhaseCount];
+		guint32 counters [FrameProfilerCounterCount];
+	};
+
+	static FrameProfiler *active;
+
+	FrameProfiler ();
+	~FrameProfiler ();
+
+	void SetEnabled (bool value);
+	bool IsEnabled () { return enabled || trace != NULL; }
+
+	void StartFrame ();
+	void EndFrame ();
+	void StartPhase (FrameProfilerPhase phase);
+	void EndPhase (FrameProfilerPhase phase);
+	void Count (FrameProfilerCounter counter) { current.counters [counter]++; }
+
+	/* The most recent frames, 0 is the last completed frame. Returns NULL if we don't have that many. */
+	Frame *GetFrame (int age);
+	int GetFrameCount () { return MIN (frame_count, FRAME_PROFILER_FRAMES); }
+	/* Average self time of a phase over the frames we have */
+	TimeSpan GetAveragePhaseTime (FrameProfilerPhase phase);
+
+	static const char *GetPhaseName (FrameProfilerPhase phase);
+	static const char *GetCounterName (FrameProfilerCounter counter);
+
+	/* Draws a bar per frame, stacked by phase, with the top left corner at x,y */
+	void DrawGraph (cairo_t *cr, double x, double y);
+	static void GetGraphSize (double *width, double *height);
+
+	/* Writes the trace in the Chrome trace event json format */
+	bool WriteTrace (const char *path);
+	const char *GetTracePath () { return trace_path; }
+
+private:
+	struct TraceEvent {
+		TimeSpan start;
+		TimeSpan duration;
+		gint32 phase; /* -1 for the whole frame */
+	};
+
+	struct PhaseState {
+		FrameProfilerPhase phase;
+		TimeSpan start;
+		TimeSpan children; /* time spent in nested phases */
+	};
+
+	bool enabled;
+
+	Frame frames [FRAME_PROFILER_FRAMES];
+	int frame_count;
+	Frame current;
+	bool in_frame;
+
+	PhaseState stack [FRAME_PROFILER_MAX_DEPTH];
+	int depth;
+
+	GArray *trace; /* TraceEvent, NULL if we're not tracing */
+	GArray *trace_counters; /* Frame, one per frame in the trace */
+	char *trace_path;
+};
+
+};
+#endif /* __MOON_FRAME_PROFILER_H__ */
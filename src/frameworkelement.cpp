@@ -27,6 +27,7 @@
 #include "projection.h"
 #include "canvas.h"
 #include "factory.h"
+#include "frame-profiler.h"
 
 namespace Moonlight {
 
@@ -622,6 +623,8 @@ FrameworkElement::MeasureWithError (Size availableSize, MoonError *error)
 
 	size = ApplySizeConstraints (size);
 
+	PROFILE_COUNT (FrameProfilerMeasured);
+
 	if (measure_cb)
 		size = (*measure_cb)(this, size, error);
 	else
@@ -721,6 +724,8 @@ FrameworkElement::ArrangeWithError (Rect finalRect, MoonError *error)
 	if (!doarrange)
 		return;
 
+	PROFILE_COUNT (FrameProfilerArranged);
+
 	/*
 	 * FIXME I'm not happy with doing this here but until I come
 	 * up with a better plan make sure that layout elements have
@@ -937,6 +942,16 @@ FrameworkElement::UpdateLayer (LayoutPass *pass, MoonError *error)
 			node->uielement->PropagateFlagUp (DIRTY_SIZE_HINT);
 			pass->size_list->Remove (node);
 		}
+
+		if (pass->interrupted || pass->OutOfTime ()) {
+			// the same goes for the measure phase when we ran out of time,
+			// the remaining elements are picked up by the next layout pass
+			while (UIElementNode *node = (UIElementNode *)pass->measure_list->First ()) {
+				node->uielement->PropagateFlagUp (DIRTY_MEASURE_HINT);
+				pass->measure_list->Remove (node);
+			}
+			break;
+		}
 		
 		pass->count = pass->count +1;
 		// Figure out which type of elements we should be selected - dirty measure, arrange or size
@@ -953,6 +968,7 @@ FrameworkElement::UpdateLayer (LayoutPass *pass, MoonError *error)
 		if (flag != NONE) {
 			DeepTreeWalker measure_walker (element);
 			while (FrameworkElement *child = (FrameworkElement *)measure_walker.Step ()) {
+				pass->visited++;
 				if (child->GetVisibility () != VisibilityVisible || !child->HasFlag (flag)) {
 					measure_walker.SkipBranch ();
 					continue;
@@ -969,7 +985,7 @@ FrameworkElement::UpdateLayer (LayoutPass *pass, MoonError *error)
 							pass->arrange_list->Append (new UIElementNode (child));
 					break;
 					case DIRTY_SIZE_HINT:
-						if (child->ReadLocalValue (LayoutInformation::LastRenderSizeProperty))
+						if (LayoutInformation::GetLastRenderSize (child))
 							pass->size_list->Append (new UIElementNode (child));
 					break;
 					default:
@@ -985,7 +1001,13 @@ FrameworkElement::UpdateLayer (LayoutPass *pass, MoonError *error)
 				node->uielement->DoMeasureWithError (error);
 				
 				pass->updated = true;
+				pass->measured++;
 				delete (node);
+
+				// measure at least one element per pass, the walk alone
+				// may use up the budget in a large tree
+				if (pass->OutOfTime ())
+					break;
 			}
 		} else if (flag == DIRTY_ARRANGE_HINT) {
 			while (UIElementNode *node = (UIElementNode*)pass->arrange_list->First ()) {
@@ -994,8 +1016,9 @@ FrameworkElement::UpdateLayer (LayoutPass *pass, MoonError *error)
 				node->uielement->DoArrangeWithError (error);
 			
 				pass->updated = true;
+				pass->arranged++;
 				delete (node);
-				if (element->HasFlag (DIRTY_MEASURE_HINT))
+				if (element->HasFlag (DIRTY_MEASURE_HINT) || pass->OutOfTime ())
 					break;
 			}
 		} else if (flag == DIRTY_SIZE_HINT) {
@@ -1012,8 +1035,9 @@ FrameworkElement::UpdateLayer (LayoutPass *pass, MoonError *error)
 				Size *last = LayoutInformation::GetLastRenderSize (fe);
 				if (last) {
 					Size last_v = *last;
-					fe->ClearValue (LayoutInformation::LastRenderSizeProperty, false);
+					LayoutInformation::SetLastRenderSize (fe, NULL);
 
+					pass->size_changed++;
 					if (fe->HasHandlers (FrameworkElement::SizeChangedEvent)) {
 						SizeChangedEventArgs *args = new SizeChangedEventArgs (last_v, fe->GetRenderSize ());
 						fe->Emit (FrameworkElement::SizeChangedEvent, args);
@@ -1031,7 +1055,7 @@ FrameworkElement::UpdateLayer (LayoutPass *pass, MoonError *error)
 
 #if SANITY
 		DeepTreeWalker verifier (element);
-		while (UIElement *e = verifier.Step ()) {
+		while (UIElement *e = pass->interrupted ? NULL : verifier.Step ()) {
 			if (e->GetVisibility () != VisibilityVisible) {
 				verifier.SkipBranch ();
 				continue;
@@ -1040,7 +1064,7 @@ FrameworkElement::UpdateLayer (LayoutPass *pass, MoonError *error)
 				g_warning ("%s still has dirty measure after the layout pass\n", e->GetType ()->GetName());
 			if (e->dirty_flags & DirtyArrange)
 				g_warning ("%s still has dirty arrange after the layout pass\n", e->GetType ()->GetName());
-			if (e->ReadLocalValue (LayoutInformation::LastRenderSizeProperty))
+			if (LayoutInformation::GetLastRenderSize (e))
 				g_warning ("%s still has LastRenderSize after the layout pass\n", e->GetType ()->GetName());
 		}
 #endif
@@ -40,6 +40,9 @@ class ImageSource : public DependencyObject {
 
 	virtual cairo_surface_t *GetImageSurface ();
 	virtual MoonSurface *GetSurface (Context *ctx);
+
+	// true if every pixel of the image is opaque
+	virtual bool IsOpaque () { return false; }
 };
 
 };
@@ -14,9 +14,62 @@
 #include "rect.h"
 #include "point.h"
 #include "factory.h"
+#include "timesource.h"
 
 namespace Moonlight {
 
+void
+LayoutInformation::SetPreviousConstraint (UIElement *item, Size *size)
+{
+	item->has_previous_constraint = size != NULL;
+	if (size)
+		item->previous_constraint = *size;
+}
+
+Size *
+LayoutInformation::GetPreviousConstraint (UIElement *item)
+{
+	return item->has_previous_constraint ? &item->previous_constraint : NULL;
+}
+
+void
+LayoutInformation::SetLastRenderSize (UIElement *item, Size *size)
+{
+	item->has_last_render_size = size != NULL;
+	if (size)
+		item->last_render_size = *size;
+}
+
+Size *
+LayoutInformation::GetLastRenderSize (UIElement *item)
+{
+	return item->has_last_render_size ? &item->last_render_size : NULL;
+}
+
+void
+LayoutInformation::SetVisualOffset (UIElement *item, Point *offset)
+{
+	item->has_visual_offset = offset != NULL;
+	if (offset)
+		item->visual_offset = *offset;
+}
+
+Point *
+LayoutInformation::GetVisualOffset (UIElement *item)
+{
+	return item->has_visual_offset ? &item->visual_offset : NULL;
+}
+
+bool
+LayoutPass::OutOfTime ()
+{
+	if (deadline == 0 || get_now () < deadline)
+		return false;
+
+	interrupted = true;
+	return true;
+}
+
 Geometry *
 LayoutInformation::GetCompositeClip (FrameworkElement *item)
 {
@@ -26,13 +26,7 @@ public:
 	/* @PropertyType=Rect,DefaultValue=Rect(),Attached,GenerateAccessors */
 	const static int LayoutSlotProperty;
 	/* @PropertyType=Size,Attached,GenerateAccessors */
-	const static int PreviousConstraintProperty;
-	/* @PropertyType=Size,Attached,GenerateAccessors */
 	const static int FinalRectProperty;
-	/* @PropertyType=Size,Attached,GenerateAccessors */
-	const static int LastRenderSizeProperty;
-	/* @PropertyType=Point,Attached,GenerateAccessors */
-	const static int VisualOffsetProperty;
 
 	static void SetLayoutClip (DependencyObject *item, Geometry *clip);
 	static Geometry* GetLayoutClip (DependencyObject *item);
@@ -43,17 +37,20 @@ public:
 	static void SetLayoutSlot (DependencyObject *item, Rect *slot);
 	static Rect *GetLayoutSlot (DependencyObject *item);
 
-	static void SetPreviousConstraint (DependencyObject *item, Size *size);
-	static Size *GetPreviousConstraint (DependencyObject *item);
-
 	static void SetFinalRect (DependencyObject *item, Size *size);
 	static Size *GetFinalRect (DependencyObject *item);
 
-	static void SetLastRenderSize (DependencyObject *item, Size *size);
-	static Size *GetLastRenderSize (DependencyObject *item);
+	// The previous constraint, last render size and visual offset are
+	// only used by the layout code, they're kept in fields on the
+	// element instead of attached properties (NULL means not set)
+	static void SetPreviousConstraint (UIElement *item, Size *size);
+	static Size *GetPreviousConstraint (UIElement *item);
+
+	static void SetLastRenderSize (UIElement *item, Size *size);
+	static Size *GetLastRenderSize (UIElement *item);
 
-	static void SetVisualOffset (DependencyObject *item, Point *offset);
-	static Point *GetVisualOffset (DependencyObject *item);
+	static void SetVisualOffset (UIElement *item, Point *offset);
+	static Point *GetVisualOffset (UIElement *item);
 
 	static void SetBounds (DependencyObject *item, Rect *bounds);
 	static Rect *GetBounds (DependencyObject *item);
@@ -69,14 +66,33 @@ public:
         int count;
 	bool updated;
 
+	// if non-zero the pass stops (leaving the rest of the work
+	// flagged for the next one) once get_now () passes it
+	TimeSpan deadline;
+	bool interrupted;
+
+	// statistics
+	int visited;
+	int measured;
+	int arranged;
+	int size_changed;
+
 	LayoutPass () {
 		measure_list = new List ();
 		arrange_list = new List ();
 		size_list = new List ();
 		count = 0;
 		updated = false;
+		deadline = 0;
+		interrupted = false;
+		visited = 0;
+		measured = 0;
+		arranged = 0;
+		size_changed = 0;
 	}
 
+	bool OutOfTime ();
+
 	~LayoutPass () {
 		delete measure_list;
 		delete arrange_list;
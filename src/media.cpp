@@ -421,7 +421,26 @@ Image::Render (Context *ctx, Region *region)
 	}
 
 	if (!HasLayoutClip () && overlap == CAIRO_REGION_OVERLAP_IN) {
-		MoonSurface *src = source->GetSurface (ctx);
+		MoonSurface *src;
+
+		if (source->Is (Type::BITMAPSOURCE)) {
+			BitmapSource *bitmap = (BitmapSource *) source;
+			cairo_matrix_t device;
+			int level, width, height;
+
+			// paint a source scaled far down from a smaller copy of it
+			ctx->Top ()->GetMatrix (&device);
+			cairo_matrix_multiply (&device, &matrix, &device);
+
+			level = bitmap->GetMipLevel (BitmapSource::GetDownscale (&device));
+			bitmap->GetMipLevelSize (level, &width, &height);
+			cairo_matrix_scale (&matrix, image.width / width, image.height / height);
+
+			src = bitmap->GetMipSurface (ctx, level);
+		}
+		else {
+			src = source->GetSurface (ctx);
+		}
 
 		if (src) {
 			ctx->Push (Context::Transform (matrix));
@@ -470,12 +489,17 @@ Image::Render (cairo_t *cr, Region *region, bool path_only)
 		if (image.width == 0.0 && image.height == 0.0)
 			goto cleanup;
 
-		pattern = cairo_pattern_create_for_surface (source->GetImageSurface ());
+		cairo_surface_t *surface = source->GetImageSurface ();
+
 		image_brush_compute_pattern_matrix (&matrix, paint.width, paint.height, 
 						    image.width, image.height,
 						    GetStretch (), 
 						    AlignmentXCenter, AlignmentYCenter, NULL, NULL);
-		
+
+		if (source->Is (Type::BITMAPSOURCE))
+			surface = ((BitmapSource *) source)->GetPatternSurface (cr, &matrix);
+
+		pattern = cairo_pattern_create_for_surface (surface);
 		cairo_pattern_set_matrix (pattern, &matrix);
 #if MAKE_EVERYTHING_SLOW_AND_BUGGY
 		cairo_pattern_set_extend (pattern, CAIRO_EXTEND_PAD);
@@ -627,36 +651,47 @@ Image::ArrangeOverrideWithError (Size finalSize, MoonError *error)
 Rect
 Image::GetCoverageBounds ()
 {
-	// FIXME: SL3 final only supports PixelFormatPbgra32 which makes this optimization
-	// obsolete - unless we keep an "has_alpha" flag with each image ?!?
-	return Rect ();
-#if FALSE
-	ImageSource *source = GetSource ();
+	ImageSource    *source = GetSource ();
+	Stretch        stretch = GetStretch ();
+	Size           specified (GetActualWidth (), GetActualHeight ());
+	Size           stretched = ApplySizeConstraints (specified);
+	cairo_matrix_t matrix;
+	Rect           image;
 
-	if (!source || source->GetPixelFormat () == PixelFormatPbgra32)
+	// the layout clip and adjusted render sizes take the slow path in
+	// Render, don't bother with them.
+	if (!source || HasLayoutClip () || specified != GetRenderSize ())
 		return Rect ();
 
-	Stretch stretch = GetStretch ();
-	if (stretch == StretchFill || stretch == StretchUniformToFill)
-		return bounds;
+	source->Lock ();
 
-	cairo_matrix_t matrix;
-	Rect image = Rect (0, 0, source->GetPixelWidth (), source->GetPixelHeight ());
-	Rect paint = Rect (0, 0, GetActualWidth (), GetActualHeight ());
+	if (source->GetPixelWidth () == 0 || source->GetPixelHeight () == 0 || !source->IsOpaque ()) {
+		source->Unlock ();
+		return Rect ();
+	}
 
-	image_brush_compute_pattern_matrix (&matrix, 
-					    paint.width, paint.height,
-					    image.width, image.height, stretch, 
-					    AlignmentXCenter, AlignmentYCenter, NULL, NULL);
+	image = Rect (0, 0, source->GetPixelWidth (), source->GetPixelHeight ());
 
-	cairo_matrix_invert (&matrix);
-	cairo_matrix_multiply (&matrix, &matrix, &absolute_xform);
+	source->Unlock ();
 
-	image = image.Transform (&matrix);
-	image = image.Intersection (bounds);
-	
-	return image;
-#endif
+	if (stretch != StretchUniformToFill)
+		specified = specified.Min (stretched);
+
+	Rect paint = Rect (0, 0, specified.width, specified.height);
+
+	if (stretch == StretchNone)
+		paint = paint.Union (image);
+
+	Image::ComputeMatrix (&matrix,
+			      paint.width, paint.height,
+			      image.width, image.height,
+			      stretch,
+			      AlignmentXCenter,
+			      AlignmentYCenter);
+
+	image = image.Transform (&matrix).Intersection (paint);
+
+	return image.Transform (&absolute_xform).Intersection (bounds);
 }
 
 void
@@ -33,7 +33,7 @@ namespace Moonlight {
  */
 
 MediaPlayer::MediaPlayer (MediaElement *el)
-	: EventObject (Type::MEDIAPLAYER)
+	: EventObject (Type::MEDIAPLAYER), cache (RenderCacheMedia, RENDER_CACHE_COST_LOW)
 {
 	LOG_MEDIAPLAYER ("MediaPlayer::MediaPlayer (%p, id=%i), id=%i\n", el, GET_OBJ_ID (el), GET_OBJ_ID (this));
 
@@ -945,6 +945,7 @@ MediaPlayer::GetSurface (Context *ctx)
 
 	ctx->Pop (&surface);
 	ctx->Replace (&cache, surface);
+	cache.Add ((gint64) frame->GetWidth () * frame->GetHeight () * 4);
 	surface->unref ();
 
 	return ctx->Lookup (&cache);
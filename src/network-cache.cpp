@@ -0,0 +1,718 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * network-cache.cpp: a persistent disk cache for http requests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
+
+#include "network-cache.h"
+#include "network.h"
+#include "debug.h"
+#include "utils.h"
+
+#define HTTP_CACHE_INDEX_VERSION "moonlight-http-cache 1"
+#define HTTP_CACHE_DEFAULT_SIZE (200 * 1024 * 1024)
+/* How often the index is written to disk (besides at shutdown) */
+#define HTTP_CACHE_SAVE_INTERVAL 32
+/* Files in the cache directory we don't know about are removed after this many seconds
+ * (they might belong to another process which hasn't saved its index yet) */
+#define HTTP_CACHE_ORPHAN_AGE (24 * 60 * 60)
+/* The longest heuristic freshness lifetime we assign (RFC 2616, 13.2.4) */
+#define HTTP_CACHE_MAX_HEURISTIC_AGE (24 * 60 * 60)
+
+namespace Moonlight {
+
+/*
+ * HTTP date parsing (RFC 2616, 3.3.1)
+ */
+
+static const char *months [] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+static int
+parse_month (const char *str)
+{
+	for (int i = 0; i < 12; i++) {
+		if (!g_ascii_strncasecmp (str, months [i], 3))
+			return i + 1;
+	}
+	return -1;
+}
+
+/* Days since 1970-01-01 for a date in the proleptic Gregorian calendar */
+static gint64
+days_from_civil (gint64 y, int m, int d)
+{
+	y -= m <= 2;
+	gint64 era = (y >= 0 ? y : y - 399) / 400;
+	gint64 yoe = y - era * 400;
+	gint64 doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	gint64 doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+gint64
+parse_http_date (const char *value)
+{
+	char month [4];
+	int year, day, hour, min, sec;
+	const char *ptr;
+	int m;
+
+	if (value == NULL)
+		return -1;
+
+	if ((ptr = strchr (value, ',')) != NULL) {
+		ptr++;
+		if (sscanf (ptr, " %d %3s %d %d:%d:%d", &day, month, &year, &hour, &min, &sec) == 6) {
+			/* rfc 1123: Sun, 06 Nov 1994 08:49:37 GMT */
+		} else if (sscanf (ptr, " %d-%3s-%d %d:%d:%d", &day, month, &year, &hour, &min, &sec) == 6) {
+			/* rfc 850: Sunday, 06-Nov-94 08:49:37 GMT */
+			if (year < 100)
+				year += year < 70 ? 2000 : 1900;
+		} else {
+			return -1;
+		}
+	} else {
+		/* asctime: Sun Nov  6 08:49:37 1994 */
+		char wday [4];
+		if (sscanf (value, "%3s %3s %d %d:%d:%d %d", wday, month, &day, &hour, &min, &sec, &year) != 7)
+			return -1;
+	}
+
+	month [3] = 0;
+	if ((m = parse_month (month)) == -1)
+		return -1;
+
+	if (day < 1 || day > 31 || hour < 0 || hour > 23 || min < 0 || min > 59 || sec < 0 || sec > 60)
+		return -1;
+
+	return days_from_civil (year, m, day) * 86400 + hour * 3600 + min * 60 + sec;
+}
+
+/*
+ * HttpCacheEntry
+ */
+
+HttpCacheEntry::HttpCacheEntry ()
+{
+	key = NULL;
+	object = NULL;
+	size = 0;
+	expires = 0;
+	last_used = 0;
+	etag = NULL;
+	last_modified = NULL;
+	content_type = NULL;
+	pinned = false;
+}
+
+HttpCacheEntry::~HttpCacheEntry ()
+{
+	g_free (key);
+	g_free (object);
+	g_free (etag);
+	g_free (last_modified);
+	g_free (content_type);
+}
+
+/*
+ * HttpCache
+ */
+
+HttpCache *HttpCache::instance = NULL;
+bool HttpCache::disabled = false;
+
+HttpCache::HttpCache (const char *dir, gint64 max_size)
+{
+	this->dir = g_strdup (dir);
+	this->max_size = max_size;
+	objects_dir = g_build_filename (dir, "objects", NULL);
+	index_path = g_build_filename (dir, "index", NULL);
+	total_size = 0;
+	print_stats = false;
+	changes = 0;
+
+	entries = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, NULL);
+	objects = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	retired = NULL;
+
+	hits = 0;
+	revalidations = 0;
+	misses = 0;
+	stores = 0;
+	evictions = 0;
+	bytes_saved = 0;
+}
+
+static void
+delete_entry (gpointer key, gpointer value, gpointer user_data)
+{
+	delete (HttpCacheEntry *) value;
+}
+
+HttpCache::~HttpCache ()
+{
+	g_hash_table_foreach (entries, delete_entry, NULL);
+	g_hash_table_destroy (entries);
+	g_hash_table_destroy (objects);
+	for (GSList *l = retired; l != NULL; l = l->next)
+		delete (HttpCacheEntry *) l->data;
+	g_slist_free (retired);
+	g_free (dir);
+	g_free (objects_dir);
+	g_free (index_path);
+}
+
+HttpCache *
+HttpCache::GetInstance ()
+{
+	const char *env;
+	char *dir = NULL;
+	gint64 max_size = HTTP_CACHE_DEFAULT_SIZE;
+	bool print_stats = false;
+
+	VERIFY_MAIN_THREAD;
+
+	if (instance != NULL || disabled)
+		return instance;
+
+	/* MOONLIGHT_HTTP_CACHE=no or MOONLIGHT_HTTP_CACHE=size=<megabytes>,dir=<path>,stats=yes */
+	if ((env = g_getenv ("MOONLIGHT_HTTP_CACHE")) != NULL) {
+		char **options = g_strsplit (env, ",", -1);
+		for (int i = 0; options [i] != NULL; i++) {
+			const char *option = options [i];
+			if (!strcmp (option, "no") || !strcmp (option, "0")) {
+				max_size = 0;
+			} else if (!strncmp (option, "size=", 5)) {
+				max_size = (gint64) atoi (option + 5) * 1024 * 1024;
+			} else if (!strncmp (option, "dir=", 4)) {
+				g_free (dir);
+				dir = g_strdup (option + 4);
+			} else if (!strcmp (option, "stats=yes")) {
+				print_stats = true;
+			} else {
+				printf ("Moonlight: unknown MOONLIGHT_HTTP_CACHE option: '%s'\n", option);
+			}
+		}
+		g_strfreev (options);
+	}
+
+	if (max_size <= 0) {
+		LOG_DOWNLOADER ("HttpCache::GetInstance (): the http cache is disabled.\n");
+		disabled = true;
+		g_free (dir);
+		return NULL;
+	}
+
+	if (dir == NULL)
+		dir = g_build_filename (g_get_user_cache_dir (), "moonlight", "http", NULL);
+
+	instance = new HttpCache (dir, max_size);
+	instance->print_stats = print_stats;
+	g_free (dir);
+
+	if (g_mkdir_with_parents (instance->objects_dir, 0700) == -1) {
+		printf ("Moonlight: could not create the http cache directory '%s': %s\n", instance->objects_dir, strerror (errno));
+		delete instance;
+		instance = NULL;
+		disabled = true;
+		return NULL;
+	}
+
+	instance->Load ();
+	instance->RemoveOrphans ();
+
+	LOG_DOWNLOADER ("HttpCache::GetInstance (): using %s with %u entries (%" G_GINT64_FORMAT " of %" G_GINT64_FORMAT " bytes)\n",
+		instance->dir, g_hash_table_size (instance->entries), instance->total_size, instance->max_size);
+
+	return instance;
+}
+
+void
+HttpCache::Shutdown ()
+{
+	if (instance == NULL)
+		return;
+
+	instance->Save ();
+	if (instance->print_stats)
+		instance->PrintStatistics ();
+
+	delete instance;
+	instance = NULL;
+}
+
+void
+HttpCache::PrintStatistics ()
+{
+	printf ("Moonlight: http cache: %u hits, %u revalidated, %u misses (%.1f%% hit rate), %" G_GINT64_FORMAT " bytes saved, "
+		"%u stored, %u evicted, %u entries using %" G_GINT64_FORMAT " bytes.\n",
+		hits, revalidations, misses, 100.0 * GetHitRate (), bytes_saved,
+		stores, evictions, g_hash_table_size (entries), total_size);
+}
+
+void
+HttpCache::AddEntry (HttpCacheEntry *entry)
+{
+	gpointer orig_key, count;
+
+	g_hash_table_insert (entries, entry->key, entry);
+
+	if (g_hash_table_lookup_extended (objects, entry->object, &orig_key, &count)) {
+		g_hash_table_insert (objects, g_strdup (entry->object), GINT_TO_POINTER (GPOINTER_TO_INT (count) + 1));
+	} else {
+		g_hash_table_insert (objects, g_strdup (entry->object), GINT_TO_POINTER (1));
+		total_size += entry->size;
+	}
+}
+
+void
+HttpCache::RemoveEntry (HttpCacheEntry *entry, bool unlink_object)
+{
+	int count;
+
+	g_hash_table_remove (entries, entry->key);
+
+	count = GPOINTER_TO_INT (g_hash_table_lookup (objects, entry->object)) - 1;
+	if (count > 0) {
+		g_hash_table_insert (objects, g_strdup (entry->object), GINT_TO_POINTER (count));
+	} else {
+		/* No other uri has the same contents */
+		if (unlink_object) {
+			char *path = GetPath (entry);
+			g_unlink (path);
+			g_free (path);
+		}
+		g_hash_table_remove (objects, entry->object);
+		total_size -= entry->size;
+	}
+
+	Changed ();
+}
+
+void
+HttpCache::Changed ()
+{
+	if (++changes >= HTTP_CACHE_SAVE_INTERVAL)
+		Save ();
+}
+
+void
+HttpCache::Load ()
+{
+	char *contents;
+	char **lines;
+	gint64 now = time (NULL);
+
+	if (!g_file_get_contents (index_path, &contents, NULL, NULL))
+		return;
+
+	lines = g_strsplit (contents, "\n", -1);
+	g_free (contents);
+
+	if (lines [0] == NULL || strcmp (lines [0], HTTP_CACHE_INDEX_VERSION)) {
+		LOG_DOWNLOADER ("HttpCache::Load (): ignoring index with unknown version\n");
+		g_strfreev (lines);
+		return;
+	}
+
+	for (int i = 1; lines [i] != NULL; i++) {
+		/* key object size expires last_used etag last_modified content_type */
+		char **fields = g_strsplit (lines [i], "\t", -1);
+		struct stat st;
+
+		if (g_strv_length (fields) == 8 && g_hash_table_lookup (entries, fields [0]) == NULL) {
+			HttpCacheEntry *entry = new HttpCacheEntry ();
+			char *path;
+
+			entry->key = g_strdup (fields [0]);
+			entry->object = g_strdup (fields [1]);
+			entry->size = g_ascii_strtoll (fields [2], NULL, 10);
+			entry->expires = g_ascii_strtoll (fields [3], NULL, 10);
+			entry->last_used = MIN (now, g_ascii_strtoll (fields [4], NULL, 10));
+			entry->etag = fields [5][0] ? g_strdup (fields [5]) : NULL;
+			entry->last_modified = fields [6][0] ? g_strdup (fields [6]) : NULL;
+			entry->content_type = fields [7][0] ? g_strdup (fields [7]) : NULL;
+
+			/* Skip entries whose object has been removed or has been truncated */
+			path = GetPath (entry);
+			if (g_stat (path, &st) == 0 && st.st_size == entry->size) {
+				AddEntry (entry);
+			} else {
+				delete entry;
+			}
+			g_free (path);
+		}
+
+		g_strfreev (fields);
+	}
+
+	g_strfreev (lines);
+
+	if (total_size > max_size)
+		Evict (0);
+}
+
+static void
+save_entry (gpointer key, gpointer value, gpointer user_data)
+{
+	HttpCacheEntry *entry = (HttpCacheEntry *) value;
+	GString *str = (GString *) user_data;
+
+	g_string_append_printf (str, "%s\t%s\t%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT "\t%s\t%s\t%s\n",
+		entry->key, entry->object, entry->size, entry->expires, entry->last_used,
+		entry->etag ? entry->etag : "", entry->last_modified ? entry->last_modified : "",
+		entry->content_type ? entry->content_type : "");
+}
+
+void
+HttpCache::Save ()
+{
+	GString *str;
+	GError *err = NULL;
+
+	if (changes == 0)
+		return;
+
+	str = g_string_new (HTTP_CACHE_INDEX_VERSION "\n");
+	g_hash_table_foreach (entries, save_entry, str);
+
+	/* g_file_set_contents writes to a temporary file and renames it, so the index is never half-written */
+	if (!g_file_set_contents (index_path, str->str, str->len, &err)) {
+		printf ("Moonlight: could not save the http cache index '%s': %s\n", index_path, err->message);
+		g_error_free (err);
+	} else {
+		changes = 0;
+	}
+
+	g_string_free (str, true);
+}
+
+void
+HttpCache::RemoveOrphans ()
+{
+	const char *name;
+	GDir *gdir;
+	gint64 now = time (NULL);
+	struct stat st;
+
+	if (!(gdir = g_dir_open (objects_dir, 0, NULL)))
+		return;
+
+	while ((name = g_dir_read_name (gdir)) != NULL) {
+		if (g_hash_table_lookup (objects, name) != NULL)
+			continue;
+
+		char *path = g_build_filename (objects_dir, name, NULL);
+		if (g_stat (path, &st) == 0 && now - st.st_mtime > HTTP_CACHE_ORPHAN_AGE) {
+			LOG_DOWNLOADER ("HttpCache::RemoveOrphans (): removing %s\n", path);
+			g_unlink (path);
+		}
+		g_free (path);
+	}
+
+	g_dir_close (gdir);
+}
+
+static gint
+compare_last_used (gconstpointer a, gconstpointer b)
+{
+	gint64 la = (*(HttpCacheEntry **) a)->last_used;
+	gint64 lb = (*(HttpCacheEntry **) b)->last_used;
+
+	return la < lb ? -1 : (la > lb ? 1 : 0);
+}
+
+static void
+collect_entry (gpointer key, gpointer value, gpointer user_data)
+{
+	if (!((HttpCacheEntry *) value)->pinned)
+		g_ptr_array_add ((GPtrArray *) user_data, value);
+}
+
+void
+HttpCache::Evict (gint64 needed)
+{
+	GPtrArray *candidates;
+	/* Evict down to 90% so that we don't have to do this again on every store */
+	gint64 target = max_size - max_size / 10 - needed;
+
+	candidates = g_ptr_array_new ();
+	g_hash_table_foreach (entries, collect_entry, candidates);
+	g_ptr_array_sort (candidates, compare_last_used);
+
+	for (guint i = 0; i < candidates->len && total_size > target; i++) {
+		HttpCacheEntry *entry = (HttpCacheEntry *) candidates->pdata [i];
+		LOG_DOWNLOADER ("HttpCache::Evict (): evicting %s (%" G_GINT64_FORMAT " bytes)\n", entry->key, entry->size);
+		evictions++;
+		RemoveEntry (entry, true);
+		delete entry;
+	}
+
+	g_ptr_array_free (candidates, true);
+}
+
+HttpCacheEntry *
+HttpCache::Lookup (const char *key, bool *fresh)
+{
+	HttpCacheEntry *entry;
+	gint64 now = time (NULL);
+
+	VERIFY_MAIN_THREAD;
+
+	entry = (HttpCacheEntry *) g_hash_table_lookup (entries, key);
+	if (entry == NULL) {
+		misses++;
+		*fresh = false;
+		return NULL;
+	}
+
+	entry->pinned = true;
+	entry->last_used = now;
+	*fresh = now < entry->expires;
+
+	if (*fresh) {
+		hits++;
+		bytes_saved += entry->size;
+	}
+
+	LOG_DOWNLOADER ("HttpCache::Lookup (%s): found %s, fresh: %i\n", key, entry->object, *fresh);
+
+	return entry;
+}
+
+char *
+HttpCache::GetPath (HttpCacheEntry *entry)
+{
+	return g_build_filename (objects_dir, entry->object, NULL);
+}
+
+HttpResponse *
+HttpCache::CreateResponse (HttpCacheEntry *entry, HttpRequest *request)
+{
+	HttpResponse *response = new HttpResponse (request);
+	char *length;
+
+	response->SetStatus (200, "OK");
+	length = g_strdup_printf ("%" G_GINT64_FORMAT, entry->size);
+	response->AppendHeader ("Content-Length", length);
+	g_free (length);
+	if (entry->content_type != NULL)
+		response->AppendHeader ("Content-Type", entry->content_type);
+	if (entry->etag != NULL)
+		response->AppendHeader ("ETag", entry->etag);
+	if (entry->last_modified != NULL)
+		response->AppendHeader ("Last-Modified", entry->last_modified);
+
+	return response;
+}
+
+/* Returns the time (seconds since the epoch) the response stops being fresh */
+gint64
+HttpCache::GetExpiration (HttpResponse *response, gint64 now, bool *cacheable)
+{
+	const char *cache_control = response->GetHeader ("Cache-Control");
+	const char *pragma = response->GetHeader ("Pragma");
+	const char *vary = response->GetHeader ("Vary");
+	const char *expires;
+	const char *last_modified;
+	gint64 date;
+	gint64 result = -1;
+	bool no_cache = false;
+
+	*cacheable = false;
+
+	/* We don't store the request headers, so we can only vary on the encoding (which curl and the browser handle) */
+	if (vary != NULL && g_ascii_strcasecmp (vary, "Accept-Encoding"))
+		return 0;
+
+	if (cache_control != NULL) {
+		char **directives = g_strsplit (cache_control, ",", -1);
+		for (int i = 0; directives [i] != NULL; i++) {
+			char *directive = g_strstrip (directives [i]);
+			if (!g_ascii_strcasecmp (directive, "no-store")) {
+				g_strfreev (directives);
+				return 0;
+			} else if (!g_ascii_strncasecmp (directive, "no-cache", 8)) {
+				no_cache = true;
+			} else if (!g_ascii_strncasecmp (directive, "max-age=", 8)) {
+				result = now + MAX (0, g_ascii_strtoll (directive + 8, NULL, 10));
+			}
+		}
+		g_strfreev (directives);
+	}
+
+	if (pragma != NULL && strstr (pragma, "no-cache") != NULL)
+		no_cache = true;
+
+	/* Correct for clock skew between us and the server by using the server's date as the base */
+	if ((date = parse_http_date (response->GetHeader ("Date"))) == -1)
+		date = now;
+
+	if (no_cache) {
+		/* We may store it, but it must be revalidated every time */
+		result = 0;
+	} else if (result == -1 && (expires = response->GetHeader ("Expires")) != NULL) {
+		gint64 value = parse_http_date (expires);
+		/* An invalid date (like "0") means already expired */
+		result = value == -1 ? 0 : now + (value - date);
+	} else if (result == -1 && (last_modified = response->GetHeader ("Last-Modified")) != NULL) {
+		gint64 value = parse_http_date (last_modified);
+		/* No explicit expiration, use 10% of the time since the document was modified (RFC 2616, 13.2.4) */
+		if (value != -1 && value < date)
+			result = now + MIN ((date - value) / 10, HTTP_CACHE_MAX_HEURISTIC_AGE);
+	}
+
+	if (result == -1)
+		result = 0;
+
+	/* Without a validator, a response which is already stale is useless */
+	*cacheable = result > now || response->GetHeader ("ETag") != NULL || response->GetHeader ("Last-Modified") != NULL;
+
+	return result;
+}
+
+void
+HttpCache::Revalidated (HttpCacheEntry *entry, HttpResponse *response)
+{
+	const char *etag;
+	bool cacheable;
+
+	VERIFY_MAIN_THREAD;
+
+	entry->expires = GetExpiration (response, time (NULL), &cacheable);
+	if ((etag = response->GetHeader ("ETag")) != NULL) {
+		g_free (entry->etag);
+		entry->etag = g_strdup (etag);
+	}
+
+	revalidations++;
+	bytes_saved += entry->size;
+	Changed ();
+
+	LOG_DOWNLOADER ("HttpCache::Revalidated (%s): expires in %" G_GINT64_FORMAT " seconds\n", entry->key, entry->expires - (gint64) time (NULL));
+}
+
+bool
+HttpCache::Store (const char *key, HttpResponse *response, const char *filename, const char *checksum, gint64 size)
+{
+	HttpCacheEntry *entry;
+	gint64 now = time (NULL);
+	gint64 expires;
+	bool cacheable;
+	char *path;
+
+	VERIFY_MAIN_THREAD;
+
+	if (response == NULL || response->GetResponseStatus () != 200)
+		return false;
+
+	/* The index is line and tab separated */
+	if (strpbrk (key, "\t\r\n") != NULL)
+		return false;
+
+	expires = GetExpiration (response, now, &cacheable);
+	if (!cacheable || size > GetMaxObjectSize ()) {
+		/* A new response replaces what we had, even if we can't store it */
+		Remove (key);
+		return false;
+	}
+
+	entry = new HttpCacheEntry ();
+	entry->key = g_strdup (key);
+	entry->object = g_strdup (checksum);
+	entry->size = size;
+	entry->expires = expires;
+	entry->last_used = now;
+	entry->etag = g_strdup (response->GetHeader ("ETag"));
+	entry->last_modified = g_strdup (response->GetHeader ("Last-Modified"));
+	entry->content_type = g_strdup (response->GetHeader ("Content-Type"));
+	entry->pinned = true;
+
+	/* Forget what we had for this key before looking for the contents, the new response might be identical */
+	Remove (key);
+
+	path = GetPath (entry);
+
+	if (g_hash_table_lookup (objects, checksum) == NULL) {
+		/* We don't have these contents yet, make room and add them */
+		if (total_size + size > max_size)
+			Evict (size);
+
+		/* A hard link is free when the download went to the same filesystem. If the
+		 * object exists already (unindexed), it has the same contents by definition. */
+		if (link (filename, path) == -1 && errno != EEXIST) {
+			int fd = g_open (path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+			if (fd == -1 || CopyFileTo (filename, fd) == -1) {
+				LOG_DOWNLOADER ("HttpCache::Store (%s): could not copy %s to %s: %s\n", key, filename, path, strerror (errno));
+				g_unlink (path);
+				g_free (path);
+				delete entry;
+				return false;
+			}
+		}
+	}
+	g_free (path);
+
+	AddEntry (entry);
+	stores++;
+	Changed ();
+
+	LOG_DOWNLOADER ("HttpCache::Store (%s): stored %" G_GINT64_FORMAT " bytes as %s, expires in %" G_GINT64_FORMAT " seconds\n",
+		key, size, checksum, expires - now);
+
+	return true;
+}
+
+void
+HttpCache::Remove (const char *key)
+{
+	HttpCacheEntry *entry = (HttpCacheEntry *) g_hash_table_lookup (entries, key);
+
+	if (entry == NULL)
+		return;
+
+	if (entry->pinned) {
+		/* The entry and its file may still be in use. The file is left unindexed
+		 * (RemoveOrphans will eventually find it), and the entry freed at shutdown. */
+		RemoveEntry (entry, false);
+		retired = g_slist_prepend (retired, entry);
+	} else {
+		RemoveEntry (entry, true);
+		delete entry;
+	}
+}
+
+int
+HttpCache::CreateTemporaryFile (char **path)
+{
+	char *templ = g_build_filename (objects_dir, "tmp-XXXXXX", NULL);
+	int fd = g_mkstemp (templ);
+
+	if (fd == -1) {
+		g_free (templ);
+		*path = NULL;
+		return -1;
+	}
+
+	*path = templ;
+	return fd;
+}
+
+};
@@ -0,0 +1,135 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * network-cache.h: a persistent disk cache for http requests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#ifndef __MOON_NETWORK_CACHE_H__
+#define __MOON_NETWORK_CACHE_H__
+
+#include <glib.h>
+
+namespace Moonlight {
+
+class HttpRequest;
+class HttpResponse;
+
+/*
+ * HttpCacheEntry
+ */
+
+class HttpCacheEntry {
+public:
+	char *key; /* the request uri */
+	char *object; /* sha1 of the contents, which is also the name of the file in the cache */
+	gint64 size;
+	gint64 expires; /* seconds since the epoch, the entry must be revalidated after this */
+	gint64 last_used; /* seconds since the epoch */
+	char *etag;
+	char *last_modified;
+	char *content_type;
+	bool pinned; /* the file has been handed out in this process, it must not be evicted */
+
+	HttpCacheEntry ();
+	~HttpCacheEntry ();
+
+	bool HasValidator () { return etag != NULL || last_modified != NULL; }
+};
+
+/*
+ * HttpCache
+ *   A size-bounded, content-addressed cache of http responses which outlives the process.
+ *   Objects are stored by the sha1 of their contents (so identical files requested
+ *   with different uris are only stored once), and an index maps uris to objects.
+ *
+ *   It must only be used from the main thread.
+ *
+ *   Configured with MOONLIGHT_HTTP_CACHE=no to disable it, or
+ *   MOONLIGHT_HTTP_CACHE=size=<megabytes>,dir=<path>,stats=yes
+ */
+
+class HttpCache {
+private:
+	char *dir;
+	char *objects_dir;
+	char *index_path;
+	gint64 max_size;
+	gint64 total_size;
+	bool print_stats;
+	int changes; /* modifications since the index was last saved */
+
+	GHashTable *entries; /* key -> HttpCacheEntry */
+	GHashTable *objects; /* object -> number of entries referencing it */
+	GSList *retired; /* pinned entries which have been replaced, freed at shutdown */
+
+	/* statistics */
+	guint32 hits;
+	guint32 revalidations;
+	guint32 misses;
+	guint32 stores;
+	guint32 evictions;
+	gint64 bytes_saved;
+
+	static HttpCache *instance;
+	static bool disabled;
+
+	HttpCache (const char *dir, gint64 max_size);
+
+	void Load ();
+	void Save ();
+	void RemoveOrphans ();
+	void AddEntry (HttpCacheEntry *entry);
+	void RemoveEntry (HttpCacheEntry *entry, bool unlink_object);
+	void Evict (gint64 needed);
+	void Changed ();
+
+public:
+	~HttpCache ();
+
+	/* Returns NULL if the cache is disabled or couldn't be created */
+	static HttpCache *GetInstance ();
+	static void Shutdown ();
+
+	/* Returns NULL if there is no entry for the key. The entry is pinned and stays valid until shutdown.
+	 * 'fresh' is set to false if the entry must be revalidated before it can be used. */
+	HttpCacheEntry *Lookup (const char *key, bool *fresh);
+	/* The caller must free the path */
+	char *GetPath (HttpCacheEntry *entry);
+	/* Creates a response with the cached headers (content type and validators) */
+	HttpResponse *CreateResponse (HttpCacheEntry *entry, HttpRequest *request);
+
+	/* The server said the entry is still valid (304), update its expiration */
+	void Revalidated (HttpCacheEntry *entry, HttpResponse *response);
+	/* Stores (a copy of, or a hard link to) 'filename' as the response for 'key', if the response may be cached. */
+	bool Store (const char *key, HttpResponse *response, const char *filename, const char *checksum, gint64 size);
+	void Remove (const char *key);
+
+	/* Creates a private file in the cache directory to download into, returns the fd (or -1). The caller must free the path */
+	int CreateTemporaryFile (char **path);
+
+	/* Responses larger than this are never stored */
+	gint64 GetMaxObjectSize () { return max_size / 4; }
+
+	guint32 GetHits () { return hits; }
+	guint32 GetRevalidations () { return revalidations; }
+	guint32 GetMisses () { return misses; }
+	gint64 GetBytesSaved () { return bytes_saved; }
+	double GetHitRate () { return hits + revalidations + misses == 0 ? 0.0 : (double) (hits + revalidations) / (hits + revalidations + misses); }
+	void PrintStatistics ();
+
+	/* Returns the time (seconds since the epoch) the response stops being fresh, 'cacheable' is set to
+	 * false if the response must not be stored */
+	static gint64 GetExpiration (HttpResponse *response, gint64 now, bool *cacheable);
+};
+
+/* Returns the seconds since the epoch, or -1 if the date couldn't be parsed */
+gint64 parse_http_date (const char *value);
+
+};
+#endif /* __MOON_NETWORK_CACHE_H__ */
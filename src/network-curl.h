@@ -125,6 +125,7 @@ class CurlDownloaderRequest : public HttpRequest {
 	virtual void SendImpl ();
 	virtual void SetHeaderImpl (const char *name, const char *value, bool disable_folding);
 	virtual void SetBodyImpl (const void *ptr, guint32 size);
+	virtual bool CanSetHeaders () { return true; }
 
 	bool isPost () { return strstr (GetVerb (), "POST"); }
 	void Close (CURLcode curl_code);
@@ -16,8 +16,10 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <glib/gstdio.h>
 
 #include "network.h"
+#include "network-cache.h"
 #include "debug.h"
 #include "deployment.h"
 #include "utils.h"
@@ -51,6 +53,11 @@ HttpRequest::HttpRequest (Type::Kind type, HttpHandler *handler, HttpRequest::Op
 	access_policy = (DownloaderAccessPolicy) -1;
 	local_file = NULL;
 	is_cross_domain = false;
+	cache_state = CacheNone;
+	cache_entry = NULL;
+	cache_checksum = NULL;
+	cache_tmpfile = NULL;
+	cache_tmpfile_fd = -1;
 }
 
 HttpRequest::~HttpRequest ()
@@ -101,6 +108,16 @@ HttpRequest::Dispose ()
 	g_free (local_file);
 	local_file = NULL;
 
+	if (cache_checksum != NULL) {
+		g_checksum_free (cache_checksum);
+		cache_checksum = NULL;
+	}
+
+	CloseCacheTemporaryFile ();
+
+	/* The cache owns the entry */
+	cache_entry = NULL;
+
 	EventObject::Dispose ();
 }
 
@@ -252,64 +269,18 @@ HttpRequest::SendAsync ()
 
 	if (local_file != NULL) {
 		LOG_DOWNLOADER ("HttpRequest::Send (): we're serving the local file: '%s' without going through a network/browser bridge\n", local_file);
-		tmpfile = g_strdup (local_file);
-		tmpfile_fd = open (local_file, O_RDONLY);
-		if (tmpfile_fd == -1) {
-			char *msg = g_strdup_printf ("Failed to open '%s': %s\n", local_file, strerror (errno));
-			Failed (msg);
-			g_free (msg);
-			return;
-		}
-
-		/* Get the size of the file */
-		gint64 file_size;
-		file_size = lseek (tmpfile_fd, 0, SEEK_END);
-		if (file_size < 0) {
-			char *msg = g_strdup_printf ("Failed to get size of file '%s': %s\n", local_file, strerror (errno));
-			Failed (msg);
-			g_free (msg);
-			return;
-		};
-
-		if (lseek (tmpfile_fd, 0, SEEK_SET) != 0) {
-			char *msg = g_strdup_printf ("Failed to seek to beginning of file '%s': %s\n", local_file, strerror (errno));
-			Failed (msg);
-			g_free (msg);
-			return;
-		}
 
-		NotifySize (file_size);
-
-		/* File is here and we can report start request */
 		HttpResponse *response = new HttpResponse (this);
 		response->SetStatus (200, "OK"); /* Not sure if this is expected or not */
-		Started (response);
+		ServeFile (local_file, response);
 		response->unref ();
-
-		/* TODO: Opt-in for write events unless we're serving a local file. */
-		/* Serve the file if needed */
-		if (HasHandlers (WriteEvent)) {
-			void *buffer = g_malloc (4096);
-			int n;
-			while ((n = read (tmpfile_fd, buffer, 4096)) > 0) {
-				Write (-1, buffer, n);
-			}
-			g_free (buffer);
-			if (n == -1) {
-				char *msg = g_strdup_printf ("Could not read from '%s': %s\n", local_file, strerror (errno));
-				Failed (msg);
-				g_free (msg);
+	} else {
+		if (IsCacheable ()) {
+			SendCached ();
+			if (cache_state == CacheHit)
 				return;
-			}
 		}
 
-		if (HasHandlers (ProgressChangedEvent)) {
-			Emit (ProgressChangedEvent, new HttpRequestProgressChangedEventArgs (1.0));
-		}
-
-		/* We're done */
-		Succeeded ();
-	} else {
 		/* create tmp file */
 		if ((options & DisableFileStorage) == 0) {
 			const char *dir = handler->GetDownloadDir ();
@@ -332,6 +303,13 @@ HttpRequest::SendAsync ()
 		} else {
 			LOG_DOWNLOADER ("HttpRequest::Send () uri %s is not being saved to disk\n", GetUri ()->ToString ());
 		}
+
+		if (cache_state != CacheNone && tmpfile_fd == -1) {
+			/* We need the response on disk to be able to cache it */
+			cache_tmpfile_fd = HttpCache::GetInstance ()->CreateTemporaryFile (&cache_tmpfile);
+			if (cache_tmpfile_fd == -1)
+				cache_state = CacheNone;
+		}
 	}
 
 #if DEBUG
@@ -342,6 +320,195 @@ HttpRequest::SendAsync ()
 		SendImpl ();
 }
 
+bool
+HttpRequest::ServeFile (const char *path, HttpResponse *response)
+{
+	gint64 file_size;
+
+	g_free (tmpfile);
+	tmpfile = g_strdup (path);
+	tmpfile_fd = open (path, O_RDONLY);
+	if (tmpfile_fd == -1) {
+		char *msg = g_strdup_printf ("Failed to open '%s': %s\n", path, strerror (errno));
+		Failed (msg);
+		g_free (msg);
+		return false;
+	}
+
+	/* Get the size of the file */
+	file_size = lseek (tmpfile_fd, 0, SEEK_END);
+	if (file_size < 0) {
+		char *msg = g_strdup_printf ("Failed to get size of file '%s': %s\n", path, strerror (errno));
+		Failed (msg);
+		g_free (msg);
+		return false;
+	};
+
+	if (lseek (tmpfile_fd, 0, SEEK_SET) != 0) {
+		char *msg = g_strdup_printf ("Failed to seek to beginning of file '%s': %s\n", path, strerror (errno));
+		Failed (msg);
+		g_free (msg);
+		return false;
+	}
+
+	NotifySize (file_size);
+
+	/* File is here and we can report start request */
+	Started (response);
+
+	/* TODO: Opt-in for write events unless we're serving a local file. */
+	/* Serve the file if needed */
+	if (!WriteFile ())
+		return false;
+
+	written_size = file_size;
+
+	if (HasHandlers (ProgressChangedEvent)) {
+		Emit (ProgressChangedEvent, new HttpRequestProgressChangedEventArgs (1.0));
+	}
+
+	/* We're done */
+	Succeeded ();
+
+	return true;
+}
+
+/* Emits write events for the contents of tmpfile_fd (from the current position) */
+bool
+HttpRequest::WriteFile ()
+{
+	void *buffer;
+	int n;
+
+	if (!HasHandlers (WriteEvent))
+		return true;
+
+	buffer = g_malloc (4096);
+	while ((n = read (tmpfile_fd, buffer, 4096)) > 0) {
+		Write (-1, buffer, n);
+	}
+	g_free (buffer);
+	if (n == -1) {
+		char *msg = g_strdup_printf ("Could not read from '%s': %s\n", tmpfile, strerror (errno));
+		Failed (msg);
+		g_free (msg);
+		return false;
+	}
+
+	return true;
+}
+
+bool
+HttpRequest::IsCacheable ()
+{
+	if (local_file != NULL || verb == NULL || strcmp (verb, "GET"))
+		return false;
+
+	/* Custom headers means range requests (and other things we don't want to store) */
+	if (options & (DisableCache | CustomHeaders))
+		return false;
+
+	return request_uri->IsScheme ("http") || request_uri->IsScheme ("https");
+}
+
+void
+HttpRequest::SendCached ()
+{
+	HttpCache *cache = HttpCache::GetInstance ();
+	const char *key = request_uri->ToString ();
+	bool fresh;
+
+	if (cache == NULL)
+		return;
+
+	cache_entry = cache->Lookup (key, &fresh);
+
+	if (cache_entry != NULL) {
+		char *path = cache->GetPath (cache_entry);
+		if (!g_file_test (path, G_FILE_TEST_EXISTS)) {
+			/* Somebody else removed it */
+			cache->Remove (key);
+			cache_entry = NULL;
+		} else if (fresh) {
+			/* Hand out the cached file directly, no need to copy it */
+			LOG_DOWNLOADER ("HttpRequest::SendCached (): serving %s from %s\n", key, path);
+			HttpResponse *response = cache->CreateResponse (cache_entry, this);
+			cache_state = CacheHit;
+			ServeFile (path, response);
+			response->unref ();
+			g_free (path);
+			return;
+		}
+		g_free (path);
+	}
+
+	if (cache_entry != NULL && cache_entry->HasValidator () && CanSetHeaders ()) {
+		LOG_DOWNLOADER ("HttpRequest::SendCached (): revalidating %s\n", key);
+		if (cache_entry->etag != NULL)
+			SetHeader ("If-None-Match", cache_entry->etag, false);
+		if (cache_entry->last_modified != NULL)
+			SetHeader ("If-Modified-Since", cache_entry->last_modified, false);
+		cache_state = CacheRevalidating;
+	} else {
+		cache_state = CacheMiss;
+	}
+
+	cache_checksum = g_checksum_new (G_CHECKSUM_SHA1);
+}
+
+void
+HttpRequest::StoreInCache ()
+{
+	const char *path = tmpfile_fd != -1 ? tmpfile : cache_tmpfile;
+	guint64 content_length;
+
+	if (response == NULL || path == NULL)
+		return;
+
+	/* Don't store truncated responses (the length doesn't match if curl decoded the content) */
+	content_length = response->GetContentLength ();
+	if (content_length != 0 && content_length != (guint64) written_size && response->GetHeader ("Content-Encoding") == NULL) {
+		LOG_DOWNLOADER ("HttpRequest::StoreInCache (): not storing %s, got %" G_GINT64_FORMAT " bytes of %" G_GUINT64_FORMAT "\n",
+			request_uri->ToString (), written_size, content_length);
+		return;
+	}
+
+	HttpCache::GetInstance ()->Store (request_uri->ToString (), response, path, g_checksum_get_string (cache_checksum), written_size);
+
+	/* The cache has its own link to (or copy of) the file now */
+	CloseCacheTemporaryFile ();
+}
+
+void
+HttpRequest::CloseCacheTemporaryFile ()
+{
+	if (cache_tmpfile_fd != -1) {
+		close (cache_tmpfile_fd);
+		cache_tmpfile_fd = -1;
+	}
+
+	if (cache_tmpfile != NULL) {
+		g_unlink (cache_tmpfile);
+		g_free (cache_tmpfile);
+		cache_tmpfile = NULL;
+	}
+}
+
+void
+HttpRequest::StopCaching ()
+{
+	HttpCache *cache = HttpCache::GetInstance ();
+
+	LOG_DOWNLOADER ("HttpRequest::StopCaching (): not caching %s, it's larger than %" G_GINT64_FORMAT " bytes\n",
+		request_uri->ToString (), cache->GetMaxObjectSize ());
+
+	cache_state = CacheNone;
+	CloseCacheTemporaryFile ();
+
+	/* A new response replaces what we had, even if we can't store it */
+	cache->Remove (request_uri->ToString ());
+}
+
 void
 HttpRequest::SendAsyncCallback (EventObject *obj)
 {
@@ -390,10 +557,29 @@ HttpRequest::Write (gint64 offset, void *buffer, gint32 length)
 	VERIFY_MAIN_THREAD;
 	LOG_DOWNLOADER ("HttpRequest::Write (%" G_GINT64_FORMAT ", %p, %i) HasHandlers: %i\n", offset, buffer, length, HasHandlers (WriteEvent));
 
+	/* Whatever the server sent with the 304, the data comes from the cache */
+	if (cache_state == CacheNotModified)
+		return;
+
+	if (cache_state == CacheMiss || cache_state == CacheRevalidating) {
+		if (offset != -1 && offset != written_size) {
+			/* We can only hash (and store) what was written sequentially */
+			LOG_DOWNLOADER ("HttpRequest::Write (): not caching %s, non-sequential write\n", request_uri->ToString ());
+			cache_state = CacheNone;
+		} else if (written_size + length > HttpCache::GetInstance ()->GetMaxObjectSize ()) {
+			/* The cache wouldn't take it, don't copy a whole video to a temporary file for nothing */
+			StopCaching ();
+		} else {
+			g_checksum_update (cache_checksum, (const guchar *) buffer, length);
+			if (cache_tmpfile_fd != -1 && write_all (cache_tmpfile_fd, (const char *) buffer, length) == -1)
+				cache_state = CacheNone;
+		}
+	}
+
 	written_size += length;
 
 	/* write to tmp file */
-	if (local_file == NULL && tmpfile_fd != -1) {
+	if (local_file == NULL && cache_state != CacheHit && tmpfile_fd != -1) {
 		if (offset != -1 && lseek (tmpfile_fd, offset, SEEK_SET) == -1) {
 			printf ("Moonlight: error while seeking to %" G_GINT64_FORMAT " in temporary file '%s': %s\n", offset, tmpfile, strerror (errno));
 		} else if (write (tmpfile_fd, buffer, length) != length) {
@@ -417,9 +603,23 @@ HttpRequest::Write (gint64 offset, void *buffer, gint32 length)
 void
 HttpRequest::Started (HttpResponse *response)
 {
+	HttpResponse *cached_response = NULL;
+
 	VERIFY_MAIN_THREAD;
 	LOG_DOWNLOADER ("HttpRequest::Started ()\n");
 
+	if (cache_state == CacheRevalidating) {
+		if (response != NULL && response->GetResponseStatus () == 304) {
+			/* Our copy is still good, pretend it's what the server sent us */
+			HttpCache *cache = HttpCache::GetInstance ();
+			cache->Revalidated (cache_entry, response);
+			cached_response = response = cache->CreateResponse (cache_entry, this);
+			cache_state = CacheNotModified;
+		} else {
+			cache_state = CacheMiss;
+		}
+	}
+
 	g_warn_if_fail (response != NULL);
 	g_warn_if_fail (this->response == NULL);
 
@@ -434,10 +634,16 @@ HttpRequest::Started (HttpResponse *response)
 		if (content_length != 0) {
 			NotifySize (content_length);
 		}
+
+		if (cache_state == CacheMiss && content_length > (guint64) HttpCache::GetInstance ()->GetMaxObjectSize ())
+			StopCaching ();
 	}
 
 	if (HasHandlers (StartedEvent))
 		Emit (StartedEvent);
+
+	if (cached_response != NULL)
+		cached_response->unref ();
 }
 
 void
@@ -537,6 +743,32 @@ HttpRequest::Succeeded ()
 	VERIFY_MAIN_THREAD;
 	LOG_DOWNLOADER ("HttpRequest::Succeeded (%s) HasHandlers: %i\n", request_uri ? request_uri->ToString () : NULL, HasHandlers (StoppedEvent));
 
+	if (cache_state == CacheNotModified) {
+		/* Replace the (empty) download with the cached file */
+		if (tmpfile_fd != -1) {
+			close (tmpfile_fd);
+			g_unlink (tmpfile);
+		}
+		g_free (tmpfile);
+		tmpfile = HttpCache::GetInstance ()->GetPath (cache_entry);
+		tmpfile_fd = open (tmpfile, O_RDONLY);
+		cache_state = CacheHit;
+
+		if (tmpfile_fd == -1) {
+			char *msg = g_strdup_printf ("Failed to open '%s': %s\n", tmpfile, strerror (errno));
+			Failed (msg);
+			g_free (msg);
+			return;
+		}
+
+		if (!WriteFile ())
+			return;
+
+		written_size = cache_entry->size;
+	} else if (cache_state == CacheMiss) {
+		StoreInCache ();
+	}
+
 	is_completed = true;
 
 	NotifySize (written_size);
@@ -757,6 +989,24 @@ HttpResponse::ContainsHeader (const char *header, const char *value)
 	return false;
 }
 
+const char *
+HttpResponse::GetHeader (const char *header)
+{
+	HttpHeader *node;
+
+	if (headers == NULL)
+		return NULL;
+
+	node = (HttpHeader *) headers->First ();
+	while (node != NULL) {
+		if (node->GetHeader () != NULL && !g_ascii_strcasecmp (node->GetHeader (), header))
+			return node->GetValue ();
+		node = (HttpHeader *) node->next;
+	}
+
+	return NULL;
+}
+
 void
 HttpResponse::SetStatus (gint32 status, const char *status_text)
 {
@@ -25,6 +25,7 @@ namespace Moonlight {
 class HttpHandler;
 class HttpRequest;
 class HttpResponse;
+class HttpCacheEntry;
 
 /*
  * HttpRequestProgressChangedEventArgs
@@ -168,6 +169,8 @@ protected:
 	virtual void AbortImpl () = 0;
 	virtual void SetBodyImpl (const void *body, guint32 length) = 0;
 	virtual void SetHeaderImpl (const char *header, const char *value, bool disable_folding) = 0;
+	/* Whether SetHeader works even if the CustomHeaders option wasn't specified (used for cache revalidation) */
+	virtual bool CanSetHeaders () { return (options & CustomHeaders) != 0; }
 
 	/* This method must be called before starting to serve any data */
 	void Started (HttpResponse *response);
@@ -205,6 +208,29 @@ private:
 	char *local_file; /* the local file we're to serve */
 	bool is_cross_domain;
 
+	/* http cache */
+	enum CacheState {
+		CacheNone, /* the request doesn't go through the cache */
+		CacheMiss, /* we're downloading, and will store the result if it can be cached */
+		CacheRevalidating, /* we've asked the server if our stale entry is still valid */
+		CacheNotModified, /* the server said it is, we ignore the (empty) body and serve the cached file */
+		CacheHit, /* we're serving the cached file */
+	};
+	CacheState cache_state;
+	HttpCacheEntry *cache_entry;
+	GChecksum *cache_checksum; /* sha1 of what we've downloaded so far */
+	char *cache_tmpfile; /* where we download to if file storage is disabled */
+	int cache_tmpfile_fd;
+
+	bool IsCacheable ();
+	void SendCached ();
+	void StoreInCache ();
+	/* The response is too large for the cache, don't keep a copy of it */
+	void StopCaching ();
+	void CloseCacheTemporaryFile ();
+	bool ServeFile (const char *path, HttpResponse *response);
+	bool WriteFile ();
+
 	bool CheckRedirectionPolicy (const Uri *url);
 	static void SendAsyncCallback (EventObject *obj);
 	void SendAsync ();
@@ -266,6 +292,8 @@ public:
 	void ParseHeaders (const char *value);
 	void AppendHeader (const char *header, const char *value);
 	bool ContainsHeader (const char *header, const char *value);
+	/* Returns the value of the first header with the given (case insensitive) name, or NULL */
+	const char *GetHeader (const char *header);
 
 	/* @GeneratePInvoke */
 	gint32 GetResponseStatus () { return response_status; }
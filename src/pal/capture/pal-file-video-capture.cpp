@@ -0,0 +1,413 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * pal-file-video-capture.cpp: a video capture device which replays raw YUV files
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+
+#include "pal/capture/pal-file-video-capture.h"
+#include "capture.h"
+#include "factory.h"
+#include "runtime.h"
+#include "clock.h"
+#include "debug.h"
+
+using namespace Moonlight;
+
+#define Y4M_MAGIC "YUV4MPEG2"
+#define Y4M_FRAME_MAGIC "FRAME"
+#define Y4M_MAX_HEADER 256
+
+/*
+ * MoonVideoCaptureServiceFile
+ */
+
+MoonVideoCaptureServiceFile::MoonVideoCaptureServiceFile (const char *options)
+{
+	this->options = g_strdup (options);
+}
+
+MoonVideoCaptureServiceFile::~MoonVideoCaptureServiceFile ()
+{
+	g_free (options);
+}
+
+void
+MoonVideoCaptureServiceFile::GetAvailableCaptureDevices (VideoCaptureDeviceCollection *col)
+{
+	MoonVideoCaptureDeviceFile *device;
+	VideoCaptureDevice *vcd;
+
+	LOG_CAPTURE ("MoonVideoCaptureServiceFile::GetAvailableCaptureDevices ()\n");
+
+	if (!(device = MoonVideoCaptureDeviceFile::CreateFromOptions (options)))
+		return;
+
+	vcd = MoonUnmanagedFactory::CreateVideoCaptureDevice ();
+	vcd->SetPalDevice (device);
+	device->SetDevice (vcd);
+	vcd->SetIsDefaultDevice (true);
+	col->Add (vcd);
+	vcd->unref ();
+
+	LOG_CAPTURE ("MoonVideoCaptureServiceFile::GetAvailableCaptureDevices (): found device: %s\n", device->GetFriendlyName ());
+}
+
+/*
+ * MoonVideoCaptureDeviceFile
+ */
+
+MoonVideoCaptureDeviceFile::MoonVideoCaptureDeviceFile (const char *filename, CaptureFrameFormat format, int width, int height, float framesPerSecond, bool y4m)
+{
+	this->filename = g_strdup (filename);
+	this->friendly_name = g_strdup_printf ("File (%s)", filename);
+	this->format = format;
+	this->width = width;
+	this->height = height;
+	this->framesPerSecond = framesPerSecond;
+	this->y4m = y4m;
+	this->data_start = 0;
+	this->fp = NULL;
+	this->capture_pipe [0] = this->capture_pipe [1] = -1;
+	this->capturing = false;
+	this->capture_thread = NULL;
+}
+
+MoonVideoCaptureDeviceFile::~MoonVideoCaptureDeviceFile ()
+{
+	StopCapturing ();
+
+	g_free (filename);
+	g_free (friendly_name);
+}
+
+static bool
+parse_format (const char *str, CaptureFrameFormat *format)
+{
+	if (!g_ascii_strcasecmp (str, "i420")) {
+		*format = CaptureFrameI420;
+	} else if (!g_ascii_strcasecmp (str, "yv12")) {
+		*format = CaptureFrameYV12;
+	} else if (!g_ascii_strcasecmp (str, "yuyv") || !g_ascii_strcasecmp (str, "yuy2")) {
+		*format = CaptureFrameYUYV;
+	} else if (!g_ascii_strcasecmp (str, "uyvy")) {
+		*format = CaptureFrameUYVY;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+// Parses the stream header of a YUV4MPEG2 file, leaves fp at the first frame
+static bool
+parse_y4m_header (FILE *fp, int *width, int *height, float *framesPerSecond)
+{
+	char header [Y4M_MAX_HEADER];
+	char **tokens;
+	bool ok = true;
+	int num, den;
+
+	if (!fgets (header, sizeof (header), fp) || !strchr (header, '\n'))
+		return false;
+
+	g_strchomp (header);
+	tokens = g_strsplit (header, " ", -1);
+
+	if (tokens [0] == NULL || strcmp (tokens [0], Y4M_MAGIC) != 0) {
+		g_strfreev (tokens);
+		return false;
+	}
+
+	for (int i = 1; tokens [i] != NULL; i++) {
+		switch (tokens [i][0]) {
+		case 'W':
+			*width = atoi (tokens [i] + 1);
+			break;
+		case 'H':
+			*height = atoi (tokens [i] + 1);
+			break;
+		case 'F':
+			if (sscanf (tokens [i] + 1, "%d:%d", &num, &den) == 2 && num > 0 && den > 0)
+				*framesPerSecond = (float) num / den;
+			break;
+		case 'C':
+			// we only do 4:2:0, which is also what the colorspace defaults to
+			if (strncmp (tokens [i] + 1, "420", 3) != 0) {
+				printf ("Moonlight: unsupported YUV4MPEG2 colorspace: %s\n", tokens [i] + 1);
+				ok = false;
+			}
+			break;
+		}
+	}
+
+	g_strfreev (tokens);
+
+	return ok;
+}
+
+MoonVideoCaptureDeviceFile *
+MoonVideoCaptureDeviceFile::CreateFromOptions (const char *options)
+{
+	CaptureFrameFormat format = CaptureFrameI420;
+	MoonVideoCaptureDeviceFile *device;
+	int width = 0, height = 0;
+	float framesPerSecond = 0;
+	float fps_option = 0;
+	bool y4m = false;
+	char **opts;
+	long data_start = 0;
+	char magic [sizeof (Y4M_MAGIC)];
+	FILE *fp;
+
+	opts = g_strsplit (options, ",", -1);
+
+	if (opts [0] == NULL || opts [0][0] == 0) {
+		g_strfreev (opts);
+		return NULL;
+	}
+
+	for (int i = 1; opts [i] != NULL; i++) {
+		if (!strncmp (opts [i], "size=", 5)) {
+			if (sscanf (opts [i] + 5, "%dx%d", &width, &height) != 2)
+				printf ("Moonlight: invalid capture file size: '%s'\n", opts [i] + 5);
+		} else if (!strncmp (opts [i], "format=", 7)) {
+			if (!parse_format (opts [i] + 7, &format))
+				printf ("Moonlight: unknown capture file format: '%s'\n", opts [i] + 7);
+		} else if (!strncmp (opts [i], "fps=", 4)) {
+			fps_option = g_ascii_strtod (opts [i] + 4, NULL);
+		} else {
+			printf ("Moonlight: unknown MOONLIGHT_CAPTURE_FILE option: '%s'\n", opts [i]);
+		}
+	}
+
+	if (!(fp = fopen (opts [0], "rb"))) {
+		printf ("Moonlight: could not open capture file '%s': %s\n", opts [0], strerror (errno));
+		g_strfreev (opts);
+		return NULL;
+	}
+
+	if (fread (magic, 1, sizeof (magic) - 1, fp) == sizeof (magic) - 1 && !strncmp (magic, Y4M_MAGIC, sizeof (magic) - 1)) {
+		rewind (fp);
+
+		if (!parse_y4m_header (fp, &width, &height, &framesPerSecond)) {
+			printf ("Moonlight: invalid YUV4MPEG2 header in capture file '%s'\n", opts [0]);
+			fclose (fp);
+			g_strfreev (opts);
+			return NULL;
+		}
+
+		data_start = ftell (fp);
+		format = CaptureFrameI420;
+		y4m = true;
+	}
+
+	fclose (fp);
+
+	if (fps_option > 0)
+		framesPerSecond = fps_option;
+	if (framesPerSecond <= 0)
+		framesPerSecond = 30;
+
+	if (width <= 0 || height <= 0 || (width & 1)) {
+		printf ("Moonlight: the capture file '%s' needs an even width and a height (size=<width>x<height>)\n", opts [0]);
+		g_strfreev (opts);
+		return NULL;
+	}
+
+	device = new MoonVideoCaptureDeviceFile (opts [0], format, width, height, framesPerSecond, y4m);
+	device->data_start = data_start;
+
+	g_strfreev (opts);
+
+	return device;
+}
+
+const char *
+MoonVideoCaptureDeviceFile::GetFriendlyName ()
+{
+	return friendly_name;
+}
+
+void
+MoonVideoCaptureDeviceFile::GetSupportedFormats (VideoFormatCollection *col)
+{
+	VideoFormat vf (MoonPixelFormatRGBA32, framesPerSecond, width * 4, width, height);
+
+	col->Add (Value (vf));
+}
+
+void
+MoonVideoCaptureDeviceFile::StartCapturing ()
+{
+	VideoFormat *desired_format;
+	float fps = framesPerSecond;
+
+	LOG_CAPTURE ("MoonVideoCaptureDeviceFile::StartCapturing ()\n");
+	VERIFY_MAIN_THREAD;
+
+	if (capturing)
+		return;
+
+	// the size is whatever is in the file, but we replay at any rate
+	if ((desired_format = GetDevice ()->GetDesiredFormat ()) && desired_format->framesPerSecond > 0)
+		fps = desired_format->framesPerSecond;
+
+	if (!(fp = fopen (filename, "rb"))) {
+		fprintf (stderr, "Moonlight: Could not open video capture file %s: %s\n", filename, strerror (errno));
+		return;
+	}
+
+	if (fseek (fp, data_start, SEEK_SET) == -1) {
+		fclose (fp);
+		fp = NULL;
+		return;
+	}
+
+	capturing_video_format = VideoFormat (MoonPixelFormatRGBA32, fps, width * 4, width, height);
+
+	GetDevice ()->EmitCaptureStarted ();
+	GetDevice ()->EmitVideoFormatChanged (&capturing_video_format);
+
+	if (pipe (capture_pipe) != 0) {
+		LOG_CAPTURE ("MoonVideoCaptureDeviceFile::StartCapturing (): Unable to create pipe (%s).\n", strerror (errno));
+		fclose (fp);
+		fp = NULL;
+		return;
+	}
+
+	capturing = true;
+	if (MoonThread::StartJoinable (&capture_thread, CaptureLoopCallback, this) != 0) {
+		capturing = false;
+		LOG_CAPTURE ("MoonVideoCaptureDeviceFile::StartCapturing (): failed to create capture thread\n");
+		close (capture_pipe [0]);
+		close (capture_pipe [1]);
+		capture_pipe [0] = capture_pipe [1] = -1;
+		fclose (fp);
+		fp = NULL;
+		return;
+	}
+}
+
+void
+MoonVideoCaptureDeviceFile::StopCapturing ()
+{
+	int result;
+
+	LOG_CAPTURE ("MoonVideoCaptureDeviceFile::StopCapturing ()\n");
+	VERIFY_MAIN_THREAD;
+
+	if (!capturing)
+		return;
+
+	capturing = false;
+
+	// Wake up the capture thread in case it's waiting for the next frame
+	do {
+		result = write (capture_pipe [1], "c", 1);
+	} while (result == 0);
+
+	capture_thread->Join ();
+	capture_thread = NULL;
+
+	close (capture_pipe [0]);
+	close (capture_pipe [1]);
+	capture_pipe [0] = capture_pipe [1] = -1;
+
+	fclose (fp);
+	fp = NULL;
+}
+
+gpointer
+MoonVideoCaptureDeviceFile::CaptureLoopCallback (gpointer context)
+{
+	((MoonVideoCaptureDeviceFile *) context)->CaptureLoop ();
+	return NULL;
+}
+
+bool
+MoonVideoCaptureDeviceFile::ReadFrame (guint8 *frame)
+{
+	int stride = (format == CaptureFrameYUYV || format == CaptureFrameUYVY) ? width * 2 : width;
+	guint32 size = CaptureFrameConverter::GetFrameSize (format, stride, height);
+	char header [Y4M_MAX_HEADER];
+
+	// at the end of the file we start over, but only once: an empty file has no frames
+	for (int attempt = 0; attempt < 2; attempt++) {
+		if (attempt > 0 && fseek (fp, data_start, SEEK_SET) == -1)
+			return false;
+
+		if (y4m) {
+			if (!fgets (header, sizeof (header), fp) || strncmp (header, Y4M_FRAME_MAGIC, strlen (Y4M_FRAME_MAGIC)) != 0)
+				continue;
+		}
+
+		if (fread (frame, 1, size, fp) == size)
+			return true;
+	}
+
+	return false;
+}
+
+void
+MoonVideoCaptureDeviceFile::CaptureLoop ()
+{
+	int stride = (format == CaptureFrameYUYV || format == CaptureFrameUYVY) ? width * 2 : width;
+	TimeSpan frame_duration = (TimeSpan) (TIMESPANTICKS_IN_SECOND_FLOAT / capturing_video_format.framesPerSecond);
+	guint32 buflen = capturing_video_format.stride * height;
+	TimeSpan next_frame, now;
+	guint8 *input, *buffer;
+	pollfd fds [1];
+	char c;
+
+	LOG_CAPTURE ("MoonVideoCaptureDeviceFile::CaptureLoop ()\n");
+
+	fds [0].fd = capture_pipe [0];
+	fds [0].events = POLLIN;
+
+	input = (guint8 *) g_malloc (CaptureFrameConverter::GetFrameSize (format, stride, height));
+	next_frame = get_now ();
+
+	while (capturing) {
+		now = get_now ();
+
+		if (now < next_frame) {
+			// wait for the next frame, or until we're stopped
+			fds [0].revents = 0;
+			if (poll (fds, 1, (next_frame - now) / 10000 + 1) > 0 && (fds [0].revents & POLLIN))
+				read (capture_pipe [0], &c, 1);
+			continue;
+		}
+
+		if (!ReadFrame (input)) {
+			LOG_CAPTURE ("MoonVideoCaptureDeviceFile::CaptureLoop () could not read a frame from %s\n", filename);
+			break;
+		}
+
+		buffer = (guint8 *) GetDevice ()->GetVideoSampleBuffer (buflen);
+		converter.Convert (format, input, stride, width, height, buffer, capturing_video_format.stride);
+		GetDevice ()->EmitVideoSampleReady (&capturing_video_format, buffer, buflen);
+
+		next_frame += frame_duration;
+
+		// if we fell far behind (the machine was suspended, or we're simply too slow),
+		// don't try to catch up by emitting a burst of frames
+		if (get_now () - next_frame > TIMESPANTICKS_IN_SECOND)
+			next_frame = get_now ();
+	}
+
+	g_free (input);
+
+	LOG_CAPTURE ("MoonVideoCaptureDeviceFile::CaptureLoop () Done\n");
+}
@@ -0,0 +1,80 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * pal-file-video-capture.h: a video capture device which replays raw YUV files
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#ifndef MOON_PAL_FILE_VIDEO_CAPTURE_H
+#define MOON_PAL_FILE_VIDEO_CAPTURE_H
+
+#include <stdio.h>
+
+#include "pal.h"
+#include "capture.h"
+#include "capture-converter.h"
+
+namespace Moonlight {
+
+/*
+ * MoonVideoCaptureDeviceFile
+ *   Replays the frames of a YUV4MPEG2 (.y4m) or raw YUV file at a fixed
+ *   frame rate, looping at the end of the file, so that the capture path
+ *   can be tested and benchmarked without a camera.
+ */
+
+class MoonVideoCaptureDeviceFile : public MoonVideoCaptureDevice {
+public:
+	MoonVideoCaptureDeviceFile (const char *filename, CaptureFrameFormat format, int width, int height, float framesPerSecond, bool y4m);
+	virtual ~MoonVideoCaptureDeviceFile ();
+
+	virtual void GetSupportedFormats (VideoFormatCollection *col);
+
+	virtual const char* GetFriendlyName ();
+
+	virtual void StartCapturing ();
+	virtual void StopCapturing ();
+
+	/* Parses MOONLIGHT_CAPTURE_FILE=<path>[,size=<width>x<height>][,format=i420|yv12|yuyv|uyvy][,fps=<fps>]
+	 * Returns NULL if the file can't be used */
+	static MoonVideoCaptureDeviceFile *CreateFromOptions (const char *options);
+
+private:
+	static gpointer CaptureLoopCallback (gpointer context);
+	void CaptureLoop ();
+	bool ReadFrame (guint8 *frame);
+
+	char *filename;
+	char *friendly_name;
+	CaptureFrameFormat format;
+	int width;
+	int height;
+	float framesPerSecond;
+	bool y4m;
+	long data_start; /* the offset of the first frame */
+
+	FILE *fp; // capture thread only while capturing
+	CaptureFrameConverter converter; // capture thread only
+	VideoFormat capturing_video_format;
+
+	int capture_pipe [2]; // this is the pipe we use to wake up the capture thread
+	bool capturing; // write on main thread only
+	MoonThread *capture_thread;
+};
+
+class MoonVideoCaptureServiceFile : public MoonVideoCaptureService {
+public:
+	MoonVideoCaptureServiceFile (const char *options);
+	virtual ~MoonVideoCaptureServiceFile ();
+
+	virtual void GetAvailableCaptureDevices (VideoCaptureDeviceCollection *col);
+
+private:
+	char *options;
+};
+
+};
+#endif /* MOON_PAL_FILE_VIDEO_CAPTURE_H */
@@ -12,6 +12,7 @@
 
 #include "pal-linux-capture.h"
 #include "pal-linux-audio-capture.h"
+#include "pal-file-video-capture.h"
 #include "deployment.h"
 #include "runtime.h"
 
@@ -23,11 +24,18 @@ using namespace Moonlight;
 
 MoonCaptureServiceLinux::MoonCaptureServiceLinux ()
 {
+	const char *capture_file;
+
+	// MOONLIGHT_CAPTURE_FILE replaces the cameras with a file, see MoonVideoCaptureDeviceFile
+	if ((capture_file = g_getenv ("MOONLIGHT_CAPTURE_FILE")) != NULL && capture_file [0] != 0) {
+		video_service = new MoonVideoCaptureServiceFile (capture_file);
+	} else {
 #if PAL_V4L2_VIDEO_CAPTURE
-	video_service = new MoonVideoCaptureServiceV4L2 ();
+		video_service = new MoonVideoCaptureServiceV4L2 ();
 #else
-	video_service = NULL;
+		video_service = NULL;
 #endif
+	}
 	audio_service = new MoonAudioCaptureServiceLinux ();
 }
 
@@ -427,14 +427,6 @@ MoonVideoCaptureDeviceV4L2::GetFriendlyName()
 	return friendly_name;
 }
 
-static inline void YUV444ToBGRA(guint8 Y, guint8 U, guint8 V, guint8 *dst)
-{
-	dst[2] = CLAMP((298 * (Y - 16) + 409 * (V - 128) + 128) >> 8, 0, 255);
-	dst[1] = CLAMP((298 * (Y - 16) - 100 * (U - 128) - 208 * (V - 128) + 128) >> 8, 0, 255);
-	dst[0] = CLAMP((298 * (Y - 16) + 516 * (U - 128) + 128) >> 8, 0, 255);
-	dst[3] = 0xFF;
-}
-
 void *
 MoonVideoCaptureDeviceV4L2::CaptureLoopCallback (gpointer context)
 {
@@ -516,7 +508,7 @@ MoonVideoCaptureDeviceV4L2::CaptureLoop ()
 		}
 
 		buflen = capturing_format.height * capturing_format.stride;
-		buffer = (guint8 *) g_malloc (buflen);
+		buffer = (guint8 *) GetDevice ()->GetVideoSampleBuffer (buflen);
 		op = buffer;
 		ip = (guint32 *) buffers [v4l2buf.index].start;
 
@@ -524,63 +516,31 @@ MoonVideoCaptureDeviceV4L2::CaptureLoop ()
 			v4l2buf.length, v4l2buf.bytesused, capturing_format.width, capturing_format.height, capturing_format.stride, capturing_video_format.width, capturing_video_format.height);
 
 		switch (capturing_format.v4l2PixelFormat) {
-		case V4L2_PIX_FMT_YUYV: {
-			while ((size_t) ((char *) ip - (char *) buffers [v4l2buf.index].start) < buffers [v4l2buf.index].length) {
-				guint8 y, u, y2, v;
-	
-				y  = ((*ip & 0x000000ff));
-				u =  ((*ip & 0x0000ff00)>>8);
-				y2 = ((*ip & 0x00ff0000)>>16);
-				v =  ((*ip & 0xff000000)>>24);
-	
-				YUV444ToBGRA (y, u, v, op); op += 4;
-				YUV444ToBGRA (y2, u, v, op); op += 4;
-				
-				ip++;
-			}
-			break;
-		}
-		case V4L2_PIX_FMT_UYVY: {
-			while ((size_t) ((char *) ip - (char *) buffers [v4l2buf.index].start) < buffers [v4l2buf.index].length) {
-				guint8 y, u, y2, v;
-
-				u =  ((*ip & 0x000000ff));
-				y  = ((*ip & 0x0000ff00)>>8);
-				v =  ((*ip & 0x00ff0000)>>16);
-				y2 = ((*ip & 0xff000000)>>24);
-
-				YUV444ToBGRA (y, u, v, op); op += 4;
-				YUV444ToBGRA (y2, u, v, op); op += 4;
-				
-				ip++;
-			}
-			break;
-		}
+		case V4L2_PIX_FMT_YUYV:
+		case V4L2_PIX_FMT_UYVY:
 		case V4L2_PIX_FMT_YUV420:
 		case V4L2_PIX_FMT_YVU420: {
-			int width = capturing_format.width;
-			int height = capturing_format.height;
-			bool u_first = (capturing_format.v4l2PixelFormat == V4L2_PIX_FMT_YUV420);
-			guint8 *yp = (guint8 *) buffers [v4l2buf.index].start;
-			guint8 *up = (guint8 *) buffers [v4l2buf.index].start + width * height + (u_first ? 0 : width * height / 4);
-			guint8 *vp = (guint8 *) buffers [v4l2buf.index].start + width * height + (u_first ? width * height / 4 : 0);
-			int i = 0, j = 0;
-	
-			while (i * j < width * height) { 
-				guint8 y  =  yp[j * width + i];
-				guint8 u =  up[j/2 * width/2 + i/2];
-				guint8 v  =  vp[j/2 * width/2 + i/2];
-				
-				YUV444ToBGRA (y, u, v, op); op += 4;
-				
-				ip++;
-				i++;
-	
-				if (i >= width) {
-					i = 0;
-					j++;
-				}
+			CaptureFrameFormat format;
+			int input_stride = capturing_format.input_stride;
+
+			switch (capturing_format.v4l2PixelFormat) {
+			case V4L2_PIX_FMT_YUYV: format = CaptureFrameYUYV; break;
+			case V4L2_PIX_FMT_UYVY: format = CaptureFrameUYVY; break;
+			case V4L2_PIX_FMT_YUV420: format = CaptureFrameI420; break;
+			default: format = CaptureFrameYV12; break;
 			}
+
+			if (input_stride == 0)
+				input_stride = (format == CaptureFrameYUYV || format == CaptureFrameUYVY) ? capturing_format.width * 2 : capturing_format.width;
+
+			if (CaptureFrameConverter::GetFrameSize (format, input_stride, capturing_format.height) > buffers [v4l2buf.index].length) {
+				LOG_CAPTURE ("MoonVideoCaptureDeviceV4L2::CaptureLoop () the frame is too small for the format\n");
+				memset (buffer, 0, buflen);
+				break;
+			}
+
+			converter.Convert (format, (guint8 *) buffers [v4l2buf.index].start, input_stride,
+					   capturing_format.width, capturing_format.height, buffer, capturing_format.stride);
 			break;
 		}
 		case V4L2_PIX_FMT_JPEG: {
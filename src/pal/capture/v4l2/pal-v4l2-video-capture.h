@@ -13,6 +13,7 @@
 
 #include "pal.h"
 #include "capture.h"
+#include "capture-converter.h"
 
 namespace Moonlight {
 
@@ -56,6 +57,7 @@ private:
 	char *filename;
 	MoonVideoFormatV4L2 capturing_format;
 	VideoFormat capturing_video_format;
+	CaptureFrameConverter converter; // capture thread only
 	char *friendly_name;
 
 	typedef struct {
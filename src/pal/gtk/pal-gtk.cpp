@@ -16,14 +16,9 @@
 #include "context-gallium.h"
 extern "C" {
 #include "pipe/p_screen.h"
-#include "util/u_debug.h"
 #define template templat
 #include "state_tracker/sw_winsys.h"
 #include "sw/null/null_sw_winsys.h"
-#include "softpipe/sp_public.h"
-#ifdef USE_LLVM
-#include "llvmpipe/lp_public.h"
-#endif
 };
 #endif
 
@@ -42,33 +37,6 @@ extern "C" {
 #include <gdk/gdkkeysyms.h>
 #include <sys/stat.h>
 
-#ifdef USE_GALLIUM
-static struct pipe_screen *
-swrast_screen_create (struct sw_winsys *ws)
-{
-	const char         *default_driver;
-	const char         *driver;
-	struct pipe_screen *screen = NULL;
-
-#ifdef USE_LLVM
-	default_driver = "llvmpipe";
-#else
-	default_driver = "softpipe";
-#endif
-
-	driver = debug_get_option ("GALLIUM_DRIVER", default_driver);
-
-#ifdef USE_LLVM
-	if (screen == NULL && strcmp (driver, "llvmpipe") == 0)
-		screen = llvmpipe_create_screen (ws);
-#endif
-
-	if (screen == NULL)
-		screen = softpipe_create_screen (ws);
-
-	return screen;
-}
-#endif
 
 using namespace Moonlight;
 
@@ -748,7 +716,7 @@ MoonWindowingSystemGtk::MoonWindowingSystemGtk (bool out_of_browser)
 	LoadSystemColors ();
 
 #ifdef USE_GALLIUM
-	gscreen = swrast_screen_create (null_sw_create ());
+	gscreen = GalliumContext::CreateSoftwareScreen (null_sw_create ());
 #endif
 
 }
@@ -17,9 +17,9 @@
 
 namespace Moonlight {
 
-MoonTlsKey::MoonTlsKey ()
+MoonTlsKey::MoonTlsKey (DestroyFunc destroy)
 {
-	pthread_key_create (&tls_key, NULL);
+	pthread_key_create (&tls_key, destroy);
 }
 
 MoonTlsKey::~MoonTlsKey ()
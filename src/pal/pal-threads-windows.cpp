@@ -18,14 +18,34 @@
 namespace Moonlight {
 
 
-MoonTlsKey::MoonTlsKey ()
+/* The fiber local storage callback only gets the value and has to be
+ * WINAPI, so keys with a destroy function store the function along with
+ * the thread's value. */
+struct MoonTlsValue {
+	MoonTlsKey::DestroyFunc destroy;
+	gpointer data;
+};
+
+static VOID WINAPI
+tls_value_destroy (PVOID value)
+{
+	MoonTlsValue *tls_value = (MoonTlsValue *) value;
+
+	if (tls_value->data)
+		tls_value->destroy (tls_value->data);
+	g_free (tls_value);
+}
+
+MoonTlsKey::MoonTlsKey (DestroyFunc destroy)
+	: destroy (destroy)
 {
-	tls_index = TlsAlloc ();
+	/* unlike TLS, FLS calls the callback when a thread exits */
+	tls_index = FlsAlloc (destroy ? tls_value_destroy : NULL);
 }
 
 MoonTlsKey::~MoonTlsKey ()
 {
-	TlsFree (tls_index);
+	FlsFree (tls_index);
 }
 
 bool
@@ -44,13 +64,36 @@ MoonThread::IsThread (MoonThread* other)
 gpointer
 MoonThread::GetSpecific (MoonTlsKey& key)
 {
-	return TlsGetValue (key.tls_index);
+	MoonTlsValue *tls_value;
+
+	if (!key.destroy)
+		return FlsGetValue (key.tls_index);
+
+	tls_value = (MoonTlsValue *) FlsGetValue (key.tls_index);
+	return tls_value ? tls_value->data : NULL;
 }
 
 void
 MoonThread::SetSpecific (MoonTlsKey& key, gpointer data)
 {
-	TlsSetValue (key.tls_index, data);
+	MoonTlsValue *tls_value;
+
+	if (!key.destroy) {
+		FlsSetValue (key.tls_index, data);
+		return;
+	}
+
+	tls_value = (MoonTlsValue *) FlsGetValue (key.tls_index);
+	if (!tls_value) {
+		if (!data)
+			return;
+
+		tls_value = g_new (MoonTlsValue, 1);
+		tls_value->destroy = key.destroy;
+		FlsSetValue (key.tls_index, tls_value);
+	}
+
+	tls_value->data = data;
 }
 
 MoonThread::MoonThread (ThreadFunc func, gpointer func_arg)
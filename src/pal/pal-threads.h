@@ -22,7 +22,10 @@ class MoonTlsKey;
 
 class MoonTlsKey {
 public:
-	MoonTlsKey ();
+	typedef void (*DestroyFunc) (gpointer);
+
+	/* @destroy is called with the thread's (non-NULL) value when a thread exits */
+	MoonTlsKey (DestroyFunc destroy = NULL);
 	~MoonTlsKey ();
 private:
 	friend class MoonThread;
@@ -30,6 +33,7 @@ private:
 	pthread_key_t tls_key;
 #elif PAL_THREADS_WINDOWS
 	DWORD tls_index;
+	DestroyFunc destroy;
 #endif
 };
 
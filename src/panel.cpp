@@ -321,6 +321,7 @@ Panel::OnCollectionItemChanged (Collection *col, DependencyObject *obj, Property
 		// if a child changes its ZIndex or Z property we need to resort our Children
 		if (args->GetId () == Canvas::ZIndexProperty || args->GetId () == Canvas::ZProperty) {
 			((UIElement *) obj)->Invalidate ();
+			((UIElementCollection *) col)->ZIndexChanged ((UIElement *) obj);
 			if (IsAttached ()) {
 				// queue a resort based on ZIndex
 				GetDeployment ()->GetSurface ()->AddDirtyElement (this, DirtyChildrenZIndices);
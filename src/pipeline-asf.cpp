@@ -24,6 +24,7 @@
 
 // according to http://msdn.microsoft.com/en-us/library/cc307965(VS.85).aspx the maximum size is 10 MB
 #define ASF_OBJECT_MAX_SIZE (10 * 1024 * 1024)
+#define ASF_DEFAULT_READAHEAD (64 * 1024)
 
 namespace Moonlight {
 
@@ -67,12 +68,22 @@ ASFDemuxer::ASFDemuxer (Media *media, IMediaSource *source, MemoryBuffer *initia
 void
 ASFDemuxer::Init (MemoryBuffer *initial_buffer, MmsPlaylistEntry *playlist_entry)
 {
+	const char *readahead;
+
 	memset (readers, 0, sizeof (ASFFrameReader *) * 127);
 	last_packet_index = G_MAXUINT64;
 	first_packet_index = G_MAXUINT64;
 	next_packet_index = G_MAXUINT64;
 	pending_packet_index = G_MAXUINT64;
+	pending_packet_count = 0;
+	delivering_packets = false;
+	more_data_requested = false;
 	seeked_to_pts = G_MAXUINT64;
+	simple_index_state = SimpleIndexNotRead;
+	simple_index = NULL;
+	simple_index_count = 0;
+	simple_index_interval = 0;
+	simple_index_seek_pts = 0;
 	header_size = 0;
 	pending_read = NULL;
 	data_object_size = 0;
@@ -91,6 +102,10 @@ ASFDemuxer::Init (MemoryBuffer *initial_buffer, MmsPlaylistEntry *playlist_entry
 		this->playlist_entry->ref ();
 	this->initial_buffer = initial_buffer;
 	this->initial_buffer->ref ();
+
+	/* 0 reads one packet at a time */
+	readahead = g_getenv ("MOONLIGHT_ASF_READAHEAD");
+	readahead_size = readahead != NULL ? (guint32) g_ascii_strtoull (readahead, NULL, 10) * 1024 : ASF_DEFAULT_READAHEAD;
 }
 
 void
@@ -122,6 +137,9 @@ ASFDemuxer::~ASFDemuxer ()
 	
 	g_free (stream_to_asf_index);
 	stream_to_asf_index = NULL;
+
+	g_free (simple_index);
+	simple_index = NULL;
 }
 
 #if DEBUG
@@ -167,6 +185,8 @@ ASFDemuxer::ResetAll ()
 	first_packet_index = G_MAXUINT64;
 	next_packet_index = G_MAXUINT64;
 	pending_packet_index = G_MAXUINT64;
+	pending_packet_count = 0;
+	more_data_requested = false;
 	
 	if (pending_read) {
 		pending_read->Cancel ();
@@ -188,10 +208,108 @@ ASFDemuxer::EstimatePacketIndexOfPts (guint64 pts)
 	return result == G_MAXUINT64 ? 0 : result;
 }
 
+guint64
+ASFDemuxer::GetPacketIndexOfPtsFromIndex (guint64 pts)
+{
+	guint64 entry;
+
+	if (simple_index == NULL)
+		return G_MAXUINT64;
+
+	/* our pts have the preroll subtracted, the index times don't */
+	entry = MIN ((pts + MilliSeconds_ToPts (GetPreroll ())) / simple_index_interval, simple_index_count - 1);
+
+	if (simple_index [entry] >= GetPacketCount ())
+		return G_MAXUINT64;
+
+	return simple_index [entry];
+}
+
+MediaResult
+ASFDemuxer::ReadSimpleIndexCallback (MediaClosure *c)
+{
+	MediaReadClosure *closure = (MediaReadClosure *) c;
+	ASFDemuxer *demuxer = (ASFDemuxer *) closure->GetContext ();
+
+	if (demuxer->IsDisposed ())
+		return MEDIA_SUCCESS;
+
+	demuxer->ReadSimpleIndex (closure->GetData ());
+	/* Now do the seek we were asked to do */
+	demuxer->SeekAsyncInternal (demuxer->simple_index_seek_pts);
+	return MEDIA_SUCCESS;
+}
+
+void
+ASFDemuxer::ReadSimpleIndex (MemoryBuffer *buffer)
+{
+	ASFGuid guid;
+	guint64 size;
+	guint64 interval;
+	guint32 count;
+	gint64 start;
+
+	LOG_ASF ("ASFDemuxer::ReadSimpleIndex (%" G_GINT64_FORMAT " bytes)\n", buffer->GetSize ());
+
+	simple_index_state = SimpleIndexRead;
+
+	/* There may be several index objects after the data object, use the first simple index */
+	while (buffer->GetRemainingSize () >= 24) {
+		start = buffer->GetPosition ();
+
+		if (!guid.Read (buffer))
+			break;
+
+		size = buffer->ReadLE_U64 ();
+		if (size < 24 || size > (guint64) (buffer->GetSize () - start)) {
+			LOG_ASF ("ASFDemuxer::ReadSimpleIndex (): invalid or truncated object (%s, %" G_GUINT64_FORMAT " bytes)\n", guid.ToString (), size);
+			break;
+		}
+
+		if (guid != asf_guids_simple_index) {
+			buffer->SeekSet (start + size);
+			continue;
+		}
+
+		/* file id, index entry time interval, maximum packet count, index entries count */
+		if (size < 56)
+			break;
+
+		guid.Read (buffer);
+		interval = buffer->ReadLE_U64 ();
+		buffer->ReadLE_U32 ();
+		count = buffer->ReadLE_U32 ();
+
+		if (interval == 0 || count == 0 || (guint64) count * 6 > size - 56) {
+			LOG_ASF ("ASFDemuxer::ReadSimpleIndex (): invalid simple index (interval: %" G_GUINT64_FORMAT " count: %u)\n", interval, count);
+			break;
+		}
+
+		simple_index = (guint32 *) g_malloc (sizeof (guint32) * count);
+		for (guint32 i = 0; i < count; i++) {
+			simple_index [i] = buffer->ReadLE_U32 ();
+			buffer->ReadLE_U16 (); /* packet count */
+		}
+		simple_index_count = count;
+		simple_index_interval = interval;
+		break;
+	}
+
+	LOG_ASF ("ASFDemuxer::ReadSimpleIndex (): %s simple index (%u entries, interval: %" G_GUINT64_FORMAT " ms)\n",
+		 simple_index != NULL ? "found a" : "no", simple_index_count, MilliSeconds_FromPts (simple_index_interval));
+}
+
 void
 ASFDemuxer::RequestMorePayloadData ()
 {
 	Media *media;
+	guint32 count = 1;
+
+	if (delivering_packets) {
+		/* DeliverData requests more data once it has delivered all the packets it got */
+		more_data_requested = true;
+		return;
+	}
 
 	/* We should only have one pending read request at a time */
 	if (pending_packet_index != G_MAXUINT64) {
@@ -199,11 +317,18 @@ ASFDemuxer::RequestMorePayloadData ()
 		return;
 	}
 
+	/* Read several packets at a time, unless we're getting the packets one by one from the server */
+	if (playlist_entry == NULL && !file_properties->IsBroadcast () && GetPacketSize () > 0 && next_packet_index < GetPacketCount ()) {
+		count = MAX (1, readahead_size / GetPacketSize ());
+		count = MIN (count, GetPacketCount () - next_packet_index);
+	}
+
 	media = GetMediaReffed ();
 	if (media != NULL) {
 		pending_packet_index = next_packet_index;
-		LOG_ASF ("ASFDemuxer::RequestMorePayloadData (): requesting %u bytes from offset %" G_GUINT64_FORMAT " (packet index: %" G_GUINT64_FORMAT ")\n", GetPacketSize (), GetPacketOffset (next_packet_index), next_packet_index);
-		MediaReadClosure *closure = new MediaReadClosure (media, DeliverDataCallback, this, GetPacketOffset (next_packet_index), GetPacketSize ());
+		pending_packet_count = count;
+		LOG_ASF ("ASFDemuxer::RequestMorePayloadData (): requesting %u bytes from offset %" G_GUINT64_FORMAT " (packet index: %" G_GUINT64_FORMAT ", %u packets)\n", GetPacketSize () * count, GetPacketOffset (next_packet_index), next_packet_index, count);
+		MediaReadClosure *closure = new MediaReadClosure (media, DeliverDataCallback, this, GetPacketOffset (next_packet_index), GetPacketSize () * count);
 		source->ReadAsync (closure);
 		closure->unref ();
 		media->unref ();
@@ -374,8 +499,31 @@ ASFDemuxer::SeekAsyncInternal (guint64 pts)
 		return;
 	}
 
-	/* Now we can only guess which packet we should seek to */
-	next_packet_index = EstimatePacketIndexOfPts (pts);
+	/* Read the simple index (if there is one) the first time we seek in a local file */
+	if (simple_index_state == SimpleIndexNotRead) {
+		gint64 index_offset = header_size + data_object_size;
+
+		if (source->GetObjectType () == Type::FILESOURCE && data_object_size > 0 && index_offset < source->GetSize ()) {
+			Media *media = GetMediaReffed ();
+			if (media != NULL) {
+				LOG_ASF ("ASFDemuxer::SeekAsyncInternal (): reading the index objects at %" G_GINT64_FORMAT "\n", index_offset);
+				simple_index_state = SimpleIndexReading;
+				simple_index_seek_pts = pts;
+				MediaReadClosure *closure = new MediaReadClosure (media, ReadSimpleIndexCallback, this, index_offset,
+					MIN (source->GetSize () - index_offset, ASF_OBJECT_MAX_SIZE));
+				source->ReadAsync (closure);
+				closure->unref ();
+				media->unref ();
+				return;
+			}
+		}
+		simple_index_state = SimpleIndexRead;
+	}
+
+	/* Look up the packet in the simple index, otherwise we can only guess which packet we should seek to */
+	next_packet_index = GetPacketIndexOfPtsFromIndex (pts);
+	if (next_packet_index == G_MAXUINT64)
+		next_packet_index = EstimatePacketIndexOfPts (pts);
 	LOG_ASF ("ASFDemuxer::SeekAsyncInternal (): Seeking to packet index: %" G_GUINT64_FORMAT ")\n", next_packet_index);
 	seeked_to_pts = pts;
 
@@ -1190,6 +1338,9 @@ void
 ASFDemuxer::DeliverData (gint64 offset, MemoryBuffer *stream)
 {
 	guint64 packet_index;
+	guint32 packet_size = GetPacketSize ();
+	guint32 count = 1;
+	ASFPacket *packet;
 
 	LOG_ASF ("ASFDemuxer::DeliverData (%" G_GINT64_FORMAT ", %" G_GINT64_FORMAT " bytes)\n", offset, stream->GetSize ());
 	VERIFY_MEDIA_THREAD;
@@ -1204,22 +1355,52 @@ ASFDemuxer::DeliverData (gint64 offset, MemoryBuffer *stream)
 	}
 
 	packet_index = GetPacketIndex (offset);
-	if (first_packet_index == G_MAXUINT64) {
-		first_packet_index = packet_index;
-	}
-	last_packet_index = packet_index;
 	if (next_packet_index == pending_packet_index) {
 		next_packet_index++;
+		if (packet_size > 0)
+			count = CLAMP (stream->GetSize () / packet_size, 1, pending_packet_count);
 	}
 	pending_packet_index = G_MAXUINT64;
+	pending_packet_count = 0;
 
-	ASFPacket *packet = new ASFPacket (this, stream, offset);
-	if (packet->Read ()) {
-		DeliverPacket (packet);
-	} else {
-		ReportErrorOccurred ("ASFDemuxer: error while parsing packet.");
+	delivering_packets = true;
+
+	for (guint32 i = 0; i < count; i++) {
+		if (i > 0) {
+			/* Delivering the previous packet may have made us seek somewhere else */
+			if (IsDisposed () || next_packet_index != packet_index + i)
+				break;
+			next_packet_index++;
+		}
+
+		if (first_packet_index == G_MAXUINT64) {
+			first_packet_index = packet_index + i;
+		}
+		last_packet_index = packet_index + i;
+
+		/* Only the last packet we deliver decides if we need more data,
+		 * every packet asks again if it's still needed */
+		more_data_requested = false;
+
+		stream->SeekSet (i * packet_size);
+		packet = new ASFPacket (this, stream, offset + (gint64) i * packet_size);
+		if (packet->Read ()) {
+			DeliverPacket (packet);
+		} else {
+			ReportErrorOccurred ("ASFDemuxer: error while parsing packet.");
+			more_data_requested = false;
+			packet->unref ();
+			break;
+		}
+		packet->unref ();
+	}
+
+	delivering_packets = false;
+
+	if (more_data_requested && !IsDisposed ()) {
+		more_data_requested = false;
+		RequestMorePayloadData ();
 	}
-	packet->unref ();
 }
 
 void
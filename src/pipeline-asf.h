@@ -399,12 +399,38 @@ private:
 	/* The index of the next packet we should read */
 	guint64 next_packet_index;
 
-	/* The index of the packet we're waiting for. */
+	/* The index of the first packet we're waiting for. */
 	guint64 pending_packet_index;
 
+	/* How many packets (starting at pending_packet_index) we're waiting for */
+	guint32 pending_packet_count;
+
+	/* How many bytes worth of packets to read at a time (MOONLIGHT_ASF_READAHEAD, in KB) */
+	guint32 readahead_size;
+
+	/* Set while the packets of one read are delivered, requests for more data are
+	 * postponed (more_data_requested) until all of them have been delivered */
+	bool delivering_packets;
+	bool more_data_requested;
+
 	/* If we're currently seeking, the pts we seeked to. */
 	guint64 seeked_to_pts;
 
+	/* The Simple Index Object after the data object: the index of the packet
+	 * with the key frame for every simple_index_interval of pts. Only read
+	 * (on the first seek) for local files, for other sources we estimate the
+	 * packet using the index the frame readers build while demuxing. */
+	enum SimpleIndexState {
+		SimpleIndexNotRead,
+		SimpleIndexReading,
+		SimpleIndexRead, /* simple_index is NULL if the file doesn't have one */
+	};
+	SimpleIndexState simple_index_state;
+	guint32 *simple_index;
+	guint32 simple_index_count;
+	guint64 simple_index_interval;
+	guint64 simple_index_seek_pts; /* The seek to do once the index has been read */
+
 	/* The pending read (if any) */
 	MediaReadClosure *pending_read;
 
@@ -465,6 +491,13 @@ private:
 	 * Calls EstimatePacketIndexOfPts on all readers and returns the lowest value. */
 	guint64 EstimatePacketIndexOfPts (guint64 pts);
 
+	/* Returns the packet index of the key frame before the specified pts from the
+	 * simple index, G_MAXUINT64 if there is no index. */
+	guint64 GetPacketIndexOfPtsFromIndex (guint64 pts);
+
+	static MediaResult ReadSimpleIndexCallback (MediaClosure *closure);
+	void ReadSimpleIndex (MemoryBuffer *buffer);
+
 	static MediaResult DeliverDataCallback (MediaClosure *closure);
 
 	void RequestMorePayloadData ();
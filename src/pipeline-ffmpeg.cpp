@@ -175,6 +175,11 @@ FfmpegDecoder::OpenDecoderAsyncInternal ()
 	}
 	
 	SetPixelFormat (FfmpegDecoder::ToMoonPixFmt (context->pix_fmt));
+
+	if (stream->IsVideo () && GetPixelFormat () == MoonPixelFormatYUV420P) {
+		// all the planes of a decoded frame go into one pooled buffer
+		stream->GetBufferPool ()->Reserve (context->width * context->height * 3 / 2 + 3 * (stream->GetMinPadding () + 15));
+	}
 	
 	ReportOpenDecoderCompleted ();
 }
@@ -206,11 +211,7 @@ FfmpegDecoder::Cleanup (MediaFrame *frame)
 	AVFrame *av_frame = (AVFrame *) frame->decoder_specific_data;
 	
 	if (av_frame != NULL) {
-		if (av_frame->data[0] != frame->data_stride[0]) {
-			for (int i = 0; i < 4; i++)
-				free (frame->data_stride[i]);
-		}
-		
+		// the planes we copied live in the frame's buffer
 		frame->decoder_specific_data = NULL;
 		av_free (av_frame);
 	}
@@ -312,6 +313,8 @@ FfmpegDecoder::DecodeFrameAsyncInternal (MediaFrame *mf)
 
 		int height = context->height;
 		int plane_bytes [4];
+		int plane_offset [4];
+		int total = 0;
 		
 		switch (GetPixelFormat ()) {
 		case MoonPixelFormatYUV420P:
@@ -329,14 +332,24 @@ FfmpegDecoder::DecodeFrameAsyncInternal (MediaFrame *mf)
 			break;
 		}
 		
+		// copy all the planes into one (pooled) buffer, each plane 16 byte aligned and padded
+		for (int i = 0; i < 4; i++) {
+			plane_offset [i] = total;
+			if (plane_bytes [i] != 0)
+				total = (total + plane_bytes [i] + stream->GetMinPadding () + 15) & ~15;
+		}
+
+		if (total != 0 && !mf->AllocateBuffer (total)) {
+			/* AllocateBuffer has reported the error */
+			av_free (frame);
+			return;
+		}
+
 		for (int i = 0; i < 4; i++) {
 			if (plane_bytes [i] != 0) {
-				if (posix_memalign ((void **)&mf->data_stride [i], 16, plane_bytes[i] + stream->GetMinPadding ())) {
-					av_free (frame);
-					ReportErrorOccurred ("FfmpegDecoder: out of memory");
-					return;
-				}
+				mf->data_stride[i] = mf->GetBuffer () + plane_offset [i];
 				memcpy (mf->data_stride[i], frame->data[i], plane_bytes[i]);
+				memset (mf->data_stride[i] + plane_bytes[i], 0, stream->GetMinPadding ());
 			} else {
 				mf->data_stride[i] = frame->data[i];
 			}
@@ -23,6 +23,9 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#if HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 
 #include "audio.h"
 #include "pipeline.h"
@@ -351,6 +354,8 @@ void
 Media::Initialize ()
 {
 	LOG_PIPELINE ("Media::Initialize ()\n");
+
+	MediaBufferPool::Initialize ();
 	
 	// demuxers
 	Media::RegisterDemuxer (new ASFDemuxerInfo ());
@@ -399,6 +404,8 @@ Media::Shutdown ()
 	// Make sure all threads are stopped
 	AudioPlayer::Shutdown ();
 	MediaThreadPool::Shutdown ();
+
+	MediaBufferPool::Shutdown ();
 	
 	current = registered_decoders;
 	while (current != NULL) {
@@ -1503,6 +1510,8 @@ FileSource::FileSource (Media *media, const char *filename) : IMediaSource (Type
 	this->filename = g_strdup (filename);
 	fd = NULL;
 	size = 0;
+	mapping = NULL;
+	position = 0;
 }
 
 FileSource::~FileSource ()
@@ -1518,6 +1527,10 @@ FileSource::Dispose ()
 		fclose (fd);
 		fd = NULL;
 	}
+	if (mapping != NULL) {
+		mapping->unref ();
+		mapping = NULL;
+	}
 	IMediaSource::Dispose ();
 }
 
@@ -1545,6 +1558,11 @@ FileSource::Initialize ()
 	} else {
 		size = 0;
 	}
+
+	if (g_getenv ("MOONLIGHT_NO_MMAP") == NULL)
+		mapping = MappedFile::Map (fileno (fd));
+
+	LOG_PIPELINE ("FileSource::Initialize () %s\n", mapping ? "mapped the file" : "reading the file");
 		
 	return MEDIA_SUCCESS;
 }
@@ -1562,6 +1580,9 @@ FileSource::GetPositionInternal ()
 	
 	if (fd == NULL)
 		return -1;
+
+	if (mapping != NULL)
+		return position;
 	
 	result = ftell (fd);
 
@@ -1573,7 +1594,12 @@ FileSource::GetPositionInternal ()
 void
 FileSource::ReadAsyncInternal (MediaReadClosure *closure)
 {
-	ReadFD (fd, closure);
+	if (mapping != NULL) {
+		ReadMapped (mapping, closure);
+		position = MIN (closure->GetOffset () + closure->GetCount (), mapping->GetSize ());
+	} else {
+		ReadFD (fd, closure);
+	}
 }
 
 bool
@@ -1581,6 +1607,9 @@ FileSource::Eof ()
 {
 	if (fd == NULL)
 		return false;
+
+	if (mapping != NULL)
+		return position >= mapping->GetSize ();
 	
 	return feof (fd);
 }
@@ -1747,6 +1776,8 @@ ProgressiveSource::ProgressiveSource (Media *media, const Uri *resource_base, co
 	size = -1;
 	write_fd = NULL;
 	read_fd = NULL;
+	mapping = NULL;
+	mapping_failed = false;
 	cancellable = NULL;
 	filename = NULL;
 	bytes_received = 0;
@@ -1770,6 +1801,10 @@ ProgressiveSource::~ProgressiveSource ()
 		fclose (read_fd);
 		read_fd = NULL;
 	}
+	if (mapping) {
+		mapping->unref ();
+		mapping = NULL;
+	}
 	delete uri;
 	uri = NULL;
 	delete resource_base;
@@ -2312,6 +2347,7 @@ ProgressiveSource::CheckPendingReads ()
 {
 	MediaReadClosureNode *node;
 	MediaReadClosureNode *next = NULL;
+	MappedFile *mapped = NULL;
 	bool checked_for_media_thread = false;
 	List pending_reads;
 	bool ready;
@@ -2359,15 +2395,35 @@ ProgressiveSource::CheckPendingReads ()
 		}
 		node = next;
 	}
+
+	/* Once the entire file is downloaded nothing writes to it anymore (unless we
+	 * do byte range requests), so we can map it and hand out buffers pointing into it */
+	if (complete && brr_enabled != 1 && !pending_reads.IsEmpty () && mapping == NULL && !mapping_failed && read_fd != NULL) {
+		if (g_getenv ("MOONLIGHT_NO_MMAP") == NULL)
+			mapping = MappedFile::Map (fileno (read_fd));
+		mapping_failed = mapping == NULL;
+		LOG_PIPELINE ("ProgressiveSource::CheckPendingReads () download complete, %s\n", mapping ? "mapped the file" : "could not map the file");
+	}
+	if (mapping != NULL) {
+		mapped = mapping;
+		mapped->ref ();
+	}
 	mutex.Unlock ();
 
 	/* Loop over the read closures we've collected and do the actual read */
 	node = (MediaReadClosureNode *) pending_reads.First ();
 	while (node != NULL) {
-		ReadFD (read_fd, node->GetClosure ());
+		if (mapped != NULL) {
+			ReadMapped (mapped, node->GetClosure ());
+		} else {
+			ReadFD (read_fd, node->GetClosure ());
+		}
 		/* The list (and all the nodes) will be deleted at function exit */
 		node = (MediaReadClosureNode *) node->next;
 	}
+
+	if (mapped != NULL)
+		mapped->unref ();
 }
 
 void
@@ -2451,12 +2507,98 @@ MemoryBuffer::MemoryBuffer (Media *media, void *memory, gint32 size, bool owner)
 	this->size = size;
 	this->pos = 0;
 	this->owner = owner;
+	this->mapping = NULL;
+}
+
+MemoryBuffer::MemoryBuffer (Media *media, MappedFile *mapping, gint64 offset, gint32 size)
+	: IMediaObject (Type::MEMORYBUFFER, media)
+{
+	this->memory = mapping->GetData () + offset;
+	this->size = size;
+	this->pos = 0;
+	this->owner = false;
+	this->mapping = mapping;
+	this->mapping->ref ();
 }
 
 MemoryBuffer::~MemoryBuffer ()
 {
 	if (owner)
 		g_free (memory);
+	if (mapping)
+		mapping->unref ();
+}
+
+/*
+ * MappedFile
+ */
+
+// how far ahead of a read we ask the kernel to read the file in
+#define MAPPED_FILE_READAHEAD (1024 * 1024)
+
+MappedFile::MappedFile (guint8 *data, gint64 size)
+{
+	this->refcount = 1;
+	this->data = data;
+	this->size = size;
+}
+
+MappedFile::~MappedFile ()
+{
+#if HAVE_SYS_MMAN_H
+	munmap (data, size);
+#endif
+}
+
+MappedFile *
+MappedFile::Map (int fd)
+{
+#if HAVE_SYS_MMAN_H
+	struct stat st;
+	void *data;
+
+	if (fstat (fd, &st) == -1 || st.st_size <= 0 || (guint64) st.st_size > (guint64) G_MAXSIZE)
+		return NULL;
+
+	data = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) {
+		LOG_PIPELINE ("MappedFile::Map (%i): could not map %" G_GINT64_FORMAT " bytes: %s\n", fd, (gint64) st.st_size, strerror (errno));
+		return NULL;
+	}
+
+	madvise (data, st.st_size, MADV_SEQUENTIAL);
+
+	return new MappedFile ((guint8 *) data, st.st_size);
+#else
+	return NULL;
+#endif
+}
+
+void
+MappedFile::ref ()
+{
+	g_atomic_int_inc (&refcount);
+}
+
+void
+MappedFile::unref ()
+{
+	if (g_atomic_int_dec_and_test (&refcount))
+		delete this;
+}
+
+void
+MappedFile::WillNeed (gint64 offset, gint64 length)
+{
+#if HAVE_SYS_MMAN_H
+	long page_size = sysconf (_SC_PAGESIZE);
+	gint64 start = offset - offset % page_size;
+
+	if (start >= size)
+		return;
+
+	madvise (data + start, MIN (length + (offset - start), size - start), MADV_WILLNEED);
+#endif
 }
 
 bool
@@ -3115,6 +3257,20 @@ IMediaStream::IMediaStream (Type::Kind kind, Media *media) : IMediaObject (kind,
 	last_enqueued_demuxed_pts = G_MAXUINT64; // The pts of the last demuxed frame enqueued, initialized to G_MAXUINT64
 	last_enqueued_decoded_pts = G_MAXUINT64; // The pts of the last decoded frame enqueued, initialized to G_MAXUINT64
 	last_available_pts = 0; // The pts of the last available frame, initialized to 0
+
+	buffer_pool = kind == Type::VIDEOSTREAM ? new MediaBufferPool ("video", 4) : NULL;
+}
+
+IMediaStream::~IMediaStream ()
+{
+	// Frames keep their stream alive, so none of the pool's buffers are in use anymore
+	delete buffer_pool;
+}
+
+MediaBufferPool *
+IMediaStream::GetBufferPool ()
+{
+	return buffer_pool != NULL ? buffer_pool : MediaBufferPool::GetSharedPool ();
 }
 
 void
@@ -4440,6 +4596,180 @@ IMediaDemuxer::GetStream (int index)
 	return (index < 0 || index >= stream_count) ? NULL : streams [index];
 }
 
+/*
+ * MediaBufferPool
+ */
+
+MediaBufferPool *MediaBufferPool::shared_pool = NULL;
+
+MediaBufferPool::MediaBufferPool (const char *name, guint32 max_free)
+{
+	this->name = name;
+	this->max_free = max_free;
+	enabled = g_getenv ("MOONLIGHT_NO_FRAME_POOL") == NULL;
+	block_size = 0;
+	free_buffers = g_ptr_array_new ();
+
+	hits = 0;
+	misses = 0;
+	in_use = 0;
+	resident_bytes = 0;
+	peak_resident_bytes = 0;
+}
+
+MediaBufferPool::~MediaBufferPool ()
+{
+	PrintStatistics ();
+
+	mutex.Lock ();
+	ClearUnlocked ();
+	mutex.Unlock ();
+
+	g_ptr_array_free (free_buffers, true);
+}
+
+void
+MediaBufferPool::Initialize ()
+{
+	if (shared_pool == NULL)
+		shared_pool = new MediaBufferPool ("shared", 32);
+}
+
+void
+MediaBufferPool::Shutdown ()
+{
+	// frames might still be alive, so the shared pool itself is never freed
+	if (shared_pool != NULL) {
+		shared_pool->PrintStatistics ();
+		shared_pool->Clear ();
+	}
+}
+
+guint8 *
+MediaBufferPool::Alloc (guint32 size, guint32 *capacity)
+{
+	void *result = NULL;
+	guint32 alloc_size;
+
+	mutex.Lock ();
+
+	if (enabled && size > block_size) {
+		// the buffers we have are too small now
+		ClearUnlocked ();
+		block_size = (size + 4095) & ~4095;
+		LOG_PIPELINE ("MediaBufferPool::Alloc (%u): %s pool block size is now %u bytes\n", size, name, block_size);
+	}
+
+	if (!enabled || size < block_size / 2) {
+		// not worth pooling
+		*capacity = 0;
+		alloc_size = size;
+	} else if (free_buffers->len > 0) {
+		result = g_ptr_array_remove_index_fast (free_buffers, free_buffers->len - 1);
+		*capacity = block_size;
+		in_use++;
+		hits++;
+		alloc_size = 0;
+	} else {
+		*capacity = block_size;
+		alloc_size = block_size;
+	}
+
+	mutex.Unlock ();
+
+	if (alloc_size == 0)
+		return (guint8 *) result;
+
+	if (posix_memalign (&result, MEDIA_BUFFER_POOL_ALIGNMENT, alloc_size) != 0)
+		return NULL;
+
+	if (*capacity != 0) {
+		mutex.Lock ();
+		in_use++;
+		misses++;
+		resident_bytes += *capacity;
+		peak_resident_bytes = MAX (peak_resident_bytes, resident_bytes);
+		mutex.Unlock ();
+	}
+
+	return (guint8 *) result;
+}
+
+void
+MediaBufferPool::Free (guint8 *buffer, guint32 capacity)
+{
+	if (buffer == NULL)
+		return;
+
+	if (capacity == 0) {
+		free (buffer);
+		return;
+	}
+
+	mutex.Lock ();
+	in_use--;
+	if (capacity == block_size && free_buffers->len < max_free) {
+		g_ptr_array_add (free_buffers, buffer);
+		buffer = NULL;
+	} else {
+		resident_bytes -= capacity;
+	}
+	mutex.Unlock ();
+
+	free (buffer);
+}
+
+void
+MediaBufferPool::Reserve (guint32 size)
+{
+	mutex.Lock ();
+	if (size > block_size) {
+		ClearUnlocked ();
+		block_size = (size + 4095) & ~4095;
+	}
+	mutex.Unlock ();
+}
+
+void
+MediaBufferPool::Clear ()
+{
+	mutex.Lock ();
+	ClearUnlocked ();
+	mutex.Unlock ();
+}
+
+void
+MediaBufferPool::ClearUnlocked ()
+{
+	for (guint i = 0; i < free_buffers->len; i++)
+		free (g_ptr_array_index (free_buffers, i));
+	resident_bytes -= (guint64) block_size * free_buffers->len;
+	g_ptr_array_set_size (free_buffers, 0);
+}
+
+void
+MediaBufferPool::GetStatistics (guint64 *hits, guint64 *misses, guint64 *resident_bytes)
+{
+	mutex.Lock ();
+	*hits = this->hits;
+	*misses = this->misses;
+	*resident_bytes = this->resident_bytes;
+	mutex.Unlock ();
+}
+
+void
+MediaBufferPool::PrintStatistics ()
+{
+	mutex.Lock ();
+	if (hits + misses > 0) {
+		LOG_PIPELINE ("MediaBufferPool (%s): %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT " misses (%.1f%% hit rate), "
+			      "%u buffers in use, %" G_GUINT64_FORMAT " KB resident (peak %" G_GUINT64_FORMAT " KB), block size: %u\n",
+			      name, hits, misses, 100.0 * hits / (hits + misses), in_use,
+			      resident_bytes / 1024, peak_resident_bytes / 1024, block_size);
+	}
+	mutex.Unlock ();
+}
+
 /*
  * MediaFrame
  */ 
@@ -4496,11 +4826,15 @@ MediaFrame::AllocateBuffer (guint32 size, guint32 alignment)
 	g_return_val_if_fail (stream != NULL, false);
 
 	buflen = size;
-	if (alignment == 0 || Media::IsMSCodecs1Installed ()) {
+	RemoveState (MediaFramePosixAlloc);
+	RemoveState (MediaFramePooled);
+	if (Media::IsMSCodecs1Installed ()) {
 		buffer = (guint8 *) g_try_malloc (buflen + stream->GetMinPadding ());
-		RemoveState (MediaFramePosixAlloc);
+	} else if (alignment <= MEDIA_BUFFER_POOL_ALIGNMENT) {
+		buffer = stream->GetBufferPool ()->Alloc (buflen + stream->GetMinPadding (), &buffer_capacity);
+		AddState (MediaFramePooled);
 	} else {
-		if (posix_memalign ((void **) &buffer, alignment, size) != 0) {
+		if (posix_memalign ((void **) &buffer, alignment, buflen + stream->GetMinPadding ()) != 0) {
 			stream->ReportErrorOccurred ("Moonlight: could not allcoate memory for next frame");
 			return false;
 		}
@@ -4517,14 +4851,25 @@ MediaFrame::AllocateBuffer (guint32 size, guint32 alignment)
 }
 
 void
-MediaFrame::FreeBuffer ()
+MediaFrame::ReleaseBuffer (guint8 *buffer, guint16 state, guint32 capacity)
 {
-	if ((state & MediaFramePosixAlloc) == MediaFramePosixAlloc) {
+	if ((state & MediaFramePooled) == MediaFramePooled) {
+		stream->GetBufferPool ()->Free (buffer, capacity);
+	} else if ((state & MediaFramePosixAlloc) == MediaFramePosixAlloc) {
 		free (buffer);
 	} else {
 		g_free (buffer);
 	}
+}
+
+void
+MediaFrame::FreeBuffer ()
+{
+	ReleaseBuffer (buffer, state, buffer_capacity);
 	buffer = NULL;
+	buffer_capacity = 0;
+	RemoveState (MediaFramePooled);
+	RemoveState (MediaFramePosixAlloc);
 }
 
 bool
@@ -4540,18 +4885,27 @@ MediaFrame::FetchData (guint32 size, void *data)
 bool
 MediaFrame::PrependData (guint32 size, void *data)
 {
+	guint8 *old_buffer = buffer;
+	guint32 old_buflen = buflen;
+	guint32 old_capacity = buffer_capacity;
+	guint16 old_state = state;
+
 	g_return_val_if_fail (buffer != NULL, false);
 	g_return_val_if_fail (stream != NULL, false);
 
-	buffer = (guint8 *) g_realloc (buffer, buflen + stream->GetMinPadding () + size);
-	if (buffer == NULL) {
-		stream->ReportErrorOccurred ("Moonlight: Could not realloacte memory for current frame");
+	// the buffer might be pooled, so allocate a new one instead of reallocating it
+	buffer = NULL;
+	if (!AllocateBuffer (old_buflen + size)) {
+		buffer = old_buffer;
+		buflen = old_buflen;
+		buffer_capacity = old_capacity;
+		state = old_state;
 		return false;
 	}
 
-	memmove (buffer + size, buffer, buflen);
 	memcpy (buffer, data, size);
-	buflen += size;
+	memcpy (buffer + size, old_buffer, old_buflen);
+	ReleaseBuffer (old_buffer, old_state, old_capacity);
 	return true;
 }
 
@@ -4567,6 +4921,7 @@ MediaFrame::Initialize ()
 	
 	buffer = NULL;
 	buflen = 0;
+	buffer_capacity = 0;
 	state = 0;
 	event = 0;
 	
@@ -4613,8 +4968,7 @@ MediaFrame::Dispose ()
 		if (decoder != NULL)
 			decoder->Cleanup (this);
 	}
-	g_free (buffer);
-	buffer = NULL;
+	FreeBuffer ();
 	if (marker) {
 		marker->unref ();
 		marker = NULL;
@@ -5013,6 +5367,41 @@ IMediaSource::ReadFD (FILE *read_fd, MediaReadClosure *closure)
 	media->unref ();
 }
 
+void
+IMediaSource::ReadMapped (MappedFile *mapping, MediaReadClosure *closure)
+{
+	Media *media;
+	MemoryBuffer *mem;
+	gint64 offset = closure->GetOffset ();
+	gint32 count;
+
+	VERIFY_MEDIA_THREAD;
+
+	LOG_PIPELINE ("IMediaSource::ReadMapped (%p, %p offset: %" G_GINT64_FORMAT " count: %" G_GUINT32_FORMAT ")\n", mapping, closure, offset, closure->GetCount ());
+
+	media = GetMediaReffed ();
+	if (media == NULL) {
+		/* We're most likely disposed */
+		LOG_PIPELINE ("IMediaSource::ReadMapped (): no media, disposed?\n");
+		return;
+	}
+
+	/* Like fread, reading past the end gives a short (or empty) buffer */
+	offset = CLAMP (offset, 0, mapping->GetSize ());
+	count = (gint32) MIN ((gint64) closure->GetCount (), mapping->GetSize () - offset);
+
+	mem = new MemoryBuffer (media, mapping, offset, count);
+	closure->SetData (mem);
+	mem->unref ();
+
+	/* The demuxer will most likely want what comes next */
+	mapping->WillNeed (offset + count, MAPPED_FILE_READAHEAD);
+
+	media->EnqueueWork (closure);
+
+	media->unref ();
+}
+
 void
 IMediaSource::ReadAsync (MediaReadClosure *closure)
 {
@@ -5585,7 +5974,7 @@ PassThroughDecoder::DecodeFrameAsyncInternal (MediaFrame *frame)
 		frame->data_stride [0] = frame->GetBuffer ();
 		frame->data_stride [1] = frame->GetBuffer () + (frame->width*frame->height);
 		frame->data_stride [2] = frame->GetBuffer () + (frame->width*frame->height)+(frame->width/2*frame->height/2);
-		frame->SetBuffer (NULL);
+		// the planes point into the buffer, it's freed with the frame
 		frame->srcStride[0] = frame->width;
 		frame->srcSlideY = frame->width;
 		frame->srcSlideH = frame->height;
@@ -5683,8 +6072,9 @@ NullDecoder::DecodeAudioFrame (MediaFrame *frame)
 
 	data_size  = samples * as->GetChannels () * 2 /* 16 bit audio */;
 
-	frame->SetBufLen (data_size);
-	frame->SetBuffer ((guint8 *) g_malloc0 (data_size));
+	if (!frame->AllocateBuffer (data_size))
+		return MEDIA_FAIL;
+	memset (frame->GetBuffer (), 0, data_size);
 	
 	frame->AddState (MediaFrameDecoded);
 	
@@ -5799,6 +6189,8 @@ NullDecoder::OpenVideo ()
 	}
 
 	SetPixelFormat (MoonPixelFormatRGB32);
+
+	vs->GetBufferPool ()->Reserve (logo_size + vs->GetMinPadding ());
 	
 	return MEDIA_SUCCESS;
 }
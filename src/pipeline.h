@@ -71,6 +71,8 @@ class ProgressiveSource;
 class MediaMarkerFoundClosure;
 class Playlist;
 class MemoryBuffer;
+class MappedFile;
+class MediaBufferPool;
 class MediaLog;
 
 /* @CBindingRequisite */
@@ -502,9 +504,10 @@ private:
 	// set by the demuxer, until then its value must be -1
 	gint32 index; 
 	guint64 pts_per_frame; // Duration (in pts) of each frame. Set to 0 if unknown.
+	MediaBufferPool *buffer_pool; // Only video streams have their own pool, NULL otherwise.
 
 protected:
-	virtual ~IMediaStream () {}
+	virtual ~IMediaStream ();
 	virtual void DecodedFrameEnqueued () {}
 
 	static char *CreateCodec (int codec_id); // converts fourcc int value into a string
@@ -571,6 +574,9 @@ public:
 	gint32 GetMinPadding () { return min_padding; }
 	void SetMinPadding (gint32 value) { min_padding = MAX (min_padding, value); }
 
+	// The pool the buffers of this stream's frames come from (the shared pool for audio streams)
+	MediaBufferPool *GetBufferPool ();
+
 	/* @GenerateCBinding */
 	gint32 GetExtraDataSize () { return extra_data_size; }
 	/* @GenerateCBinding */
@@ -851,17 +857,77 @@ public:
 	static bool IsThreadPoolThread ();
 };
  
+/*
+ * MediaBufferPool
+ *
+ * Recycles the buffers frames are stored in, so that decoding a frame doesn't
+ * have to malloc (and page fault in) a new buffer and free it once it has
+ * been rendered. All the pooled buffers have the same size (the block size),
+ * which grows to fit the biggest buffer requested. Buffers smaller than half
+ * the block size (encoded frames, mostly) are allocated separately.
+ *
+ * Buffers are allocated on the media thread and freed wherever the frame is
+ * disposed, so the pool is thread safe.
+ */
+
+#define MEDIA_BUFFER_POOL_ALIGNMENT 16
+
+class MediaBufferPool {
+private:
+	MoonMutex mutex;
+	const char *name;
+	bool enabled;
+	guint32 block_size;
+	guint32 max_free;
+	GPtrArray *free_buffers;
+
+	guint64 hits;
+	guint64 misses;
+	guint32 in_use; // pooled buffers which have been handed out
+	guint64 resident_bytes; // pooled buffers, handed out or not
+	guint64 peak_resident_bytes;
+
+	static MediaBufferPool *shared_pool;
+
+	void ClearUnlocked ();
+
+public:
+	// @max_free: how many unused buffers to keep around
+	MediaBufferPool (const char *name, guint32 max_free);
+	~MediaBufferPool ();
+
+	// Returns a MEDIA_BUFFER_POOL_ALIGNMENT aligned buffer of at least @size bytes, or
+	// NULL if out of memory. @capacity must be passed to Free when the buffer is returned.
+	guint8 *Alloc (guint32 size, guint32 *capacity);
+	void Free (guint8 *buffer, guint32 capacity);
+
+	// Makes the pooled buffers at least @size bytes, for decoders which know the size of their output
+	void Reserve (guint32 size);
+	// Frees the unused buffers
+	void Clear ();
+
+	void GetStatistics (guint64 *hits, guint64 *misses, guint64 *resident_bytes);
+	void PrintStatistics ();
+
+	// The pool for the frames of audio (and marker) streams
+	static MediaBufferPool *GetSharedPool () { return shared_pool; }
+	static void Initialize ();
+	static void Shutdown ();
+};
+
 class MediaFrame : public EventObject {
 private:
 	// The demuxer sets these to the encoded data which the
 	// decoder then uses and replaces with the decoded data.
 	guint8 *buffer;
 	guint32 buflen;
+	guint32 buffer_capacity; // Passed back to the stream's MediaBufferPool if the buffer is pooled
 	guint32 generation;
 	guint64 duration;
 	guint16 state; // Current state of the frame
 
 	void Initialize ();
+	void ReleaseBuffer (guint8 *buffer, guint16 state, guint32 capacity);
 	
 protected:
 	virtual ~MediaFrame ();
@@ -937,7 +1003,7 @@ public:
 	/* @GeneratePInvoke */
 	guint8* GetBuffer () { return buffer; }
 	/* @GenerateCBinding */
-	void SetBuffer (guint8 *value) { buffer = value; }
+	void SetBuffer (guint8 *value) { buffer = value; RemoveState (MediaFramePooled); }
 	/* @GenerateCBinding */
 	guint64 GetPts () { return pts; }
 	/* @GenerateCBinding */
@@ -1266,6 +1332,8 @@ protected:
 	virtual void ReadAsyncInternal (MediaReadClosure *closure) = 0;
 	
 	void ReadFD (FILE *read_fd, MediaReadClosure *closure);
+	/* Like ReadFD, but hands out a MemoryBuffer pointing into the mapping instead of copying */
+	void ReadMapped (MappedFile *mapping, MediaReadClosure *closure);
 	
 public:
 	/* @SkipFactories */
@@ -1326,6 +1394,8 @@ private:
 	gint64 size;
 	FILE *fd;
 	char *filename;
+	MappedFile *mapping; /* NULL if the file couldn't be mapped, reads go through fd then */
+	gint64 position; /* only used with the mapping */
 
 protected:
 	
@@ -1358,6 +1428,8 @@ private:
 	// handlers, one for reading and one for writing.
 	FILE *write_fd;
 	FILE *read_fd;
+	MappedFile *mapping; /* Mapped (on the media thread) once the download is complete. Needs mutex locked. */
+	bool mapping_failed;
 	char *filename;
 	Uri *uri;
 	Uri *resource_base;
@@ -1424,6 +1496,37 @@ public:
 #endif
 };
 
+/*
+ * MappedFile
+ *
+ * A read-only mmap of an entire file. It's shared (refcounted) by the
+ * MemoryBuffers which point into it, so the file can be closed while
+ * buffers are still alive.
+ */
+class MappedFile {
+private:
+	gint32 refcount;
+	guint8 *data;
+	gint64 size;
+
+	MappedFile (guint8 *data, gint64 size);
+	~MappedFile ();
+
+public:
+	/* Returns NULL if the file can't be mapped (empty, too big for the address space,
+	 * or the system doesn't support it), the caller should read the file instead */
+	static MappedFile *Map (int fd);
+
+	void ref ();
+	void unref ();
+
+	guint8 *GetData () { return data; }
+	gint64 GetSize () { return size; }
+
+	/* Asks the kernel to start reading the given range in */
+	void WillNeed (gint64 offset, gint64 length);
+};
+
 /*
  * MemoryBuffer
  */
@@ -1433,6 +1536,7 @@ private:
 	gint32 size;
 	gint32 pos;
 	bool owner;
+	MappedFile *mapping;
 
 protected:
 	virtual ~MemoryBuffer ();
@@ -1440,6 +1544,9 @@ protected:
 public:
 	/* @SkipFactories */
 	MemoryBuffer (Media *media, void *memory, gint32 size, bool owner);
+	// A view of @size bytes at @offset into @mapping (which is reffed)
+	/* @SkipFactories */
+	MemoryBuffer (Media *media, MappedFile *mapping, gint64 offset, gint32 size);
 
 	void *GetCurrentPtr () { return pos + (guint8 *) memory; }
 	gint64 GetSize () { return size; }
@@ -57,6 +57,17 @@ LocalPropertyValueProvider::ClearValue (DependencyProperty *property)
 	g_hash_table_remove (local_values, property);
 }
 
+Value *
+LocalPropertyValueProvider::TakeValue (DependencyProperty *property)
+{
+	Value *value = (Value *) g_hash_table_lookup (local_values, property);
+
+	if (value)
+		g_hash_table_steal (local_values, property);
+
+	return value;
+}
+
 void
 LocalPropertyValueProvider::SetValue (DependencyProperty *property, Value *new_value)
 {
@@ -1168,6 +1179,17 @@ AutoCreatePropertyValueProvider::ClearValue (DependencyProperty *property)
 	g_hash_table_remove (auto_values, property);
 }
 
+Value *
+AutoCreatePropertyValueProvider::TakeValue (DependencyProperty *property)
+{
+	Value *value = (Value *) g_hash_table_lookup (auto_values, property);
+
+	if (value)
+		g_hash_table_steal (auto_values, property);
+
+	return value;
+}
+
 Value* 
 AutoCreators::default_autocreator (Type::Kind kind, DependencyProperty *property, DependencyObject *forObj)
 {
@@ -112,6 +112,8 @@ public:
 	virtual void ForeachValue (GHFunc func, gpointer data);
 	void SetValue (DependencyProperty *property, Value *value);
 	void ClearValue (DependencyProperty *property);
+	/* removes the value without freeing it, the caller owns the result */
+	Value *TakeValue (DependencyProperty *property);
 
 
  private:
@@ -268,6 +270,8 @@ class AutoCreatePropertyValueProvider : public PropertyValueProvider {
 	
 	Value *ReadLocalValue (DependencyProperty *property);
 	void ClearValue (DependencyProperty *property);
+	/* removes the value without freeing it, the caller owns the result */
+	Value *TakeValue (DependencyProperty *property);
 
 	virtual void RecomputePropertyValue (DependencyProperty *property, ProviderFlags flags, MoonError *error);
 
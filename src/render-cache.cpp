@@ -0,0 +1,273 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * render-cache.cpp: a memory budget shared by the render caches
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "render-cache.h"
+#include "runtime.h"
+
+namespace Moonlight {
+
+#define RENDER_CACHE_DEFAULT_BUDGET (256 * 1024 * 1024)
+
+static const char *category_names [] = { "bitmap cache", "images", "media", "shapes" };
+
+/*
+ * RenderCache::Entry
+ */
+
+RenderCache::Entry::Entry (RenderCacheCategory category, int cost)
+{
+	this->category = category;
+	this->cost = cost;
+	size = 0;
+	last_used = 0;
+	resident = false;
+	prev = NULL;
+	next = NULL;
+}
+
+RenderCache::Entry::~Entry ()
+{
+	Remove ();
+}
+
+void
+RenderCache::Entry::Add (gint64 size)
+{
+	RenderCache *cache = RenderCache::GetInstance ();
+
+	if (resident)
+		cache->Unlink (this);
+
+	this->size = size;
+	cache->Link (this);
+}
+
+void
+RenderCache::Entry::Resize (gint64 size)
+{
+	RenderCache *cache = RenderCache::instance;
+
+	if (!resident || cache == NULL)
+		return;
+
+	cache->residency [category] += size - this->size;
+	cache->total += size - this->size;
+	if (cache->total > cache->peak)
+		cache->peak = cache->total;
+
+	this->size = size;
+}
+
+void
+RenderCache::Entry::Remove ()
+{
+	if (!resident)
+		return;
+
+	if (RenderCache::instance != NULL)
+		RenderCache::instance->Unlink (this);
+
+	resident = false;
+	size = 0;
+}
+
+void
+RenderCache::Entry::Touch ()
+{
+	RenderCache *cache = RenderCache::instance;
+
+	if (!resident || cache == NULL || (last_used == cache->frame && cache->tail == this))
+		return;
+
+	cache->Unlink (this);
+	cache->Link (this);
+}
+
+/*
+ * RenderCache
+ */
+
+RenderCache *RenderCache::instance = NULL;
+
+RenderCache::RenderCache (gint64 budget)
+{
+	this->budget = budget;
+	head = NULL;
+	tail = NULL;
+	frame = 1;
+	total = 0;
+	peak = 0;
+	print_stats = false;
+
+	for (int i = 0; i < RenderCacheCategoryCount; i++) {
+		residency [i] = 0;
+		evictions [i] = 0;
+	}
+}
+
+RenderCache *
+RenderCache::GetInstance ()
+{
+	gint64 budget = RENDER_CACHE_DEFAULT_BUDGET;
+	bool print_stats = false;
+	const char *env;
+
+	VERIFY_MAIN_THREAD;
+
+	if (instance != NULL)
+		return instance;
+
+	/* MOONLIGHT_RENDER_CACHE=size=<megabytes>,stats=yes */
+	if ((env = g_getenv ("MOONLIGHT_RENDER_CACHE")) != NULL) {
+		char **options = g_strsplit (env, ",", -1);
+		for (int i = 0; options [i] != NULL; i++) {
+			const char *option = options [i];
+			if (!strncmp (option, "size=", 5)) {
+				budget = (gint64) atoi (option + 5) * 1024 * 1024;
+			} else if (!strcmp (option, "stats=yes")) {
+				print_stats = true;
+			} else {
+				printf ("Moonlight: unknown MOONLIGHT_RENDER_CACHE option: '%s'\n", option);
+			}
+		}
+		g_strfreev (options);
+	}
+
+	instance = new RenderCache (MAX (budget, 0));
+	instance->print_stats = print_stats;
+
+	return instance;
+}
+
+void
+RenderCache::Shutdown ()
+{
+	Entry *entry, *next;
+
+	if (instance == NULL)
+		return;
+
+	if (instance->print_stats)
+		instance->PrintStatistics ();
+
+	/* the entries still alive forget about the list */
+	for (entry = instance->head; entry != NULL; entry = next) {
+		next = entry->next;
+		entry->prev = NULL;
+		entry->next = NULL;
+		entry->resident = false;
+		entry->size = 0;
+	}
+
+	delete instance;
+	instance = NULL;
+}
+
+void
+RenderCache::Link (Entry *entry)
+{
+	entry->prev = tail;
+	entry->next = NULL;
+	if (tail)
+		tail->next = entry;
+	else
+		head = entry;
+	tail = entry;
+
+	entry->resident = true;
+	entry->last_used = frame;
+
+	residency [entry->category] += entry->size;
+	total += entry->size;
+	if (total > peak)
+		peak = total;
+}
+
+void
+RenderCache::Unlink (Entry *entry)
+{
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		head = entry->next;
+
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		tail = entry->prev;
+
+	entry->prev = NULL;
+	entry->next = NULL;
+
+	residency [entry->category] -= entry->size;
+	total -= entry->size;
+}
+
+void
+RenderCache::SetBudget (gint64 budget)
+{
+	this->budget = MAX (budget, 0);
+	Trim ();
+}
+
+void
+RenderCache::FrameRendered ()
+{
+	Trim ();
+	frame++;
+}
+
+void
+RenderCache::Trim ()
+{
+	Entry *entry, *next;
+
+	if (budget == 0)
+		return;
+
+	// evict the cheap entries first, even if a more expensive one is
+	// older, and only then the expensive ones.
+	for (int cost = RENDER_CACHE_COST_LOW; cost <= RENDER_CACHE_COST_HIGH && total > budget; cost++) {
+		for (entry = head; entry != NULL && total > budget; entry = next) {
+			next = entry->next;
+
+			// everything from here on has been used in this frame
+			if (entry->last_used == frame)
+				break;
+
+			if (entry->cost > cost)
+				continue;
+
+			evictions [entry->category]++;
+			entry->Remove ();
+			entry->Evict ();
+		}
+	}
+}
+
+void
+RenderCache::PrintStatistics ()
+{
+	printf ("RenderCache: %.3f MB in use (peak %.3f MB) of a %.3f MB budget\n",
+		total / 1048576.0, peak / 1048576.0, budget / 1048576.0);
+
+	for (int i = 0; i < RenderCacheCategoryCount; i++)
+		printf ("    %-12s %10.3f MB, %u evictions\n", category_names [i], residency [i] / 1048576.0, evictions [i]);
+}
+
+};
@@ -0,0 +1,120 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * render-cache.h: a memory budget shared by the render caches
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#ifndef __MOON_RENDER_CACHE_H__
+#define __MOON_RENDER_CACHE_H__
+
+#include <glib.h>
+
+namespace Moonlight {
+
+enum RenderCacheCategory {
+	RenderCacheBitmapCache,	/* UIElement.CacheMode */
+	RenderCacheImage,	/* BitmapSource pixels uploaded to a native surface */
+	RenderCacheMedia,	/* the current video frame */
+	RenderCacheShape,	/* rasterized shapes */
+	RenderCacheCategoryCount,
+};
+
+/* what it costs to recreate an evicted entry, cheap entries are evicted first */
+#define RENDER_CACHE_COST_LOW 1		/* a blit from memory we still have */
+#define RENDER_CACHE_COST_MEDIUM 2	/* rasterizing a path */
+#define RENDER_CACHE_COST_HIGH 3	/* rendering a subtree */
+
+/*
+ * RenderCache
+ *   Keeps track of the surfaces the render caches hold on to, in least
+ *   recently used order, and evicts the least recently used ones (the
+ *   cheapest to recreate first) when their total size goes over the
+ *   budget. Entries used in the frame being rendered are never evicted,
+ *   so the budget can be exceeded for a frame which needs them all.
+ *
+ *   It must only be used from the main thread.
+ *
+ *   Configured with MOONLIGHT_RENDER_CACHE=size=<megabytes>,stats=yes,
+ *   size=0 removes the limit.
+ */
+
+class RenderCache {
+public:
+	class Entry {
+	public:
+		Entry (RenderCacheCategory category, int cost);
+		virtual ~Entry ();
+
+		/* @size bytes are cached now, the entry counts as used in this frame */
+		void Add (gint64 size);
+		/* the resident data is @size bytes now, it doesn't count as used */
+		void Resize (gint64 size);
+		/* the cached data is gone */
+		void Remove ();
+		/* the cached data was used in this frame */
+		void Touch ();
+
+		bool IsResident () { return resident; }
+		gint64 GetSize () { return size; }
+
+	protected:
+		/* drop the cached data, Remove has already been called.
+		 * Must not destroy any other entry, the caller is walking the list */
+		virtual void Evict () = 0;
+
+	private:
+		RenderCacheCategory category;
+		int cost;
+		gint64 size;
+		guint32 last_used; /* frame */
+		bool resident;
+		Entry *prev; /* towards the least recently used entry */
+		Entry *next;
+
+		friend class RenderCache;
+	};
+
+	static RenderCache *GetInstance ();
+	static void Shutdown ();
+
+	/* Called when a frame has been rendered, evicts entries until the total is within the budget */
+	void FrameRendered ();
+
+	/* bytes */
+	gint64 GetBudget () { return budget; }
+	void SetBudget (gint64 budget);
+	gint64 GetResidency () { return total; }
+	gint64 GetResidency (RenderCacheCategory category) { return residency [category]; }
+
+	void PrintStatistics ();
+
+private:
+	Entry *head; /* least recently used */
+	Entry *tail; /* most recently used */
+	guint32 frame;
+	gint64 budget;
+	gint64 total;
+	gint64 residency [RenderCacheCategoryCount];
+	bool print_stats;
+
+	/* statistics */
+	guint32 evictions [RenderCacheCategoryCount];
+	gint64 peak;
+
+	static RenderCache *instance;
+
+	RenderCache (gint64 budget);
+
+	void Link (Entry *entry);
+	void Unlink (Entry *entry);
+	void Trim ();
+};
+
+};
+#endif /* __MOON_RENDER_CACHE_H__ */
@@ -18,6 +18,7 @@
 #include "error.h"
 #include "deployment.h"
 #include "factory.h"
+#include "debug.h"
 
 namespace Moonlight {
 
@@ -169,12 +170,36 @@ ResourceDictionaryIterator::GetCurrentKey (MoonError *err)
 // ResourceDictionary
 //
 
+//
+// An entry which is kept as xaml until it's looked up. The parse data
+// is the XamlContext the xaml is parsed in, which is usually shared by
+// all the deferred entries of a dictionary.
+//
+
+struct DeferredResource {
+	parse_resource_func *parse;
+	Value *parse_data;
+	char *xaml;
+};
+
+static void
+free_deferred_resource (DeferredResource *resource)
+{
+	delete resource->parse_data;
+	g_free (resource->xaml);
+	g_free (resource);
+}
+
 static void
 free_value (Value *value)
 {
 	delete value;
 }
 
+guint32 ResourceDictionary::deferred_count = 0;
+guint32 ResourceDictionary::realized_count = 0;
+guint32 ResourceDictionary::discarded_count = 0;
+
 ResourceDictionary::ResourceDictionary ()
 {
 	SetObjectType (Type::RESOURCE_DICTIONARY);
@@ -182,6 +207,7 @@ ResourceDictionary::ResourceDictionary ()
 				      g_str_equal,
 				      (GDestroyNotify)g_free,
 				      (GDestroyNotify)free_value);
+	deferred = NULL;
 	from_resource_dictionary_api = false;
 	source = NULL;
 
@@ -192,6 +218,7 @@ ResourceDictionary::ResourceDictionary ()
 
 ResourceDictionary::~ResourceDictionary ()
 {
+	ClearDeferred ();
 	g_hash_table_destroy (hash);
 
 	g_free (source);
@@ -202,9 +229,150 @@ ResourceDictionary::~ResourceDictionary ()
 #endif
 }
 
+void
+ResourceDictionary::Dispose ()
+{
+	ClearDeferred ();
+	Collection::Dispose ();
+}
+
+void
+ResourceDictionary::ShuttingDownEventHandler (Deployment *sender, EventArgs *args)
+{
+	// The xaml context of the deferred entries refs this dictionary (and
+	// the elements it belongs to), so drop them now or we'd never be
+	// destroyed. Clearing them may drop the last ref to us.
+	ref ();
+	ClearDeferred ();
+	unref ();
+}
+
+void
+ResourceDictionary::ClearDeferred ()
+{
+	if (!deferred)
+		return;
+
+	guint32 count = g_hash_table_size (deferred);
+	GHashTable *entries = deferred;
+
+	discarded_count += count;
+	if (count > 0)
+		LOG_XAML ("ResourceDictionary::ClearDeferred (): %p dropped %u entries which were never used (%u of %u deferred entries realized so far)\n",
+			  this, count, realized_count, deferred_count);
+
+	// destroying the entries may unref us
+	deferred = NULL;
+	g_hash_table_destroy (entries);
+
+	GetDeployment ()->RemoveHandler (Deployment::ShuttingDownEvent, ShuttingDownEventCallback, this);
+}
+
+void
+ResourceDictionary::GetDeferredStatistics (guint32 *deferred, guint32 *realized, guint32 *discarded)
+{
+	*deferred = deferred_count;
+	*realized = realized_count;
+	*discarded = discarded_count;
+}
+
+bool
+ResourceDictionary::AddDeferredWithError (const char *key, parse_resource_func *parse, Value *parse_data, const char *xaml, MoonError *error)
+{
+	if (!key) {
+		MoonError::FillIn (error, MoonError::ARGUMENT_NULL, "key was null");
+		return false;
+	}
+
+	if (IsDeferred (key) || g_hash_table_lookup (hash, key)) {
+		MoonError::FillIn (error, MoonError::ARGUMENT, "An item with the same key has already been added");
+		return false;
+	}
+
+	if (!deferred) {
+		deferred = g_hash_table_new_full (g_str_hash, g_str_equal, (GDestroyNotify) g_free, (GDestroyNotify) free_deferred_resource);
+		GetDeployment ()->AddHandler (Deployment::ShuttingDownEvent, ShuttingDownEventCallback, this);
+	}
+
+	DeferredResource *resource = g_new (DeferredResource, 1);
+	resource->parse = parse;
+	resource->parse_data = new Value (*parse_data);
+	resource->xaml = g_strdup (xaml);
+
+	g_hash_table_insert (deferred, g_strdup (key), resource);
+	deferred_count++;
+
+	return true;
+}
+
+void
+ResourceDictionary::Realize (const char *key)
+{
+	DependencyObject *obj;
+	DeferredResource *resource;
+	char *orig_key;
+	MoonError err;
+
+	if (!g_hash_table_lookup_extended (deferred, key, (gpointer *) &orig_key, (gpointer *) &resource))
+		return;
+
+	// take the entry out first, a lookup of the same key while it's
+	// being parsed must not find it again
+	g_hash_table_steal (deferred, key);
+	realized_count++;
+
+	if (g_hash_table_size (deferred) == 0)
+		ClearDeferred ();
+
+	obj = resource->parse (resource->parse_data, GetResourceBaseRecursive (), resource->xaml, &err);
+
+	if (obj) {
+		Value v (obj);
+		obj->unref ();
+		if (!AddWithError (orig_key, &v, &err))
+			obj = NULL;
+	}
+
+	if (!obj)
+		g_warning ("Moonlight: could not create the resource '%s': %s", orig_key, err.message ? err.message : "unknown error");
+
+	g_free (orig_key);
+	free_deferred_resource (resource);
+}
+
+void
+ResourceDictionary::RealizeDeferred ()
+{
+	GList *keys, *walk;
+
+	if (!deferred)
+		return;
+
+	keys = g_hash_table_get_keys (deferred);
+	for (walk = keys; walk; walk = walk->next) {
+		char *key = g_strdup ((const char *) walk->data);
+		// realizing an entry may have realized (or removed) others
+		if (deferred && IsDeferred (key))
+			Realize (key);
+		g_free (key);
+	}
+	g_list_free (keys);
+}
+
+bool
+ResourceDictionary::RealizeDeferredKey (const char *key)
+{
+	if (!key || !IsDeferred (key))
+		return false;
+
+	Realize (key);
+	return true;
+}
+
 CollectionIterator *
 ResourceDictionary::GetIterator ()
 {
+	RealizeDeferred ();
 	return new ResourceDictionaryIterator (this);
 }
 
@@ -297,6 +465,8 @@ _true ()
 bool
 ResourceDictionary::Clear ()
 {
+	ClearDeferred ();
+
 	EmitChanged (CollectionChangedActionClearing, NULL, NULL, NULL);
 
 	from_resource_dictionary_api = true;
@@ -326,6 +496,8 @@ bool
 ResourceDictionary::ContainsKey (const char *key)
 {
 	bool exists = false;
+	if (key && IsDeferred (key))
+		return true;
 	if (key)
 		Get (key, &exists);
 	return exists;
@@ -337,6 +509,13 @@ ResourceDictionary::Remove (const char *key)
 	if (!key)
 		return false;
 
+	/* deferred entries were never added to the collection */
+	if (IsDeferred (key)) {
+		g_hash_table_remove (deferred, key);
+		discarded_count++;
+		return true;
+	}
+
 	/* check if the item exists first */
 	Value* orig_value;
 	gpointer orig_key;
@@ -367,6 +546,9 @@ ResourceDictionary::Remove (const char *key)
 bool
 ResourceDictionary::Set (const char *key, Value *value)
 {
+	if (IsDeferred (key))
+		Realize (key);
+
 	/* check if the item exists first */
 	Value* orig_value;
 	gpointer orig_key;
@@ -399,6 +581,9 @@ ResourceDictionary::Get (const char *key, bool *exists)
 	Value *v = NULL;
 	gpointer orig_key;
 
+	if (IsDeferred (key))
+		Realize (key);
+
 	*exists = g_hash_table_lookup_extended (hash, key,
 						&orig_key, (gpointer*)&v);
 
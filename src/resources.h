@@ -18,6 +18,12 @@
 
 namespace Moonlight {
 
+class Uri;
+struct DeferredResource;
+
+/* Creates the object of a deferred resource from its xaml, returns a reffed object */
+typedef DependencyObject *parse_resource_func (Value *data, const Uri *resource_base, const char *xaml, MoonError *error);
+
 class ResourceDictionaryIterator : public CollectionIterator {
 #ifdef HAVE_G_HASH_TABLE_ITER
 	GHashTableIter iter;
@@ -63,6 +69,24 @@ public:
 	/* @GeneratePInvoke */
 	bool AddWithError (const char* key, Value *value, MoonError *error);
 
+	/* Adds an entry which is created from @xaml (by @parse, which is
+	 * passed @parse_data) the first time it's looked up. If it can't be
+	 * created that lookup warns and finds nothing, the entry is gone */
+	bool AddDeferredWithError (const char *key, parse_resource_func *parse, Value *parse_data, const char *xaml, MoonError *error);
+
+	/* @GeneratePInvoke */
+	void RealizeDeferred ();
+
+	/* Creates the deferred entry for @key (if there is one), returns
+	 * whether there was one */
+	/* @GeneratePInvoke */
+	bool RealizeDeferredKey (const char *key);
+
+	/* How many entries have been added as deferred entries, how many of
+	 * those have been realized and how many were dropped without ever
+	 * being looked up, for all dictionaries */
+	static void GetDeferredStatistics (guint32 *deferred, guint32 *realized, guint32 *discarded);
+
 	/* @GeneratePInvoke */
 	bool Clear ();
 
@@ -86,6 +110,8 @@ public:
 	void SetInternalSourceWithError (const char* source, MoonError *error);
 	const char* GetInternalSource ();
 
+	virtual void Dispose ();
+
 	virtual void OnIsAttachedChanged (bool value);
 	virtual void UnregisterAllNamesRootedAt (NameScope *from_ns);
 	virtual void RegisterAllNamesRootedAt (NameScope *to_ns, MoonError *error);
@@ -110,8 +136,19 @@ protected:
 
 private:
 	GHashTable *hash;
+	GHashTable *deferred; /* key -> DeferredResource, created on demand */
 	bool from_resource_dictionary_api;
 	char *source;
+
+	static guint32 deferred_count;
+	static guint32 realized_count;
+	static guint32 discarded_count;
+
+	bool IsDeferred (const char *key) { return deferred && g_hash_table_lookup (deferred, key) != NULL; }
+	void Realize (const char *key);
+	void ClearDeferred ();
+
+	EVENTHANDLER (ResourceDictionary, ShuttingDownEvent, Deployment, EventArgs);
 };
 
 };
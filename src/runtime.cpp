@@ -29,6 +29,8 @@
 #include "transform.h"
 #include "animation.h"
 #include "downloader.h"
+#include "network-cache.h"
+#include "font-index-cache.h"
 #include "frameworkelement.h"
 #include "textblock.h"
 #include "media.h"
@@ -41,6 +43,8 @@
 #include "fullscreen.h"
 #include "incomplete-support.h"
 #include "framerate-display.h"
+#include "frame-profiler.h"
+#include "render-cache.h"
 #include "drm.h"
 #include "jpeg.h"
 #include "utils.h"
@@ -89,6 +93,10 @@ namespace Moonlight {
 
 #define NO_EVENT_ID -1
 
+// where the frame time graph goes, right below the frame rate counter
+#define FRAME_GRAPH_X 0
+#define FRAME_GRAPH_Y 20
+
 bool Surface::main_thread_inited = false;
 MoonThread* Surface::main_thread = 0;
 
@@ -130,6 +138,8 @@ static MoonlightRuntimeOption options [] = {
 	{ RUNTIME_INIT_AUDIO_ALSA,            "alsa",              "yes",        "no" },
 	{ RUNTIME_INIT_AUDIO_OPENSLES,        "opensles",          "yes",        "no" },
 	{ RUNTIME_INIT_AUDIO_ALSA_RW,         "alsa-rw",           "yes",        "no" },
+	{ RUNTIME_INIT_AUDIO_MIXER,           "audio-mixer",       "yes",        "no" },
+	{ RUNTIME_INIT_AUDIO_NULL,            "null-audio",        "yes",        "no" },
 	{ RUNTIME_INIT_USE_IDLE_HINT,         "idlehint",          "yes",        "no" },
 	{ RUNTIME_INIT_KEEP_MEDIA,            "keepmedia",         "yes",        "no",     true,            "Don't remove media files from /tmp after download" },
 	{ RUNTIME_INIT_ALL_IMAGE_FORMATS,     "allimages",         "yes",        "no" },
@@ -141,6 +151,9 @@ static MoonlightRuntimeOption options [] = {
 #ifdef USE_GLX
 	{ RUNTIME_INIT_HW_ACCELERATION,       "hwaccel",            "yes",       "no",     true,            "Use hardware acceleration" },
 #endif
+#ifdef USE_GALLIUM
+	{ RUNTIME_INIT_GALLIUM_SOFTPIPE,      "gallium",           "softpipe",   "default" },
+#endif
 
 	{ (RuntimeInitFlag)0 }
 
@@ -308,6 +321,7 @@ static void
 cache_report_default (Surface *surface, long bytes, void *user_data)
 {
 	printf ("Cache size is ~%.3f MB\n", bytes / 1048576.0);
+	RenderCache::GetInstance ()->PrintStatistics ();
 }
 
 GList *
@@ -426,6 +440,7 @@ Surface::Surface (MoonWindow *window)
 	expose_handoff_last_timespan = G_MAXINT64; 
 	
 	enable_redraw_regions = false;
+	raw_damage = NULL;
 	
 	emittingMouseEvent = false;
 	pendingCapture = NULL;
@@ -479,6 +494,7 @@ Surface::~Surface ()
 	
 	delete up_dirty;
 	delete down_dirty;
+	delete raw_damage;
 
 	surface_list = g_list_remove (surface_list, this);
 }
@@ -504,6 +520,10 @@ Surface::Zombify ()
 	}
 	input_list->Clear (true);
 	focus_changed_events->Clear (true);
+
+	damage.Clear ();
+	delete raw_damage;
+	raw_damage = NULL;
 }
 
 guint32
@@ -820,12 +840,39 @@ Surface::DetachLayer (UIElement *layer)
 void
 Surface::Invalidate (Rect r)
 {
-	active_window->Invalidate (r);
+	if (zombie)
+		return;
+
+	damage.Add (r);
+	time_manager->NeedRedraw ();
+}
+
+void
+Surface::FlushDamage ()
+{
+	int count = damage.GetRectangleCount ();
+
+	if (damage.IsEmpty ())
+		return;
+
+	if (active_window) {
+		for (int i = 0; i < count; i++)
+			active_window->Invalidate (damage.GetRectangle (i));
+	}
+
+	if (GetEnableRedrawRegions ()) {
+		delete raw_damage;
+		raw_damage = damage.TakeRaw ();
+	}
+
+	damage.Clear ();
+	damage.SetKeepRaw (GetEnableRedrawRegions ());
 }
 
 void
 Surface::ProcessUpdates ()
 {
+	FlushDamage ();
 	active_window->ProcessUpdates();
 }
 
@@ -912,10 +959,7 @@ Surface::Paint (Context *ctx, Region *region, bool transparent, bool clear_trans
 
 	frames++;
 
-#if OCCLUSION_CULLING_STATS
-	uielements_rendered_with_occlusion_culling = 0;
-	uielements_rendered_with_painters = 0;
-#endif
+	PROFILE_PHASE_START (FrameProfilerPaint);
 
 	// mono_gc_disable ();
 	// GetDeployment()->DisableToggleRefs ();
@@ -1001,19 +1045,34 @@ Surface::Paint (Context *ctx, Region *region, bool transparent, bool clear_trans
 		cairo_set_source_rgba (cr, (double) r / 255.0, (double) g / 255.0, (double) b / 255.0, 0.75);
 		cairo_fill (cr);
 
+		// outline what was invalidated before it was merged into
+		// the region above
+		if (raw_damage) {
+			cairo_new_path (cr);
+			raw_damage->Draw (cr);
+			cairo_set_line_width (cr, 1.0);
+			cairo_set_source_rgba (cr, 1.0, 0.0, 0.0, 0.9);
+			cairo_stroke (cr);
+
+			delete raw_damage;
+			raw_damage = NULL;
+		}
+
 		ctx->Pop ();
 	}
 
+	if (GetEnableFrameRateCounter () && time_manager->GetProfiler ()->IsEnabled ()) {
+		cairo_t *cr = ctx->Push (Context::Cairo ());
+		time_manager->GetProfiler ()->DrawGraph (cr, FRAME_GRAPH_X, FRAME_GRAPH_Y);
+		ctx->Pop ();
+	}
 
 	delete render_list;
 
+	PROFILE_PHASE_END (FrameProfilerPaint);
+
 	// GetDeployment()->EnableToggleRefs ();
 	// mono_gc_enable ();
-
-#if OCCLUSION_CULLING_STATS
-	printf ("%d UIElements rendered using occlusion culling for Surface::Paint (%p)\n", uielements_rendered_with_occlusion_culling, this);
-	printf ("%d UIElements rendered using normal painter's algorithm for Surface::Paint (%p)\n", uielements_rendered_with_painters, this);
-#endif
 }
 
 void
@@ -1477,6 +1536,8 @@ Surface::SetEnableFrameRateCounter (bool value)
 	else {
 		HideFrameRateCounter ();
 	}
+
+	time_manager->GetProfiler ()->SetEnabled (GetEnableFrameRateCounter ());
 }
 
 bool
@@ -1573,6 +1634,11 @@ Surface::UpdateFrameRateCounter (gint64 now)
 
 	fps_nframes = 0;
 	fps_start = now;
+
+	// redraw the frame time graph at the same rate as the counters
+	double width, height;
+	FrameProfiler::GetGraphSize (&width, &height);
+	Invalidate (Rect (FRAME_GRAPH_X, FRAME_GRAPH_Y, width, height));
 }
 
 void
@@ -1613,6 +1679,7 @@ Surface::render_cb (EventObject *sender, EventArgs *calldata, gpointer closure)
 		s->down_dirty->Clear (true);
 	} else {
 		dirty = s->ProcessDirtyElements ();
+		s->FlushDamage ();
 	}
 
 	if (s->expose_handoff) {
@@ -1628,11 +1695,17 @@ Surface::render_cb (EventObject *sender, EventArgs *calldata, gpointer closure)
 	GDK_THREADS_LEAVE ();
 #endif
 
-	if (s->GetEnableFrameRateCounter () && s->fps_start == 0)
+	if (s->GetEnableFrameRateCounter () && s->fps_start == 0) {
 		s->fps_start = get_now ();
+		s->time_manager->GetProfiler ()->SetEnabled (true);
+	}
 	
 	if (dirty) {
+		PROFILE_PHASE_START (FrameProfilerPresent);
 		s->ProcessUpdates ();
+		PROFILE_PHASE_END (FrameProfilerPresent);
+
+		RenderCache::GetInstance ()->FrameRendered ();
 	}
 
 	if (s->GetEnableFrameRateCounter ()) {
@@ -1725,16 +1798,14 @@ RenderNode::Render (Context *ctx)
 {
 	bool use_occlusion_culling = uielement->UseOcclusionCulling ();
 
-#if OCCLUSION_CULLING_STATS
-	if (use_occlusion_culling)
-		uielements_rendered_with_occlusion_culling ++;
-#endif
-
 	if (pre_render)
 		pre_render (ctx, uielement, region, use_occlusion_culling);
 
-	if (render_element && ctx->IsMutable ())
+	if (render_element && ctx->IsMutable ()) {
+		PROFILE_COUNT (FrameProfilerRendered);
+		PROFILE_COUNT (FrameProfilerRenderedFrontToBack);
 		uielement->Render (ctx, region);
+	}
 	
 	if (post_render)
 		post_render (ctx, uielement, region, use_occlusion_culling);
@@ -2962,6 +3033,16 @@ Runtime::Shutdown (void)
 		return;
 
 	Media::Shutdown ();
+	HttpCache::Shutdown ();
+	FontIndexCache::Shutdown ();
+	RenderCache::Shutdown ();
+
+#if LOGGING
+	guint64 allocated, recycled;
+
+	Value::GetAllocationStatistics (&allocated, &recycled);
+	LOG_VALUE ("Runtime::Shutdown (): %" G_GUINT64_FORMAT " Values and boxed structs allocated, %" G_GUINT64_FORMAT " of them recycled\n", allocated, recycled);
+#endif
 	
 	inited = false;
 
@@ -24,6 +24,7 @@
 #include "type.h"
 #include "list.h"
 #include "error.h"
+#include "damage.h"
 
 #include "pal.h"
 
@@ -31,8 +32,6 @@ namespace Moonlight {
 
 #define MAXIMUM_CACHE_SIZE 6000000
 
-#define OCCLUSION_CULLING_STATS 0
-
 #define TIMERS 0
 #define DEBUG_MARKER_KEY 0
 #if TIMERS
@@ -69,6 +68,7 @@ enum RuntimeInitFlag {
 	RUNTIME_INIT_USE_UPDATE_POSITION   = 1 << 12,
 	RUNTIME_INIT_ALLOW_WINDOWLESS      = 1 << 13,
 	RUNTIME_INIT_AUDIO_ALSA_RW         = 1 << 14,
+	RUNTIME_INIT_AUDIO_NULL            = 1 << 15,
 	RUNTIME_INIT_AUDIO_ALSA            = 1 << 16,
 	RUNTIME_INIT_AUDIO_PULSE           = 1 << 17,
 	RUNTIME_INIT_AUDIO_OPENSLES        = 1 << 18,
@@ -83,6 +83,9 @@ enum RuntimeInitFlag {
 	RUNTIME_INIT_ENABLE_TOGGLEREFS	   = 1 << 27,
 	RUNTIME_INIT_OOB_LAUNCHER_FIREFOX  = 1 << 28,
 	RUNTIME_INIT_HW_ACCELERATION       = 1 << 29,
+	RUNTIME_INIT_AUDIO_MIXER           = 1 << 30,
+	/* the last bit of moonlight_flags (a guint32), it must not be a signed shift */
+	RUNTIME_INIT_GALLIUM_SOFTPIPE      = 1U << 31,
 };
 
 struct MoonlightRuntimeOption {
@@ -224,8 +227,10 @@ public:
 	int GetFrameCount () { return frames; }
 	void ResetFrameCount () { frames = 0; }
 
+	/* the rectangles are batched and handed to the window by FlushDamage */
 	virtual void Invalidate (Rect r);
 	virtual void ProcessUpdates ();
+	void FlushDamage ();
 
 	/* @GeneratePInvoke */
 	UIElement *GetToplevel() { return toplevel; }
@@ -308,11 +313,6 @@ public:
 
 	bool IsZombie () { return zombie; }
 
-#if OCCLUSION_CULLING_STATS
-	int uielements_rendered_with_occlusion_culling;
-	int uielements_rendered_with_painters;
-#endif
-
 #ifdef DEBUG
 	UIElement *debug_selected_element;
 #endif
@@ -436,6 +436,9 @@ private:
 	int user_initiated_monotonic_counter;
 
 	bool enable_redraw_regions;
+
+	DamageAccumulator damage;
+	Region *raw_damage; /* what was invalidated before the damage was merged, for the redraw regions overlay */
 	
 	void UpdateFullScreen (bool value);
 	
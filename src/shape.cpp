@@ -94,7 +94,7 @@ convert_fill_rule (FillRule fill_rule)
 //
 
 Shape::Shape ()
-	: stroke (this, StrokeWeakRef), fill (this, FillWeakRef)
+	: stroke (this, StrokeWeakRef), fill (this, FillWeakRef), cache_entry (this)
 {
 	SetObjectType (Type::SHAPE);
 
@@ -537,6 +537,7 @@ Shape::DoDraw (cairo_t *cr, bool do_op)
 			
 			// Increase our cache size
 			cached_size = GetDeployment ()->GetSurface ()->AddToCacheSizeCounter ((int) cache_extents.width, (int) cache_extents.height);
+			cache_entry.Add ((gint64) cache_extents.width * cache_extents.height * 4);
 		} else {
 			cairo_surface_destroy (cached_surface);
 			cached_surface = NULL;
@@ -546,6 +547,8 @@ Shape::DoDraw (cairo_t *cr, bool do_op)
 	if (do_op && cached_surface && !has_external_xform) {
 		cairo_pattern_t *cached_pattern = NULL;
 
+		cache_entry.Touch ();
+
 		cached_pattern = cairo_pattern_create_for_surface (cached_surface);
 
 		if (do_op)
@@ -1064,9 +1067,16 @@ Shape::InvalidateSurfaceCache (void)
 		}
 		cached_surface = NULL;
 		cached_size = 0;
+		cache_entry.Remove ();
 	}
 }
 
+void
+ShapeCacheEntry::Evict ()
+{
+	shape->InvalidateSurfaceCache ();
+}
+
 //
 // Ellipse
 //
@@ -20,10 +20,12 @@
 #include "geometry.h"
 #include "frameworkelement.h"
 #include "moon-path.h"
+#include "render-cache.h"
 
 namespace Moonlight {
 
 class Brush;
+class Shape;
 
 //
 // Helpers
@@ -37,6 +39,21 @@ void calc_line_bounds (double x1, double x2, double y1, double y2, double thickn
 G_END_DECLS
 
 
+//
+// ShapeCacheEntry: accounts for the surface a shape is cached in
+//
+class ShapeCacheEntry : public RenderCache::Entry {
+ public:
+	ShapeCacheEntry (Shape *shape) : RenderCache::Entry (RenderCacheShape, RENDER_CACHE_COST_MEDIUM), shape (shape) {}
+
+ protected:
+	virtual void Evict ();
+
+ private:
+	Shape *shape;
+};
+
+
 //
 // Shape class 
 // 
@@ -49,6 +66,7 @@ class Shape : public FrameworkElement {
 	WeakRef<Brush> fill;
 	cairo_surface_t *cached_surface;
 	gint64 cached_size;
+	ShapeCacheEntry cache_entry;
 	bool needs_clip;
 
 	void DoDraw (cairo_t *cr, bool do_op);
@@ -88,6 +106,8 @@ class Shape : public FrameworkElement {
 	
 	DoubleCollection *GetStrokeDashArray ();
 	Rect natural_bounds;
+
+	friend class ShapeCacheEntry;
  public: 
 	cairo_matrix_t stretch_transform;
  	/* @PropertyType=Brush,GenerateAccessors */
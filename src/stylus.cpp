@@ -32,6 +32,20 @@ namespace Moonlight {
 // StylusPointCollection
 //
 
+StylusPointCollection::StylusPointCollection ()
+{
+	SetObjectType (Type::STYLUSPOINT_COLLECTION);
+	packed_points = g_array_new (false, false, sizeof (StylusPointData));
+	chunk_bounds = g_array_new (false, false, sizeof (Rect));
+	packed_bounds = Rect (0, 0, 0, 0);
+}
+
+StylusPointCollection::~StylusPointCollection ()
+{
+	g_array_free (packed_points, true);
+	g_array_free (chunk_bounds, true);
+}
+
 bool
 StylusPointCollection::CanAdd (Value *value)
 {
@@ -40,6 +54,106 @@ StylusPointCollection::CanAdd (Value *value)
 	return Collection::CanAdd (value) && !Contains (value);
 }
 
+bool
+StylusPointCollection::InsertWithError (int index, Value *value, MoonError *error)
+{
+	// points appended at the end are packed when they're needed
+	if (index >= 0 && (guint) index < array->len)
+		InvalidatePackedPoints ();
+
+	return DependencyObjectCollection::InsertWithError (index, value, error);
+}
+
+void
+StylusPointCollection::RemovedFromCollection (Value *value, bool is_value_safe)
+{
+	InvalidatePackedPoints ();
+
+	DependencyObjectCollection::RemovedFromCollection (value, is_value_safe);
+}
+
+void
+StylusPointCollection::OnSubPropertyChanged (DependencyProperty *prop, DependencyObject *obj, PropertyChangedEventArgs *subobj_args)
+{
+	// a point moved, this has to happen before the Stroke hears about it
+	InvalidatePackedPoints ();
+
+	DependencyObjectCollection::OnSubPropertyChanged (prop, obj, subobj_args);
+}
+
+void
+StylusPointCollection::InvalidatePackedPoints ()
+{
+	g_array_set_size (packed_points, 0);
+	g_array_set_size (chunk_bounds, 0);
+	packed_bounds = Rect (0, 0, 0, 0);
+}
+
+void
+StylusPointCollection::UpdatePackedPoints ()
+{
+	StylusPointData data;
+	StylusPoint *point;
+	Rect *bounds;
+	guint chunk;
+
+	for (guint i = packed_points->len; i < array->len; i++) {
+		point = ((Value *) array->pdata[i])->AsStylusPoint ();
+		data.x = point->GetX ();
+		data.y = point->GetY ();
+		data.pressure = point->GetPressureFactor ();
+		g_array_append_val (packed_points, data);
+
+		if (i == 0)
+			packed_bounds = Rect (data.x, data.y, 0, 0);
+		else
+			packed_bounds = packed_bounds.ExtendTo (data.x, data.y);
+
+		// the first point of a chunk is also the last point of
+		// the previous one, so every segment is in one chunk
+		chunk = i / STYLUS_POINT_CHUNK_SIZE;
+		if (i > 0 && i % STYLUS_POINT_CHUNK_SIZE == 0) {
+			bounds = &g_array_index (chunk_bounds, Rect, chunk - 1);
+			*bounds = bounds->ExtendTo (data.x, data.y);
+		}
+
+		if (chunk == chunk_bounds->len) {
+			Rect start = Rect (data.x, data.y, 0, 0);
+			g_array_append_val (chunk_bounds, start);
+		} else {
+			bounds = &g_array_index (chunk_bounds, Rect, chunk);
+			*bounds = bounds->ExtendTo (data.x, data.y);
+		}
+	}
+}
+
+const StylusPointData *
+StylusPointCollection::GetPackedPoints ()
+{
+	if (packed_points->len != array->len)
+		UpdatePackedPoints ();
+
+	return (const StylusPointData *) packed_points->data;
+}
+
+guint
+StylusPointCollection::GetChunkCount ()
+{
+	if (packed_points->len != array->len)
+		UpdatePackedPoints ();
+
+	return chunk_bounds->len;
+}
+
+Rect
+StylusPointCollection::GetChunkBounds (guint chunk)
+{
+	if (packed_points->len != array->len)
+		UpdatePackedPoints ();
+
+	return g_array_index (chunk_bounds, Rect, chunk);
+}
+
 double
 StylusPointCollection::AddStylusPoints (StylusPointCollection *points)
 {
@@ -56,18 +170,10 @@ StylusPointCollection::AddStylusPoints (StylusPointCollection *points)
 Rect
 StylusPointCollection::GetBounds ()
 {
-	if (array->len == 0)
-		return Rect (0, 0, 0, 0);
-	
-	StylusPoint *point = GetValueAt (0)->AsStylusPoint ();
-	Rect r = Rect (point->GetX (), point->GetY (), 0, 0);
-	
-	for (guint i = 1; i < array->len; i++) {
-		point = GetValueAt (i)->AsStylusPoint ();
-		r = r.ExtendTo (point->GetX (), point->GetY ());
-	}
-	
-	return r;
+	if (packed_points->len != array->len)
+		UpdatePackedPoints ();
+
+	return packed_bounds;
 }
 
 
@@ -371,22 +477,17 @@ Stroke::HitTestSegmentPoint (Point stroke_p1, Point stroke_p2,
 			      
 
 bool
-Stroke::HitTestSegment (Point p1, Point p2, double w, double h, StylusPointCollection *stylusPoints)
+Stroke::HitTestSegment (Point p1, Point p2, double w, double h, const StylusPointData *points, int count)
 {
-	StylusPoint *sp;
-	
-	if (HitTestEndcap (p1, w, h, stylusPoints))
+	if (HitTestEndcap (p1, w, h, points, count))
 		return true;
 	
-	if (HitTestEndcap (p2, w, h, stylusPoints))
+	if (HitTestEndcap (p2, w, h, points, count))
 		return true;
 	
-	int stylusPoints_count = stylusPoints->GetCount ();
-	for (int i = 0; i < stylusPoints_count; i++) {
-		sp = stylusPoints->GetValueAt (i)->AsStylusPoint ();
-		
-		if (i + 1 == stylusPoints_count) {
-			Point p (sp->GetX (), sp->GetY ());
+	for (int i = 0; i < count; i++) {
+		if (i + 1 == count) {
+			Point p (points[i].x, points[i].y);
 			
 			if (!bounds.PointInside (p))
 				continue;
@@ -397,12 +498,10 @@ Stroke::HitTestSegment (Point p1, Point p2, double w, double h, StylusPointColle
 				return true;
 		}
 		else  {
-			StylusPoint *next_sp = stylusPoints->GetValueAt (i + 1)->AsStylusPoint ();
+			Point p (points[i].x, points[i].y);
+			Point next_p (points[i + 1].x, points[i + 1].y);
 			i++;
 			
-			Point p (sp->GetX (), sp->GetY ());
-			Point next_p (next_sp->GetX (), next_sp->GetY ());
-			
 			if (HitTestSegmentSegment (p1, p2,
 						   w, h,
 						   p, next_p))
@@ -414,16 +513,14 @@ Stroke::HitTestSegment (Point p1, Point p2, double w, double h, StylusPointColle
 }
 
 bool
-Stroke::HitTestEndcap (Point p, double w, double h, StylusPointCollection *stylusPoints)
+Stroke::HitTestEndcap (Point p, double w, double h, const StylusPointData *points, int count)
 {
-	StylusPoint *sp = stylusPoints->GetValueAt (0)->AsStylusPoint ();
 	Point cur, next;
-	int stylusPoints_count = stylusPoints->GetCount ();
 
-	cur.x = sp->GetX ();
-	cur.y = sp->GetY ();
+	cur.x = points[0].x;
+	cur.y = points[0].y;
 	
-	if (stylusPoints_count < 2) {
+	if (count < 2) {
 		// singleton input point to match against
 		if (bounds.PointInside (cur)) {
 			if (HitTestEndcapPoint (p, w, h, cur))
@@ -441,10 +538,9 @@ Stroke::HitTestEndcap (Point p, double w, double h, StylusPointCollection *stylu
 		}
 	}
 	
-	for (int i = 1; i < stylusPoints_count; i++) {
-		sp = stylusPoints->GetValueAt (i)->AsStylusPoint ();
-		next.x = sp->GetX ();
-		next.y = sp->GetY ();
+	for (int i = 1; i < count; i++) {
+		next.x = points[i].x;
+		next.y = points[i].y;
 		
 		if (HitTestEndcapSegment (p, w, h, cur, next))
 			return true;
@@ -474,80 +570,71 @@ Stroke::HitTest (StylusPointCollection *stylusPoints)
 		return false;
 	}
 
-	DrawingAttributes *da = GetDrawingAttributes ();
-	StylusPoint *sp;
+	int points_count = stylusPoints->GetCount ();
+	if (points_count == 0)
+		return false;
 
+	const StylusPointData *points = stylusPoints->GetPackedPoints ();
+	const StylusPointData *myPoints = myStylusPoints->GetPackedPoints ();
+	Rect points_bounds = stylusPoints->GetBounds ();
 	double height, width;
 
-	if (da) {
-		height = da->GetHeight ();
-		width = da->GetWidth ();
-
-		Color *col = da->GetOutlineColor ();
-		if (col->a != 0x00) {
-			height += 4.0;
-			width += 4.0;
-		}
-	}
-	else {
-		height = width = 6.0;
-
-	}
+	GetPenSize (&width, &height);
 	
 #if DEBUG_HITTEST
 	g_warning ("Stroke::HitTest()\n");
 	g_warning ("\tInput points:\n");
 	
-	int stylusPoints_count = stylusPoints->GetCount ();
-	for (int i = 0; i < stylusPoints_count; i++) {
-		sp = stylusPoints->GetValueAt (i)->AsStylusPoint ();
-		
-		g_warning ("\t\tPoint: (%f, %f)\n", sp->GetX (), sp->GetY ());
-	}
+	for (int i = 0; i < points_count; i++)
+		g_warning ("\t\tPoint: (%f, %f)\n", points[i].x, points[i].y);
 	
 	g_warning ("\tStroke points:\n");
 	
-	for (int i = 0; i < myStylusPoints_count; i++) {
-		sp = myStylusPoints->GetValueAt (i)->AsStylusPoint ();
-		
-		g_warning ("\t\tPoint: (%f, %f)\n", sp->GetX (), sp->GetY ());
-	}
+	for (int i = 0; i < myStylusPoints_count; i++)
+		g_warning ("\t\tPoint: (%f, %f)\n", myPoints[i].x, myPoints[i].y);
 #endif	
-	if (!GetBounds ().IntersectsWith (stylusPoints->GetBounds ()))
+	if (!GetBounds ().IntersectsWith (points_bounds))
 		return false;
 
 	/* test the beginning endcap */
-	sp = myStylusPoints->GetValueAt (0)->AsStylusPoint ();
-	
-	if (HitTestEndcap (Point (sp->GetX (), sp->GetY ()),
-			   width, height, stylusPoints)) {
+	if (HitTestEndcap (Point (myPoints[0].x, myPoints[0].y),
+			   width, height, points, points_count)) {
 #if DEBUG_HITTEST
 		g_warning ("\tA point matched the beginning endcap\n");
 #endif
 		return true;
 	}
 	
-	/* test all the interior line segments */
-	StylusPoint *prev_point = sp;
-	for (int i = 1; i < myStylusPoints_count; i++) {
-		sp = myStylusPoints->GetValueAt (i)->AsStylusPoint ();
-		
-		if (HitTestSegment (Point (prev_point->GetX (), prev_point->GetY ()),
-				    Point (sp->GetX (), sp->GetY ()),
-				    width, height, stylusPoints)) {
+	/* test all the interior line segments, skipping the chunks
+	 * of the stroke which are too far away from the input */
+	guint chunk_count = myStylusPoints->GetChunkCount ();
+	for (guint chunk = 0; chunk < chunk_count; chunk++) {
+		Rect chunk_bounds = myStylusPoints->GetChunkBounds (chunk).GrowBy (width / 2, height / 2);
+
+		if (!chunk_bounds.IntersectsWith (points_bounds))
+			continue;
+
+		int first = MAX (chunk * STYLUS_POINT_CHUNK_SIZE, 1);
+		int last = MIN ((chunk + 1) * STYLUS_POINT_CHUNK_SIZE, (guint) myStylusPoints_count - 1);
+
+		for (int i = first; i <= last; i++) {
+			if (HitTestSegment (Point (myPoints[i - 1].x, myPoints[i - 1].y),
+					    Point (myPoints[i].x, myPoints[i].y),
+					    width, height, points, points_count)) {
 #if DEBUG_HITTEST
-			g_warning ("\tA point matched an interior line segment\n");
+				g_warning ("\tA point matched an interior line segment\n");
 #endif
-			return true;
+				return true;
+			}
 		}
 	}
 
 	/* the the ending endcap */
 	if (myStylusPoints_count > 1) {
-		sp = myStylusPoints->GetValueAt (myStylusPoints_count - 1)->AsStylusPoint ();
-		
-		if (HitTestEndcap (Point (sp->GetX (), sp->GetY ()),
-				   width, height, stylusPoints)) {
+		int last = myStylusPoints_count - 1;
+
+		if (HitTestEndcap (Point (myPoints[last].x, myPoints[last].y),
+				   width, height, points, points_count)) {
 #if DEBUG_HITTEST
 			g_warning ("\tA point matched the ending endcap\n");
 #endif
@@ -562,24 +649,31 @@ Stroke::HitTest (StylusPointCollection *stylusPoints)
 	return false;
 }
 
-Rect
-Stroke::AddStylusPointToBounds (StylusPoint *stylus_point, const Rect &bounds)
+void
+Stroke::GetPenSize (double *width, double *height)
 {
 	DrawingAttributes *da = GetDrawingAttributes ();
-	double height, width;
 
 	if (da) {
-		height = da->GetHeight ();
-		width = da->GetWidth ();
+		*height = da->GetHeight ();
+		*width = da->GetWidth ();
 		
 		Color *col = da->GetOutlineColor ();
 		if (col->a != 0x00) {
-			height += 4.0;
-			width += 4.0;
+			*height += 4.0;
+			*width += 4.0;
 		}
 	} else {
-		height = width = 6.0;
+		*height = *width = 6.0;
 	}
+}
+
+Rect
+Stroke::AddStylusPointToBounds (StylusPoint *stylus_point, const Rect &bounds)
+{
+	double height, width;
+
+	GetPenSize (&width, &height);
 	
 	return bounds.Union (Rect (stylus_point->GetX () - width / 2,
 				   stylus_point->GetY () - height / 2,
@@ -592,12 +686,14 @@ Stroke::ComputeBounds ()
 	bounds = Rect ();
 	
 	StylusPointCollection *spc = GetStylusPoints ();
-	if (!spc)
+	if (!spc || spc->GetCount () == 0)
 		return;
 	
-	int spc_count = spc->GetCount ();
-	for (int i = 0; i < spc_count; i++)
-		bounds = AddStylusPointToBounds (spc->GetValueAt (i)->AsStylusPoint (), bounds);
+	double height, width;
+
+	GetPenSize (&width, &height);
+
+	bounds = spc->GetBounds ().GrowBy (width / 2, height / 2);
 }
 
 void
@@ -751,31 +847,48 @@ StrokeCollection::HitTest (StylusPointCollection *stylusPoints)
 }
 
 static void
-drawing_attributes_quick_render (cairo_t *cr, double thickness, Color *color, StylusPointCollection *collection)
+drawing_attributes_quick_render (cairo_t *cr, double thickness, Color *color, StylusPointCollection *collection, const Rect &visible)
 {
-	StylusPoint *sp;
-	double x, y;
-	
 	int count = collection->GetCount ();
 	if (count == 0)
 		return;
 	
-	sp = collection->GetValueAt (0)->AsStylusPoint ();
-	x = sp->GetX ();
-	y = sp->GetY ();
+	const StylusPointData *points = collection->GetPackedPoints ();
+	Rect reach = visible.GrowBy (thickness / 2 + 1.0);
 	
-	cairo_move_to (cr, x, y);
+	if (!visible.IsEmpty () && !collection->GetBounds ().IntersectsWith (reach))
+		return;
 	
 	if (count > 1) {
-		for (int i = 1; i < count; i++) {
-			sp = collection->GetValueAt (i)->AsStylusPoint ();
-			x = sp->GetX ();
-			y = sp->GetY ();
+		// leave out the chunks of the stroke which can't touch
+		// the visible area, the ones which do are drawn as one
+		// sub path so that they join up like before
+		guint chunk_count = collection->GetChunkCount ();
+		bool drawing = false;
+		
+		for (guint chunk = 0; chunk < chunk_count; chunk++) {
+			int first = chunk * STYLUS_POINT_CHUNK_SIZE;
+			int last = MIN (first + STYLUS_POINT_CHUNK_SIZE, count - 1);
+			
+			if (first == last)
+				break;
 			
-			cairo_line_to (cr, x, y);
+			if (!visible.IsEmpty () && !collection->GetChunkBounds (chunk).IntersectsWith (reach)) {
+				drawing = false;
+				continue;
+			}
+			
+			if (!drawing)
+				cairo_move_to (cr, points[first].x, points[first].y);
+			
+			for (int i = first + 1; i <= last; i++)
+				cairo_line_to (cr, points[i].x, points[i].y);
+			
+			drawing = true;
 		}
 	} else {
-		cairo_line_to (cr, x, y);
+		cairo_move_to (cr, points[0].x, points[0].y);
+		cairo_line_to (cr, points[0].x, points[0].y);
 	}
 	
 	if (color)
@@ -788,16 +901,16 @@ drawing_attributes_quick_render (cairo_t *cr, double thickness, Color *color, St
 }
 
 static void
-drawing_attributes_normal_render (cairo_t *cr, double width, double height, Color *color, Color *outline, StylusPointCollection *collection)
+drawing_attributes_normal_render (cairo_t *cr, double width, double height, Color *color, Color *outline, StylusPointCollection *collection, const Rect &visible)
 {
 	// FIXME: use cairo_stroke_to_path once available
 	// until then draw bigger with the outline color and smaller with the inner color
-	drawing_attributes_quick_render (cr, height + 4.0, outline, collection);
-	drawing_attributes_quick_render (cr, (height > 4.0) ? height - 2.0 : 2.0, color, collection);
+	drawing_attributes_quick_render (cr, height + 4.0, outline, collection, visible);
+	drawing_attributes_quick_render (cr, (height > 4.0) ? height - 2.0 : 2.0, color, collection, visible);
 }
 
 void
-DrawingAttributes::Render (cairo_t *cr, StylusPointCollection *collection)
+DrawingAttributes::Render (cairo_t *cr, StylusPointCollection *collection, const Rect &visible)
 {
 	if (!collection)
 		return;
@@ -810,19 +923,19 @@ DrawingAttributes::Render (cairo_t *cr, StylusPointCollection *collection)
 	// we can render very quickly if the pen is round, i.e. Width==Height (circle)
 	// and when no OutlineColor are specified (e.g. NULL, transparent)
 	if ((!outline || outline->a == 0x00) && (height == width)) {
-		drawing_attributes_quick_render (cr, height, color, collection);
+		drawing_attributes_quick_render (cr, height, color, collection, visible);
 		// TODO - we could add another fast-path in the case where height!=width and without an outline
 		// in this case we would need a scaling transform (for the pen) and adjust the coordinates
 	} else {
-		drawing_attributes_normal_render (cr, width, height, color, outline, collection);
+		drawing_attributes_normal_render (cr, width, height, color, outline, collection, visible);
 	}
 }
 
 void
-DrawingAttributes::RenderWithoutDrawingAttributes (cairo_t *cr, StylusPointCollection *collection)
+DrawingAttributes::RenderWithoutDrawingAttributes (cairo_t *cr, StylusPointCollection *collection, const Rect &visible)
 {
 	// default values that (seems to) match the output when no DrawingAttributes are specified
-	drawing_attributes_quick_render (cr, 2.0, NULL, collection);
+	drawing_attributes_quick_render (cr, 2.0, NULL, collection, visible);
 }
 
 
@@ -849,6 +962,20 @@ InkPresenter::PostRender (Context *ctx, Region *region, bool skip_children)
 	int strokes_count = strokes->GetCount ();
 
 	if (strokes_count > 0 && ctx->IsMutable ()) {
+		Rect visible = Rect ();
+		cairo_matrix_t inverse;
+
+		// while more ink is being added only the last few
+		// segments are invalidated, so don't redraw the whole
+		// ink layer for them. The region is in device space,
+		// which we only know how to map back when there's no
+		// intermediate surface
+		if (!skip_children && region && !region->IsEmpty () && (flags & COMPOSITE_TRANSFORM) == 0) {
+			ctx->Top ()->GetMatrix (&inverse);
+			if (cairo_matrix_invert (&inverse) == CAIRO_STATUS_SUCCESS)
+				visible = region->GetExtents ().Transform (&inverse);
+		}
+
 		cairo_t *cr = ctx->Push (Context::Cairo ());
 	
 		cairo_set_line_cap (cr, CAIRO_LINE_CAP_ROUND);
@@ -861,9 +988,9 @@ InkPresenter::PostRender (Context *ctx, Region *region, bool skip_children)
 			StylusPointCollection *spc = stroke->GetStylusPoints ();
 			
 			if (da) {
-				da->Render (cr, spc);
+				da->Render (cr, spc, visible);
 			} else {
-				DrawingAttributes::RenderWithoutDrawingAttributes (cr, spc);
+				DrawingAttributes::RenderWithoutDrawingAttributes (cr, spc, visible);
 			}
 		
 			stroke->ResetDirty ();
@@ -94,22 +94,53 @@ class UnmanagedStylusPoint : public StylusPoint {
 	UnmanagedStylusPoint () { SetObjectType (Type::UNMANAGEDSTYLUSPOINT); }
 };
 
+// number of segments covered by each of the StylusPointCollection chunk bounds
+#define STYLUS_POINT_CHUNK_SIZE 32
+
+struct StylusPointData {
+	double x;
+	double y;
+	double pressure;
+};
+
 /* @Namespace=System.Windows.Input */
 class StylusPointCollection : public DependencyObjectCollection {
+	// A packed copy of the points, so that rendering and hit testing
+	// don't have to go through the StylusPoint properties. It's
+	// extended as points are appended (which is all that happens
+	// while inking) and thrown away when any other change is made.
+	GArray *packed_points;
+	// bounds of the points [i * STYLUS_POINT_CHUNK_SIZE, (i + 1) * STYLUS_POINT_CHUNK_SIZE]
+	GArray *chunk_bounds;
+	Rect packed_bounds;
+
+	void UpdatePackedPoints ();
+	void InvalidatePackedPoints ();
+
  protected:
 	virtual bool CanAdd (Value *value);
+	virtual void RemovedFromCollection (Value *value, bool is_value_safe);
 	
-	virtual ~StylusPointCollection () {}
+	virtual ~StylusPointCollection ();
 	
  public:
 	/* @GeneratePInvoke */
-	StylusPointCollection () { SetObjectType (Type::STYLUSPOINT_COLLECTION); }
+	StylusPointCollection ();
 
 	virtual Type::Kind GetElementType () { return Type::STYLUSPOINT; }
+
+	virtual bool InsertWithError (int index, Value *value, MoonError *error);
+	virtual void OnSubPropertyChanged (DependencyProperty *prop, DependencyObject *obj, PropertyChangedEventArgs *subobj_args);
 	
 	/* @GeneratePInvoke */
 	double AddStylusPoints (StylusPointCollection *stylusPointCollection);
 	
+	// GetCount () points, valid until the collection changes
+	const StylusPointData *GetPackedPoints ();
+
+	guint GetChunkCount ();
+	Rect GetChunkBounds (guint chunk);
+
 	Rect GetBounds ();
 };
 
@@ -217,8 +248,9 @@ class DrawingAttributes : public DependencyObject {
 	/* @GeneratePInvoke */
 	DrawingAttributes () { SetObjectType (Type::DRAWINGATTRIBUTES); }
 	
-	void Render (cairo_t *cr, StylusPointCollection *collection);
-	static void RenderWithoutDrawingAttributes (cairo_t *cr, StylusPointCollection *collection);
+	// only the parts of the stroke near @visible are drawn, unless it's empty
+	void Render (cairo_t *cr, StylusPointCollection *collection, const Rect &visible);
+	static void RenderWithoutDrawingAttributes (cairo_t *cr, StylusPointCollection *collection, const Rect &visible);
 	
 	//
 	// Property Accessors
@@ -243,16 +275,17 @@ class Stroke : public DependencyObject {
 	Rect bounds;
 	Rect dirty;
 	
+	void GetPenSize (double *width, double *height);
 	Rect AddStylusPointToBounds (StylusPoint *stylus_point, const Rect &bounds);
 	void ComputeBounds ();
 
 	bool HitTestEndcapSegment (Point c, double w, double h, Point p1, Point p2);
 	bool HitTestEndcapPoint (Point c, double w, double h, Point p1);
-	bool HitTestEndcap (Point p, double w, double h, StylusPointCollection *stylusPoints);
+	bool HitTestEndcap (Point p, double w, double h, const StylusPointData *points, int count);
 
 	bool HitTestSegmentSegment (Point stroke_p1, Point stroke_p2, double w, double h, Point p1, Point p2);
 	bool HitTestSegmentPoint (Point stroke_p1, Point stroke_p2, double w, double h, Point p1);
-	bool HitTestSegment (Point stroke_p1, Point stroke_p2, double w, double h, StylusPointCollection *stylusPoints);
+	bool HitTestSegment (Point stroke_p1, Point stroke_p2, double w, double h, const StylusPointData *points, int count);
 	
  protected:
 	virtual ~Stroke () {}
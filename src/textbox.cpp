@@ -43,51 +43,89 @@ namespace Moonlight {
 //
 // TextBuffer
 //
+// A gap buffer: the text is stored in two segments, [0, gap_start) and
+// [gap_end, allocated), with the gap at the position of the last edit
+// so that typing (or deleting) at the cursor doesn't have to move the
+// rest of the text, no matter how long it is.
+//
 
 #define UNICODE_LEN(size) (sizeof (gunichar) * (size))
 #define UNICODE_OFFSET(buf,offset) (((char *) buf) + UNICODE_LEN (offset))
 
+#define TEXT_BUFFER_MIN_GAP 128
+
 class TextBuffer {
+	gunichar *text;
 	int allocated;
+	int gap_start;
+	int gap_end;
+	
+	int GapLength () { return gap_end - gap_start; }
+	
+	void MoveGap (int index)
+	{
+		int n;
+		
+		if (index < gap_start) {
+			// move the chars in [index, gap_start) to the end of the gap
+			n = gap_start - index;
+			memmove (UNICODE_OFFSET (text, gap_end - n), UNICODE_OFFSET (text, index), UNICODE_LEN (n));
+			gap_start -= n;
+			gap_end -= n;
+		} else if (index > gap_start) {
+			// move the chars following the gap up to @index to the beginning of the gap
+			n = index - gap_start;
+			memmove (UNICODE_OFFSET (text, gap_start), UNICODE_OFFSET (text, gap_end), UNICODE_LEN (n));
+			gap_start += n;
+			gap_end += n;
+		}
+	}
 	
 	bool Resize (int needed)
 	{
-		int new_size = allocated;
-		bool resize = false;
+		int new_size, tail;
 		void *buf;
 		
-		if (allocated >= needed + 128) {
-			while (new_size >= needed + 128)
-				new_size -= 128;
-			resize = true;
-		} else if (allocated < needed) {
-			while (new_size < needed)
-				new_size += 128;
-			resize = true;
-		}
+		if (GapLength () >= needed)
+			return true;
 		
-		if (resize) {
-			if (!(buf = g_try_realloc (text, UNICODE_LEN (new_size)))) {
-				// if new_size is < allocated, then we can pretend like we succeeded
-				return new_size < allocated;
-			}
-			
-			text = (gunichar *) buf;
-			allocated = new_size;
-		}
+		// grow geometrically so that appending in a loop stays linear
+		new_size = MAX (allocated + allocated / 2, len + needed + TEXT_BUFFER_MIN_GAP);
+		
+		if (!(buf = g_try_realloc (text, UNICODE_LEN (new_size))))
+			return false;
+		
+		text = (gunichar *) buf;
+		
+		// move the text following the gap to the end of the new buffer
+		tail = allocated - gap_end;
+		memmove (UNICODE_OFFSET (text, new_size - tail), UNICODE_OFFSET (text, gap_end), UNICODE_LEN (tail));
+		gap_end = new_size - tail;
+		allocated = new_size;
 		
 		return true;
 	}
 	
+	void Copy (gunichar *dest, int start, int length)
+	{
+		int n = 0;
+		
+		if (start < gap_start) {
+			n = MIN (length, gap_start - start);
+			memcpy (dest, text + start, UNICODE_LEN (n));
+		}
+		
+		if (n < length)
+			memcpy (dest + n, text + (start + n) + GapLength (), UNICODE_LEN (length - n));
+	}
+	
  public:
-	gunichar *text;
 	int len;
 	
 	TextBuffer (const gunichar *text, int len)
 	{
-		this->allocated = 0;
 		this->text = NULL;
-		this->len = 0;
+		Reset ();
 		
 		Append (text, len);
 	}
@@ -98,20 +136,73 @@ class TextBuffer {
 		Reset ();
 	}
 	
+	~TextBuffer ()
+	{
+		g_free (text);
+	}
+	
 	void Reset ()
 	{
-		text = (gunichar *) g_realloc (text, UNICODE_LEN (128));
-		allocated = 128;
-		text[0] = '\0';
+		text = (gunichar *) g_realloc (text, UNICODE_LEN (TEXT_BUFFER_MIN_GAP));
+		allocated = TEXT_BUFFER_MIN_GAP;
+		gap_start = 0;
+		gap_end = allocated;
 		len = 0;
 	}
 	
+	// Returns 0 for @index == len, like the nul-terminator of a string would
+	gunichar GetCharAt (int index)
+	{
+		if (index < gap_start)
+			return text[index];
+		
+		if (index >= len)
+			return 0;
+		
+		return text[index + GapLength ()];
+	}
+	
+	// Returns the whole text as a nul-terminated string, owned by the buffer
+	// and only valid until the next modification. Moves the gap to the end.
+	const gunichar *GetText ()
+	{
+		MoveGap (len);
+		
+		if (GapLength () == 0 && !Resize (1))
+			return NULL;
+		
+		text[len] = 0;
+		
+		return text;
+	}
+	
+	// Converts @length chars starting at @start to utf8, without moving the gap
+	char *ToUtf8 (int start, int length)
+	{
+		char *utf8, *outptr;
+		int n_bytes = 0;
+		
+		for (int i = start; i < start + length; i++)
+			n_bytes += g_unichar_to_utf8 (GetCharAt (i), NULL);
+		
+		outptr = utf8 = (char *) g_malloc (n_bytes + 1);
+		
+		for (int i = start; i < start + length; i++)
+			outptr += g_unichar_to_utf8 (GetCharAt (i), outptr);
+		
+		*outptr = '\0';
+		
+		return utf8;
+	}
+	
 	void Print ()
 	{
 		printf ("TextBuffer::text = \"");
 		
 		for (int i = 0; i < len; i++) {
-			switch (text[i]) {
+			gunichar c = GetCharAt (i);
+			
+			switch (c) {
 			case '\r':
 				fputs ("\\r", stdout);
 				break;
@@ -125,7 +216,7 @@ class TextBuffer {
 				fputc ('\\', stdout);
 				// fall thru
 			default:
-				fputc ((char) text[i], stdout);
+				fputc ((char) c, stdout);
 				break;
 			}
 		}
@@ -135,146 +226,78 @@ class TextBuffer {
 	
 	void Append (gunichar c)
 	{
-		if (!Resize (len + 2))
-			return;
-		
-		text[len++] = c;
-		text[len] = 0;
+		Insert (len, &c, 1);
 	}
 	
 	void Append (const gunichar *str, int count)
 	{
-		if (!Resize (len + count + 1))
-			return;
-		
-		memcpy (UNICODE_OFFSET (text, len), str, UNICODE_LEN (count));
-		len += count;
-		text[len] = 0;
+		Insert (len, str, count);
 	}
 	
 	void Cut (int start, int length)
 	{
-		char *dest, *src;
-		int beyond;
-		
 		if (length == 0 || start >= len)
 			return;
 		
 		if (start + length > len)
 			length = len - start;
 		
-		src = UNICODE_OFFSET (text, start + length);
-		dest = UNICODE_OFFSET (text, start);
-		beyond = len - (start + length);
-		
-		memmove (dest, src, UNICODE_LEN (beyond + 1));
+		// the cut chars simply become part of the gap
+		MoveGap (start);
+		gap_end += length;
 		len -= length;
 	}
 	
 	void Insert (int index, gunichar c)
 	{
-		if (!Resize (len + 2))
-			return;
-		
-		if (index < len) {
-			// shift all chars beyond position @index down by 1 char
-			memmove (UNICODE_OFFSET (text, index + 1), UNICODE_OFFSET (text, index), UNICODE_LEN ((len - index) + 1));
-			text[index] = c;
-			len++;
-		} else {
-			text[len++] = c;
-			text[len] = 0;
-		}
+		Insert (index, &c, 1);
 	}
 	
 	void Insert (int index, const gunichar *str, int count)
 	{
-		if (!Resize (len + count + 1))
+		if (index > len)
+			index = len;
+		
+		if (!Resize (count))
 			return;
 		
-		if (index < len) {
-			// shift all chars beyond position @index down by @count chars
-			memmove (UNICODE_OFFSET (text, index + count), UNICODE_OFFSET (text, index), UNICODE_LEN ((len - index) + 1));
-			
-			// insert @count chars of @str into our buffer at position @index
-			memcpy (UNICODE_OFFSET (text, index), str, UNICODE_LEN (count));
-			len += count;
-		} else {
-			// simply append @count chars of @str onto the end of our buffer
-			memcpy (UNICODE_OFFSET (text, len), str, UNICODE_LEN (count));
-			len += count;
-			text[len] = 0;
-		}
+		MoveGap (index);
+		memcpy (UNICODE_OFFSET (text, gap_start), str, UNICODE_LEN (count));
+		gap_start += count;
+		len += count;
 	}
 	
 	void Prepend (gunichar c)
 	{
-		if (!Resize (len + 2))
-			return;
-		
-		// shift the entire buffer down by 1 char
-		memmove (UNICODE_OFFSET (text, 1), text, UNICODE_LEN (len + 1));
-		text[0] = c;
-		len++;
+		Insert (0, &c, 1);
 	}
 	
 	void Prepend (const gunichar *str, int count)
 	{
-		if (!Resize (len + count + 1))
-			return;
-		
-		// shift the endtire buffer down by @count chars
-		memmove (UNICODE_OFFSET (text, count), text, UNICODE_LEN (len + 1));
-		
-		// copy @count chars of @str into the beginning of our buffer
-		memcpy (text, str, UNICODE_LEN (count));
-		len += count;
+		Insert (0, str, count);
 	}
 	
 	void Replace (int start, int length, const gunichar *str, int count)
 	{
-		char *dest, *src;
-		int beyond;
-		
 		if (start > len)
 			return;
 		
 		if (start + length > len)
 			length = len - start;
 		
-		// Check for the easy cases first...
-		if (length == 0) {
-			Insert (start, str, count);
-			return;
-		} else if (count == 0) {
-			Cut (start, length);
-			return;
-		} else if (count == length) {
+		if (count == length && start + count <= gap_start) {
+			// easy case, overwrite the chars in place
 			memcpy (UNICODE_OFFSET (text, start), str, UNICODE_LEN (count));
 			return;
 		}
 		
-		if (count > length && !Resize (len + (count - length) + 1))
-			return;
-		
-		// calculate the number of chars beyond @start that won't be cut
-		beyond = len - (start + length);
-		
-		// shift all chars beyond position (@start + length) into position...
-		dest = UNICODE_OFFSET (text, start + count);
-		src = UNICODE_OFFSET (text, start + length);
-		memmove (dest, src, UNICODE_LEN (beyond + 1));
-		
-		// copy @count chars of @str into our buffer at position @start
-		memcpy (UNICODE_OFFSET (text, start), str, UNICODE_LEN (count));
-		
-		len = (len - length) + count;
+		Cut (start, length);
+		Insert (start, str, count);
 	}
 	
 	gunichar *Substring (int start, int length = -1)
 	{
 		gunichar *substr;
-		size_t n_bytes;
 		
 		if (start < 0 || start > len || length == 0)
 			return NULL;
@@ -282,11 +305,8 @@ class TextBuffer {
 		if (length < 0)
 			length = len - start;
 		
-		n_bytes = sizeof (gunichar) * (length + 1);
-		substr = (gunichar *) g_malloc (n_bytes);
-		n_bytes -= sizeof (gunichar);
-		
-		memcpy (substr, text + start, n_bytes);
+		substr = (gunichar *) g_malloc (UNICODE_LEN (length + 1));
+		Copy (substr, start, length);
 		substr[length] = 0;
 		
 		return substr;
@@ -777,10 +797,10 @@ static bool
 is_start_of_word (TextBuffer *buffer, int index)
 {
 	// A 'word' starts with an AlphaNumeric or some punctuation symbols immediately preceeded by lwsp
-	if (index > 0 && !g_unichar_isspace (buffer->text[index - 1]))
+	if (index > 0 && !g_unichar_isspace (buffer->GetCharAt (index - 1)))
 		return false;
 	
-	switch (g_unichar_type (buffer->text[index])) {
+	switch (g_unichar_type (buffer->GetCharAt (index))) {
 	case G_UNICODE_LOWERCASE_LETTER:
 	case G_UNICODE_TITLECASE_LETTER:
 	case G_UNICODE_UPPERCASE_LETTER:
@@ -795,7 +815,7 @@ is_start_of_word (TextBuffer *buffer, int index)
 		return true;
 	case G_UNICODE_OTHER_PUNCTUATION:
 		// words cannot start with '.', but they can start with '&' or '*' (for example)
-		return g_unichar_break_type (buffer->text[index]) == G_UNICODE_BREAK_ALPHABETIC;
+		return g_unichar_break_type (buffer->GetCharAt (index)) == G_UNICODE_BREAK_ALPHABETIC;
 	default:
 		return false;
 	}
@@ -809,7 +829,7 @@ TextBoxBase::CursorNextWord (int cursor)
 	
 	// find the end of the current line
 	cr = CursorLineEnd (cursor);
-	if (buffer->text[cr] == '\r' && buffer->text[cr + 1] == '\n')
+	if (buffer->GetCharAt (cr) == '\r' && buffer->GetCharAt (cr + 1) == '\n')
 		lf = cr + 1;
 	else
 		lf = cr;
@@ -823,25 +843,25 @@ TextBoxBase::CursorNextWord (int cursor)
 	}
 	
 #ifdef EMULATE_GTK
-	CharClass cc = char_class (buffer->text[cursor]);
+	CharClass cc = char_class (buffer->GetCharAt (cursor));
 	i = cursor;
 	
 	// skip over the word, punctuation, or run of whitespace
-	while (i < cr && char_class (buffer->text[i]) == cc)
+	while (i < cr && char_class (buffer->GetCharAt (i)) == cc)
 		i++;
 	
 	// skip any whitespace after the word/punct
-	while (i < cr && g_unichar_isspace (buffer->text[i]))
+	while (i < cr && g_unichar_isspace (buffer->GetCharAt (i)))
 		i++;
 #else
 	i = cursor;
 	
 	// skip to the end of the current word
-	while (i < cr && !g_unichar_isspace (buffer->text[i]))
+	while (i < cr && !g_unichar_isspace (buffer->GetCharAt (i)))
 		i++;
 	
 	// skip any whitespace after the word
-	while (i < cr && g_unichar_isspace (buffer->text[i]))
+	while (i < cr && g_unichar_isspace (buffer->GetCharAt (i)))
 		i++;
 	
 	// find the start of the next word
@@ -860,7 +880,7 @@ TextBoxBase::CursorPrevWord (int cursor)
 	// find the beginning of the current line
 	lf = CursorLineBegin (cursor) - 1;
 	
-	if (lf > 0 && buffer->text[lf] == '\n' && buffer->text[lf - 1] == '\r')
+	if (lf > 0 && buffer->GetCharAt (lf) == '\n' && buffer->GetCharAt (lf - 1) == '\r')
 		cr = lf - 1;
 	else
 		cr = lf;
@@ -874,18 +894,18 @@ TextBoxBase::CursorPrevWord (int cursor)
 	}
 	
 #ifdef EMULATE_GTK
-	CharClass cc = char_class (buffer->text[cursor - 1]);
+	CharClass cc = char_class (buffer->GetCharAt (cursor - 1));
 	begin = lf + 1;
 	i = cursor;
 	
 	// skip over the word, punctuation, or run of whitespace
-	while (i > begin && char_class (buffer->text[i - 1]) == cc)
+	while (i > begin && char_class (buffer->GetCharAt (i - 1)) == cc)
 		i--;
 	
 	// if the cursor was at whitespace, skip back a word too
 	if (cc == CharClassWhitespace && i > begin) {
-		cc = char_class (buffer->text[i - 1]);
-		while (i > begin && char_class (buffer->text[i - 1]) == cc)
+		cc = char_class (buffer->GetCharAt (i - 1));
+		while (i > begin && char_class (buffer->GetCharAt (i - 1)) == cc)
 			i--;
 	}
 #else
@@ -894,7 +914,7 @@ TextBoxBase::CursorPrevWord (int cursor)
 	
 	if (cursor < buffer->len) {
 		// skip to the beginning of this word
-		while (i > begin && !g_unichar_isspace (buffer->text[i - 1]))
+		while (i > begin && !g_unichar_isspace (buffer->GetCharAt (i - 1)))
 			i--;
 		
 		if (i < cursor && is_start_of_word (buffer, i))
@@ -902,7 +922,7 @@ TextBoxBase::CursorPrevWord (int cursor)
 	}
 	
 	// skip to the start of the lwsp
-	while (i > begin && g_unichar_isspace (buffer->text[i - 1]))
+	while (i > begin && g_unichar_isspace (buffer->GetCharAt (i - 1)))
 		i--;
 	
 	if (i > begin)
@@ -922,7 +942,7 @@ TextBoxBase::CursorLineBegin (int cursor)
 	int cur = cursor;
 	
 	// find the beginning of the line
-	while (cur > 0 && !IsEOL (buffer->text[cur - 1]))
+	while (cur > 0 && !IsEOL (buffer->GetCharAt (cur - 1)))
 		cur--;
 	
 	return cur;
@@ -934,11 +954,11 @@ TextBoxBase::CursorLineEnd (int cursor, bool include)
 	int cur = cursor;
 	
 	// find the end of the line
-	while (cur < buffer->len && !IsEOL (buffer->text[cur]))
+	while (cur < buffer->len && !IsEOL (buffer->GetCharAt (cur)))
 		cur++;
 	
 	if (include && cur < buffer->len) {
-		if (buffer->text[cur] == '\r' && buffer->text[cur + 1] == '\n')
+		if (buffer->GetCharAt (cur) == '\r' && buffer->GetCharAt (cur + 1) == '\n')
 			cur += 2;
 		else
 			cur++;
@@ -969,7 +989,7 @@ TextBoxBase::KeyPressBackSpace (MoonModifier modifiers)
 		length = cursor - start;
 	} else if (cursor > 0) {
 		// BackSpace: delete the char before the cursor position
-		if (cursor >= 2 && buffer->text[cursor - 1] == '\n' && buffer->text[cursor - 2] == '\r') {
+		if (cursor >= 2 && buffer->GetCharAt (cursor - 1) == '\n' && buffer->GetCharAt (cursor - 2) == '\r') {
 			start = cursor - 2;
 			length = 2;
 		} else {
@@ -1025,7 +1045,7 @@ TextBoxBase::KeyPressDelete (MoonModifier modifiers)
 		start = cursor;
 	} else if (cursor < buffer->len) {
 		// Delete: delete the char after the cursor position
-		if (buffer->text[cursor] == '\r' && buffer->text[cursor + 1] == '\n')
+		if (buffer->GetCharAt (cursor) == '\r' && buffer->GetCharAt (cursor + 1) == '\n')
 			length = 2;
 		else
 			length = 1;
@@ -1280,7 +1300,7 @@ TextBoxBase::KeyPressRight (MoonModifier modifiers)
 		cursor = MAX (anchor, cursor);
 	} else {
 		// move the cursor forward one character
-		if (buffer->text[cursor] == '\r' && buffer->text[cursor + 1] == '\n') 
+		if (buffer->GetCharAt (cursor) == '\r' && buffer->GetCharAt (cursor + 1) == '\n') 
 			cursor += 2;
 		else if (cursor < buffer->len)
 			cursor++;
@@ -1322,7 +1342,7 @@ TextBoxBase::KeyPressLeft (MoonModifier modifiers)
 		cursor = MIN (anchor, cursor);
 	} else {
 		// move the cursor backward one character
-		if (cursor >= 2 && buffer->text[cursor - 2] == '\r' && buffer->text[cursor - 1] == '\n')
+		if (cursor >= 2 && buffer->GetCharAt (cursor - 2) == '\r' && buffer->GetCharAt (cursor - 1) == '\n')
 			cursor -= 2;
 		else if (cursor > 0)
 			cursor--;
@@ -2400,7 +2420,7 @@ TextBoxBase::Redo ()
 	case TextBoxUndoActionTypeInsert:
 		insert = (TextBoxUndoActionInsert *) action;
 		
-		buffer->Insert (insert->start, insert->buffer->text, insert->buffer->len);
+		buffer->Insert (insert->start, insert->buffer->GetText (), insert->buffer->len);
 		anchor = cursor = insert->start + insert->buffer->len;
 		break;
 	case TextBoxUndoActionTypeDelete:
@@ -2556,7 +2576,7 @@ TextBox::SyncSelectedText ()
 		int start = MIN (selection_anchor, selection_cursor);
 		char *text;
 		
-		text = g_ucs4_to_utf8 (buffer->text + start, length, NULL, NULL, NULL);
+		text = buffer->ToUtf8 (start, length);
 		
 		setvalue = false;
 		SetValue (TextBox::SelectedTextProperty, Value (text, Type::STRING, true));
@@ -2573,7 +2593,7 @@ TextBox::SyncText ()
 {
 	char *text;
 	
-	text = g_ucs4_to_utf8 (buffer->text, buffer->len, NULL, NULL, NULL);
+	text = buffer->ToUtf8 (0, buffer->len);
 	
 	setvalue = false;
 	SetValue (TextBox::TextProperty, Value (text, Type::STRING, true));
@@ -2952,7 +2972,7 @@ PasswordBox::SyncSelectedText ()
 		int start = MIN (selection_anchor, selection_cursor);
 		char *text;
 		
-		text = g_ucs4_to_utf8 (buffer->text + start, length, NULL, NULL, NULL);
+		text = buffer->ToUtf8 (start, length);
 		
 		setvalue = false;
 		SetValue (PasswordBox::SelectedTextProperty, Value (text, Type::STRING, true));
@@ -2980,7 +3000,7 @@ PasswordBox::SyncText ()
 {
 	char *text;
 	
-	text = g_ucs4_to_utf8 (buffer->text, buffer->len, NULL, NULL, NULL);
+	text = buffer->ToUtf8 (0, buffer->len);
 	
 	SyncDisplayText ();
 	
@@ -3243,6 +3263,7 @@ TextBoxView::TextBoxView ()
 	enable_cursor = true;
 	blink_timeout = 0;
 	textbox = NULL;
+	text_changed = false;
 	dirty = false;
 }
 
@@ -3495,10 +3516,26 @@ TextBoxView::ArrangeOverrideWithError (Size finalSize, MoonError *error)
 void
 TextBoxView::Layout (Size constraint)
 {
+	double top, bottom;
+	
 	layout->SetMaxWidth (constraint.width);
 	
 	layout->Layout ();
 	dirty = false;
+	
+	if (text_changed) {
+		// if the layout only had to update the lines around the edit, only those need a redraw
+		if (layout->GetDirtyRange (&top, &bottom) && GetFlowDirection () == FlowDirectionLeftToRight) {
+			Rect rect = layout->GetRenderExtents ();
+			
+			rect = Rect (0.0, top, MAX (rect.x + rect.width, GetActualWidth ()), bottom - top);
+			Invalidate (rect.Transform (&absolute_xform));
+		} else {
+			Invalidate ();
+		}
+		
+		text_changed = false;
+	}
 }
 
 double
@@ -3632,10 +3669,14 @@ TextBoxView::OnModelChanged (TextBoxModelChangedEventArgs *args)
 		dirty = true;
 		break;
 	case TextBoxModelChangedText:
-		// the text has changed, need to recalculate layout/bounds
+		// the text has changed, need to recalculate layout/bounds, the
+		// changed lines get invalidated once they've been laid out
 		UpdateText ();
+		text_changed = true;
 		dirty = true;
-		break;
+		InvalidateMeasure ();
+		UpdateBounds ();
+		return;
 	default:
 		// nothing changed??
 		return;
@@ -597,6 +597,7 @@ class TextBoxView : public FrameworkElement {
 	int had_selected_text:1;
 	int cursor_visible:1;
 	int enable_cursor:1;
+	int text_changed:1;
 	int dirty:1;
 	
 	// mouse events
@@ -232,6 +232,7 @@ TextLayoutLine::TextLayoutLine (TextLayout *_layout, int _start, int _offset)
 	descend = 0.0;
 	height = 0.0;
 	width = 0.0;
+	paragraph = false;
 	length = 0;
 	count = 0;
 }
@@ -269,7 +270,9 @@ TextLayout::TextLayout ()
 	line_height = NAN;
 	attributes = NULL;
 	lines = g_ptr_array_new ();
+	has_dirty_range = false;
 	is_wrapped = true;
+	edit_start = -1;
 	text = NULL;
 	length = 0;
 	count = 0;
@@ -302,6 +305,7 @@ TextLayout::ResetState ()
 {
 	actual_height = NAN;
 	actual_width = NAN;
+	edit_start = -1;
 }
 
 void
@@ -441,9 +445,56 @@ TextLayout::SetTextAttributes (List *attrs)
 	return true;
 }
 
+bool
+TextLayout::CanLayoutIncrementally ()
+{
+	TextLayoutAttributes *attrs;
+	
+	// the selection is baked into the glyph clusters and runs are split
+	// at attribute boundaries, so only plain single-attribute text (as
+	// in a TextBox) can be updated around an edit
+	if (selection_length > 0 || !attributes)
+		return false;
+	
+	if (!(attrs = (TextLayoutAttributes *) attributes->First ()) || attrs->next)
+		return false;
+	
+	return true;
+}
+
 bool
 TextLayout::SetText (const char *str, int len)
 {
+	int prefix = 0, suffix = 0;
+	bool incremental;
+	int n, max;
+	
+	// if the lines are still valid for the current text (or for the text
+	// before a pending edit), find the bytes that changed so that Layout()
+	// only has to update the lines around them.
+	incremental = length > 0 && str && (!isnan (actual_width) || edit_start != -1) && CanLayoutIncrementally ();
+	
+	if (incremental) {
+		n = len == -1 ? strlen (str) : len;
+		max = MIN (length, n);
+		
+		while (prefix < max && text[prefix] == str[prefix])
+			prefix++;
+		
+		while (suffix < max - prefix && text[length - suffix - 1] == str[n - suffix - 1])
+			suffix++;
+		
+		if (edit_start != -1) {
+			// merge with the pending edit
+			prefix = MIN (prefix, edit_start);
+			suffix = MIN (suffix, edit_suffix);
+		} else {
+			edit_height = actual_height;
+			edit_width = actual_width;
+			edit_length = length;
+		}
+	}
+	
 	g_free (text);
 	
 	if (str) {
@@ -460,6 +511,11 @@ TextLayout::SetText (const char *str, int len)
 	
 	ResetState ();
 	
+	if (incremental) {
+		edit_suffix = suffix;
+		edit_start = prefix;
+	}
+	
 	return true;
 }
 
@@ -636,6 +692,19 @@ TextLayout::GetActualExtents (double *width, double *height)
 	*width = actual_width;
 }
 
+bool
+TextLayout::GetDirtyRange (double *top, double *bottom)
+{
+	if (!has_dirty_range)
+		return false;
+	
+	has_dirty_range = false;
+	*bottom = dirty_bottom;
+	*top = dirty_top;
+	
+	return true;
+}
+
 double
 TextLayout::GetBaselineOffset ()
 {
@@ -1500,6 +1569,31 @@ validate_attrs (List *attributes)
 	return true;
 }
 
+void
+TextLayout::UpdateActualExtents ()
+{
+	TextLayoutLine *line;
+	
+	actual_height = 0.0;
+	actual_width = 0.0;
+	
+	for (guint i = 0; i < lines->len; i++) {
+		line = (TextLayoutLine *) lines->pdata[i];
+		
+		// a line wrapped at the very end of the text doesn't add any height
+		if (i > 0 && i + 1 == lines->len && line->length == 0 && !line->paragraph)
+			break;
+		
+		// ActualWidth extents only include trailing lwsp on the last line
+		if (line->start + line->length == length)
+			actual_width = MAX (actual_width, line->advance);
+		else
+			actual_width = MAX (actual_width, line->width);
+		
+		actual_height += line->height;
+	}
+}
+
 void
 TextLayout::Layout ()
 {
@@ -1507,9 +1601,14 @@ TextLayout::Layout ()
 	TextLayoutAttributes *attrs, *nattrs;
 	LayoutWordCallback layout_word;
 	const char *inptr, *inend;
+	GPtrArray *old_lines = NULL;
+	double old_height = 0.0;
 	size_t n_bytes, n_chars;
-	TextLayoutLine *line;
+	TextLayoutLine *line, *old;
+	bool resynced = false;
 	TextLayoutRun *run;
+	guint resync = 0;
+	guint first = 0;
 	GlyphInfo *prev;
 	LayoutWord word;
 	TextFont *font;
@@ -1520,10 +1619,44 @@ TextLayout::Layout ()
 	if (!isnan (actual_width))
 		return;
 	
+	has_dirty_range = false;
+	
+	if (edit_start != -1 && text && lines->len > 0 && validate_attrs (attributes) && CanLayoutIncrementally ()) {
+		// the paragraphs preceding the edit are unchanged, so only the lines from
+		// the start of the edited paragraph need to be laid out again (lines
+		// wrap within a paragraph, so a change can pull words up onto the
+		// previous lines of the same paragraph)
+		for (guint i = 0; i < lines->len; i++) {
+			line = (TextLayoutLine *) lines->pdata[i];
+			
+			if (line->start >= edit_start)
+				break;
+			
+			if (line->paragraph)
+				first = i;
+		}
+		
+		old_lines = g_ptr_array_sized_new (lines->len - first);
+		for (guint i = first; i < lines->len; i++)
+			g_ptr_array_add (old_lines, lines->pdata[i]);
+		g_ptr_array_set_size (lines, first);
+		
+		line = (TextLayoutLine *) old_lines->pdata[0];
+		offset = line->offset;
+		inptr = text + line->start;
+		
+		dirty_top = 0.0;
+		for (guint i = 0; i < first; i++)
+			dirty_top += ((TextLayoutLine *) lines->pdata[i])->height;
+	} else {
+		edit_start = -1;
+		is_wrapped = false;
+		ClearLines ();
+		inptr = text;
+	}
+	
 	actual_height = 0.0;
 	actual_width = 0.0;
-	is_wrapped = false;
-	ClearLines ();
 	count = 0;
 	
 	if (!text || !validate_attrs (attributes))
@@ -1539,14 +1672,17 @@ TextLayout::Layout ()
 	layout_word = layout_word_behavior[wrapping];
 	
 	attrs = (TextLayoutAttributes *) attributes->First ();
-	line = new TextLayoutLine (this, 0, 0);
+	line = new TextLayoutLine (this, inptr - text, offset);
+	line->paragraph = true;
 	if (OverrideLineHeight ()) {
 		line->descend = DescendOverride ();
 		line->height = LineHeightOverride ();
+	} else if (inptr > text && *inptr == '\0') {
+		line->descend = attrs->Font ()->Descender ();
+		line->height = attrs->Font ()->Height ();
 	}
 	
 	g_ptr_array_add (lines, line);
-	inptr = text;
 	
 	do {
 		nattrs = (TextLayoutAttributes *) attrs->next;
@@ -1665,9 +1801,28 @@ TextLayout::Layout ()
 				// update actual height extents
 				actual_height += line->height;
 				
+				if (linebreak && old_lines && (inptr - text) >= length - edit_suffix) {
+					// past the edit: once we get to the start of a paragraph which
+					// was laid out before, the rest of the old lines can be reused
+					int start = (inptr - text) - (length - edit_length);
+					
+					while (resync < old_lines->len && ((TextLayoutLine *) old_lines->pdata[resync])->start < start)
+						resync++;
+					
+					if (resync < old_lines->len) {
+						old = (TextLayoutLine *) old_lines->pdata[resync];
+						
+						if (old->start == start && old->paragraph) {
+							resynced = true;
+							break;
+						}
+					}
+				}
+				
 				if (linebreak || wrapped) {
 					// more text to layout... which means we'll need a new line
 					line = new TextLayoutLine (this, inptr - text, offset);
+					line->paragraph = linebreak;
 					
 					if (!OverrideLineHeight ()) {
 						if (*inptr == '\0') {
@@ -1695,13 +1850,68 @@ TextLayout::Layout ()
 		}
 		
 		attrs = nattrs;
-	} while (*inptr != '\0');
+	} while (!resynced && *inptr != '\0');
 	
 	if (word.break_ops != NULL)
 		g_array_free (word.break_ops, true);
 	
 	count = offset;
 	
+	if (old_lines) {
+		// the lines which were laid out again
+		double height = 0.0;
+		
+		for (guint i = first; i < lines->len; i++)
+			height += ((TextLayoutLine *) lines->pdata[i])->height;
+		
+		if (resynced) {
+			// move the remaining old lines to where the edit moved their text
+			int delta_bytes = (inptr - text) - old->start;
+			int delta_chars = offset - old->offset;
+			
+			for (guint i = 0; i < resync; i++) {
+				old_height += ((TextLayoutLine *) old_lines->pdata[i])->height;
+				delete (TextLayoutLine *) old_lines->pdata[i];
+			}
+			
+			for (guint i = resync; i < old_lines->len; i++) {
+				line = (TextLayoutLine *) old_lines->pdata[i];
+				line->offset += delta_chars;
+				line->start += delta_bytes;
+				
+				for (guint j = 0; j < line->runs->len; j++) {
+					run = (TextLayoutRun *) line->runs->pdata[j];
+					run->start += delta_bytes;
+					
+					for (guint k = 0; k < run->clusters->len; k++)
+						((TextLayoutGlyphCluster *) run->clusters->pdata[k])->start += delta_bytes;
+				}
+				
+				g_ptr_array_add (lines, line);
+			}
+			
+			count = line->offset + line->count;
+		} else {
+			for (guint i = 0; i < old_lines->len; i++)
+				delete (TextLayoutLine *) old_lines->pdata[i];
+		}
+		
+		g_ptr_array_free (old_lines, true);
+		edit_start = -1;
+		
+		UpdateActualExtents ();
+		
+		// if the following lines didn't move, only the lines which were laid out
+		// again need a redraw, otherwise everything from the edit down does
+		if (resynced && height == old_height)
+			dirty_bottom = dirty_top + height;
+		else
+			dirty_bottom = MAX (actual_height, edit_height);
+		
+		// lines are aligned to the widest line when the width isn't constrained
+		has_dirty_range = alignment == TextAlignmentLeft || actual_width == edit_width;
+	}
+	
 #if DEBUG
 	if (debug_flags & RUNTIME_DEBUG_LAYOUT) {
 		print_lines (lines);
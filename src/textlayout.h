@@ -94,6 +94,7 @@ struct TextLayoutLine {
 	double descend;
 	double height;
 	double width;
+	bool paragraph;  // first line, or the line following a line break
 	
 	TextLayoutLine (TextLayout *layout, int start, int offset);
 	~TextLayoutLine ();
@@ -142,6 +143,20 @@ class TextLayout {
 	double actual_width;
 	GPtrArray *lines;
 	
+	// pending edit: the lines were laid out for a text of edit_length bytes
+	// of which only the bytes between edit_start and the last edit_suffix
+	// bytes have changed (edit_start is -1 if there's no pending edit)
+	double edit_height;
+	double edit_width;
+	int edit_length;
+	int edit_suffix;
+	int edit_start;
+	
+	// the lines changed by the last incremental layout
+	double dirty_bottom;
+	double dirty_top;
+	bool has_dirty_range;
+	
 	bool OverrideLineHeight () { return (strategy == LineStackingStrategyBlockLineHeight && line_height != 0); }
 	double LineHeightOverride ();
 	double DescendOverride ();
@@ -149,6 +164,9 @@ class TextLayout {
 	void ClearCache ();
 	void ClearLines ();
 	
+	bool CanLayoutIncrementally ();
+	void UpdateActualExtents ();
+	
  public:
 	TextLayout ();
 	~TextLayout ();
@@ -217,6 +235,11 @@ class TextLayout {
 	
 	void GetActualExtents (double *width, double *height);
 	Rect GetRenderExtents ();
+	
+	// Gets the vertical range of the lines which changed in the last
+	// Layout() if it only had to update the lines around an edit,
+	// and forgets it. Returns %false if everything needs a redraw.
+	bool GetDirtyRange (double *top, double *bottom);
 };
 
 };
@@ -16,6 +16,7 @@
 #include "timemanager.h"
 #include "timesource.h"
 #include "runtime.h"
+#include "frame-profiler.h"
 
 namespace Moonlight {
 
@@ -115,6 +116,8 @@ TimeManager::TimeManager ()
 
 	stop_time = 0;
 	was_stopped = false;
+
+	profiler = new FrameProfiler ();
 }
 
 TimeManager::~TimeManager ()
@@ -135,6 +138,9 @@ TimeManager::~TimeManager ()
 	rendering_args->unref ();
 
 	RemoveAllRegisteredTimeouts ();
+
+	delete profiler;
+	profiler = NULL;
 }
 
 void
@@ -174,6 +180,9 @@ TimeManager::Shutdown ()
 	source->Stop ();
 	source_tick_pending = false;
 	tick_calls.Clear (true);
+
+	if (profiler->GetTracePath () != NULL)
+		profiler->WriteTrace (profiler->GetTracePath ());
 }
 
 void
@@ -488,14 +497,19 @@ TimeManager::SourceTick ()
 	current_global_time = source->GetNow();
 	current_global_time_usec = current_global_time / 10;
 
+	profiler->StartFrame ();
+
 	if (current_flags & TIME_MANAGER_TICK_CALL) {
 		STARTTICKTIMER (tm_tick_call, "TimeManager::Tick - Call");
+		PROFILE_PHASE_START (FrameProfilerTickCalls);
 		InvokeTickCalls ();
+		PROFILE_PHASE_END (FrameProfilerTickCalls);
 		ENDTICKTIMER (tm_tick_call, "TimeManager::Tick - Call");
 	}
 
 	if (current_flags & TIME_MANAGER_UPDATE_CLOCKS) {
 		STARTTICKTIMER (tick_update_clocks, "TimeManager::Tick - UpdateClocks");
+		PROFILE_PHASE_START (FrameProfilerClocks);
 
 		bool need_another_tick = root_clock->UpdateFromParentTime (GetCurrentTime());
 
@@ -505,11 +519,15 @@ TimeManager::SourceTick ()
 		// ... then cause all clocks to raise the events they've queued up
 		root_clock->RaiseAccumulatedEvents ();
 		
+		PROFILE_PHASE_START (FrameProfilerApplier);
 		applier->Apply ();
 		applier->Flush ();
+		PROFILE_PHASE_END (FrameProfilerApplier);
 	
 		root_clock->RaiseAccumulatedCompleted ();
 
+		PROFILE_PHASE_END (FrameProfilerClocks);
+
 #if CLOCK_DEBUG
 		if (need_another_tick)
 			ListClocks ();
@@ -519,7 +537,9 @@ TimeManager::SourceTick ()
 
 	if (current_flags & TIME_MANAGER_UPDATE_INPUT) {
 		STARTTICKTIMER (tick_input, "TimeManager::Tick - Input");
+		PROFILE_PHASE_START (FrameProfilerInput);
 		Emit (UpdateInputEvent);
+		PROFILE_PHASE_END (FrameProfilerInput);
 		ENDTICKTIMER (tick_input, "TimeManager::Tick - Input");
 	}
 
@@ -532,6 +552,8 @@ TimeManager::SourceTick ()
 		ENDTICKTIMER (tick_render, "TimeManager::Tick - Render");
 	}
 
+	profiler->EndFrame ();
+
 	last_global_time = current_global_time;
 
 #if PUT_TIME_MANAGER_TO_SLEEP
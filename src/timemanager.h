@@ -20,6 +20,8 @@
 
 namespace Moonlight {
 
+class FrameProfiler;
+
 // our root level time manager (basically the object that registers
 // the gtk_timeout and drives all Clock objects
 /* @Namespace=Mono,ManagedEvents=Manual */
@@ -68,6 +70,7 @@ public:
 
 	void ListClocks ();
 	Applier* GetApplier () { return applier; }
+	FrameProfiler *GetProfiler () { return profiler; }
 	
 protected:
 	virtual ~TimeManager ();
@@ -83,6 +86,7 @@ private:
 	TimelineGroup *timeline;
 	ClockGroup *root_clock;
 	Applier *applier;
+	FrameProfiler *profiler;
 
 	bool was_stopped;
 	TimeSpan stop_time;
@@ -309,23 +309,30 @@ Type::GetContentPropertyName ()
 	return parent_type->GetContentPropertyName ();
 }
 
+// the property tables are keyed by the lowercased names (DependencyProperty::GetHashKey),
+// hashing and comparing case insensitively means a lookup doesn't have to lowercase
+// (and allocate) the name first
+static guint
+property_name_hash (gconstpointer name)
+{
+	return Types::HashName ((const char *) name, 0);
+}
+
+static gboolean
+property_name_equal (gconstpointer name1, gconstpointer name2)
+{
+	return !g_ascii_strcasecmp ((const char *) name1, (const char *) name2);
+}
+
 DependencyProperty *
 Type::LookupProperty (const char *name)
 {
-	DependencyProperty *property = NULL;
-	
 	g_return_val_if_fail (name != NULL, NULL);
 	
-	if (properties != NULL) {
-		char *key = g_ascii_strdown (name, -1);
-		property = (DependencyProperty*) g_hash_table_lookup (properties, key);
-		g_free (key);
-		
-		if (property)
-			return property;
-	}
-	
-	return NULL;
+	if (properties == NULL)
+		return NULL;
+
+	return (DependencyProperty *) g_hash_table_lookup (properties, name);
 }
 
 void
@@ -336,7 +343,7 @@ Type::AddProperty (DependencyProperty *property)
 	g_return_if_fail (property != NULL);
 
 	if (properties == NULL) {
-		properties = g_hash_table_new (g_str_hash, g_str_equal);
+		properties = g_hash_table_new (property_name_hash, property_name_equal);
 	} else {
 		existing = (DependencyProperty *) g_hash_table_lookup (properties, property->GetHashKey ());
 	}
@@ -505,15 +512,46 @@ Types::Find (const char *name)
 	return Types::Find (name, true);
 }
 
+guint32
+Types::HashName (const char *name, guint32 seed)
+{
+	// FNV-1a, this must match HashName in the generator
+	guint32 hash = 2166136261U ^ seed;
+
+	for (const char *p = name; *p; p++) {
+		hash ^= (guchar) g_ascii_tolower (*p);
+		hash *= 16777619;
+	}
+
+	return hash;
+}
+
+Type *
+Types::FindNative (const char *name, bool ignore_case)
+{
+	guint32 seed = native_type_hash_seeds [HashName (name, 0) & native_type_hash_bucket_mask];
+	Type::Kind kind = (Type::Kind) native_type_hash_slots [HashName (name, seed) & native_type_hash_slot_mask];
+	Type *t;
+
+	if (kind == Type::INVALID || !(t = (Type *) types [(int) kind]))
+		return NULL;
+
+	if ((ignore_case && !g_ascii_strcasecmp (t->GetName (), name)) || !strcmp (t->GetName (), name))
+		return t;
+
+	return NULL;
+}
+
 Type *
 Types::Find (const char *name, bool ignore_case)
 {
 	Type *t;
-	
-	for (int i = 1; i < types.GetCount (); i++) { // 0 = INVALID, shouldn't compare against that
-		if (i == Type::LASTTYPE)
-			continue;
-	
+
+	if ((t = FindNative (name, ignore_case)))
+		return t;
+
+	// the types registered by managed code
+	for (int i = Type::LASTTYPE + 1; i < types.GetCount (); i++) {
 		t = (Type *) types [i];
 		if ((ignore_case && !g_ascii_strcasecmp (t->GetName (), name)) || !strcmp (t->GetName (), name))
 			return t;
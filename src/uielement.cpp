@@ -29,25 +29,36 @@
 #include "resources.h"
 #include "popup.h"
 #include "window.h"
+#include "frame-profiler.h"
 #include "provider.h"
 #include "effect.h"
 #include "projection.h"
 #include "factory.h"
 #include "bitmapcache.h"
+#include "display-list.h"
 
 namespace Moonlight {
 
 //#define DEBUG_INVALIDATE 0
 
+// frames a subtree must be rendered without changing before it's recorded into a
+// display list, doubled every time a list is thrown away (up to the maximum)
+#define DISPLAY_LIST_STATIC_FRAMES 2
+#define DISPLAY_LIST_MAX_STATIC_FRAMES 64
+// give up on subtrees which can't be recorded
+#define DISPLAY_LIST_MAX_FAILURES 3
+
 UIElement::UIElement ()
-	: DependencyObject (Type::UIELEMENT), visual_parent (this, VisualParentWeakRef), subtree_object (this, SubtreeObjectWeakRef)
+	: DependencyObject (Type::UIELEMENT), bitmap_cache (RenderCacheBitmapCache, RENDER_CACHE_COST_HIGH),
+	  visual_parent (this, VisualParentWeakRef), subtree_object (this, SubtreeObjectWeakRef)
 {
 	Init ();
 }
 
 
 UIElement::UIElement (Type::Kind object_type)
-	: DependencyObject (object_type), visual_parent (this, VisualParentWeakRef), subtree_object (this, SubtreeObjectWeakRef)
+	: DependencyObject (object_type), bitmap_cache (RenderCacheBitmapCache, RENDER_CACHE_COST_HIGH),
+	  visual_parent (this, VisualParentWeakRef), subtree_object (this, SubtreeObjectWeakRef)
 {
 	Init ();
 }
@@ -78,6 +89,10 @@ UIElement::Init ()
 	Matrix3D::Identity (render_projection);
 	effect_padding = Thickness (0);
 	bitmap_cache_size = 0;
+	display_list = NULL;
+	display_list_frames = 0;
+	display_list_threshold = DISPLAY_LIST_STATIC_FRAMES;
+	display_list_failures = 0;
 
 	dirty_flags = DirtyMeasure;
 	PropagateFlagUp (DIRTY_MEASURE_HINT);
@@ -87,6 +102,9 @@ UIElement::Init ()
 
 	desired_size = Size (0, 0);
 	render_size = Size (0, 0);
+	has_previous_constraint = false;
+	has_last_render_size = false;
+	has_visual_offset = false;
 	
 	ComputeLocalTransform ();
 	ComputeLocalProjection ();
@@ -97,6 +115,7 @@ UIElement::Init ()
 UIElement::~UIElement()
 {
 	InvalidateBitmapCache ();
+	delete display_list;
 	delete dirty_region;
 }
 
@@ -679,6 +698,8 @@ UIElement::ComputeTransform ()
 	}
 	
 	if (memcmp (old_projection, local_projection, sizeof (double) * 16)) {
+		InvalidateDisplayList ();
+
 		if (GetVisualParent ())
 			GetVisualParent ()->Invalidate (GetSubtreeBounds ());
 		else if (GetDeployment ()->GetSurface ()->IsTopLevel (this))
@@ -861,13 +882,13 @@ UIElement::ElementAdded (UIElement *item)
 	
 	InvalidateMeasure ();
 	ClearValue (LayoutInformation::LayoutClipProperty);
-	ClearValue (LayoutInformation::PreviousConstraintProperty);
+	LayoutInformation::SetPreviousConstraint (this, NULL);
 	item->SetRenderSize (Size (0,0));
 	item->UpdateTransform ();
 	item->UpdateProjection ();
 	item->InvalidateMeasure ();
 	item->InvalidateArrange ();
-	if (item->HasFlag (DIRTY_SIZE_HINT) || item->ReadLocalValue (LayoutInformation::LastRenderSizeProperty))
+	if (item->HasFlag (DIRTY_SIZE_HINT) || LayoutInformation::GetLastRenderSize (item))
 		item->PropagateFlagUp (DIRTY_SIZE_HINT);
 }
 
@@ -1136,6 +1157,9 @@ UIElement::InvalidatePaint ()
 void
 UIElement::InvalidateParent (Rect r)
 {
+	// our own list includes the clip, opacity, etc
+	InvalidateDisplayList ();
+
 	if (GetVisualParent ())
 		GetVisualParent ()->Invalidate (r);
 	else if (IsAttached ())
@@ -1201,6 +1225,31 @@ UIElement::InvalidateBitmapCache ()
 	}
 }
 
+void
+UIElement::InvalidateDisplayList ()
+{
+	if (display_list) {
+		delete display_list;
+		display_list = NULL;
+
+		// it didn't stay unchanged for long, wait longer before recording it again
+		display_list_threshold = MIN (display_list_threshold * 2, DISPLAY_LIST_MAX_STATIC_FRAMES);
+	}
+
+	display_list_frames = 0;
+}
+
+void
+UIElement::ReleaseDisplayLists ()
+{
+	delete display_list;
+	display_list = NULL;
+
+	VisualTreeWalker walker (this, ZForward, false);
+	while (UIElement *child = walker.Step ())
+		child->ReleaseDisplayLists ();
+}
+
 void
 UIElement::InvalidateCacheMode ()
 {
@@ -1371,24 +1420,99 @@ UIElement::DoRender (Context *ctx, Region *parent_region)
 		return;
 	}
 
-#if OCCLUSION_CULLING_STATS
-	GetDeployment ()->GetSurface ()->uielements_rendered_with_painters ++;
-#endif
-
 	STARTTIMER (UIElement_render, Type::Find (GetObjectType())->name);
 
-	PreRender (ctx, region, false);
+	PROFILE_COUNT (FrameProfilerRendered);
 
-	if (ctx->IsMutable ())
-		Render (ctx, region);
+	if (UseDisplayList ()) {
+		RenderDisplayList (ctx, region);
+	}
+	else {
+		PreRender (ctx, region, false);
 
-	PostRender (ctx, region, false);
+		if (ctx->IsMutable ())
+			Render (ctx, region);
+
+		PostRender (ctx, region, false);
+	}
 
 	ENDTIMER (UIElement_render, Type::Find (GetObjectType())->name);
 
 	delete region;
 }
 
+bool
+UIElement::UseDisplayList ()
+{
+	if (!DisplayList::IsEnabled () || DisplayList::IsRecording ())
+		return false;
+
+	if (display_list)
+		return true;
+
+	// intermediate surfaces are rendered with a transform of their own
+	if (RenderToIntermediate () || display_list_failures >= DISPLAY_LIST_MAX_FAILURES)
+		return false;
+
+	return ++display_list_frames > display_list_threshold;
+}
+
+void
+UIElement::RenderDisplayList (Context *ctx, Region *region)
+{
+	// scaled, rotated or moved by a fraction of a pixel, record it again once it settles
+	if (display_list && !display_list->CanReplay (ctx))
+		InvalidateDisplayList ();
+
+	if (!display_list && display_list_frames > display_list_threshold) {
+		Rect           extents = GetSubtreeExtents ().Transform (&render_xform).Transform (ctx).RoundOut ();
+		Region         *all = new Region (extents);
+		cairo_matrix_t ctm;
+		Context        *recorder;
+
+		ctx->Top ()->GetMatrix (&ctm);
+
+		// render the whole subtree, not just the region which is being repainted
+		recorder = DisplayList::BeginRecording (&ctm, extents);
+
+		PreRender (recorder, all, false);
+
+		if (recorder->IsMutable ())
+			Render (recorder, all);
+
+		PostRender (recorder, all, false);
+
+		display_list = DisplayList::EndRecording (recorder);
+		delete all;
+
+		if (display_list) {
+			PROFILE_COUNT (FrameProfilerDisplayListRecords);
+
+			// the subtree is drawn from our list now
+			VisualTreeWalker walker (this, ZForward, false);
+			while (UIElement *child = walker.Step ())
+				child->ReleaseDisplayLists ();
+		}
+		else {
+			display_list_failures++;
+			display_list_frames = 0;
+		}
+	}
+
+	if (display_list) {
+		PROFILE_COUNT (FrameProfilerDisplayListReplays);
+		display_list->Replay (ctx);
+		return;
+	}
+
+	PreRender (ctx, region, false);
+
+	if (ctx->IsMutable ())
+		Render (ctx, region);
+
+	PostRender (ctx, region, false);
+}
+
 bool
 UIElement::UseOcclusionCulling ()
 {
@@ -1425,6 +1549,21 @@ UIElement::FrontToBack (Region *surface_region, List *render_list)
 	    || IS_INVISIBLE (local_opacity))
 		return;
 
+	if (UseDisplayList ()) {
+		Region *self_region = new Region (surface_region);
+
+		self_region->Intersect (GetSubtreeBounds ().RoundOut ());
+
+		// like the elements which can't be culled, we draw the whole
+		// subtree without removing anything from the surface region
+		if (!self_region->IsEmpty ())
+			render_list->Prepend (new RenderNode (this, self_region, false,
+							      UIElement::CallRenderDisplayList, NULL));
+		else
+			delete self_region;
+		return;
+	}
+
 	if (!UseOcclusionCulling ()) {
 		Region *self_region;
 
@@ -1514,8 +1653,16 @@ UIElement::FrontToBack (Region *surface_region, List *render_list)
 	if (!self_region->IsEmpty()) {
 		if (((absolute_xform.yx == 0 && absolute_xform.xy == 0) /* no skew/rotation */
 		     || (absolute_xform.xx == 0 && absolute_xform.yy == 0)) /* allow 90 degree rotations */
-		    && can_subtract_self)
-			region->Subtract (GetCoverageBounds ());
+		    && can_subtract_self) {
+			// only whole pixels are covered, the partially covered
+			// ones at the edges still have to show what's beneath
+			Rect coverage = GetCoverageBounds ().RoundIn ();
+
+			if (!coverage.IsEmpty ()) {
+				PROFILE_COUNT (FrameProfilerOccluders);
+				region->Subtract (coverage);
+			}
+		}
 	}
 
 	if (delete_region)
@@ -1617,11 +1764,14 @@ UIElement::PreRender (Context *ctx, Region *region, bool skip_children)
 		MoonSurface *cache = ctx->Lookup (&bitmap_cache);
 
 		if (cache) {
+			PROFILE_COUNT (FrameProfilerCacheHits);
 			ctx->Push (Context::Group (r), cache);
 		}
 		else {
 			Surface *surface = GetDeployment ()->GetSurface ();
 
+			PROFILE_COUNT (FrameProfilerCacheMisses);
+
 			ctx->Push (Context::Group (r));
 			ctx->Push (Context::AbsoluteTransform (cache_xform));
 
@@ -1635,8 +1785,13 @@ UIElement::PreRender (Context *ctx, Region *region, bool skip_children)
 
 			ctx->Replace (&bitmap_cache, cache);
 
+			// the previous surface may have been evicted
+			if (bitmap_cache_size)
+				surface->RemoveGPUSurface (bitmap_cache_size);
+
 			bitmap_cache_size = r.RoundOut ().Area () * 4;
 			surface->AddGPUSurface (bitmap_cache_size);
+			bitmap_cache.Add (bitmap_cache_size);
 
 			ctx->Push (Context::Group (r), cache);
 			cache->unref ();
@@ -1843,11 +1998,6 @@ UIElement::Paint (Context *ctx,  Rect bounds, cairo_matrix_t *xform)
 {
 	Region region (bounds.RoundOut ());
 
-#if OCCLUSION_CULLING_STATS
-	GetDeployment ()->GetSurface ()->uielements_rendered_with_occlusion_culling = 0;
-	GetDeployment ()->GetSurface ()->uielements_rendered_with_painters = 0;
-#endif
-
 	cairo_matrix_t inverse = layout_xform;
 
 	// reverse the effect of the layout_xform
@@ -1859,11 +2009,6 @@ UIElement::Paint (Context *ctx,  Rect bounds, cairo_matrix_t *xform)
 	ctx->Push (Context::Transform (inverse));
 	DoRender (ctx, &region);
 	ctx->Pop ();
-
-#if OCCLUSION_CULLING_STATS
-	printf ("%d UIElements rendered front-to-back for: %s(%p)\n", GetDeployment ()->GetSurface ()->uielements_rendered_with_occlusion_culling, GetName (), this);
-	printf ("%d UIElements rendered back-to-front for: %s(%p)\n", GetDeployment ()->GetSurface ()->uielements_rendered_with_painters, GetName (), this);
-#endif
 }
 
 void
@@ -1878,6 +2023,13 @@ UIElement::CallPostRender (Context *ctx, UIElement *element, Region *region, boo
 	element->PostRender (ctx, region, skip_children);
 }
 
+void
+UIElement::CallRenderDisplayList (Context *ctx, UIElement *element, Region *region, bool skip_children)
+{
+	if (ctx->IsMutable ())
+		element->RenderDisplayList (ctx, region);
+}
+
 void
 UIElement::Render (Context *ctx, Region *region)
 {
@@ -39,6 +39,7 @@
 namespace Moonlight {
 
 class Surface;
+class DisplayList;
 
 // return false to skip the subtree rooted at el
 typedef bool (*VisualTreeVisitor)(UIElement *el, gpointer data);
@@ -393,6 +394,13 @@ public:
 	void InvalidateBitmapCache ();
 	void InvalidateCacheMode ();
 
+	//
+	// InvalidateDisplayList:
+	//   Drops the recorded rendering of the subtree, called when the
+	//   element or anything below it changes.
+	//
+	void InvalidateDisplayList ();
+
 	//
 	// GetTransformOrigin:
 	//   Returns the transformation origin based on  of the item and the
@@ -691,6 +699,12 @@ protected:
 
 	static void CallPreRender (Context *ctx, UIElement *element, Region *region, bool skip_children);
 	static void CallPostRender (Context *ctx, UIElement *element, Region *region, bool skip_children);
+	static void CallRenderDisplayList (Context *ctx, UIElement *element, Region *region, bool skip_children);
+
+	// Whether the subtree should be drawn from (or recorded into) its display list this frame
+	bool UseDisplayList ();
+	void RenderDisplayList (Context *ctx, Region *region);
+	void ReleaseDisplayLists ();
 
 	// Local perspective transform, including local affine transforms
 	double local_projection[16];
@@ -703,6 +717,11 @@ protected:
 	Context::Cache bitmap_cache;
 	int bitmap_cache_size;
 
+	DisplayList *display_list;
+	int display_list_frames; // frames the subtree has been rendered without changing
+	int display_list_threshold; // frames it has to stay unchanged before it's recorded
+	int display_list_failures;
+
 private:
 	bool loaded;
 	int visual_level;
@@ -713,6 +732,15 @@ private:
 	Size desired_size;
 	Size render_size;
 
+	// layout state, see LayoutInformation
+	friend class LayoutInformation;
+	Size previous_constraint;
+	Size last_render_size;
+	Point visual_offset;
+	bool has_previous_constraint;
+	bool has_last_render_size;
+	bool has_visual_offset;
+
 	// The local render transform including tranform origin
 	cairo_matrix_t local_xform;
 	cairo_matrix_t render_xform;
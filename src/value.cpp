@@ -40,6 +40,133 @@
 
 namespace Moonlight {
 
+/**
+ * Value pool
+ *
+ * Every GetValue/SetValue, property change and animation tick creates
+ * and destroys Values and the structs they box, so freed blocks are
+ * kept on per-thread free lists (one per block size) and handed out
+ * again instead of going through malloc. The blocks are still malloc'ed
+ * one by one, a block freed on another thread (or allocated by managed
+ * code with Marshal.AllocHGlobal, which frees nothing itself) only ends
+ * up on that thread's list. Set MOONLIGHT_NO_VALUE_POOL to disable it.
+ */
+
+#define VALUE_POOL_MAX_BLOCK_SIZE 64
+#define VALUE_POOL_MAX_FREE 256
+
+struct ValuePool {
+	gpointer free_list [VALUE_POOL_MAX_BLOCK_SIZE + 1]; /* by block size, linked through the first word of the blocks */
+	guint16 free_count [VALUE_POOL_MAX_BLOCK_SIZE + 1];
+	guint64 allocated;
+	guint64 recycled;
+};
+
+static MoonMutex pool_statistics_mutex;
+static guint64 pool_allocated = 0; /* the statistics of the threads which have exited */
+static guint64 pool_recycled = 0;
+
+static void
+pool_destroy (gpointer data)
+{
+	ValuePool *pool = (ValuePool *) data;
+	gpointer block, next;
+
+	for (int i = 0; i <= VALUE_POOL_MAX_BLOCK_SIZE; i++) {
+		for (block = pool->free_list [i]; block; block = next) {
+			next = *(gpointer *) block;
+			g_free (block);
+		}
+	}
+
+	pool_statistics_mutex.Lock ();
+	pool_allocated += pool->allocated;
+	pool_recycled += pool->recycled;
+	pool_statistics_mutex.Unlock ();
+
+	g_free (pool);
+}
+
+static ValuePool *
+pool_get ()
+{
+	static MoonTlsKey pool_key (pool_destroy);
+	static bool disabled = g_getenv ("MOONLIGHT_NO_VALUE_POOL") != NULL;
+	ValuePool *pool;
+
+	if (G_UNLIKELY (disabled))
+		return NULL;
+
+	if (G_UNLIKELY (!(pool = (ValuePool *) MoonThread::GetSpecific (pool_key)))) {
+		pool = g_new0 (ValuePool, 1);
+		MoonThread::SetSpecific (pool_key, pool);
+	}
+
+	return pool;
+}
+
+static gpointer
+pool_alloc (gsize size)
+{
+	ValuePool *pool;
+	gpointer block;
+
+	if (size < sizeof (gpointer) || size > VALUE_POOL_MAX_BLOCK_SIZE || !(pool = pool_get ()))
+		return g_malloc (size);
+
+	pool->allocated++;
+
+	if (!(block = pool->free_list [size]))
+		return g_malloc (size);
+
+	pool->free_list [size] = *(gpointer *) block;
+	pool->free_count [size]--;
+	pool->recycled++;
+
+	return block;
+}
+
+static void
+pool_free (gpointer block, gsize size)
+{
+	ValuePool *pool;
+
+	if (block == NULL)
+		return;
+
+	if (size < sizeof (gpointer) || size > VALUE_POOL_MAX_BLOCK_SIZE || !(pool = pool_get ()) || pool->free_count [size] >= VALUE_POOL_MAX_FREE) {
+		g_free (block);
+		return;
+	}
+
+	*(gpointer *) block = pool->free_list [size];
+	pool->free_list [size] = block;
+	pool->free_count [size]++;
+}
+
+void *
+Value::operator new (size_t size)
+{
+	return pool_alloc (size);
+}
+
+void
+Value::operator delete (void *ptr, size_t size)
+{
+	pool_free (ptr, size);
+}
+
+void
+Value::GetAllocationStatistics (guint64 *allocated, guint64 *recycled)
+{
+	ValuePool *pool = pool_get ();
+
+	pool_statistics_mutex.Lock ();
+	*allocated = pool_allocated + (pool ? pool->allocated : 0);
+	*recycled = pool_recycled + (pool ? pool->recycled : 0);
+	pool_statistics_mutex.Unlock ();
+}
+
 /**
  * Value implementation
  */
@@ -198,7 +325,7 @@ Value::Value (Color c)
 {
 	Init ();
 	SetKind (Type::COLOR);
-	u.color = g_new (Color, 1);
+	u.color = (Color *) pool_alloc (sizeof (Color));
 	*u.color = Color (c);
 	SetIsNull (false);
 }
@@ -250,7 +377,7 @@ Value::Value (FontWeight weight)
 {
 	Init ();
 	SetKind (Type::FONTWEIGHT);
-	u.fontweight = g_new (FontWeight, 1);
+	u.fontweight = (FontWeight *) pool_alloc (sizeof (FontWeight));
 	u.fontweight->weight = weight.weight;
 	SetIsNull (false);
 }
@@ -259,7 +386,7 @@ Value::Value (FontStretch stretch)
 {
 	Init ();
 	SetKind (Type::FONTSTRETCH);
-	u.fontstretch = g_new (FontStretch, 1);
+	u.fontstretch = (FontStretch *) pool_alloc (sizeof (FontStretch));
 	u.fontstretch->stretch = stretch.stretch;
 	SetIsNull (false);
 }
@@ -268,7 +395,7 @@ Value::Value (FontStyle style)
 {
 	Init ();
 	SetKind (Type::FONTSTYLE);
-	u.fontstyle = g_new (FontStyle, 1);
+	u.fontstyle = (FontStyle *) pool_alloc (sizeof (FontStyle));
 	u.fontstyle->style = style.style;
 	SetIsNull (false);
 }
@@ -324,7 +451,7 @@ Value::Value (Point pt)
 {
 	Init ();
 	SetKind (Type::POINT);
-	u.point = g_new (Point, 1);
+	u.point = (Point *) pool_alloc (sizeof (Point));
 	*u.point = Point (pt);
 	SetIsNull (false);
 }
@@ -341,7 +468,7 @@ Value::Value (Rect rect)
 {
 	Init ();
 	SetKind (Type::RECT);
-	u.rect = g_new (Rect, 1);
+	u.rect = (Rect *) pool_alloc (sizeof (Rect));
 	*u.rect = Rect (rect);
 	SetIsNull (false);
 }
@@ -350,7 +477,7 @@ Value::Value (Size size)
 {
 	Init ();
 	SetKind (Type::SIZE);
-	u.size = g_new (Size, 1);
+	u.size = (Size *) pool_alloc (sizeof (Size));
 	*u.size = Size (size);
 	SetIsNull (false);
 }
@@ -359,7 +486,7 @@ Value::Value (RepeatBehavior repeat)
 {
 	Init();
 	SetKind (Type::REPEATBEHAVIOR);
-	u.repeat = g_new (RepeatBehavior, 1);
+	u.repeat = (RepeatBehavior *) pool_alloc (sizeof (RepeatBehavior));
 	*u.repeat = RepeatBehavior (repeat);
 	SetIsNull (false);
 }
@@ -368,7 +495,7 @@ Value::Value (Duration duration)
 {
 	Init();
 	SetKind (Type::DURATION);
-	u.duration = g_new (Duration, 1);
+	u.duration = (Duration *) pool_alloc (sizeof (Duration));
 	*u.duration = Duration (duration);
 	SetIsNull (false);
 }
@@ -377,7 +504,7 @@ Value::Value (KeyTime keytime)
 {
 	Init ();
 	SetKind (Type::KEYTIME);
-	u.keytime = g_new (KeyTime, 1);
+	u.keytime = (KeyTime *) pool_alloc (sizeof (KeyTime));
 	*u.keytime = KeyTime (keytime);
 	SetIsNull (false);
 }
@@ -395,7 +522,7 @@ Value::Value (GridLength grid_length)
 {
 	Init ();
 	SetKind (Type::GRIDLENGTH);
-	u.grid_length = g_new (GridLength, 1);
+	u.grid_length = (GridLength *) pool_alloc (sizeof (GridLength));
 	*u.grid_length = GridLength (grid_length);
 	SetIsNull (false);
 }
@@ -404,7 +531,7 @@ Value::Value (Thickness thickness)
 {
 	Init ();
 	SetKind (Type::THICKNESS);
-	u.thickness = g_new (Thickness, 1);
+	u.thickness = (Thickness *) pool_alloc (sizeof (Thickness));
 	*u.thickness = Thickness (thickness);
 	SetIsNull (false);
 }
@@ -413,7 +540,7 @@ Value::Value (CornerRadius corner)
 {
 	Init ();
 	SetKind (Type::CORNERRADIUS);
-	u.corner = g_new (CornerRadius, 1);
+	u.corner = (CornerRadius *) pool_alloc (sizeof (CornerRadius));
 	*u.corner = CornerRadius (corner);
 	SetIsNull (false);
 }
@@ -422,7 +549,7 @@ Value::Value (AudioFormat format)
 {
 	Init ();
 	SetKind (Type::AUDIOFORMAT);
-	u.audioformat = g_new (AudioFormat, 1);
+	u.audioformat = (AudioFormat *) pool_alloc (sizeof (AudioFormat));
 	*u.audioformat = AudioFormat (format);
 	SetIsNull (false);
 }
@@ -431,7 +558,7 @@ Value::Value (VideoFormat format)
 {
 	Init ();
 	SetKind (Type::VIDEOFORMAT);
-	u.videoformat = g_new (VideoFormat, 1);
+	u.videoformat = (VideoFormat *) pool_alloc (sizeof (VideoFormat));
 	*u.videoformat = VideoFormat (format);
 	SetIsNull (false);
 }
@@ -440,7 +567,7 @@ Value::Value (AudioFormat *format)
 {
 	Init ();
 	SetKind (Type::AUDIOFORMAT);
-	u.audioformat = g_new (AudioFormat, 1);
+	u.audioformat = (AudioFormat *) pool_alloc (sizeof (AudioFormat));
 	*u.audioformat = AudioFormat (*format);
 	SetIsNull (false);
 }
@@ -449,7 +576,7 @@ Value::Value (VideoFormat *format)
 {
 	Init ();
 	SetKind (Type::VIDEOFORMAT);
-	u.videoformat = g_new (VideoFormat, 1);
+	u.videoformat = (VideoFormat *) pool_alloc (sizeof (VideoFormat));
 	*u.videoformat = VideoFormat (*format);
 	SetIsNull (false);
 }
@@ -615,19 +742,19 @@ Value::Copy (const Value& v)
 		break;
 	case Type::FONTWEIGHT:
 		if (v.u.fontweight) {
-			u.fontweight = g_new (FontWeight, 1);
+			u.fontweight = (FontWeight *) pool_alloc (sizeof (FontWeight));
 			*u.fontweight = *v.u.fontweight;
 		}
 		break;
 	case Type::FONTSTRETCH:
 		if (v.u.fontstretch) {
-			u.fontstretch = g_new (FontStretch, 1);
+			u.fontstretch = (FontStretch *) pool_alloc (sizeof (FontStretch));
 			*u.fontstretch = *v.u.fontstretch;
 		}
 		break;
 	case Type::FONTSTYLE:
 		if (v.u.fontstyle) {
-			u.fontstyle = g_new (FontStyle, 1);
+			u.fontstyle = (FontStyle *) pool_alloc (sizeof (FontStyle));
 			*u.fontstyle = *v.u.fontstyle;
 		}
 		break;
@@ -641,25 +768,25 @@ Value::Copy (const Value& v)
 		break;
 	case Type::COLOR:
 		if (v.u.color) {
-			u.color = g_new (Color, 1);
+			u.color = (Color *) pool_alloc (sizeof (Color));
 			*u.color = *v.u.color;
 		}
 		break;
 	case Type::POINT:
 		if (v.u.point) {
-			u.point = g_new (Point, 1);
+			u.point = (Point *) pool_alloc (sizeof (Point));
 			*u.point = *v.u.point;
 		}
 		break;
 	case Type::RECT:
 		if (v.u.rect) {
-			u.rect = g_new (Rect, 1);
+			u.rect = (Rect *) pool_alloc (sizeof (Rect));
 			*u.rect = *v.u.rect;
 		}
 		break;
 	case Type::SIZE:
 		if (v.u.size) {
-			u.size = g_new (Size, 1);
+			u.size = (Size *) pool_alloc (sizeof (Size));
 			*u.size = *v.u.size;
 		}
 		break;
@@ -672,49 +799,49 @@ Value::Copy (const Value& v)
 		break;
 	case Type::REPEATBEHAVIOR:
 		if (v.u.repeat) {
-			u.repeat = g_new (RepeatBehavior, 1);
+			u.repeat = (RepeatBehavior *) pool_alloc (sizeof (RepeatBehavior));
 			*u.repeat = *v.u.repeat;
 		}
 		break;
 	case Type::DURATION:
 		if (v.u.duration) {
-			u.duration = g_new (Duration, 1);
+			u.duration = (Duration *) pool_alloc (sizeof (Duration));
 			*u.duration = *v.u.duration;
 		}
 		break;
 	case Type::KEYTIME:
 		if (v.u.keytime) {
-			u.keytime = g_new (KeyTime, 1);
+			u.keytime = (KeyTime *) pool_alloc (sizeof (KeyTime));
 			*u.keytime = *v.u.keytime;
 		}
 		break;
 	case Type::GRIDLENGTH:
 		if (v.u.grid_length) {
-			u.grid_length = g_new (GridLength, 1);
+			u.grid_length = (GridLength *) pool_alloc (sizeof (GridLength));
 			*u.grid_length = *v.u.grid_length;
 		}
 		break;
 	case Type::THICKNESS:
 		if (v.u.thickness) {
-			u.thickness = g_new (Thickness, 1);
+			u.thickness = (Thickness *) pool_alloc (sizeof (Thickness));
 			*u.thickness = *v.u.thickness;
 		}
 		break;
 	case Type::CORNERRADIUS:
 		if (v.u.corner) {
-			u.corner = g_new (CornerRadius, 1);
+			u.corner = (CornerRadius *) pool_alloc (sizeof (CornerRadius));
 			*u.corner = *v.u.corner;
 		}
 		break;
 	case Type::AUDIOFORMAT:
 		if (v.u.audioformat) {
-			u.audioformat = g_new (AudioFormat, 1);
+			u.audioformat = (AudioFormat *) pool_alloc (sizeof (AudioFormat));
 			*u.audioformat = *v.u.audioformat;
 		}
 		break;
 	case Type::VIDEOFORMAT:
 		if (v.u.videoformat) {
-			u.videoformat = g_new (VideoFormat, 1);
+			u.videoformat = (VideoFormat *) pool_alloc (sizeof (VideoFormat));
 			*u.videoformat = *v.u.videoformat;
 		}
 		break;
@@ -756,7 +883,7 @@ Value::FreeValueInternal ()
 		g_free (u.s);
 		break;
 	case Type::COLOR:
-		g_free (u.color);
+		pool_free (u.color, sizeof (Color));
 		break;
 	case Type::FONTFAMILY:
 		if (u.fontfamily) {
@@ -765,13 +892,13 @@ Value::FreeValueInternal ()
 		}
 		break;
 	case Type::FONTWEIGHT:
-		g_free (u.fontweight);
+		pool_free (u.fontweight, sizeof (FontWeight));
 		break;
 	case Type::FONTSTYLE:
-		g_free (u.fontstyle);
+		pool_free (u.fontstyle, sizeof (FontStyle));
 		break;
 	case Type::FONTSTRETCH:
-		g_free (u.fontstretch);
+		pool_free (u.fontstretch, sizeof (FontStretch));
 		break;
 	case Type::FONTSOURCE:
 		if (u.fontsource) {
@@ -797,40 +924,40 @@ Value::FreeValueInternal ()
 		}
 		break;
 	case Type::POINT:
-		g_free (u.point);
+		pool_free (u.point, sizeof (Point));
 		break;
 	case Type::RECT:
-		g_free (u.rect);
+		pool_free (u.rect, sizeof (Rect));
 		break;
 	case Type::SIZE:
-		g_free (u.size);
+		pool_free (u.size, sizeof (Size));
 		break;
 	case Type::URI:
 		delete u.uri;
 		break;
 	case Type::REPEATBEHAVIOR:
-		g_free (u.repeat);
+		pool_free (u.repeat, sizeof (RepeatBehavior));
 		break;
 	case Type::DURATION:
-		g_free (u.duration);
+		pool_free (u.duration, sizeof (Duration));
 		break;
 	case Type::KEYTIME:
-		g_free (u.keytime);
+		pool_free (u.keytime, sizeof (KeyTime));
 		break;
 	case Type::GRIDLENGTH:
-		g_free (u.grid_length);
+		pool_free (u.grid_length, sizeof (GridLength));
 		break;
 	case Type::THICKNESS:
-		g_free (u.thickness);
+		pool_free (u.thickness, sizeof (Thickness));
 		break;
 	case Type::CORNERRADIUS:
-		g_free (u.corner);
+		pool_free (u.corner, sizeof (CornerRadius));
 		break;
 	case Type::AUDIOFORMAT:
-		g_free (u.audioformat);
+		pool_free (u.audioformat, sizeof (AudioFormat));
 		break;
 	case Type::VIDEOFORMAT:
-		g_free (u.videoformat);
+		pool_free (u.videoformat, sizeof (VideoFormat));
 		break;
 	case Type::GLYPHTYPEFACE:
 		delete u.typeface;
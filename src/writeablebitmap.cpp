@@ -29,41 +29,10 @@ extern "C" {
 #undef CLAMP
 #endif
 #include "util/u_inlines.h"
-#include "util/u_debug.h"
 #define template templat
 #include "state_tracker/sw_winsys.h"
 #include "sw/null/null_sw_winsys.h"
-#include "softpipe/sp_public.h"
-#ifdef USE_LLVM
-#include "llvmpipe/lp_public.h"
-#endif
 };
-
-static struct pipe_screen *
-swrast_screen_create (struct sw_winsys *ws)
-{
-	const char         *default_driver;
-	const char         *driver;
-	struct pipe_screen *screen = NULL;
-
-#ifdef USE_LLVM
-	default_driver = "llvmpipe";
-#else
-	default_driver = "softpipe";
-#endif
-
-	driver = debug_get_option ("GALLIUM_DRIVER", default_driver);
-
-#ifdef USE_LLVM
-	if (screen == NULL && strcmp (driver, "llvmpipe") == 0)
-		screen = llvmpipe_create_screen (ws);
-#endif
-
-	if (screen == NULL)
-		screen = softpipe_create_screen (ws);
-
-	return screen;
-}
 #endif
 
 namespace Moonlight {
@@ -130,7 +99,7 @@ WriteableBitmap::Render (UIElement *element, Transform *transform)
 	struct pipe_resource pt, *texture;
 	GalliumSurface       *target;
 	struct pipe_screen   *screen =
-		swrast_screen_create (null_sw_create ());
+		GalliumContext::CreateSoftwareScreen (null_sw_create ());
 
 	memset (&pt, 0, sizeof (pt));
 	pt.target = PIPE_TEXTURE_2D;
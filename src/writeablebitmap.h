@@ -42,6 +42,10 @@ public:
 	virtual void Lock ();
 	/* @GeneratePInvoke */
 	virtual void Unlock ();
+
+	// Animated bitmaps are invalidated every frame, and scanning all
+	// their pixels for alpha each time costs more than culling saves.
+	virtual bool IsOpaque () { return false; }
 };
 
 };
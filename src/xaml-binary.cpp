@@ -0,0 +1,572 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * xaml-binary.cpp: tokenized (binary) xaml
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include <expat.h>
+
+#include "xaml-binary.h"
+#include "debug.h"
+
+namespace Moonlight {
+
+enum {
+	HeaderMagic,
+	HeaderVersion,
+	HeaderSourceOffset,
+	HeaderSourceLength,
+	HeaderStringTableOffset,
+	HeaderStringCount,
+	HeaderPoolOffset,
+	HeaderPoolSize,
+	HeaderEventsOffset,
+	HeaderEventsSize,
+	HeaderMaxAttributes,
+	HeaderFieldCount
+};
+
+#define HEADER_SIZE (HeaderFieldCount * 4)
+
+static guint32
+read_uint32 (const guint8 *data)
+{
+	guint32 value;
+
+	memcpy (&value, data, 4);
+	return GUINT32_FROM_LE (value);
+}
+
+static guint32
+read_header (const void *data, int field)
+{
+	return read_uint32 ((const guint8 *) data + field * 4);
+}
+
+/*
+ * XamlBinaryDocument
+ */
+
+XamlBinaryDocument::XamlBinaryDocument ()
+{
+	data = NULL;
+	source = NULL;
+	source_length = 0;
+	byte_index = 0;
+	strings = NULL;
+	string_count = 0;
+	pool = NULL;
+	pool_size = 0;
+	events = NULL;
+	events_size = 0;
+	position = 0;
+	attrs = NULL;
+	max_attributes = 0;
+	corrupt = false;
+}
+
+XamlBinaryDocument::~XamlBinaryDocument ()
+{
+	g_free (attrs);
+}
+
+bool
+XamlBinaryDocument::IsBinary (const void *data, gsize size)
+{
+	return data != NULL && size >= 4 && !memcmp (data, XAML_BINARY_MAGIC, 4);
+}
+
+const char *
+XamlBinaryDocument::GetSource (const void *data, gsize size)
+{
+	guint32 offset, length;
+
+	if (!IsBinary (data, size) || size < HEADER_SIZE)
+		return NULL;
+
+	offset = read_header (data, HeaderSourceOffset);
+	length = read_header (data, HeaderSourceLength);
+
+	// the source must be within the data and nul terminated
+	if (offset < HEADER_SIZE || offset > size || length >= size - offset)
+		return NULL;
+
+	if (((const char *) data) [offset + length] != 0)
+		return NULL;
+
+	return (const char *) data + offset;
+}
+
+static bool
+range_is_valid (gsize size, guint32 offset, guint32 length)
+{
+	return offset >= HEADER_SIZE && offset <= size && length <= size - offset;
+}
+
+XamlBinaryDocument *
+XamlBinaryDocument::Open (const void *data, gsize size)
+{
+	XamlBinaryDocument *doc;
+	const char *source;
+	guint32 string_table, string_count, pool_offset, pool_size, events_offset, events_size, max_attributes;
+
+	if (!(source = GetSource (data, size)))
+		return NULL;
+
+	if (read_header (data, HeaderVersion) != XAML_BINARY_VERSION) {
+		LOG_XAML ("XamlBinaryDocument::Open (): unsupported version %u\n", read_header (data, HeaderVersion));
+		return NULL;
+	}
+
+	string_table = read_header (data, HeaderStringTableOffset);
+	string_count = read_header (data, HeaderStringCount);
+	pool_offset = read_header (data, HeaderPoolOffset);
+	pool_size = read_header (data, HeaderPoolSize);
+	events_offset = read_header (data, HeaderEventsOffset);
+	events_size = read_header (data, HeaderEventsSize);
+	max_attributes = read_header (data, HeaderMaxAttributes);
+
+	if (string_count > G_MAXUINT32 / 4 || !range_is_valid (size, string_table, string_count * 4) ||
+	    !range_is_valid (size, pool_offset, pool_size) || !range_is_valid (size, events_offset, events_size) ||
+	    max_attributes > events_size / 8) {
+		LOG_XAML ("XamlBinaryDocument::Open (): corrupt header\n");
+		return NULL;
+	}
+
+	// every string ends within the pool as long as the pool ends with a nul
+	if (pool_size == 0 || ((const char *) data) [pool_offset + pool_size - 1] != 0) {
+		LOG_XAML ("XamlBinaryDocument::Open (): corrupt string pool\n");
+		return NULL;
+	}
+
+	doc = new XamlBinaryDocument ();
+	doc->data = (const guint8 *) data;
+	doc->source = source;
+	doc->source_length = read_header (data, HeaderSourceLength);
+	doc->strings = doc->data + string_table;
+	doc->string_count = string_count;
+	doc->pool = (const char *) data + pool_offset;
+	doc->pool_size = pool_size;
+	doc->events = doc->data + events_offset;
+	doc->events_size = events_size;
+	doc->max_attributes = max_attributes;
+	doc->attrs = g_new0 (const char *, max_attributes * 2 + 1);
+
+	return doc;
+}
+
+bool
+XamlBinaryDocument::ReadUInt32 (guint32 *value)
+{
+	if (events_size - position < 4) {
+		corrupt = true;
+		return false;
+	}
+
+	*value = read_uint32 (events + position);
+	position += 4;
+
+	return true;
+}
+
+bool
+XamlBinaryDocument::ReadString (const char **str, int *length)
+{
+	guint32 index, offset;
+
+	if (!ReadUInt32 (&index))
+		return false;
+
+	if (index == XAML_BINARY_NO_STRING) {
+		*str = NULL;
+		if (length)
+			*length = 0;
+		return true;
+	}
+
+	if (index >= string_count || (offset = read_uint32 (strings + index * 4)) >= pool_size) {
+		corrupt = true;
+		return false;
+	}
+
+	*str = pool + offset;
+	if (length)
+		*length = strlen (*str);
+
+	return true;
+}
+
+bool
+XamlBinaryDocument::NextEvent (XamlBinaryEvent *event)
+{
+	guint32 op, count;
+
+	if (corrupt || position == events_size)
+		return false;
+
+	if (!ReadUInt32 (&op) || !ReadUInt32 (&event->byte_index) || !ReadUInt32 (&event->line) || !ReadUInt32 (&event->column))
+		return false;
+
+	// the loader reads the source text at the byte index
+	if (event->byte_index > source_length || event->byte_index < byte_index) {
+		corrupt = true;
+		return false;
+	}
+	byte_index = event->byte_index;
+
+	event->op = (XamlBinaryOp) op;
+	event->name = NULL;
+	event->name_length = 0;
+	event->uri = NULL;
+	event->attrs = NULL;
+
+	switch (op) {
+	case XamlBinaryNamespace:
+		return ReadString (&event->name, &event->name_length) && ReadString (&event->uri, NULL);
+	case XamlBinaryStartElement:
+		if (!ReadString (&event->name, &event->name_length) || !ReadUInt32 (&count))
+			return false;
+
+		if (count > max_attributes) {
+			corrupt = true;
+			return false;
+		}
+
+		for (guint32 i = 0; i < count * 2; i++) {
+			if (!ReadString (&attrs [i], NULL))
+				return false;
+			if (attrs [i] == NULL) {
+				corrupt = true;
+				return false;
+			}
+		}
+		attrs [count * 2] = NULL;
+		event->attrs = attrs;
+		break;
+	case XamlBinaryEndElement:
+	case XamlBinaryText:
+		if (!ReadString (&event->name, &event->name_length))
+			return false;
+		break;
+	default:
+		corrupt = true;
+		return false;
+	}
+
+	if (event->name == NULL) {
+		corrupt = true;
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * XamlBinaryWriter
+ */
+
+class XamlBinaryWriterInfo {
+public:
+	XML_Parser parser;
+
+	GHashTable *string_indices; /* string -> index + 1 */
+	GPtrArray *strings;
+	GByteArray *events;
+	guint32 max_attributes;
+
+	/* character data is reported in pieces, it's written as one event */
+	GString *text;
+	guint32 text_position [3];
+
+	char *error_message;
+	int error_code;
+	int error_line;
+	int error_column;
+
+	XamlBinaryWriterInfo (XML_Parser parser)
+	{
+		this->parser = parser;
+		string_indices = g_hash_table_new (g_str_hash, g_str_equal);
+		strings = g_ptr_array_new ();
+		events = g_byte_array_new ();
+		max_attributes = 0;
+		text = NULL;
+		error_message = NULL;
+		error_code = 0;
+		error_line = 0;
+		error_column = 0;
+	}
+
+	~XamlBinaryWriterInfo ()
+	{
+		g_hash_table_destroy (string_indices);
+		for (guint i = 0; i < strings->len; i++)
+			g_free (strings->pdata [i]);
+		g_ptr_array_free (strings, true);
+		g_byte_array_free (events, true);
+		if (text)
+			g_string_free (text, true);
+		g_free (error_message);
+	}
+
+	void WriteUInt32 (guint32 value)
+	{
+		value = GUINT32_TO_LE (value);
+		g_byte_array_append (events, (const guint8 *) &value, 4);
+	}
+
+	void WriteString (const char *str)
+	{
+		gpointer index;
+
+		if (str == NULL) {
+			WriteUInt32 (XAML_BINARY_NO_STRING);
+			return;
+		}
+
+		if (!(index = g_hash_table_lookup (string_indices, str))) {
+			char *copy = g_strdup (str);
+			g_ptr_array_add (strings, copy);
+			index = GUINT_TO_POINTER (strings->len);
+			g_hash_table_insert (string_indices, copy, index);
+		}
+
+		WriteUInt32 (GPOINTER_TO_UINT (index) - 1);
+	}
+
+	void WriteEventStart (XamlBinaryOp op)
+	{
+		WriteUInt32 (op);
+		WriteUInt32 (XML_GetCurrentByteIndex (parser));
+		WriteUInt32 (XML_GetCurrentLineNumber (parser));
+		WriteUInt32 (XML_GetCurrentColumnNumber (parser));
+	}
+
+	void FlushText ()
+	{
+		if (!text)
+			return;
+
+		WriteUInt32 (XamlBinaryText);
+		for (int i = 0; i < 3; i++)
+			WriteUInt32 (text_position [i]);
+		WriteString (text->str);
+
+		g_string_free (text, true);
+		text = NULL;
+	}
+
+	void Fail (int code, const char *message)
+	{
+		if (error_message)
+			return;
+
+		error_code = code;
+		error_message = g_strdup (message);
+		error_line = XML_GetCurrentLineNumber (parser);
+		error_column = XML_GetCurrentColumnNumber (parser);
+
+		XML_StopParser (parser, FALSE);
+	}
+};
+
+static void
+writer_start_namespace_handler (void *data, const char *prefix, const char *uri)
+{
+	XamlBinaryWriterInfo *info = (XamlBinaryWriterInfo *) data;
+
+	info->FlushText ();
+	info->WriteEventStart (XamlBinaryNamespace);
+	info->WriteString (prefix);
+	info->WriteString (uri);
+}
+
+static void
+writer_start_element_handler (void *data, const char *el, const char **attr)
+{
+	XamlBinaryWriterInfo *info = (XamlBinaryWriterInfo *) data;
+	guint32 count = 0;
+
+	while (attr [count * 2])
+		count++;
+
+	info->max_attributes = MAX (info->max_attributes, count);
+
+	info->FlushText ();
+	info->WriteEventStart (XamlBinaryStartElement);
+	info->WriteString (el);
+	info->WriteUInt32 (count);
+	for (guint32 i = 0; i < count * 2; i++)
+		info->WriteString (attr [i]);
+}
+
+static void
+writer_end_element_handler (void *data, const char *el)
+{
+	XamlBinaryWriterInfo *info = (XamlBinaryWriterInfo *) data;
+
+	info->FlushText ();
+	info->WriteEventStart (XamlBinaryEndElement);
+	info->WriteString (el);
+}
+
+static void
+writer_char_data_handler (void *data, const char *in, int inlen)
+{
+	XamlBinaryWriterInfo *info = (XamlBinaryWriterInfo *) data;
+
+	if (!info->text) {
+		info->text = g_string_sized_new (inlen);
+		info->text_position [0] = XML_GetCurrentByteIndex (info->parser);
+		info->text_position [1] = XML_GetCurrentLineNumber (info->parser);
+		info->text_position [2] = XML_GetCurrentColumnNumber (info->parser);
+	}
+
+	g_string_append_len (info->text, in, inlen);
+}
+
+static void
+writer_start_doctype_handler (void *data, const char *doctype_name, const char *sysid, const char *pubid, int has_internal_subset)
+{
+	XamlBinaryWriterInfo *info = (XamlBinaryWriterInfo *) data;
+
+	// same errors as the parser, we don't want to hide them until the document is loaded
+	if (sysid)
+		info->Fail (7050, "DTD was found but is prohibited");
+	else if (doctype_name)
+		info->Fail (7016, "incorrect document syntax.");
+}
+
+static void
+append_uint32 (GByteArray *array, guint32 value)
+{
+	value = GUINT32_TO_LE (value);
+	g_byte_array_append (array, (const guint8 *) &value, 4);
+}
+
+static void
+align_uint32 (GByteArray *array)
+{
+	static const guint8 padding [4] = { 0, 0, 0, 0 };
+
+	if (array->len & 3)
+		g_byte_array_append (array, padding, 4 - (array->len & 3));
+}
+
+static void
+set_header (GByteArray *array, int field, guint32 value)
+{
+	value = GUINT32_TO_LE (value);
+	memcpy (array->data + field * 4, &value, 4);
+}
+
+void
+XamlBinaryWriter::SkipByteOrderMark (const char **text, gsize *length)
+{
+	if (*length >= 3 && !memcmp (*text, "\xef\xbb\xbf", 3)) {
+		*text += 3;
+		*length -= 3;
+	}
+}
+
+GByteArray *
+XamlBinaryWriter::Compile (const char *xaml, gsize length, MoonError *error)
+{
+	XamlBinaryWriterInfo *info;
+	GByteArray *result;
+	XML_Parser parser;
+	guint32 pool_size;
+
+	SkipByteOrderMark (&xaml, &length);
+
+	// the loaders skip leading white space, byte indices are relative to the first non-space
+	while (length > 0 && g_ascii_isspace (*xaml)) {
+		xaml++;
+		length--;
+	}
+
+	if (!(parser = XML_ParserCreateNS ("UTF-8", '|'))) {
+		MoonError::FillIn (error, MoonError::EXCEPTION, "Could not create the xml parser");
+		return NULL;
+	}
+
+	info = new XamlBinaryWriterInfo (parser);
+
+	XML_SetUserData (parser, info);
+	XML_SetElementHandler (parser, writer_start_element_handler, writer_end_element_handler);
+	XML_SetCharacterDataHandler (parser, writer_char_data_handler);
+	XML_SetNamespaceDeclHandler (parser, writer_start_namespace_handler, NULL);
+	XML_SetDoctypeDeclHandler (parser, writer_start_doctype_handler, NULL);
+
+	if (!XML_Parse (parser, xaml, length, true) && !info->error_message)
+		info->Fail (XML_GetErrorCode (parser), XML_ErrorString (XML_GetErrorCode (parser)));
+
+	if (info->error_message) {
+		MoonError::FillIn (error, MoonError::XAML_PARSE_EXCEPTION, info->error_code, info->error_message);
+		if (error) {
+			error->line_number = info->error_line;
+			error->char_position = info->error_column;
+		}
+
+		XML_ParserFree (parser);
+		delete info;
+		return NULL;
+	}
+
+	info->FlushText ();
+	XML_ParserFree (parser);
+
+	result = g_byte_array_new ();
+	g_byte_array_set_size (result, HEADER_SIZE);
+	memcpy (result->data, XAML_BINARY_MAGIC, 4);
+	set_header (result, HeaderVersion, XAML_BINARY_VERSION);
+	set_header (result, HeaderMaxAttributes, info->max_attributes);
+
+	// string table
+	set_header (result, HeaderStringTableOffset, result->len);
+	set_header (result, HeaderStringCount, info->strings->len);
+	pool_size = 0;
+	for (guint i = 0; i < info->strings->len; i++) {
+		append_uint32 (result, pool_size);
+		pool_size += strlen ((const char *) info->strings->pdata [i]) + 1;
+	}
+
+	// string pool, never empty so that it always ends with a nul
+	set_header (result, HeaderPoolOffset, result->len);
+	set_header (result, HeaderPoolSize, MAX (pool_size, 1));
+	for (guint i = 0; i < info->strings->len; i++) {
+		const char *str = (const char *) info->strings->pdata [i];
+		g_byte_array_append (result, (const guint8 *) str, strlen (str) + 1);
+	}
+	if (pool_size == 0)
+		g_byte_array_append (result, (const guint8 *) "", 1);
+	align_uint32 (result);
+
+	// source
+	set_header (result, HeaderSourceOffset, result->len);
+	set_header (result, HeaderSourceLength, length);
+	g_byte_array_append (result, (const guint8 *) xaml, length);
+	g_byte_array_append (result, (const guint8 *) "", 1);
+	align_uint32 (result);
+
+	// events
+	set_header (result, HeaderEventsOffset, result->len);
+	set_header (result, HeaderEventsSize, info->events->len);
+	g_byte_array_append (result, info->events->data, info->events->len);
+
+	delete info;
+
+	return result;
+}
+
+};
@@ -0,0 +1,141 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * xaml-binary.h: tokenized (binary) xaml
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#ifndef __MOON_XAML_BINARY_H__
+#define __MOON_XAML_BINARY_H__
+
+#include <glib.h>
+
+#include "error.h"
+
+namespace Moonlight {
+
+/*
+ * Binary xaml is the stream of xml events expat reports for a xaml
+ * document, recorded once (by mxamlc at build time) so that loading it
+ * doesn't have to tokenize xml, decode entities or expand namespace
+ * prefixes again. Element and attribute names are stored namespace
+ * qualified ("uri|Name", like XML_ParserCreateNS reports them) in a
+ * string table shared by the whole document, every distinct string is
+ * stored once and used in place by the loader.
+ *
+ * Only the xml is tokenized, nothing is resolved: the loader looks up
+ * every type and property by name and converts every attribute value
+ * from its text, as it does for text xaml, and resource dictionary
+ * entries are deferred the same way (see defer_resource in xaml.cpp).
+ * Type and property tokens would be indices into the generated type
+ * tables, which only hold within one build, so such documents would need
+ * a version tied to the build and a fall back for everything else.
+ *
+ * The original text (minus leading white space) is stored as well:
+ * templates are kept as xaml text until they are expanded, and a
+ * runtime which doesn't understand the version of a binary document
+ * falls back to parsing the text.
+ *
+ * Layout, all integers are 32 bit little endian:
+ *
+ *   header      magic, version, source offset/length, string table
+ *               offset/count, string pool offset/size, events
+ *               offset/size, max attribute count
+ *   strings     offset of each string in the pool
+ *   pool        nul terminated strings
+ *   source      nul terminated xaml text
+ *   events      op, byte index (into the source, never decreasing),
+ *               line, column, payload:
+ *                 namespace:  prefix (or XAML_BINARY_NO_STRING), uri
+ *                 start:      name, attribute count, (name, value)*
+ *                 end:        name
+ *                 text:       text
+ *
+ * The magic, version and source fields keep their place in every
+ * version of the format.
+ */
+
+#define XAML_BINARY_MAGIC "MXBF"
+#define XAML_BINARY_VERSION 1
+#define XAML_BINARY_NO_STRING 0xffffffff
+
+enum XamlBinaryOp {
+	XamlBinaryNamespace = 1,
+	XamlBinaryStartElement,
+	XamlBinaryEndElement,
+	XamlBinaryText,
+};
+
+struct XamlBinaryEvent {
+	XamlBinaryOp op;
+
+	/* where the event was in the source text */
+	guint32 byte_index;
+	guint32 line;
+	guint32 column;
+
+	/* the element name, the namespace prefix, or the text */
+	const char *name;
+	int name_length;
+	/* the namespace uri */
+	const char *uri;
+	/* name/value pairs, NULL terminated. Only valid until the next event */
+	const char **attrs;
+};
+
+class XamlBinaryDocument {
+public:
+	/* @data must stay alive (and unchanged) as long as the document */
+	static XamlBinaryDocument *Open (const void *data, gsize size);
+	~XamlBinaryDocument ();
+
+	/* true if @data starts with the binary xaml magic */
+	static bool IsBinary (const void *data, gsize size);
+	/* the source text stored in a binary document of any version, NULL if there is none */
+	static const char *GetSource (const void *data, gsize size);
+
+	const char *GetSource () { return source; }
+
+	/* false at the end of the document, or if the document is corrupt (IsCorrupt) */
+	bool NextEvent (XamlBinaryEvent *event);
+	bool IsCorrupt () { return corrupt; }
+
+private:
+	XamlBinaryDocument ();
+
+	bool ReadUInt32 (guint32 *value);
+	bool ReadString (const char **str, int *length);
+
+	const guint8 *data;
+	const char *source;
+	guint32 source_length;
+	guint32 byte_index; /* of the last event, they never go back */
+	const guint8 *strings; /* string_count offsets */
+	guint32 string_count;
+	const char *pool;
+	guint32 pool_size;
+	const guint8 *events;
+	guint32 events_size;
+	guint32 position; /* in events */
+	const char **attrs; /* max_attributes * 2 + 1 */
+	guint32 max_attributes;
+	bool corrupt;
+};
+
+class MOON_API XamlBinaryWriter {
+public:
+	/* Compiles the xaml text @xaml into a binary document, returns NULL
+	 * and fills in @error if the text isn't well formed xml */
+	static GByteArray *Compile (const char *xaml, gsize length, MoonError *error);
+
+	/* Moves @text past a UTF-8 byte order mark, if it starts with one */
+	static void SkipByteOrderMark (const char **text, gsize *length);
+};
+
+};
+#endif /* __MOON_XAML_BINARY_H__ */
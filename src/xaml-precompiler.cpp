@@ -0,0 +1,226 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * xaml-precompiler.cpp: compiles xaml documents to binary xaml on worker threads
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <unistd.h>
+
+#include "xaml-precompiler.h"
+#include "xaml-binary.h"
+#include "timesource.h"
+#include "debug.h"
+
+namespace Moonlight {
+
+#define XAML_PRECOMPILER_MAX_THREADS 3
+
+XamlPrecompiler::XamlPrecompiler ()
+{
+	thread_count = -1;
+	threads = NULL;
+	pending = g_queue_new ();
+	jobs = NULL;
+	shutting_down = false;
+
+	queued_count = 0;
+	used_count = 0;
+	skipped_count = 0;
+	compile_time = 0;
+	wait_time = 0;
+}
+
+XamlPrecompiler::~XamlPrecompiler ()
+{
+	mutex.Lock ();
+	shutting_down = true;
+	work_cond.Broadcast ();
+	mutex.Unlock ();
+
+	for (int i = 0; i < thread_count; i++)
+		threads [i]->Join ();
+
+	g_free (threads);
+
+	PrintStatistics ();
+
+	g_list_foreach (jobs, (GFunc) FreeJob, NULL);
+	g_list_free (jobs);
+	g_queue_free (pending);
+}
+
+void
+XamlPrecompiler::FreeJob (Job *job)
+{
+	if (job->binary)
+		g_byte_array_free (job->binary, true);
+	g_free (job->xaml);
+	g_free (job->name);
+	g_free (job);
+}
+
+void
+XamlPrecompiler::StartThreads ()
+{
+	long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+	// the main thread has enough to do, so use a worker even on a single cpu
+	int count = CLAMP (cpus - 1, 1, XAML_PRECOMPILER_MAX_THREADS);
+	int result;
+
+	threads = g_new0 (MoonThread *, count);
+	thread_count = 0;
+
+	for (int i = 0; i < count; i++) {
+		if ((result = MoonThread::StartJoinable (&threads [i], WorkerLoop, this)) != 0) {
+			g_warning ("Moonlight: could not create xaml compiler thread: %s (%i)\n", strerror (result), result);
+			break;
+		}
+
+		thread_count++;
+	}
+
+	LOG_XAML ("XamlPrecompiler::StartThreads (): compiling with %i worker thread(s)\n", thread_count);
+}
+
+gpointer
+XamlPrecompiler::WorkerLoop (gpointer data)
+{
+	XamlPrecompiler *precompiler = (XamlPrecompiler *) data;
+	GByteArray *binary;
+	TimeSpan start;
+	Job *job;
+
+	precompiler->mutex.Lock ();
+	while (true) {
+		while (!precompiler->shutting_down && g_queue_is_empty (precompiler->pending))
+			precompiler->work_cond.Wait (precompiler->mutex);
+
+		if (precompiler->shutting_down)
+			break;
+
+		job = (Job *) g_queue_pop_head (precompiler->pending);
+		job->state = JobCompiling;
+
+		// the main thread doesn't touch a job which is being compiled
+		// except to wait for it
+		precompiler->mutex.Unlock ();
+		start = get_now ();
+		binary = XamlBinaryWriter::Compile ((const char *) job->xaml, job->length, NULL);
+		precompiler->mutex.Lock ();
+
+		job->compile_time = get_now () - start;
+		job->binary = binary;
+		job->state = JobDone;
+		precompiler->done_cond.Broadcast ();
+	}
+	precompiler->mutex.Unlock ();
+
+	return NULL;
+}
+
+void
+XamlPrecompiler::Queue (const char *name, const void *xaml, gsize length)
+{
+	Job *job;
+
+	if (thread_count == -1)
+		StartThreads ();
+
+	if (thread_count == 0 || length == 0)
+		return;
+
+	job = g_new0 (Job, 1);
+	job->name = g_strdup (name);
+	job->xaml = (guint8 *) g_memdup (xaml, length);
+	job->length = length;
+	job->state = JobPending;
+
+	mutex.Lock ();
+	jobs = g_list_prepend (jobs, job);
+	g_queue_push_tail (pending, job);
+	work_cond.Signal ();
+	mutex.Unlock ();
+
+	queued_count++;
+}
+
+GByteArray *
+XamlPrecompiler::Take (const void *xaml, gsize length)
+{
+	GByteArray *binary;
+	TimeSpan start;
+	GList *link;
+	Job *job = NULL;
+
+	mutex.Lock ();
+
+	for (link = jobs; link; link = link->next) {
+		Job *j = (Job *) link->data;
+		if (j->length == length && !memcmp (j->xaml, xaml, length)) {
+			job = j;
+			break;
+		}
+	}
+
+	if (!job) {
+		mutex.Unlock ();
+		return NULL;
+	}
+
+	jobs = g_list_delete_link (jobs, link);
+
+	if (job->state == JobPending) {
+		// parsing it right away is faster than waiting for a worker
+		g_queue_remove (pending, job);
+		mutex.Unlock ();
+
+		LOG_XAML ("XamlPrecompiler::Take (): %s wasn't compiled yet\n", job->name);
+		skipped_count++;
+		FreeJob (job);
+		return NULL;
+	}
+
+	start = get_now ();
+	while (job->state != JobDone)
+		done_cond.Wait (mutex);
+	wait_time += get_now () - start;
+
+	mutex.Unlock ();
+
+	binary = job->binary;
+	job->binary = NULL;
+
+	if (binary) {
+		used_count++;
+		compile_time += job->compile_time;
+	}
+
+	LOG_XAML ("XamlPrecompiler::Take (): %s %s, compiled in %.2f ms\n", job->name,
+		  binary ? "is precompiled" : "could not be compiled", job->compile_time / 10000.0);
+
+	FreeJob (job);
+
+	return binary;
+}
+
+void
+XamlPrecompiler::PrintStatistics ()
+{
+	if (queued_count == 0)
+		return;
+
+	LOG_XAML ("XamlPrecompiler: %u documents queued, %u used, %u parsed before they were compiled, "
+		  "%.2f ms of compiling done by the workers, %.2f ms waited for them\n",
+		  queued_count, used_count, skipped_count, compile_time / 10000.0, wait_time / 10000.0);
+}
+
+};
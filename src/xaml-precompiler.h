@@ -0,0 +1,93 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * xaml-precompiler.h: compiles xaml documents to binary xaml on worker threads
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#ifndef __MOON_XAML_PRECOMPILER_H__
+#define __MOON_XAML_PRECOMPILER_H__
+
+#include <glib.h>
+
+#include "pal.h"
+
+namespace Moonlight {
+
+/*
+ * XamlPrecompiler
+ *   Tokenizes the xaml documents an application is going to load (its
+ *   pages, merged dictionaries, generic.xaml) into binary xaml on a few
+ *   worker threads while the main thread is busy with something else.
+ *   Creating the objects still happens on the main thread: when a
+ *   document is loaded the loader takes the binary xaml (waiting for it
+ *   if it's being compiled) and replays it instead of parsing the text.
+ *
+ *   Documents are matched by their contents. A document the workers
+ *   haven't started on when it's needed is parsed as text as usual.
+ *
+ *   Queue and Take may only be called from the main thread.
+ */
+
+class MOON_API XamlPrecompiler {
+public:
+	XamlPrecompiler ();
+	~XamlPrecompiler ();
+
+	/* Queues a copy of @xaml to be compiled, @name is only used for logging */
+	void Queue (const char *name, const void *xaml, gsize length);
+
+	/* Returns the binary xaml for @xaml if it was queued and compiled
+	 * (waiting for the worker if it's being compiled), NULL otherwise.
+	 * The job is forgotten either way, the caller frees the result */
+	GByteArray *Take (const void *xaml, gsize length);
+
+	/* Prints how many documents were compiled and used, and how long the
+	 * main thread waited for the workers */
+	void PrintStatistics ();
+
+private:
+	enum JobState {
+		JobPending,
+		JobCompiling,
+		JobDone,
+	};
+
+	struct Job {
+		char *name;
+		guint8 *xaml;
+		gsize length;
+		JobState state;
+		GByteArray *binary; /* NULL if the document isn't well formed */
+		gint64 compile_time; /* TimeSpan ticks */
+	};
+
+	MoonMutex mutex;
+	MoonCond work_cond;
+	MoonCond done_cond;
+
+	int thread_count;
+	MoonThread **threads;
+	GQueue *pending; /* Job, in the order they were queued */
+	GList *jobs; /* all the Jobs which haven't been taken */
+	bool shutting_down;
+
+	/* main thread only */
+	guint32 queued_count;
+	guint32 used_count;
+	guint32 skipped_count; /* taken before a worker got to them */
+	gint64 compile_time; /* TimeSpan ticks the workers spent on the documents which were used */
+	gint64 wait_time; /* TimeSpan ticks the main thread waited for a worker */
+
+	void StartThreads ();
+	static void FreeJob (Job *job);
+	static gpointer WorkerLoop (gpointer data);
+};
+
+};
+#endif /* __MOON_XAML_PRECOMPILER_H__ */
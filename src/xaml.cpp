@@ -61,6 +61,8 @@
 #include "bitmapcache.h"
 #include "usercontrol.h"
 #include "factory.h"
+#include "xaml-binary.h"
+#include "xaml-precompiler.h"
 
 namespace Moonlight {
 
@@ -112,6 +114,9 @@ static void dependency_object_add_child (XamlParserInfo *p, XamlElementInstance
 static void dependency_object_set_attributes (XamlParserInfo *p, XamlElementInstance *item, const char **attr);
 static void value_type_set_attributes (XamlParserInfo *p, XamlElementInstance *item, const char **attr);
 static bool element_begins_buffering (Type::Kind kind);
+static bool defer_resource (XamlParserInfo *p, XamlElementInfo *elem, const char *el, const char **attr);
+static void end_deferred_resource (XamlParserInfo *p);
+static XamlContext *create_xaml_context (XamlParserInfo *p, FrameworkTemplate *template_, XamlContext *parent_context);
 static bool is_managed_kind (Type::Kind kind);
 static bool kind_requires_managed_load (Type::Kind kind);
 static bool is_legal_top_level_kind (Type::Kind kind);
@@ -124,6 +129,7 @@ static void destroy_created_namespace (gpointer data, gpointer user_data);
 
 enum BufferMode {
 	BUFFER_MODE_TEMPLATE,
+	BUFFER_MODE_RESOURCE,
 	BUFFER_MODE_IGNORE
 };
 
@@ -353,6 +359,24 @@ parse_template (Value *data, const Uri *resource_base, Surface *surface, Depende
 	delete loader;
 	return result;
 }
+
+static DependencyObject *
+parse_resource (Value *data, const Uri *resource_base, const char *xaml, MoonError *error)
+{
+	XamlContext *xaml_context = data->AsXamlContext ();
+	SL3XamlLoader *loader = new SL3XamlLoader (resource_base, Deployment::GetCurrent ()->GetSurface (), xaml_context);
+	Type::Kind dummy;
+
+	loader->SetImportDefaultXmlns (true);
+
+	DependencyObject *result = loader->CreateDependencyObjectFromString (xaml, true, &dummy);
+
+	if (error && loader->error_args && loader->error_args->GetErrorCode () != -1)
+		MoonError::FillIn (error, loader->error_args);
+
+	delete loader;
+	return result;
+}
 	 
 XamlContext::XamlContext (XamlContextInternal *internal, XamlContext *parent)
 	: EventObject (Type::XAMLCONTEXT)
@@ -663,7 +687,8 @@ unref_xaml_element (gpointer data, gpointer user_data)
 
 class XamlParserInfo {
  public:
-	XML_Parser parser;
+	XML_Parser parser; // NULL when replaying binary xaml
+	const XamlBinaryEvent *binary_event; // the event being replayed
 
 	const char *file_name;
 
@@ -697,6 +722,16 @@ class XamlParserInfo {
 	GString *buffer;
 	bool validate_templates;
 
+	// keyed resources are buffered (BUFFER_MODE_RESOURCE) and
+	// created when they're first looked up
+	bool defer_resources;
+	ResourceDictionary *deferred_dictionary;
+	char *deferred_key;
+	bool deferred_empty_element;
+	// shared by the deferred resources of the same parent element
+	XamlContext *deferred_context;
+	XamlElementInstance *deferred_context_parent;
+
  private:
 	GList *created_elements;
 	GList *created_namespaces;
@@ -709,6 +744,7 @@ class XamlParserInfo {
 	{
 		this->deployment = Deployment::GetCurrent ();
 		this->parser = parser;
+		this->binary_event = NULL;
 		this->file_name = file_name;
 		this->namescope = MoonUnmanagedFactory::CreateNameScope();
 
@@ -732,6 +768,13 @@ class XamlParserInfo {
 		multi_buffer_offset = 0;
 		validate_templates = false;
 
+		defer_resources = false;
+		deferred_dictionary = NULL;
+		deferred_key = NULL;
+		deferred_empty_element = false;
+		deferred_context = NULL;
+		deferred_context_parent = NULL;
+
 		namespace_map = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 	}
 
@@ -793,6 +836,34 @@ class XamlParserInfo {
 		created_namespaces = g_list_prepend (created_namespaces, ns);
 	}
 
+	int GetCurrentByteIndex ()
+	{
+		if (parser)
+			return XML_GetCurrentByteIndex (parser);
+		return binary_event ? binary_event->byte_index : 0;
+	}
+
+	int GetCurrentLineNumber ()
+	{
+		if (parser)
+			return XML_GetCurrentLineNumber (parser);
+		return binary_event ? binary_event->line : 0;
+	}
+
+	int GetCurrentColumnNumber ()
+	{
+		if (parser)
+			return XML_GetCurrentColumnNumber (parser);
+		return binary_event ? binary_event->column : 0;
+	}
+
+	void StopParser ()
+	{
+		// binary xaml is replayed until there's an error
+		if (parser)
+			XML_StopParser (parser, FALSE);
+	}
+
 	void QueueBeginBuffering (char* buffer_until, BufferMode mode)
 	{
 		buffer_until_element = buffer_until;
@@ -804,7 +875,7 @@ class XamlParserInfo {
 
 	void BeginBuffering ()
 	{
-		xml_buffer_start_index = XML_GetCurrentByteIndex (parser) - multi_buffer_offset;
+		xml_buffer_start_index = GetCurrentByteIndex () - multi_buffer_offset;
 		buffer = g_string_new (NULL);
 	}
 
@@ -822,10 +893,45 @@ class XamlParserInfo {
 	{
 		if (!buffer)
 			return;
-		int pos = XML_GetCurrentByteIndex (parser) - multi_buffer_offset;
+		int pos = GetCurrentByteIndex () - multi_buffer_offset;
 		g_string_append_len (buffer, xml_buffer + xml_buffer_start_index, pos - xml_buffer_start_index);
 	}
 	
+	// the source from the current position to the end of the buffer
+	const char *GetCurrentXml ()
+	{
+		return xml_buffer + GetCurrentByteIndex () - multi_buffer_offset;
+	}
+
+	// true if the start tag at the current position is an empty element tag (<Foo/>)
+	bool IsCurrentEmptyElement ()
+	{
+		const char *tag = GetCurrentXml ();
+		char quote = 0;
+
+		for (; *tag; tag++) {
+			if (quote) {
+				if (*tag == quote)
+					quote = 0;
+			} else if (*tag == '"' || *tag == '\'') {
+				quote = *tag;
+			} else if (*tag == '>') {
+				return tag [-1] == '/';
+			}
+		}
+
+		return false;
+	}
+
+	// the end tag at the current position, the buffer stops right before it
+	char *GetCurrentEndTag ()
+	{
+		const char *tag = xml_buffer + GetCurrentByteIndex () - multi_buffer_offset;
+		const char *end = strchr (tag, '>');
+
+		return end ? g_strndup (tag, end + 1 - tag) : g_strdup ("");
+	}
+
 	char* ClearBuffer ()
 	{
 		AppendCurrentXml ();
@@ -870,7 +976,7 @@ class XamlParserInfo {
 		delete loader;
 
 		if (error.number != MoonError::NO_ERROR) {
-			int line_number = error.line_number + XML_GetCurrentLineNumber (parser);
+			int line_number = error.line_number + GetCurrentLineNumber ();
 			error_args = new ParserErrorEventArgs (NULL, error.message, file_name, line_number, error.char_position, error.code, NULL, NULL);
 		}
 	}
@@ -921,6 +1027,11 @@ class XamlParserInfo {
 
 		if (cdata)
 			g_string_free (cdata, TRUE);
+		if (deferred_dictionary)
+			deferred_dictionary->unref ();
+		g_free (deferred_key);
+		if (deferred_context)
+			deferred_context->unref ();
 		if (top_element)
 			delete top_element;
 		namescope->unref ();
@@ -1763,8 +1874,8 @@ parser_error (XamlParserInfo *p, const char *el, const char *attr, int error_cod
 	
 	// if parsing fails too early it's not safe (i.e. sigsegv) to call some functions, e.g. XML_GetCurrentLineNumber
 	bool report_line_col = (error_code != XML_ERROR_XML_DECL);
-	int line_number = report_line_col ? XML_GetCurrentLineNumber (p->parser) : 0;
-	int char_position = report_line_col ? XML_GetCurrentColumnNumber (p->parser) : 0;
+	int line_number = report_line_col ? p->GetCurrentLineNumber () : 0;
+	int char_position = report_line_col ? p->GetCurrentColumnNumber () : 0;
 	
 	va_start (args, format);
 	message = g_strdup_vprintf (format, args);
@@ -1777,7 +1888,7 @@ parser_error (XamlParserInfo *p, const char *el, const char *attr, int error_cod
 	LOG_XAML ("PARSER ERROR, STOPPING PARSING:  (%d) %s  line: %d   char: %d\n", error_code, message,
 		  line_number, char_position);
 	
-	XML_StopParser (p->parser, FALSE);
+	p->StopParser ();
 }
 
 static void
@@ -1837,6 +1948,8 @@ start_element (void *data, const char *el, const char **attr)
 	if (p->error_args)
 		return;
 
+	if (elem && p->defer_resources && defer_resource (p, elem, el, attr))
+		return;
 	
 	if (elem) {
 		if (p->hydrate_expecting){
@@ -1983,6 +2096,273 @@ element_begins_buffering (Type::Kind kind)
 	return Type::IsSubclassOf (Deployment::GetCurrent (), kind, Type::FRAMEWORKTEMPLATE);
 }
 
+static bool
+deferred_resources_enabled ()
+{
+	static int enabled = -1;
+
+	if (enabled == -1)
+		enabled = g_getenv ("MOONLIGHT_NO_DEFERRED_RESOURCES") == NULL;
+
+	return enabled;
+}
+
+static bool
+resource_can_be_deferred (Type::Kind kind)
+{
+	static Type::Kind deferred_kinds [] = {
+		Type::STYLE,
+		Type::FRAMEWORKTEMPLATE,
+		Type::SOLIDCOLORBRUSH,
+		Type::GRADIENTBRUSH,
+		Type::INVALID
+	};
+
+	for (int i = 0; deferred_kinds [i] != Type::INVALID; i++) {
+		if (Type::IsSubclassOf (Deployment::GetCurrent (), kind, deferred_kinds [i]))
+			return true;
+	}
+
+	return false;
+}
+
+// the dictionary @parent adds its children to: a ResourceDictionary element,
+// or the Resources property element of a UIElement or the Application
+static ResourceDictionary *
+get_parent_resource_dictionary (XamlParserInfo *p, XamlElementInstance *parent)
+{
+	DependencyObject *owner;
+	const char *dot;
+
+	if (parent->element_type == XamlElementInstance::ELEMENT) {
+		if (!Type::IsSubclassOf (p->deployment, parent->info->GetKind (), Type::RESOURCE_DICTIONARY) || !parent->IsDependencyObject ())
+			return NULL;
+		return (ResourceDictionary *) parent->GetAsDependencyObject ();
+	}
+
+	if (parent->info->RequiresManagedSet () || !parent->parent || !parent->parent->IsDependencyObject ())
+		return NULL;
+
+	dot = strchr (parent->element_name, '.');
+	if (!dot || strcmp (dot + 1, "Resources"))
+		return NULL;
+
+	if (!(owner = parent->parent->GetAsDependencyObject ()))
+		return NULL;
+
+	if (owner->Is (Type::UIELEMENT))
+		return ((UIElement *) owner)->GetResources ();
+	if (owner->Is (Type::APPLICATION))
+		return ((Application *) owner)->GetResources ();
+
+	return NULL;
+}
+
+// Name, x:Name (with any prefix) or a Name property element
+static bool
+is_name_token (const char *token, int len)
+{
+	if (len < 4 || strncmp (token + len - 4, "Name", 4))
+		return false;
+
+	return len == 4 || token [len - 5] == ':' || token [len - 5] == '.';
+}
+
+// the names inside a template go in the namescope of each of its instances
+static bool
+is_template_token (const char *token, int len)
+{
+	static const char *templates [] = { "ControlTemplate", "DataTemplate", "ItemsPanelTemplate", NULL };
+	const char *colon = (const char *) memchr (token, ':', len);
+
+	if (colon) {
+		len -= colon + 1 - token;
+		token = colon + 1;
+	}
+
+	for (int i = 0; templates [i]; i++) {
+		if ((int) strlen (templates [i]) == len && !strncmp (token, templates [i], len))
+			return true;
+	}
+
+	return false;
+}
+
+static const char *
+skip_past (const char *xml, const char *end)
+{
+	const char *found = strstr (xml, end);
+
+	return found ? found + strlen (end) : NULL;
+}
+
+//
+// true if the element which starts at @xml, or anything inside it outside of
+// a template, has a name which would be registered in the namescope of the
+// document. This is also true if the element doesn't end within @xml.
+//
+static bool
+xml_element_has_names (const char *xml)
+{
+	const char *token;
+	int depth = 0;
+	int template_depth = 0;
+	bool empty;
+	int len;
+
+	while (xml && *xml) {
+		if (*xml != '<') {
+			xml++;
+			continue;
+		}
+
+		if (!strncmp (xml, "<!--", 4)) {
+			xml = skip_past (xml + 4, "-->");
+			continue;
+		} else if (!strncmp (xml, "<![CDATA[", 9)) {
+			xml = skip_past (xml + 9, "]]>");
+			continue;
+		} else if (xml [1] == '?') {
+			xml = skip_past (xml + 2, "?>");
+			continue;
+		} else if (xml [1] == '/') {
+			if (!(xml = skip_past (xml + 2, ">")))
+				break;
+			if (depth == template_depth)
+				template_depth = 0;
+			if (--depth == 0)
+				return false;
+			continue;
+		}
+
+		token = ++xml;
+		while (*xml && !g_ascii_isspace (*xml) && *xml != '/' && *xml != '>')
+			xml++;
+		len = xml - token;
+
+		if (!template_depth && is_name_token (token, len))
+			return true;
+
+		while (*xml && *xml != '>') {
+			const char *attr = xml;
+
+			if (*xml == '"' || *xml == '\'') {
+				// an attribute value
+				if (!(xml = strchr (xml + 1, *xml)))
+					return true;
+				xml++;
+				continue;
+			}
+
+			while (*xml && !g_ascii_isspace (*xml) && *xml != '=' && *xml != '/' && *xml != '>')
+				xml++;
+
+			if (xml == attr)
+				xml++;
+			else if (!template_depth && is_name_token (attr, xml - attr))
+				return true;
+		}
+
+		if (!*xml)
+			break;
+
+		empty = xml [-1] == '/';
+		xml++;
+
+		if (empty) {
+			if (depth == 0)
+				return false;
+		} else {
+			depth++;
+			if (!template_depth && is_template_token (token, len))
+				template_depth = depth;
+		}
+	}
+
+	return true;
+}
+
+//
+// Keyed styles, templates and brushes in a resource dictionary are only
+// buffered, the dictionary creates them when they're looked up. Large theme
+// dictionaries are mostly made of entries the application never uses.
+//
+// Entries with names in them are created right away, their names have to be
+// found in the document's namescope. An entry which can't be created (an
+// unknown type or a bad property value, xml errors are still found when the
+// document is loaded) isn't reported when the document is loaded, the
+// dictionary warns about it and doesn't contain it when it's looked up.
+//
+static bool
+defer_resource (XamlParserInfo *p, XamlElementInfo *elem, const char *el, const char **attr)
+{
+	ResourceDictionary *rd;
+	const char *key = NULL;
+
+	if (p->hydrate_expecting || !p->current_element || p->loader->GetExpandingTemplate ())
+		return false;
+
+	if (!resource_can_be_deferred (elem->GetKind ()))
+		return false;
+
+	for (int i = 0; attr [i]; i += 2) {
+		if (!strcmp (attr [i], X_NAMESPACE_URI "|Key"))
+			key = attr [i + 1];
+	}
+
+	if (!key || *key == '{')
+		return false;
+
+	if (xml_element_has_names (p->GetCurrentXml ()))
+		return false;
+
+	if (!(rd = get_parent_resource_dictionary (p, p->current_element)))
+		return false;
+
+	rd->ref ();
+	p->deferred_dictionary = rd;
+	p->deferred_key = g_strdup (key);
+
+	// unlike templates we keep the element itself too
+	p->QueueBeginBuffering (g_strdup (el), BUFFER_MODE_RESOURCE);
+	p->BeginBuffering ();
+	p->deferred_empty_element = p->IsCurrentEmptyElement ();
+
+	return true;
+}
+
+static void
+end_deferred_resource (XamlParserInfo *p)
+{
+	ResourceDictionary *rd = p->deferred_dictionary;
+	char *end_tag = p->deferred_empty_element ? NULL : p->GetCurrentEndTag ();
+	char *name = p->buffer_until_element; // ClearBuffer doesn't free it
+	char *buffer = p->ClearBuffer ();
+	char *xaml = g_strconcat (buffer, end_tag, NULL);
+	MoonError err;
+
+	if (p->deferred_context_parent != p->current_element) {
+		if (p->deferred_context)
+			p->deferred_context->unref ();
+		p->deferred_context = create_xaml_context (p, NULL, p->loader->GetContext ());
+		p->deferred_context_parent = p->current_element;
+	}
+
+	Value v (p->deferred_context);
+	if (!rd->AddDeferredWithError (p->deferred_key, parse_resource, &v, xaml, &err))
+		parser_error (p, name, NULL, err.code, err.message);
+
+	p->deferred_dictionary = NULL;
+	g_free (p->deferred_key);
+	p->deferred_key = NULL;
+	rd->unref ();
+
+	g_free (xaml);
+	g_free (buffer);
+	g_free (end_tag);
+	g_free (name);
+}
+
 static gboolean
 is_default_namespace (gpointer key, gpointer value, gpointer user_data)
 {
@@ -2146,6 +2526,8 @@ end_element_handler (void *data, const char *el)
 						p->current_element->parent->AddChild (p, p->current_element);
 
 					p->current_element = p->current_element->parent;
+				} else if (p->buffer_mode == BUFFER_MODE_RESOURCE) {
+					end_deferred_resource (p);
 				} else if (p->buffer_mode == BUFFER_MODE_IGNORE) {
 					// For now we'll actually keep/clear this buffer because it makes testing easier
 					char *buffer = p->ClearBuffer ();
@@ -2417,6 +2799,22 @@ Xaml::ParseXmlns (const char* xmlns, char** type_name, char** ns, char** assembl
 	g_free (buffer);
 }
 
+static bool
+is_binary_xaml_file (const char *filename)
+{
+	char magic [4];
+	bool binary;
+	FILE *fp;
+
+	if (!(fp = fopen (filename, "rb")))
+		return false;
+
+	binary = fread (magic, 1, sizeof (magic), fp) == sizeof (magic) && XamlBinaryDocument::IsBinary (magic, sizeof (magic));
+	fclose (fp);
+
+	return binary;
+}
+
 Value *
 SL3XamlLoader::CreateFromFile (const char *xaml_file, bool create_namescope,
 			    Type::Kind *element_type)
@@ -2431,6 +2829,21 @@ SL3XamlLoader::CreateFromFile (const char *xaml_file, bool create_namescope,
 	ssize_t nread, n;
 
 	LOG_XAML ("attemtping to load xaml file: %s\n", xaml_file);
+
+	if (is_binary_xaml_file (xaml_file)) {
+		gchar *contents;
+		gsize length;
+
+		if (!g_file_get_contents (xaml_file, &contents, &length, NULL)) {
+			error_args = new ParserErrorEventArgs (NULL, "Error opening xaml file", xaml_file, 0, 0, 1, "", "");
+			return NULL;
+		}
+
+		res = HydrateFromBinary (contents, length, NULL, create_namescope, element_type, 0, xaml_file);
+		g_free (contents);
+
+		return res;
+	}
 	
 	stream = new TextStream ();
 	if (!stream->OpenFile (xaml_file, false)) {
@@ -2578,6 +2991,120 @@ XamlLoader::CreateDependencyObjectFromString (const char *xaml, bool create_name
 	return obj;
 }
 
+static void
+prepare_hydrate (SL3XamlLoader *loader, XamlParserInfo *parser_info, Value *object, bool create_namescope, int flags)
+{
+	parser_info->namescope->SetTemporary (!create_namescope);
+
+	parser_info->loader = loader;
+	parser_info->validate_templates = (flags & XamlLoader::VALIDATE_TEMPLATES) == XamlLoader::VALIDATE_TEMPLATES;
+	// errors in deferred resources would only show up when they're used
+	parser_info->defer_resources = !parser_info->validate_templates && deferred_resources_enabled ();
+
+	//
+	// If we are hydrating, we are not null
+	//
+	if (object != NULL) {
+		parser_info->hydrate_expecting = object;
+		parser_info->hydrating = true;
+		if (Type::IsSubclassOf (parser_info->deployment, object->GetKind (), Type::DEPENDENCY_OBJECT)) {
+			DependencyObject *dob = object->AsDependencyObject ();
+			dob->SetResourceBase (loader->GetResourceBase());
+		}
+	} else {
+		parser_info->hydrate_expecting = NULL;
+		parser_info->hydrating = false;
+	}
+	
+	// from_str gets the default namespaces implictly added
+	add_default_namespaces (parser_info, (flags & XamlLoader::IMPORT_DEFAULT_XMLNS) == XamlLoader::IMPORT_DEFAULT_XMLNS);
+}
+
+static Value *
+finish_hydrate (XamlParserInfo *parser_info, Value *object, Type::Kind *element_type)
+{
+	Value *res = NULL;
+
+	print_tree (parser_info->top_element, 0);
+	
+	if (parser_info->top_element) {
+		if (is_legal_top_level_kind (parser_info->top_element->info->GetKind ())) {
+			res = parser_info->top_element->GetAsValue ();
+			res = new Value (*res);
+			if (res->Is (parser_info->deployment, Type::DEPENDENCY_OBJECT) && object) {
+				DependencyObject *dob = res->AsDependencyObject ();
+				dob->unref ();
+				dob->SetIsHydratedFromXaml (parser_info->hydrating);
+			}
+		}
+
+		if (element_type)
+			*element_type = parser_info->top_element->info->GetKind ();
+
+		if (!res && !parser_info->error_args)
+			parser_info->error_args = new ParserErrorEventArgs (NULL, "No DependencyObject found", "", 0, 0, 1, "", "");
+
+		if (parser_info->error_args) {
+			delete res;
+			res = NULL;
+			if (element_type)
+				*element_type = Type::INVALID;
+		}
+	}
+
+	return res;
+}
+
+static void
+report_hydrate_error (SL3XamlLoader *loader, XamlParserInfo *parser_info)
+{
+	ParserErrorEventArgs *error_args;
+
+	if (parser_info && parser_info->error_args) {
+		error_args = loader->error_args = parser_info->error_args;
+		error_args->ref ();
+		printf ("Could not parse element %s, attribute %s, error: %s\n",
+			error_args->xml_element,
+			error_args->xml_attribute,
+			error_args->GetErrorMessage());
+	}
+}
+
+//
+// Feeds the events of a binary xaml document to the same handlers expat calls
+//
+static void
+replay_binary_xaml (XamlParserInfo *p, XamlBinaryDocument *doc)
+{
+	XamlBinaryEvent event;
+
+	p->SetXmlBuffer (doc->GetSource ());
+
+	while (!p->error_args && doc->NextEvent (&event)) {
+		p->binary_event = &event;
+
+		switch (event.op) {
+		case XamlBinaryNamespace:
+			start_namespace_handler (p, event.name, event.uri);
+			break;
+		case XamlBinaryStartElement:
+			start_element_handler (p, event.name, event.attrs);
+			break;
+		case XamlBinaryEndElement:
+			end_element_handler (p, event.name);
+			break;
+		case XamlBinaryText:
+			char_data_handler (p, event.name, event.name_length);
+			break;
+		}
+	}
+
+	if (doc->IsCorrupt ())
+		parser_error (p, NULL, NULL, 7000, "corrupt binary xaml");
+
+	p->binary_event = NULL;
+}
+
 /**
  * Hydrates an existing DependencyObject (@object) with the contents from the @xaml
  * data
@@ -2616,28 +3143,7 @@ SL3XamlLoader::HydrateFromString (const char *xaml, Value *object, bool create_n
 	
 	parser_info = new XamlParserInfo (p, NULL);
 
-	parser_info->namescope->SetTemporary (!create_namescope);
-
-	parser_info->loader = this;
-	parser_info->validate_templates = (flags & VALIDATE_TEMPLATES) == VALIDATE_TEMPLATES;
-
-	//
-	// If we are hydrating, we are not null
-	//
-	if (object != NULL) {
-		parser_info->hydrate_expecting = object;
-		parser_info->hydrating = true;
-		if (Type::IsSubclassOf (parser_info->deployment, object->GetKind (), Type::DEPENDENCY_OBJECT)) {
-			DependencyObject *dob = object->AsDependencyObject ();
-			dob->SetResourceBase (GetResourceBase());
-		}
-	} else {
-		parser_info->hydrate_expecting = NULL;
-		parser_info->hydrating = false;
-	}
-	
-	// from_str gets the default namespaces implictly added
-	add_default_namespaces (parser_info, (flags & IMPORT_DEFAULT_XMLNS) == IMPORT_DEFAULT_XMLNS);
+	prepare_hydrate (this, parser_info, object, create_namescope, flags);
 
 	XML_SetUserData (p, parser_info);
 
@@ -2674,44 +3180,11 @@ SL3XamlLoader::HydrateFromString (const char *xaml, Value *object, bool create_n
 		}
 	}
 	
-	print_tree (parser_info->top_element, 0);
-	
-	if (parser_info->top_element) {
-		if (is_legal_top_level_kind (parser_info->top_element->info->GetKind ())) {
-			res = parser_info->top_element->GetAsValue ();
-			res = new Value (*res);
-			if (res->Is (parser_info->deployment, Type::DEPENDENCY_OBJECT) && object) {
-				DependencyObject *dob = res->AsDependencyObject ();
-				dob->unref ();
-				dob->SetIsHydratedFromXaml (parser_info->hydrating);
-			}
-		}
-
-		if (element_type)
-			*element_type = parser_info->top_element->info->GetKind ();
-
-		if (!res && !parser_info->error_args)
-			parser_info->error_args = new ParserErrorEventArgs (NULL, "No DependencyObject found", "", 0, 0, 1, "", "");
-
-		if (parser_info->error_args) {
-			delete res;
-			res = NULL;
-			if (element_type)
-				*element_type = Type::INVALID;
-			goto cleanup_and_return;
-		}
-	}
+	res = finish_hydrate (parser_info, object, element_type);
 
  cleanup_and_return:
 	
-	if (parser_info->error_args) {
-		error_args = parser_info->error_args;
-		error_args->ref ();
-		printf ("Could not parse element %s, attribute %s, error: %s\n",
-			error_args->xml_element,
-			error_args->xml_attribute,
-			error_args->GetErrorMessage());
-	}
+	report_hydrate_error (this, parser_info);
 	
 	if (p)
 		XML_ParserFree (p);
@@ -2725,6 +3198,73 @@ SL3XamlLoader::HydrateFromString (const char *xaml, Value *object, bool create_n
 	return res;
 }
 
+/**
+ * Same as HydrateFromString, for binary xaml (see xaml-binary.h). Text is
+ * accepted too, as is binary xaml of another version, from which we parse
+ * the source text.
+ */
+Value *
+SL3XamlLoader::HydrateFromBinary (const void *data, gsize size, Value *object, bool create_namescope, Type::Kind *element_type, int flags, const char *file_name)
+{
+	XamlParserInfo *parser_info;
+	XamlBinaryDocument *doc;
+	const char *source;
+	Value *res = NULL;
+
+	if (!XamlBinaryDocument::IsBinary (data, size)) {
+		XamlPrecompiler *precompiler = Deployment::GetCurrent ()->GetXamlPrecompiler ();
+		GByteArray *binary;
+
+		// the application's documents may have been compiled in the background
+		if (precompiler && (binary = precompiler->Take (data, size))) {
+			res = HydrateFromBinary (binary->data, binary->len, object, create_namescope, element_type, flags, file_name);
+			g_byte_array_free (binary, true);
+			return res;
+		}
+
+		const char *text = (const char *) data;
+		gsize length = size;
+
+		XamlBinaryWriter::SkipByteOrderMark (&text, &length);
+
+		char *xaml = g_strndup (text, length);
+		res = HydrateFromString (xaml, object, create_namescope, element_type, flags);
+		g_free (xaml);
+		return res;
+	}
+
+	doc = XamlBinaryDocument::Open (data, size);
+
+	// only the text parser can wrap the content in an ignorable element
+	if (doc == NULL || context->internal->create_ignorable) {
+		delete doc;
+
+		if (!(source = XamlBinaryDocument::GetSource (data, size))) {
+			error_args = new ParserErrorEventArgs (NULL, "Invalid binary xaml", file_name, 0, 0, 1, "", "");
+			return NULL;
+		}
+
+		LOG_XAML ("SL3XamlLoader::HydrateFromBinary (): parsing the source text of %s\n", file_name ? file_name : "binary xaml");
+		return HydrateFromString (source, object, create_namescope, element_type, flags);
+	}
+
+	parser_info = new XamlParserInfo (NULL, file_name);
+
+	prepare_hydrate (this, parser_info, object, create_namescope, flags);
+
+	replay_binary_xaml (parser_info, doc);
+
+	if (!parser_info->error_args)
+		res = finish_hydrate (parser_info, object, element_type);
+
+	report_hydrate_error (this, parser_info);
+
+	delete parser_info;
+	delete doc;
+
+	return res;
+}
+
 Value *
 SL3XamlLoader::CreateFromFileWithError (const char *xaml_file, bool create_namescope, Type::Kind *element_type, MoonError *error)
 {
@@ -2752,6 +3292,36 @@ SL3XamlLoader::HydrateFromStringWithError (const char *xaml, Value *object, bool
 	return res;
 }
 
+Value *
+SL3XamlLoader::HydrateFromBinaryWithError (const void *data, gint32 length, Value *object, bool create_namescope, Type::Kind *element_type, int flags, MoonError *error)
+{
+	Value *res = HydrateFromBinary (data, length, object, create_namescope, element_type, flags, NULL);
+	if (error_args && error_args->GetErrorCode () != -1)
+		MoonError::FillIn (error, error_args);
+	return res;
+}
+
+Value *
+XamlLoader::HydrateFromBinaryWithError (const void *data, gint32 length, Value *object, bool create_namescope, Type::Kind *element_type, int flags, MoonError *error)
+{
+	const char *source = XamlBinaryDocument::GetSource (data, length);
+	Value *res;
+
+	if (source != NULL)
+		return HydrateFromStringWithError (source, object, create_namescope, element_type, flags, error);
+
+	if (XamlBinaryDocument::IsBinary (data, length)) {
+		MoonError::FillIn (error, MoonError::XAML_PARSE_EXCEPTION, "Invalid binary xaml");
+		return NULL;
+	}
+
+	char *xaml = g_strndup ((const char *) data, length);
+	res = HydrateFromStringWithError (xaml, object, create_namescope, element_type, flags, error);
+	g_free (xaml);
+
+	return res;
+}
+
 
 XamlLoader *
 XamlLoaderFactory::CreateLoader (const Uri *resource_base, Surface *surface)
@@ -149,7 +149,7 @@ class XamlLoaderFactory {
 	static XamlLoader *CreateLoader (const Uri* resource_base, Surface *surface, XamlContext *context);
 };
 
-class XamlLoader {
+class MOON_API XamlLoader {
 
  public:
 	
@@ -171,6 +171,10 @@ class XamlLoader {
 	/* @GeneratePInvoke */
 	virtual Value* HydrateFromStringWithError (const char *xaml, Value *obj, bool create_namescope, Type::Kind *element_type, int flags, MoonError *error) = 0;
 
+	/* Hydrates from binary xaml (see xaml-binary.h) or text. The default implementation parses the source text */
+	/* @GeneratePInvoke */
+	virtual Value* HydrateFromBinaryWithError (/* @MarshalAs=byte[] */ const void *data, gint32 length, Value *obj, bool create_namescope, Type::Kind *element_type, int flags, MoonError *error);
+
 	virtual ~XamlLoader () {}
 };
 
@@ -189,7 +193,7 @@ class SL4XamlLoader : public XamlLoader {
 	Deployment *deployment;
 };
 
-class SL3XamlLoader : public XamlLoader {
+class MOON_API SL3XamlLoader : public XamlLoader {
 	bool expanding_template;
 	DependencyObject *template_owner;
 	Surface *surface;
@@ -233,6 +237,7 @@ class SL3XamlLoader : public XamlLoader {
 	Value* CreateFromFile (const char *xaml, bool create_namescope, Type::Kind *element_type);
 	Value* CreateFromString  (const char *xaml, bool create_namescope, Type::Kind *element_type, int flags);
 	Value* HydrateFromString (const char *xaml, Value *object, bool create_namescope, Type::Kind *element_type, int flags);
+	Value* HydrateFromBinary (const void *data, gsize size, Value *object, bool create_namescope, Type::Kind *element_type, int flags, const char *file_name);
 
 	/* @GeneratePInvoke */
 	Value* CreateFromFileWithError (const char *xaml, bool create_namescope, Type::Kind *element_type, MoonError *error);
@@ -240,6 +245,7 @@ class SL3XamlLoader : public XamlLoader {
 	Value* CreateFromStringWithError  (const char *xaml, bool create_namescope, Type::Kind *element_type, int flags, MoonError *error, DependencyObject* owner = NULL);
 	/* @GeneratePInvoke */
 	Value* HydrateFromStringWithError (const char *xaml, Value *obj, bool create_namescope, Type::Kind *element_type, int flags, MoonError *error);
+	virtual Value* HydrateFromBinaryWithError (const void *data, gint32 length, Value *obj, bool create_namescope, Type::Kind *element_type, int flags, MoonError *error);
 	
 	XamlLoaderCallbacks GetCallbacks ();
 	void SetCallbacks (XamlLoaderCallbacks callbacks);
@@ -16,6 +16,12 @@
 #include <glib.h>
 
 #include <stdlib.h>
+#include <string.h>
+
+#if HAVE_SSE2 && defined (__SSE2__)
+#define USE_SSE2_YUV 1
+#include <emmintrin.h>
+#endif
 
 #include "yuv-converter.h"
 #include "cpu.h"
@@ -248,6 +254,171 @@ static inline void YUV444ToBGRA(guint8 Y, guint8 U, guint8 V, guint8 *dst)
 	dst[3] = 0xFF;
 }
 
+#if USE_SSE2_YUV
+
+/*
+ * SSE2 kernels for the capture formats
+ *
+ * These use the same fixed point coefficients as YUV444ToBGRA, with
+ * 32 bit intermediates, so they produce exactly the same pixels. They
+ * have no alignment requirements, and convert 8 pixels at a time.
+ */
+
+// Returns (a * ca + b * cb + c * cc + d * cd) >> 8 for 8 16 bit values
+static inline __m128i
+yuv_dot_sse2 (__m128i a, __m128i b, int ca, int cb, __m128i c, __m128i d, int cc, int cd)
+{
+	__m128i ab = _mm_set1_epi32 ((cb << 16) | (ca & 0xffff));
+	__m128i cd_ = _mm_set1_epi32 ((cd << 16) | (cc & 0xffff));
+	__m128i lo, hi;
+
+	lo = _mm_add_epi32 (_mm_madd_epi16 (_mm_unpacklo_epi16 (a, b), ab), _mm_madd_epi16 (_mm_unpacklo_epi16 (c, d), cd_));
+	hi = _mm_add_epi32 (_mm_madd_epi16 (_mm_unpackhi_epi16 (a, b), ab), _mm_madd_epi16 (_mm_unpackhi_epi16 (c, d), cd_));
+
+	return _mm_packs_epi32 (_mm_srai_epi32 (lo, 8), _mm_srai_epi32 (hi, 8));
+}
+
+// y, u and v are 8 16 bit values each, u and v already upsampled to one per pixel
+static inline void
+yuv_to_bgra_sse2 (__m128i y, __m128i u, __m128i v, guint8 *dest)
+{
+	__m128i zero = _mm_setzero_si128 ();
+	__m128i one = _mm_set1_epi16 (1);
+	__m128i r, g, b, bg, ra;
+
+	y = _mm_sub_epi16 (y, _mm_set1_epi16 (16));
+	u = _mm_sub_epi16 (u, _mm_set1_epi16 (128));
+	v = _mm_sub_epi16 (v, _mm_set1_epi16 (128));
+
+	// the rounding (+ 128) goes through the multiply-add as 1 * 128
+	r = yuv_dot_sse2 (y, v, 298, 409, one, zero, 128, 0);
+	g = yuv_dot_sse2 (y, u, 298, -100, v, one, -208, 128);
+	b = yuv_dot_sse2 (y, u, 298, 516, one, zero, 128, 0);
+
+	// clamp to [0-255]
+	r = _mm_packus_epi16 (r, r);
+	g = _mm_packus_epi16 (g, g);
+	b = _mm_packus_epi16 (b, b);
+
+	bg = _mm_unpacklo_epi8 (b, g);
+	ra = _mm_unpacklo_epi8 (r, _mm_set1_epi8 ((char) 0xff));
+
+	_mm_storeu_si128 ((__m128i *) dest, _mm_unpacklo_epi16 (bg, ra));
+	_mm_storeu_si128 ((__m128i *) (dest + 16), _mm_unpackhi_epi16 (bg, ra));
+}
+
+// Returns the number of pixels converted
+static int
+packed_row_to_bgra_sse2 (const guint8 *src, int width, guint8 *dest, bool uyvy)
+{
+	__m128i mask = _mm_set1_epi16 (0x00ff);
+	__m128i pixels, y, uv, u, v;
+	int i;
+
+	for (i = 0; i + 8 <= width; i += 8, src += 16, dest += 32) {
+		pixels = _mm_loadu_si128 ((const __m128i *) src);
+
+		if (uyvy) {
+			y = _mm_srli_epi16 (pixels, 8);
+			uv = _mm_and_si128 (pixels, mask);
+		} else {
+			y = _mm_and_si128 (pixels, mask);
+			uv = _mm_srli_epi16 (pixels, 8);
+		}
+
+		// uv [U0 V0 U1 V1 ...] -> u [U0 U0 U1 U1 ...], v [V0 V0 V1 V1 ...]
+		u = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (uv, _MM_SHUFFLE (2, 2, 0, 0)), _MM_SHUFFLE (2, 2, 0, 0));
+		v = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (uv, _MM_SHUFFLE (3, 3, 1, 1)), _MM_SHUFFLE (3, 3, 1, 1));
+
+		yuv_to_bgra_sse2 (y, u, v, dest);
+	}
+
+	return i;
+}
+
+// Returns the number of pixels converted
+static int
+planar_row_to_bgra_sse2 (const guint8 *y_row, const guint8 *u_row, const guint8 *v_row, int width, guint8 *dest)
+{
+	__m128i zero = _mm_setzero_si128 ();
+	__m128i y, u, v;
+	guint32 uv;
+	int i;
+
+	for (i = 0; i + 8 <= width; i += 8, y_row += 8, u_row += 4, v_row += 4, dest += 32) {
+		y = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *) y_row), zero);
+
+		memcpy (&uv, u_row, 4);
+		u = _mm_unpacklo_epi8 (_mm_cvtsi32_si128 (uv), zero);
+		u = _mm_unpacklo_epi16 (u, u);
+
+		memcpy (&uv, v_row, 4);
+		v = _mm_unpacklo_epi8 (_mm_cvtsi32_si128 (uv), zero);
+		v = _mm_unpacklo_epi16 (v, v);
+
+		yuv_to_bgra_sse2 (y, u, v, dest);
+	}
+
+	return i;
+}
+
+#endif /* USE_SSE2_YUV */
+
+void
+YUVConverter::PackedToBGRA (const guint8 *src, int srcStride, int width, int height, guint8 *dest, int dstStride, bool uyvy)
+{
+	bool sse2 = CPU::HaveSSE2 ();
+	const guint8 *ip;
+	guint8 *op;
+	int i;
+
+	for (int row = 0; row < height; row++, src += srcStride, dest += dstStride) {
+		i = 0;
+#if USE_SSE2_YUV
+		if (sse2)
+			i = packed_row_to_bgra_sse2 (src, width, dest, uyvy);
+#endif
+		ip = src + i * 2;
+		op = dest + i * 4;
+
+		for (; i + 2 <= width; i += 2, ip += 4, op += 8) {
+			guint8 y, u, y2, v;
+
+			if (uyvy) {
+				u = ip [0]; y = ip [1]; v = ip [2]; y2 = ip [3];
+			} else {
+				y = ip [0]; u = ip [1]; y2 = ip [2]; v = ip [3];
+			}
+
+			YUV444ToBGRA (y, u, v, op);
+			YUV444ToBGRA (y2, u, v, op + 4);
+		}
+	}
+}
+
+void
+YUVConverter::PlanarToBGRA (guint8 *planes[], int strides[], int width, int height, guint8 *dest, int dstStride)
+{
+	bool sse2 = CPU::HaveSSE2 ();
+	const guint8 *y_row, *u_row, *v_row;
+	guint8 *op;
+	int i;
+
+	for (int row = 0; row < height; row++, dest += dstStride) {
+		y_row = planes [0] + row * strides [0];
+		u_row = planes [1] + (row >> 1) * strides [1];
+		v_row = planes [2] + (row >> 1) * strides [2];
+
+		i = 0;
+#if USE_SSE2_YUV
+		if (sse2)
+			i = planar_row_to_bgra_sse2 (y_row, u_row, v_row, width, dest);
+#endif
+		for (op = dest + i * 4; i < width; i++, op += 4)
+			YUV444ToBGRA (y_row [i], u_row [i >> 1], v_row [i >> 1], op);
+	}
+}
+
 void
 YUVConverter::YV12ToBGRA (guint8 *src[], int srcStride[], int width, int height, guint8* dest, int dstStride, char *rgb_uv, bool have_mmx, bool have_sse2)
 {
@@ -316,19 +487,10 @@ YUVConverter::YV12ToBGRA (guint8 *src[], int srcStride[], int width, int height,
 			__asm__ __volatile__ ("emms");
 		} else {
 #endif
-			for (i = 0; i < height >> 1; i ++, y_row1 += srcStride[0], y_row2 += srcStride[0], dest_row1 += dstStride, dest_row2 += dstStride) {
-				for (j = 0; j < width >> 1; j ++, dest_row1 += 8, dest_row2 += 8, y_row1 += 2, y_row2 += 2, u_plane += 1, v_plane += 1) {
-					YUV444ToBGRA (*y_row1, *u_plane, *v_plane, dest_row1);
-					YUV444ToBGRA (y_row1[1], *u_plane, *v_plane, (dest_row1+4));
-			
-					YUV444ToBGRA (*y_row2, *u_plane, *v_plane, dest_row2);
-					YUV444ToBGRA (y_row2[1], *u_plane, *v_plane, (dest_row2+4));
-				}
-				y_row1 += pad;
-				y_row2 += pad;
-				u_plane += pad >> 1;
-				v_plane += pad >> 1;
-			}
+			// the chroma rows are half as wide as the luma rows, including the padding
+			int strides [3] = { srcStride[0], srcStride[0] >> 1, srcStride[0] >> 1 };
+
+			PlanarToBGRA (src, strides, width & ~1, height & ~1, dest, dstStride);
 #if HAVE_MMX
 		}
 #endif
@@ -30,6 +30,12 @@ public:
 
 	static void YV12ToBGRA (guint8 *src[], int srcStride[], int width, int height, guint8* dest, int dstStride, char *rgb_uv, bool have_mmx, bool have_sse2);
 
+	/* YUYV (or UYVY) to BGRA, width must be even */
+	static void PackedToBGRA (const guint8 *src, int srcStride, int width, int height, guint8 *dest, int dstStride, bool uyvy);
+	/* 4:2:0 planes (Y, U, V) to BGRA. The chroma row of a luma row is row / 2, so a frame can be
+	 * converted in several bands as long as each band starts on an even row */
+	static void PlanarToBGRA (guint8 *planes[], int strides[], int width, int height, guint8 *dest, int dstStride);
+
 private:
 	char *rgb_uv;
 	bool have_mmx;
@@ -18,6 +18,22 @@ using System.Text;
 
 namespace MoonTest.System.Windows
 {
+	internal class ResourceDictionaryDeferredTestPage : Canvas {
+
+		public ResourceDictionaryDeferredTestPage ()
+		{
+			Application.LoadComponent (this, new Uri ("/moon-unit;component/System.Windows/ResourceDictionaryDeferredTest.xaml", UriKind.Relative));
+		}
+	}
+
+	internal class ResourceDictionaryDeferredErrorTestPage : Canvas {
+
+		public ResourceDictionaryDeferredErrorTestPage ()
+		{
+			Application.LoadComponent (this, new Uri ("/moon-unit;component/System.Windows/ResourceDictionaryDeferredErrorTest.xaml", UriKind.Relative));
+		}
+	}
+
 	[TestClass]
 	public partial class ResourceDictionaryTest
 	{
@@ -49,6 +65,80 @@ namespace MoonTest.System.Windows
 			Assert.Throws<ArgumentException> (delegate { rd.Add ("hi", new object()); } );
 		}
 
+		[TestMethod]
+		public void DeferredIndexer ()
+		{
+			// nothing has enumerated the dictionary, so the
+			// entries may not have been created yet
+			ResourceDictionary rd = new ResourceDictionaryDeferredTestPage ().Resources;
+
+			SolidColorBrush brush = rd["red"] as SolidColorBrush;
+			Assert.IsNotNull (brush, "#1");
+			Assert.AreEqual (Colors.Red, brush.Color, "#2");
+			Assert.AreSame (brush, rd["red"], "#3");
+			Assert.IsInstanceOfType<Style> (rd["style"], "#4");
+			Assert.IsNull (rd["missing"], "#5");
+		}
+
+		[TestMethod]
+		public void DeferredContains ()
+		{
+			ResourceDictionary rd = new ResourceDictionaryDeferredTestPage ().Resources;
+
+			Assert.IsTrue (rd.Contains ("blue"), "#1");
+			Assert.IsTrue (rd.Contains ("style"), "#2");
+			Assert.IsFalse (rd.Contains ("missing"), "#3");
+			Assert.AreEqual (Colors.Blue, ((SolidColorBrush) rd["blue"]).Color, "#4");
+		}
+
+		[TestMethod]
+		public void DeferredTryGetValue ()
+		{
+			IDictionary<object, object> rd = new ResourceDictionaryDeferredTestPage ().Resources;
+			object value;
+
+			Assert.IsTrue (rd.TryGetValue ("style", out value), "#1");
+			Assert.IsInstanceOfType<Style> (value, "#2");
+			Assert.IsTrue (rd.TryGetValue ("red", out value), "#3");
+			Assert.AreEqual (Colors.Red, ((SolidColorBrush) value).Color, "#4");
+			Assert.IsFalse (rd.TryGetValue ("missing", out value), "#5");
+			Assert.IsNull (value, "#6");
+		}
+
+		[TestMethod]
+		public void DeferredNamedDescendant ()
+		{
+			ResourceDictionaryDeferredTestPage page = new ResourceDictionaryDeferredTestPage ();
+
+			GradientStop stop = page.FindName ("stop") as GradientStop;
+			Assert.IsNotNull (stop, "#1");
+			Assert.AreSame (stop, ((LinearGradientBrush) page.Resources["gradient"]).GradientStops[0], "#2");
+		}
+
+		[TestMethod]
+		public void DeferredTemplateNames ()
+		{
+			ResourceDictionaryDeferredTestPage page = new ResourceDictionaryDeferredTestPage ();
+
+			// the names inside a template aren't in the page's namescope
+			Assert.IsNull (page.FindName ("templateRoot"), "#1");
+			Assert.IsInstanceOfType<ControlTemplate> (page.Resources["template"], "#2");
+			Assert.IsNull (page.FindName ("templateRoot"), "#3");
+		}
+
+		[TestMethod]
+		[SilverlightBug ("Silverlight creates the resources when it loads the page and throws a XamlParseException there")]
+		public void DeferredError ()
+		{
+			// the broken entry is only created when it's looked up
+			ResourceDictionary rd = new ResourceDictionaryDeferredErrorTestPage ().Resources;
+
+			Assert.IsNull (rd["broken"], "#1");
+			Assert.IsFalse (rd.Contains ("broken"), "#2");
+			Assert.IsNotNull (rd["red"], "#3");
+			Assert.AreEqual (1, rd.Count, "#4");
+		}
+
 		[TestMethod]
 		public void CanAddToSameRDTwiceTest ()
 		{
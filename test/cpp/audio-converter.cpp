@@ -0,0 +1,143 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include <string.h>
+
+#include "audio.h"
+#include "audio-converter.h"
+#include "cpu.h"
+
+using namespace Moonlight;
+
+#define MAX_FRAMES 67
+#define MAX_CHANNELS 4
+
+static void
+fill_random (guint8 *data, guint32 size, guint32 seed)
+{
+	GRand *rand = g_rand_new_with_seed (seed);
+
+	for (guint32 i = 0; i < size; i++)
+		data [i] = (guint8) g_rand_int (rand);
+
+	// make sure the extremes are in there
+	if (size >= 4) {
+		data [0] = 0x00;
+		data [1] = 0x80;
+		data [2] = 0xff;
+		data [3] = 0x7f;
+	}
+
+	g_rand_free (rand);
+}
+
+/* converts into @dest (interleaved), with or without SSE2 */
+static void
+convert (bool simd, guint32 input_bytes, guint32 channels, const guint8 *src, guint32 frames, const gint32 *volumes, guint8 *dest)
+{
+	AudioData data [MAX_CHANNELS];
+	AudioData *channel_data [MAX_CHANNELS];
+	guint8 *write_ptr [MAX_CHANNELS];
+
+	for (guint32 c = 0; c < channels; c++) {
+		data [c].dest = dest + c * 2;
+		data [c].distance = channels * 2;
+		channel_data [c] = &data [c];
+		write_ptr [c] = dest + c * 2;
+	}
+
+	CPU::SetSIMDEnabled (simd);
+	EXPECT_TRUE (AudioConverter::Convert (input_bytes, 2, channels, src, frames, volumes, channel_data, write_ptr));
+	CPU::SetSIMDEnabled (true);
+
+	// every channel was written up to the end
+	for (guint32 c = 0; c < channels; c++)
+		EXPECT_EQ (dest + frames * channels * 2 + c * 2, write_ptr [c]);
+}
+
+TEST(AudioConverter, SIMDMatchesScalar)
+{
+	static const gint32 volume_sets [][MAX_CHANNELS] = {
+		{ AUDIO_VOLUME_UNITY, AUDIO_VOLUME_UNITY, AUDIO_VOLUME_UNITY, AUDIO_VOLUME_UNITY },
+		{ 0, AUDIO_VOLUME_UNITY / 2, 12345, G_MAXINT16 },
+		{ G_MAXINT16, 1, 0, AUDIO_VOLUME_UNITY + 1 },
+	};
+	static const guint32 channel_counts [] = { 1, 2, 4 };
+	guint8 src [MAX_FRAMES * MAX_CHANNELS * 2 + 16];
+	guint8 simd [MAX_FRAMES * MAX_CHANNELS * 2 + 16];
+	guint8 scalar [MAX_FRAMES * MAX_CHANNELS * 2 + 16];
+
+	fill_random (src, sizeof (src), 42);
+
+	for (guint32 input_bytes = 1; input_bytes <= 2; input_bytes++) {
+	for (guint32 c = 0; c < G_N_ELEMENTS (channel_counts); c++) {
+	for (guint32 v = 0; v < G_N_ELEMENTS (volume_sets); v++) {
+	for (guint32 frames = 1; frames <= MAX_FRAMES; frames += 3) {
+	// unaligned source and destination
+	for (guint32 offset = 0; offset < 4; offset++) {
+		guint32 channels = channel_counts [c];
+		guint32 size = frames * channels * 2;
+
+		SCOPED_TRACE (testing::Message () << input_bytes << " byte input, " << channels << " channels, volumes " << v
+			      << ", " << frames << " frames, offset " << offset);
+
+		memset (simd, 0xcc, sizeof (simd));
+		memset (scalar, 0xcc, sizeof (scalar));
+
+		convert (true, input_bytes, channels, src + offset, frames, volume_sets [v], simd + offset * 2);
+		convert (false, input_bytes, channels, src + offset, frames, volume_sets [v], scalar + offset * 2);
+
+		EXPECT_EQ (0, memcmp (simd, scalar, sizeof (simd)));
+		// nothing past the end was touched
+		EXPECT_EQ (0xcc, simd [offset * 2 + size]);
+	}
+	}
+	}
+	}
+	}
+}
+
+TEST(AudioConverter, AccumulateAndSaturate)
+{
+	gint16 src [MAX_FRAMES * 2 + 1];
+	gint32 simd [MAX_FRAMES * 2 + 1];
+	gint32 scalar [MAX_FRAMES * 2 + 1];
+	gint16 simd16 [MAX_FRAMES * 2 + 1];
+	gint16 scalar16 [MAX_FRAMES * 2 + 1];
+
+	fill_random ((guint8 *) src, sizeof (src), 7);
+
+	for (guint32 frames = 1; frames <= MAX_FRAMES; frames += 2) {
+		guint32 samples = frames * 2;
+
+		SCOPED_TRACE (frames);
+
+		// start with something which saturates when more is added
+		for (guint32 i = 0; i < G_N_ELEMENTS (simd); i++)
+			simd [i] = scalar [i] = (i % 3 == 0) ? G_MAXINT16 : (i % 3 == 1) ? G_MININT16 : 0;
+
+		// unaligned: start at the second sample
+		CPU::SetSIMDEnabled (true);
+		AudioConverter::Accumulate (src + 1, 2, simd + 1, 2, frames);
+		AudioConverter::Saturate (simd + 1, simd16 + 1, samples);
+		CPU::SetSIMDEnabled (false);
+		AudioConverter::Accumulate (src + 1, 2, scalar + 1, 2, frames);
+		AudioConverter::Saturate (scalar + 1, scalar16 + 1, samples);
+		CPU::SetSIMDEnabled (true);
+
+		EXPECT_EQ (0, memcmp (simd + 1, scalar + 1, samples * sizeof (gint32)));
+		EXPECT_EQ (0, memcmp (simd16 + 1, scalar16 + 1, samples * sizeof (gint16)));
+	}
+}
@@ -0,0 +1,100 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include "bitmapsource.h"
+#include "context-cairo.h"
+#include "surface-cairo.h"
+#include "render-cache.h"
+#include "factory.h"
+
+using namespace Moonlight;
+
+#define SIZE 64
+
+static BitmapSource *
+create_bitmap ()
+{
+	BitmapSource *source = MoonUnmanagedFactory::CreateBitmapSource ();
+
+	source->SetPixelWidth (SIZE);
+	source->SetPixelHeight (SIZE);
+	source->SetBitmapData (g_malloc0 (SIZE * SIZE * 4), true);
+	source->Invalidate ();
+
+	return source;
+}
+
+TEST(BitmapSource, MipSurfaceResidency)
+{
+	RenderCache *cache = RenderCache::GetInstance ();
+	gint64 initial = cache->GetResidency (RenderCacheImage);
+	BitmapSource *source = create_bitmap ();
+	gint64 built, uploaded;
+	int level, width, height;
+
+	level = source->GetMipLevel (4.0);
+	ASSERT_EQ (2, level);
+	source->GetMipLevelSize (level, &width, &height);
+	uploaded = (gint64) width * height * 4;
+	built = cache->GetResidency (RenderCacheImage);
+
+	// the levels' pixels are accounted for
+	EXPECT_EQ (initial + (SIZE / 2) * (SIZE / 2) * 4 + (SIZE / 4) * (SIZE / 4) * 4, built);
+
+	// painting through a new context every frame (as the gtk windows
+	// do without gallium) doesn't add up
+	for (int frame = 0; frame < 4; frame++) {
+		CairoSurface *target = new CairoSurface (SIZE, SIZE);
+		Context *ctx = new CairoContext (target);
+
+		ASSERT_TRUE (source->GetMipSurface (ctx, level) != NULL);
+		EXPECT_EQ (built + uploaded, cache->GetResidency (RenderCacheImage));
+		ASSERT_TRUE (source->GetMipSurface (ctx, level) != NULL);
+		EXPECT_EQ (built + uploaded, cache->GetResidency (RenderCacheImage));
+
+		delete ctx;
+		target->unref ();
+
+		EXPECT_EQ (built, cache->GetResidency (RenderCacheImage));
+	}
+
+	// the level is counted once while several contexts hold it
+	CairoSurface *target1 = new CairoSurface (SIZE, SIZE);
+	CairoSurface *target2 = new CairoSurface (SIZE, SIZE);
+	Context *ctx1 = new CairoContext (target1);
+	Context *ctx2 = new CairoContext (target2);
+
+	ASSERT_TRUE (source->GetMipSurface (ctx1, level) != NULL);
+	ASSERT_TRUE (source->GetMipSurface (ctx2, level) != NULL);
+	EXPECT_EQ (built + uploaded, cache->GetResidency (RenderCacheImage));
+
+	delete ctx1;
+	EXPECT_EQ (built + uploaded, cache->GetResidency (RenderCacheImage));
+	delete ctx2;
+	EXPECT_EQ (built, cache->GetResidency (RenderCacheImage));
+
+	// changing the pixels drops the levels along with their surfaces
+	ctx1 = new CairoContext (target1);
+	ASSERT_TRUE (source->GetMipSurface (ctx1, level) != NULL);
+	source->Invalidate ();
+	EXPECT_EQ (initial, cache->GetResidency (RenderCacheImage));
+
+	delete ctx1;
+	target2->unref ();
+	target1->unref ();
+	source->unref ();
+
+	EXPECT_EQ (initial, cache->GetResidency (RenderCacheImage));
+}
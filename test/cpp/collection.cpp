@@ -0,0 +1,235 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include <string.h>
+
+#include "collection.h"
+#include "canvas.h"
+#include "shape.h"
+#include "factory.h"
+
+using namespace Moonlight;
+
+#define COUNT 40
+
+static int
+expected_index_of (GPtrArray *expected, gpointer item)
+{
+	for (guint i = 0; i < expected->len; i++) {
+		if (expected->pdata[i] == item)
+			return i;
+	}
+	
+	return -1;
+}
+
+// looks every item up twice: the first round can build the index
+// table, the second one then uses it
+static void
+expect_index_of (Collection *col, GPtrArray *expected, Rectangle **rects)
+{
+	ASSERT_EQ ((int) expected->len, col->GetCount ());
+	
+	for (int round = 0; round < 2; round++) {
+		for (guint i = 0; i < expected->len; i++) {
+			Value value ((EventObject *) expected->pdata[i]);
+			EXPECT_EQ (expected_index_of (expected, expected->pdata[i]), col->IndexOf (&value));
+		}
+		
+		for (int i = 0; i < COUNT; i++) {
+			Value value (rects[i]);
+			EXPECT_EQ (expected_index_of (expected, rects[i]) != -1, col->Contains (&value));
+		}
+	}
+}
+
+static void
+insert_item (Collection *col, GPtrArray *expected, int index, Rectangle *rect)
+{
+	g_ptr_array_add (expected, NULL);
+	memmove (expected->pdata + index + 1, expected->pdata + index, (expected->len - index - 1) * sizeof (gpointer));
+	expected->pdata[index] = rect;
+	col->Insert (index, Value (rect));
+}
+
+static void
+remove_item (Collection *col, GPtrArray *expected, Rectangle *rect)
+{
+	g_ptr_array_remove (expected, rect);
+	col->Remove (Value (rect));
+}
+
+TEST(Collection, IndexOf)
+{
+	UIElementCollection *col = new UIElementCollection (false);
+	GPtrArray *expected = g_ptr_array_new ();
+	Rectangle *rects[COUNT];
+	
+	for (int i = 0; i < COUNT; i++)
+		rects[i] = MoonUnmanagedFactory::CreateRectangle ();
+	
+	for (int i = 0; i < COUNT - 2; i++)
+		insert_item (col, expected, i, rects[i]);
+	expect_index_of (col, expected, rects);
+	
+	// things which keep the table
+	insert_item (col, expected, expected->len, rects[COUNT - 2]);
+	expect_index_of (col, expected, rects);
+	col->RemoveAt (col->GetCount () - 1);
+	g_ptr_array_remove_index (expected, expected->len - 1);
+	expect_index_of (col, expected, rects);
+	
+	// and things which invalidate it
+	insert_item (col, expected, 10, rects[COUNT - 1]);
+	expect_index_of (col, expected, rects);
+	remove_item (col, expected, rects[3]);
+	expect_index_of (col, expected, rects);
+	insert_item (col, expected, 0, rects[3]);
+	expect_index_of (col, expected, rects);
+	remove_item (col, expected, rects[20]);
+	remove_item (col, expected, rects[21]);
+	expect_index_of (col, expected, rects);
+	Value replacement (rects[20]);
+	col->SetValueAt (5, &replacement);
+	expected->pdata[5] = rects[20];
+	expect_index_of (col, expected, rects);
+	
+	// removing from the front in a loop
+	while (expected->len > 20) {
+		col->RemoveAt (0);
+		g_ptr_array_remove_index (expected, 0);
+		expect_index_of (col, expected, rects);
+	}
+	
+	col->Clear ();
+	g_ptr_array_set_size (expected, 0);
+	expect_index_of (col, expected, rects);
+	
+	col->unref ();
+	g_ptr_array_free (expected, true);
+	for (int i = 0; i < COUNT; i++)
+		rects[i]->unref ();
+}
+
+TEST(Collection, IndexOfDuplicates)
+{
+	UIElementCollection *col = new UIElementCollection (false);
+	GPtrArray *expected = g_ptr_array_new ();
+	Rectangle *rects[COUNT];
+	
+	for (int i = 0; i < COUNT; i++)
+		rects[i] = MoonUnmanagedFactory::CreateRectangle ();
+	
+	for (int i = 0; i < COUNT; i++)
+		insert_item (col, expected, i, rects[i]);
+	expect_index_of (col, expected, rects);
+	
+	// IndexOf returns the first one, appending a duplicate keeps it
+	insert_item (col, expected, expected->len, rects[5]);
+	expect_index_of (col, expected, rects);
+	
+	// removing the duplicate at the end leaves the first one
+	col->RemoveAt (col->GetCount () - 1);
+	g_ptr_array_remove_index (expected, expected->len - 1);
+	expect_index_of (col, expected, rects);
+	
+	// a duplicate in front of the original
+	insert_item (col, expected, 2, rects[30]);
+	expect_index_of (col, expected, rects);
+	
+	// Remove (value) removes the first one, the second is found then
+	remove_item (col, expected, rects[30]);
+	expect_index_of (col, expected, rects);
+	remove_item (col, expected, rects[30]);
+	expect_index_of (col, expected, rects);
+	
+	col->unref ();
+	g_ptr_array_free (expected, true);
+	for (int i = 0; i < COUNT; i++)
+		rects[i]->unref ();
+}
+
+// compares the incrementally resorted children of @canvas against
+// a new collection holding the same children, fully sorted
+static void
+expect_z_sorted (Canvas *canvas)
+{
+	UIElementCollection *children = canvas->GetChildren ();
+	UIElementCollection *sorted = new UIElementCollection (false);
+	
+	for (int i = 0; i < children->GetCount (); i++)
+		sorted->Add (children->GetValueAt (i));
+	
+	children->ResortByZIndex ();
+	sorted->ResortByZIndex ();
+	
+	ASSERT_EQ (sorted->z_sorted->len, children->z_sorted->len);
+	for (guint i = 0; i < sorted->z_sorted->len; i++) {
+		SCOPED_TRACE (i);
+		EXPECT_EQ (sorted->z_sorted->pdata[i], children->z_sorted->pdata[i]);
+	}
+	
+	sorted->unref ();
+}
+
+TEST(Collection, ResortByZIndex)
+{
+	Canvas *canvas = MoonUnmanagedFactory::CreateCanvas ();
+	UIElementCollection *children = canvas->GetChildren ();
+	GRand *rand = g_rand_new_with_seed (1);
+	Rectangle *rects[COUNT];
+	
+	for (int i = 0; i < COUNT; i++) {
+		rects[i] = MoonUnmanagedFactory::CreateRectangle ();
+		// few distinct values, so that there are plenty of ties
+		Canvas::SetZIndex (rects[i], g_rand_int_range (rand, 0, 4));
+		children->Add (Value (rects[i]));
+	}
+	expect_z_sorted (canvas);
+	
+	// a single change, moving up, down and to the same value
+	Canvas::SetZIndex (rects[7], 10);
+	expect_z_sorted (canvas);
+	Canvas::SetZIndex (rects[7], -1);
+	expect_z_sorted (canvas);
+	Canvas::SetZIndex (rects[12], Canvas::GetZIndex (rects[12]));
+	expect_z_sorted (canvas);
+	
+	// several changes between resorts, some to the same element
+	for (int round = 0; round < 10; round++) {
+		for (int i = 0; i < round * 3 + 1; i++)
+			Canvas::SetZIndex (rects[g_rand_int_range (rand, 0, COUNT)], g_rand_int_range (rand, -2, 6));
+		expect_z_sorted (canvas);
+	}
+	
+	// more changes than are moved one at a time
+	for (int i = 0; i < COUNT; i++)
+		Canvas::SetZIndex (rects[i], g_rand_int_range (rand, 0, 4));
+	expect_z_sorted (canvas);
+	
+	// changes mixed with adding and removing children
+	Canvas::SetZIndex (rects[3], 7);
+	children->RemoveAt (10);
+	Canvas::SetZIndex (rects[4], -3);
+	expect_z_sorted (canvas);
+	Canvas::SetZIndex (rects[5], 2);
+	children->Insert (0, Value (rects[10]));
+	expect_z_sorted (canvas);
+	
+	g_rand_free (rand);
+	canvas->unref ();
+	for (int i = 0; i < COUNT; i++)
+		rects[i]->unref ();
+}
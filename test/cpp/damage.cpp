@@ -0,0 +1,151 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include "damage.h"
+
+using namespace Moonlight;
+
+static bool
+is_covered (DamageAccumulator *damage, const Rect &r)
+{
+	for (int i = 0; i < damage->GetRectangleCount (); i++) {
+		if (damage->GetRectangle (i).Intersection (r) == r)
+			return true;
+	}
+
+	return false;
+}
+
+TEST(DamageAccumulator, Empty)
+{
+	DamageAccumulator damage;
+
+	EXPECT_TRUE (damage.IsEmpty ());
+	EXPECT_EQ (0, damage.GetRectangleCount ());
+	EXPECT_EQ (0, damage.GetRawCount ());
+	EXPECT_TRUE (damage.TakeRaw () == NULL);
+
+	/* empty rectangles don't count */
+	damage.Add (Rect (10, 10, 0, 0));
+	damage.Add (Rect (10, 10, 0, 5));
+	EXPECT_TRUE (damage.IsEmpty ());
+	EXPECT_EQ (0, damage.GetRawCount ());
+
+	damage.Add (Rect (0, 0, 10, 10));
+	EXPECT_FALSE (damage.IsEmpty ());
+	damage.Clear ();
+	EXPECT_TRUE (damage.IsEmpty ());
+	EXPECT_EQ (0, damage.GetRectangleCount ());
+	EXPECT_EQ (0, damage.GetRawCount ());
+}
+
+TEST(DamageAccumulator, RoundOut)
+{
+	DamageAccumulator damage;
+
+	damage.Add (Rect (0.5, 0.5, 9, 9));
+	ASSERT_EQ (1, damage.GetRectangleCount ());
+	EXPECT_TRUE (damage.GetRectangle (0) == Rect (0, 0, 10, 10));
+}
+
+TEST(DamageAccumulator, MergeAdjacentAndOverlapping)
+{
+	DamageAccumulator damage;
+
+	/* side by side, the union doesn't waste anything */
+	damage.Add (Rect (0, 0, 100, 100));
+	damage.Add (Rect (100, 0, 100, 100));
+	ASSERT_EQ (1, damage.GetRectangleCount ());
+	EXPECT_TRUE (damage.GetRectangle (0) == Rect (0, 0, 200, 100));
+
+	/* contained */
+	damage.Add (Rect (10, 10, 20, 20));
+	ASSERT_EQ (1, damage.GetRectangleCount ());
+	EXPECT_TRUE (damage.GetRectangle (0) == Rect (0, 0, 200, 100));
+
+	EXPECT_EQ (3, damage.GetRawCount ());
+}
+
+TEST(DamageAccumulator, MergeThreshold)
+{
+	DamageAccumulator damage;
+
+	/* merging two 1x1 rectangles which are x apart wastes x - 1 pixels */
+	damage.Add (Rect (0, 0, 1, 1));
+	damage.Add (Rect (DAMAGE_RECTANGLE_COST + 1, 0, 1, 1));
+	EXPECT_EQ (1, damage.GetRectangleCount ());
+
+	damage.Clear ();
+	damage.Add (Rect (0, 0, 1, 1));
+	damage.Add (Rect (DAMAGE_RECTANGLE_COST + 2, 0, 1, 1));
+	EXPECT_EQ (2, damage.GetRectangleCount ());
+
+	/* a rectangle which bridges the two pulls them together */
+	damage.Add (Rect (1, 0, DAMAGE_RECTANGLE_COST + 1, 1));
+	ASSERT_EQ (1, damage.GetRectangleCount ());
+	EXPECT_TRUE (damage.GetRectangle (0) == Rect (0, 0, DAMAGE_RECTANGLE_COST + 3, 1));
+}
+
+TEST(DamageAccumulator, TooManyRectangles)
+{
+	DamageAccumulator damage;
+	int n = DAMAGE_MAX_RECTANGLES * 2;
+
+	/* too far apart to be worth merging, until there are too many */
+	for (int i = 0; i < n; i++)
+		damage.Add (Rect (i * 1000, (i % 2) * 1000, 10, 10));
+
+	EXPECT_EQ (DAMAGE_MAX_RECTANGLES, damage.GetRectangleCount ());
+	EXPECT_EQ (n, damage.GetRawCount ());
+
+	for (int i = 0; i < n; i++)
+		EXPECT_TRUE (is_covered (&damage, Rect (i * 1000, (i % 2) * 1000, 10, 10)));
+}
+
+TEST(DamageAccumulator, Grid)
+{
+	DamageAccumulator damage;
+
+	/* a few hundred small invalidations next to each other come out as their bounding box */
+	for (int y = 0; y < 20; y++) {
+		for (int x = 0; x < 20; x++)
+			damage.Add (Rect (x * 10, y * 10, 10, 10));
+	}
+
+	ASSERT_EQ (1, damage.GetRectangleCount ());
+	EXPECT_TRUE (damage.GetRectangle (0) == Rect (0, 0, 200, 200));
+	EXPECT_EQ (400, damage.GetRawCount ());
+}
+
+TEST(DamageAccumulator, KeepRaw)
+{
+	DamageAccumulator damage;
+	Region *raw;
+
+	damage.Add (Rect (0, 0, 10, 10));
+	EXPECT_TRUE (damage.TakeRaw () == NULL);
+
+	damage.SetKeepRaw (true);
+	damage.Add (Rect (0, 0, 10, 10));
+	damage.Add (Rect (10, 0, 10, 10));
+
+	raw = damage.TakeRaw ();
+	ASSERT_TRUE (raw != NULL);
+	EXPECT_TRUE (raw->GetExtents () == Rect (0, 0, 20, 10));
+	delete raw;
+
+	/* it's been handed out */
+	EXPECT_TRUE (damage.TakeRaw () == NULL);
+}
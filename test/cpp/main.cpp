@@ -13,7 +13,29 @@
 #include "config.h"
 #include "main.h"
 
+#include <string.h>
+#include <gtk/gtk.h>
+
+#include "runtime.h"
+
+// the tests which create dependency objects, responses or text layouts
+// need a deployment (and with it the type tables and the font manager)
+#define NEEDS_RUNTIME "BitmapSource.*:Collection.*:Types.*:HttpCache.GetExpiration:TextLayout.*"
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
+
+  if (gtk_init_check (&argc, &argv)) {
+    Moonlight::Runtime::InitDesktop ();
+  } else {
+    // no display (e.g. on a build bot), run everything else
+    const char *filter = ::testing::GTEST_FLAG(filter).c_str ();
+    char *skip = g_strdup_printf ("%s%s" NEEDS_RUNTIME, filter, strchr (filter, '-') ? ":" : "-");
+
+    g_warning ("gtk_init_check failed, skipping the tests which need the runtime (" NEEDS_RUNTIME ")");
+    ::testing::GTEST_FLAG(filter) = skip;
+    g_free (skip);
+  }
+
   return RUN_ALL_TESTS();
 }
\ No newline at end of file
@@ -0,0 +1,146 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include <stdarg.h>
+
+#include "network.h"
+#include "network-cache.h"
+
+using namespace Moonlight;
+
+/* Sun, 06 Nov 1994 08:49:37 GMT */
+#define DATE 784111777
+
+TEST(HttpCache, parse_http_date)
+{
+	EXPECT_EQ (DATE, parse_http_date ("Sun, 06 Nov 1994 08:49:37 GMT"));
+	EXPECT_EQ (DATE, parse_http_date ("Sunday, 06-Nov-94 08:49:37 GMT"));
+	EXPECT_EQ (DATE, parse_http_date ("Sun Nov  6 08:49:37 1994"));
+
+	EXPECT_EQ (951782400, parse_http_date ("Tue, 29 Feb 2000 00:00:00 GMT"));
+	EXPECT_EQ (0, parse_http_date ("Thu, 01 Jan 1970 00:00:00 GMT"));
+	/* two digit years before 70 are in this century */
+	EXPECT_EQ (951782400, parse_http_date ("Tuesday, 29-Feb-00 00:00:00 GMT"));
+
+	EXPECT_EQ (-1, parse_http_date (NULL));
+	EXPECT_EQ (-1, parse_http_date (""));
+	EXPECT_EQ (-1, parse_http_date ("0"));
+	EXPECT_EQ (-1, parse_http_date ("-1"));
+	EXPECT_EQ (-1, parse_http_date ("Sun, 06 Foo 1994 08:49:37 GMT"));
+	EXPECT_EQ (-1, parse_http_date ("Sun, 32 Nov 1994 08:49:37 GMT"));
+	EXPECT_EQ (-1, parse_http_date ("Sun, 06 Nov 1994 24:49:37 GMT"));
+	EXPECT_EQ (-1, parse_http_date ("Sun, 06 Nov 1994 08:60:37 GMT"));
+	EXPECT_EQ (-1, parse_http_date ("Sun, 06 Nov 1994"));
+}
+
+static HttpResponse *
+create_response (const char *name, const char *value, ...)
+{
+	HttpResponse *response = new HttpResponse ((HttpRequest *) NULL);
+	va_list args;
+
+	response->SetStatus (200, "OK");
+
+	va_start (args, value);
+	while (name != NULL) {
+		response->AppendHeader (name, value);
+		name = va_arg (args, const char *);
+		if (name != NULL)
+			value = va_arg (args, const char *);
+	}
+	va_end (args);
+
+	return response;
+}
+
+TEST(HttpCache, GetExpiration)
+{
+	HttpResponse *response;
+	bool cacheable;
+	gint64 now = DATE + 1000;
+
+	/* max-age is relative to now */
+	response = create_response ("Cache-Control", "public, max-age=60", NULL);
+	EXPECT_EQ (now + 60, HttpCache::GetExpiration (response, now, &cacheable));
+	EXPECT_TRUE (cacheable);
+	response->unref ();
+
+	/* and wins over Expires */
+	response = create_response ("Cache-Control", "max-age=60", "Expires", "Sun, 06 Nov 1994 09:49:37 GMT", NULL);
+	EXPECT_EQ (now + 60, HttpCache::GetExpiration (response, now, &cacheable));
+	response->unref ();
+
+	/* Expires is relative to the server's Date, not to our clock */
+	response = create_response ("Date", "Sun, 06 Nov 1994 08:49:37 GMT", "Expires", "Sun, 06 Nov 1994 09:49:37 GMT", NULL);
+	EXPECT_EQ (now + 3600, HttpCache::GetExpiration (response, now, &cacheable));
+	EXPECT_TRUE (cacheable);
+	response->unref ();
+
+	/* an invalid Expires means already expired, useless without a validator */
+	response = create_response ("Expires", "0", NULL);
+	EXPECT_EQ (0, HttpCache::GetExpiration (response, now, &cacheable));
+	EXPECT_FALSE (cacheable);
+	response->unref ();
+
+	/* but it can be revalidated if there is one */
+	response = create_response ("Expires", "0", "ETag", "\"abc\"", NULL);
+	EXPECT_EQ (0, HttpCache::GetExpiration (response, now, &cacheable));
+	EXPECT_TRUE (cacheable);
+	response->unref ();
+
+	/* no-cache must always be revalidated */
+	response = create_response ("Cache-Control", "no-cache, max-age=60", "ETag", "\"abc\"", NULL);
+	EXPECT_EQ (0, HttpCache::GetExpiration (response, now, &cacheable));
+	EXPECT_TRUE (cacheable);
+	response->unref ();
+
+	response = create_response ("Pragma", "no-cache", "Expires", "Sun, 06 Nov 1994 09:49:37 GMT", NULL);
+	EXPECT_EQ (0, HttpCache::GetExpiration (response, now, &cacheable));
+	EXPECT_FALSE (cacheable);
+	response->unref ();
+
+	/* no-store and Vary on anything but the encoding can't be stored at all */
+	response = create_response ("Cache-Control", "max-age=60, no-store", NULL);
+	EXPECT_EQ (0, HttpCache::GetExpiration (response, now, &cacheable));
+	EXPECT_FALSE (cacheable);
+	response->unref ();
+
+	response = create_response ("Cache-Control", "max-age=60", "Vary", "Cookie", NULL);
+	EXPECT_EQ (0, HttpCache::GetExpiration (response, now, &cacheable));
+	EXPECT_FALSE (cacheable);
+	response->unref ();
+
+	response = create_response ("Cache-Control", "max-age=60", "Vary", "Accept-Encoding", NULL);
+	EXPECT_EQ (now + 60, HttpCache::GetExpiration (response, now, &cacheable));
+	EXPECT_TRUE (cacheable);
+	response->unref ();
+
+	/* without an expiration, 10% of the time since it was last modified */
+	response = create_response ("Date", "Sun, 06 Nov 1994 08:49:37 GMT", "Last-Modified", "Sun, 06 Nov 1994 07:49:37 GMT", NULL);
+	EXPECT_EQ (now + 360, HttpCache::GetExpiration (response, now, &cacheable));
+	EXPECT_TRUE (cacheable);
+	response->unref ();
+
+	/* up to a day */
+	response = create_response ("Date", "Sun, 06 Nov 1994 08:49:37 GMT", "Last-Modified", "Sun, 06 Nov 1984 08:49:37 GMT", NULL);
+	EXPECT_EQ (now + 24 * 60 * 60, HttpCache::GetExpiration (response, now, &cacheable));
+	response->unref ();
+
+	/* nothing at all */
+	response = create_response (NULL, NULL);
+	EXPECT_EQ (0, HttpCache::GetExpiration (response, now, &cacheable));
+	EXPECT_FALSE (cacheable);
+	response->unref ();
+}
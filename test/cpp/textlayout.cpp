@@ -0,0 +1,282 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include <string.h>
+
+#include "textlayout.h"
+
+using namespace Moonlight;
+
+class TestTextAttributes : public ITextAttributes {
+	TextFontDescription *font;
+
+ public:
+	TestTextAttributes ()
+	{
+		font = new TextFontDescription ();
+		font->SetFamily ("Sans");
+		font->SetSize (14.0);
+	}
+
+	virtual ~TestTextAttributes ()
+	{
+		delete font;
+	}
+
+	virtual TextFontDescription *FontDescription () { return font; }
+	virtual FlowDirection Direction () { return FlowDirectionLeftToRight; }
+	virtual TextDecorations Decorations () { return TextDecorationsNone; }
+	virtual Brush *Background (bool selected) { return NULL; }
+	virtual Brush *Foreground (bool selected) { return NULL; }
+};
+
+static const char *paragraphs =
+	"The quick brown fox jumps over the lazy dog, again and again and again.\n"
+	"Pack my box with five dozen liquor jugs, then pack another box with more.\n"
+	"How vexingly quick daft zebras jump when nobody is looking at them at all.";
+
+static TextLayout *
+create_layout (TestTextAttributes *source)
+{
+	TextLayout *layout = new TextLayout ();
+	List *attrs = new List ();
+
+	attrs->Append (new TextLayoutAttributes (source, 0));
+	layout->SetTextAttributes (attrs);
+	layout->SetTextWrapping (TextWrappingWrap);
+	layout->SetMaxWidth (150.0);
+
+	return layout;
+}
+
+static void
+layout_text (TextLayout *layout, const char *text)
+{
+	layout->SetText (text, -1);
+	layout->Layout ();
+}
+
+/* the lines of @layout (laid out around the edits) must be the same as
+ * the lines of a layout of its text from scratch */
+static void
+expect_full_relayout (TextLayout *layout, TestTextAttributes *source)
+{
+	TextLayout *full = create_layout (source);
+	double width, height, full_width, full_height;
+
+	layout_text (full, layout->GetText ());
+
+	layout->GetActualExtents (&width, &height);
+	full->GetActualExtents (&full_width, &full_height);
+	EXPECT_EQ (full_width, width);
+	EXPECT_EQ (full_height, height);
+
+	ASSERT_EQ (full->GetLineCount (), layout->GetLineCount ());
+
+	for (int i = 0; i < full->GetLineCount (); i++) {
+		TextLayoutLine *expected = full->GetLineFromIndex (i);
+		TextLayoutLine *line = layout->GetLineFromIndex (i);
+
+		SCOPED_TRACE (i);
+		EXPECT_EQ (expected->start, line->start);
+		EXPECT_EQ (expected->length, line->length);
+		EXPECT_EQ (expected->offset, line->offset);
+		EXPECT_EQ (expected->count, line->count);
+		EXPECT_EQ (expected->paragraph, line->paragraph);
+		EXPECT_EQ (expected->height, line->height);
+		EXPECT_EQ (expected->width, line->width);
+
+		ASSERT_EQ (expected->runs->len, line->runs->len);
+		for (guint j = 0; j < expected->runs->len; j++) {
+			TextLayoutRun *expected_run = (TextLayoutRun *) expected->runs->pdata[j];
+			TextLayoutRun *run = (TextLayoutRun *) line->runs->pdata[j];
+
+			EXPECT_EQ (expected_run->start, run->start);
+			EXPECT_EQ (expected_run->length, run->length);
+			EXPECT_EQ (expected_run->count, run->count);
+
+			/* clusters are generated when the run is first rendered, the
+			 * ones of reused lines must have been shifted with the line */
+			if (run->clusters->len == 0 || expected_run->clusters->len == 0)
+				continue;
+
+			ASSERT_EQ (expected_run->clusters->len, run->clusters->len);
+			for (guint k = 0; k < run->clusters->len; k++) {
+				TextLayoutGlyphCluster *expected_cluster = (TextLayoutGlyphCluster *) expected_run->clusters->pdata[k];
+				TextLayoutGlyphCluster *cluster = (TextLayoutGlyphCluster *) run->clusters->pdata[k];
+
+				EXPECT_EQ (expected_cluster->start, cluster->start);
+				EXPECT_EQ (expected_cluster->length, cluster->length);
+			}
+		}
+	}
+
+	delete full;
+}
+
+/* @text with @insert inserted at @at (of @text) after removing @remove bytes */
+static char *
+edit (const char *text, int at, int remove, const char *insert)
+{
+	return g_strdup_printf ("%.*s%s%s", at, text, insert, text + at + remove);
+}
+
+/* byte offset of the start of paragraph @n, plus @offset */
+static int
+paragraph_offset (const char *text, int n, int offset)
+{
+	const char *inptr = text;
+
+	while (n-- > 0)
+		inptr = strchr (inptr, '\n') + 1;
+
+	return (inptr - text) + offset;
+}
+
+TEST(TextLayout, IncrementalInsert)
+{
+	TestTextAttributes source;
+	TextLayout *layout = create_layout (&source);
+	double top, bottom;
+	char *text;
+
+	layout_text (layout, paragraphs);
+	ASSERT_GT (layout->GetLineCount (), 3);
+
+	/* a word in the middle of the second paragraph */
+	text = edit (paragraphs, paragraph_offset (paragraphs, 1, 20), 0, "very ");
+	layout_text (layout, text);
+	EXPECT_TRUE (layout->GetDirtyRange (&top, &bottom));
+	EXPECT_GT (top, 0.0);
+	EXPECT_FALSE (layout->GetDirtyRange (&top, &bottom));
+	expect_full_relayout (layout, &source);
+	g_free (text);
+
+	/* multi-byte characters move the following lines by more bytes than characters */
+	text = edit (layout->GetText (), paragraph_offset (layout->GetText (), 1, 10), 0, "\xc3\xa9\xc3\xa9\xe2\x82\xac ");
+	layout_text (layout, text);
+	expect_full_relayout (layout, &source);
+	g_free (text);
+
+	/* enough to wrap onto another line */
+	text = edit (layout->GetText (), paragraph_offset (layout->GetText (), 1, 5), 0, "several more words which need a line of their own ");
+	layout_text (layout, text);
+	expect_full_relayout (layout, &source);
+	g_free (text);
+
+	/* in the first and in the last paragraph */
+	text = edit (layout->GetText (), 4, 0, "very ");
+	layout_text (layout, text);
+	expect_full_relayout (layout, &source);
+	g_free (text);
+
+	text = edit (layout->GetText (), paragraph_offset (layout->GetText (), 2, 8), 0, "very ");
+	layout_text (layout, text);
+	expect_full_relayout (layout, &source);
+	g_free (text);
+
+	delete layout;
+}
+
+TEST(TextLayout, IncrementalDelete)
+{
+	TestTextAttributes source;
+	TextLayout *layout = create_layout (&source);
+	char *text;
+
+	layout_text (layout, paragraphs);
+
+	/* a word in the middle of the second paragraph */
+	text = edit (paragraphs, paragraph_offset (paragraphs, 1, 8), 4, "");
+	layout_text (layout, text);
+	expect_full_relayout (layout, &source);
+	g_free (text);
+
+	/* enough to pull the next line up */
+	text = edit (layout->GetText (), paragraph_offset (layout->GetText (), 1, 4), 30, "");
+	layout_text (layout, text);
+	expect_full_relayout (layout, &source);
+	g_free (text);
+
+	/* a multi-byte character */
+	text = edit (layout->GetText (), paragraph_offset (layout->GetText (), 1, 4), 0, "\xe2\x82\xac");
+	layout_text (layout, text);
+	g_free (text);
+	text = edit (layout->GetText (), paragraph_offset (layout->GetText (), 1, 4), 3, "");
+	layout_text (layout, text);
+	expect_full_relayout (layout, &source);
+	g_free (text);
+
+	delete layout;
+}
+
+TEST(TextLayout, IncrementalLineBreaks)
+{
+	TestTextAttributes source;
+	TextLayout *layout = create_layout (&source);
+	char *text;
+	int at;
+
+	layout_text (layout, paragraphs);
+
+	/* split the second paragraph */
+	at = paragraph_offset (paragraphs, 1, 20);
+	text = edit (paragraphs, at, 0, "\n");
+	layout_text (layout, text);
+	expect_full_relayout (layout, &source);
+	g_free (text);
+
+	/* and join it again */
+	text = edit (layout->GetText (), at, 1, "");
+	layout_text (layout, text);
+	EXPECT_STREQ (paragraphs, layout->GetText ());
+	expect_full_relayout (layout, &source);
+	g_free (text);
+
+	/* join the first two paragraphs */
+	text = edit (layout->GetText (), paragraph_offset (layout->GetText (), 1, -1), 1, " ");
+	layout_text (layout, text);
+	expect_full_relayout (layout, &source);
+	g_free (text);
+
+	/* an empty paragraph at the end */
+	text = g_strdup_printf ("%s\n", layout->GetText ());
+	layout_text (layout, text);
+	expect_full_relayout (layout, &source);
+	g_free (text);
+
+	delete layout;
+}
+
+TEST(TextLayout, IncrementalPendingEdits)
+{
+	TestTextAttributes source;
+	TextLayout *layout = create_layout (&source);
+	char *first, *second;
+
+	layout_text (layout, paragraphs);
+
+	/* two edits before the next layout are merged */
+	first = edit (paragraphs, paragraph_offset (paragraphs, 2, 4), 0, "very ");
+	layout->SetText (first, -1);
+	second = edit (first, paragraph_offset (first, 1, 10), 5, "");
+	layout->SetText (second, -1);
+	layout->Layout ();
+	expect_full_relayout (layout, &source);
+
+	g_free (second);
+	g_free (first);
+	delete layout;
+}
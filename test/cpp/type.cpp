@@ -0,0 +1,96 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include <string.h>
+
+#include "deployment.h"
+#include "type.h"
+
+using namespace Moonlight;
+
+TEST(Types, HashName)
+{
+	// FNV-1a test vectors, the generator must produce the same values
+	EXPECT_EQ (2166136261U, Types::HashName ("", 0));
+	EXPECT_EQ (0xe40c292cU, Types::HashName ("a", 0));
+	EXPECT_EQ (0xbf9cf968U, Types::HashName ("foobar", 0));
+
+	// names are lowercased before hashing
+	EXPECT_EQ (Types::HashName ("foobar", 0), Types::HashName ("FooBar", 0));
+	EXPECT_EQ (Types::HashName ("foobar", 12345), Types::HashName ("FOOBAR", 12345));
+	EXPECT_NE (Types::HashName ("foobar", 0), Types::HashName ("foobar", 1));
+}
+
+TEST(Types, FindNative)
+{
+	Types *types = Deployment::GetCurrent ()->GetTypes ();
+	int count = 0;
+
+	for (int i = Type::INVALID + 1; i < Type::LASTTYPE; i++) {
+		Type *type = types->Find ((Type::Kind) i);
+
+		if (type == NULL || type->GetName () == NULL)
+			continue;
+
+		const char *name = type->GetName ();
+		char *lower = g_ascii_strdown (name, -1);
+		char *upper = g_ascii_strup (name, -1);
+
+		SCOPED_TRACE (name);
+
+		EXPECT_EQ (type, types->Find (name));
+		EXPECT_EQ (type, types->Find (name, false));
+		EXPECT_EQ (type, types->Find (lower, true));
+		EXPECT_EQ (type, types->Find (upper, true));
+
+		// a case sensitive lookup only finds the exact name
+		if (strcmp (name, lower))
+			EXPECT_TRUE (types->Find (lower, false) == NULL);
+		if (strcmp (name, upper))
+			EXPECT_TRUE (types->Find (upper, false) == NULL);
+
+		g_free (upper);
+		g_free (lower);
+		count++;
+	}
+
+	EXPECT_LT (100, count);
+}
+
+TEST(Types, FindNativeMisses)
+{
+	Types *types = Deployment::GetCurrent ()->GetTypes ();
+	const char *misses [] = {
+		"",
+		"NotAType",
+		"UIElemen",
+		"UIElementX",
+		"UI Element",
+		"System.Windows.UIElement",
+		"DependencyObject ",
+		"Moonlight",
+		NULL
+	};
+
+	for (int i = 0; misses [i]; i++) {
+		SCOPED_TRACE (misses [i]);
+		EXPECT_TRUE (types->Find (misses [i], false) == NULL);
+		EXPECT_TRUE (types->Find (misses [i], true) == NULL);
+	}
+
+	// Enum and DateTime aren't generated types, but are in the table
+	EXPECT_EQ (Type::ENUM, types->Find ("enum", true)->GetKind ());
+	EXPECT_EQ (Type::DATETIME, types->Find ("DateTime", false)->GetKind ());
+}
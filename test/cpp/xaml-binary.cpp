@@ -0,0 +1,154 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include <string.h>
+
+#include "xaml-binary.h"
+
+using namespace Moonlight;
+
+static const char *xaml = "<Canvas><Rectangle Width=\"10\"/></Canvas>";
+
+static guint32
+get_uint32 (GByteArray *array, guint32 offset)
+{
+	guint32 value;
+
+	memcpy (&value, array->data + offset, 4);
+	return GUINT32_FROM_LE (value);
+}
+
+static void
+set_uint32 (GByteArray *array, guint32 offset, guint32 value)
+{
+	value = GUINT32_TO_LE (value);
+	memcpy (array->data + offset, &value, 4);
+}
+
+/* offset of the first event, from the header */
+static guint32
+get_events_offset (GByteArray *array)
+{
+	return get_uint32 (array, 8 * 4);
+}
+
+/* reads every event of @array, returns how many there were */
+static int
+read_events (GByteArray *array, bool *corrupt)
+{
+	XamlBinaryDocument *doc;
+	XamlBinaryEvent event;
+	int count = 0;
+
+	doc = XamlBinaryDocument::Open (array->data, array->len);
+	if (doc == NULL) {
+		*corrupt = true;
+		return -1;
+	}
+
+	while (doc->NextEvent (&event))
+		count++;
+
+	*corrupt = doc->IsCorrupt ();
+	delete doc;
+
+	return count;
+}
+
+TEST(XamlBinary, RoundTrip)
+{
+	GByteArray *binary;
+	bool corrupt;
+
+	binary = XamlBinaryWriter::Compile (xaml, strlen (xaml), NULL);
+	ASSERT_TRUE (binary != NULL);
+
+	EXPECT_TRUE (XamlBinaryDocument::IsBinary (binary->data, binary->len));
+	EXPECT_STREQ (xaml, XamlBinaryDocument::GetSource (binary->data, binary->len));
+
+	// start Canvas, start Rectangle, end Rectangle, end Canvas
+	EXPECT_EQ (4, read_events (binary, &corrupt));
+	EXPECT_FALSE (corrupt);
+
+	g_byte_array_free (binary, true);
+}
+
+TEST(XamlBinary, Truncated)
+{
+	GByteArray *binary;
+	bool corrupt;
+
+	binary = XamlBinaryWriter::Compile (xaml, strlen (xaml), NULL);
+	ASSERT_TRUE (binary != NULL);
+
+	// the events run to the end of the document
+	g_byte_array_set_size (binary, binary->len - 6);
+	read_events (binary, &corrupt);
+	EXPECT_TRUE (corrupt);
+
+	// not even a header
+	g_byte_array_set_size (binary, 10);
+	EXPECT_TRUE (XamlBinaryDocument::Open (binary->data, binary->len) == NULL);
+	EXPECT_TRUE (XamlBinaryDocument::GetSource (binary->data, binary->len) == NULL);
+
+	g_byte_array_free (binary, true);
+}
+
+TEST(XamlBinary, ByteIndexPastSource)
+{
+	GByteArray *binary;
+	bool corrupt;
+
+	binary = XamlBinaryWriter::Compile (xaml, strlen (xaml), NULL);
+	ASSERT_TRUE (binary != NULL);
+
+	// the byte index of the first event, right after its op
+	set_uint32 (binary, get_events_offset (binary) + 4, strlen (xaml) + 1);
+	EXPECT_EQ (0, read_events (binary, &corrupt));
+	EXPECT_TRUE (corrupt);
+
+	set_uint32 (binary, get_events_offset (binary) + 4, 0xffffffff);
+	EXPECT_EQ (0, read_events (binary, &corrupt));
+	EXPECT_TRUE (corrupt);
+
+	// the end of the source is a valid position
+	set_uint32 (binary, get_events_offset (binary) + 4, strlen (xaml));
+	EXPECT_EQ (1, read_events (binary, &corrupt));
+	EXPECT_TRUE (corrupt); // the next event goes back
+
+	g_byte_array_free (binary, true);
+}
+
+TEST(XamlBinary, ByteIndexGoesBack)
+{
+	GByteArray *binary;
+	guint32 second;
+	bool corrupt;
+
+	binary = XamlBinaryWriter::Compile (xaml, strlen (xaml), NULL);
+	ASSERT_TRUE (binary != NULL);
+
+	// start Canvas is op, byte index, line, column, name, attribute count
+	second = get_events_offset (binary) + 6 * 4;
+	EXPECT_EQ ((guint32) XamlBinaryStartElement, get_uint32 (binary, second));
+	EXPECT_EQ ((guint32) 8, get_uint32 (binary, second + 4));
+
+	set_uint32 (binary, second + 4, 7);
+	set_uint32 (binary, get_events_offset (binary) + 4, 8);
+	EXPECT_EQ (1, read_events (binary, &corrupt));
+	EXPECT_TRUE (corrupt);
+
+	g_byte_array_free (binary, true);
+}
@@ -0,0 +1,121 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include <string.h>
+
+#include "yuv-converter.h"
+#include "cpu.h"
+
+using namespace Moonlight;
+
+#define MAX_WIDTH 41
+#define HEIGHT 5
+
+static guint8 *
+create_random (guint32 size, guint32 seed)
+{
+	GRand *rand = g_rand_new_with_seed (seed);
+	guint8 *data = (guint8 *) g_malloc (size);
+
+	for (guint32 i = 0; i < size; i++)
+		data [i] = (guint8) g_rand_int (rand);
+
+	// values outside of the video range clamp
+	data [0] = 0;
+	data [1] = 255;
+	data [2] = 16;
+	data [3] = 235;
+
+	g_rand_free (rand);
+
+	return data;
+}
+
+TEST(YUVConverter, PackedSIMDMatchesScalar)
+{
+	// odd strides and an odd start, so that no row is aligned
+	int src_stride = MAX_WIDTH * 2 + 3;
+	int dest_stride = MAX_WIDTH * 4 + 4;
+	guint8 *src = create_random (src_stride * HEIGHT + 1, 1);
+	guint8 *simd = (guint8 *) g_malloc (dest_stride * HEIGHT + 1);
+	guint8 *scalar = (guint8 *) g_malloc (dest_stride * HEIGHT + 1);
+
+	for (int uyvy = 0; uyvy < 2; uyvy++) {
+		// packed formats come in pairs of pixels
+		for (int width = 2; width <= MAX_WIDTH - 1; width += 2) {
+			SCOPED_TRACE (testing::Message () << (uyvy ? "UYVY" : "YUYV") << ", width " << width);
+
+			memset (simd, 0xcc, dest_stride * HEIGHT + 1);
+			memset (scalar, 0xcc, dest_stride * HEIGHT + 1);
+
+			CPU::SetSIMDEnabled (true);
+			YUVConverter::PackedToBGRA (src + 1, src_stride, width, HEIGHT, simd + 1, dest_stride, uyvy);
+			CPU::SetSIMDEnabled (false);
+			YUVConverter::PackedToBGRA (src + 1, src_stride, width, HEIGHT, scalar + 1, dest_stride, uyvy);
+			CPU::SetSIMDEnabled (true);
+
+			EXPECT_EQ (0, memcmp (simd, scalar, dest_stride * HEIGHT + 1));
+			// the padding at the end of the rows wasn't touched
+			EXPECT_EQ (0xcc, simd [1 + width * 4]);
+		}
+	}
+
+	g_free (scalar);
+	g_free (simd);
+	g_free (src);
+}
+
+TEST(YUVConverter, PlanarSIMDMatchesScalar)
+{
+	int strides [3] = { MAX_WIDTH + 3, (MAX_WIDTH + 1) / 2 + 1, (MAX_WIDTH + 1) / 2 + 5 };
+	int dest_stride = MAX_WIDTH * 4 + 4;
+	guint8 *y = create_random (strides [0] * HEIGHT + 1, 2);
+	guint8 *u = create_random (strides [1] * ((HEIGHT + 1) / 2) + 1, 3);
+	guint8 *v = create_random (strides [2] * ((HEIGHT + 1) / 2) + 1, 4);
+	guint8 *planes [3] = { y + 1, u + 1, v + 1 };
+	guint8 *simd = (guint8 *) g_malloc (dest_stride * HEIGHT + 1);
+	guint8 *scalar = (guint8 *) g_malloc (dest_stride * HEIGHT + 1);
+
+	for (int width = 1; width <= MAX_WIDTH; width++) {
+		SCOPED_TRACE (width);
+
+		memset (simd, 0xcc, dest_stride * HEIGHT + 1);
+		memset (scalar, 0xcc, dest_stride * HEIGHT + 1);
+
+		CPU::SetSIMDEnabled (true);
+		YUVConverter::PlanarToBGRA (planes, strides, width, HEIGHT, simd + 1, dest_stride);
+		CPU::SetSIMDEnabled (false);
+		YUVConverter::PlanarToBGRA (planes, strides, width, HEIGHT, scalar + 1, dest_stride);
+		CPU::SetSIMDEnabled (true);
+
+		EXPECT_EQ (0, memcmp (simd, scalar, dest_stride * HEIGHT + 1));
+		EXPECT_EQ (0xcc, simd [1 + width * 4]);
+	}
+
+	// converting in bands of even rows gives the same result as the whole frame
+	CPU::SetSIMDEnabled (true);
+	YUVConverter::PlanarToBGRA (planes, strides, MAX_WIDTH, HEIGHT, scalar + 1, dest_stride);
+	for (int row = 0; row < HEIGHT; row += 2) {
+		guint8 *band [3] = { planes [0] + row * strides [0], planes [1] + (row / 2) * strides [1], planes [2] + (row / 2) * strides [2] };
+		YUVConverter::PlanarToBGRA (band, strides, MAX_WIDTH, MIN (2, HEIGHT - row), simd + 1 + row * dest_stride, dest_stride);
+	}
+	EXPECT_EQ (0, memcmp (simd, scalar, dest_stride * HEIGHT + 1));
+
+	g_free (scalar);
+	g_free (simd);
+	g_free (v);
+	g_free (u);
+	g_free (y);
+}
@@ -0,0 +1,304 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * mxamlc.cpp: tokenizes xaml to binary xaml, and compares how long both take to load
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2010 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <gtk/gtk.h>
+#include "runtime.h"
+#include "deployment.h"
+#include "xaml.h"
+#include "xaml-binary.h"
+#include "xaml-precompiler.h"
+
+using namespace Moonlight;
+
+static void
+usage ()
+{
+	printf ("usage: mxamlc FILE.xaml [OUTPUT]\n");
+	printf ("         tokenizes FILE.xaml to binary xaml (FILE.xaml.mxb by default)\n");
+	printf ("       mxamlc --benchmark [--iterations N] FILE.xaml\n");
+	printf ("         loads FILE.xaml N times as text and as binary xaml and prints the times\n");
+	printf ("       mxamlc --benchmark --parallel [--iterations N] FILE.xaml...\n");
+	printf ("         loads all the files as text, and with a XamlPrecompiler compiling them in the background\n");
+}
+
+static GByteArray *
+tokenize (const char *filename, gchar **text, gsize *length)
+{
+	GError *err = NULL;
+	MoonError error;
+	GByteArray *binary;
+
+	if (!g_file_get_contents (filename, text, length, &err)) {
+		fprintf (stderr, "mxamlc: %s\n", err->message);
+		g_error_free (err);
+		return NULL;
+	}
+
+	if (!(binary = XamlBinaryWriter::Compile (*text, *length, &error))) {
+		fprintf (stderr, "%s(%i,%i): error %i: %s\n", filename, error.line_number, error.char_position, error.code, error.message);
+		g_free (*text);
+		*text = NULL;
+	}
+
+	return binary;
+}
+
+static double
+load (SL3XamlLoader *loader, const char *text, GByteArray *binary, int iterations)
+{
+	GTimer *timer = g_timer_new ();
+	Type::Kind kind;
+	Value *v;
+
+	for (int i = 0; i < iterations; i++) {
+		if (binary)
+			v = loader->HydrateFromBinary (binary->data, binary->len, NULL, true, &kind, XamlLoader::IMPORT_DEFAULT_XMLNS, NULL);
+		else
+			v = loader->HydrateFromString (text, NULL, true, &kind, XamlLoader::IMPORT_DEFAULT_XMLNS);
+
+		if (!v) {
+			fprintf (stderr, "mxamlc: could not load the %s xaml\n", binary ? "binary" : "text");
+			g_timer_destroy (timer);
+			return -1;
+		}
+
+		delete v;
+	}
+
+	double elapsed = g_timer_elapsed (timer, NULL);
+	g_timer_destroy (timer);
+
+	return elapsed * 1000.0 / iterations;
+}
+
+static int
+benchmark (const char *filename, int iterations)
+{
+	SL3XamlLoader *loader;
+	GByteArray *binary;
+	gchar *text;
+	gsize length;
+	double text_time, binary_time;
+	GTimer *timer = g_timer_new ();
+
+	binary = tokenize (filename, &text, &length);
+	g_timer_stop (timer);
+
+	if (!binary) {
+		g_timer_destroy (timer);
+		return 1;
+	}
+
+	printf ("%s: %" G_GSIZE_FORMAT " bytes of xaml, %u bytes of binary xaml, tokenized in %.2f ms\n", filename, length, binary->len,
+		g_timer_elapsed (timer, NULL) * 1000.0);
+	g_timer_destroy (timer);
+
+	Deployment::SetCurrent (new Deployment ());
+	loader = new SL3XamlLoader (NULL, NULL);
+
+	// warm up the type tables and the caches
+	text_time = load (loader, text, NULL, 1);
+	binary_time = load (loader, NULL, binary, 1);
+
+	if (text_time >= 0)
+		text_time = load (loader, text, NULL, iterations);
+	if (binary_time >= 0)
+		binary_time = load (loader, NULL, binary, iterations);
+
+	if (text_time >= 0 && binary_time >= 0) {
+		printf ("  text:   %8.3f ms per load\n", text_time);
+		printf ("  binary: %8.3f ms per load (%.1f%%)\n", binary_time, binary_time * 100.0 / text_time);
+	}
+
+	delete loader;
+	g_byte_array_free (binary, true);
+	g_free (text);
+
+	return text_time >= 0 && binary_time >= 0 ? 0 : 1;
+}
+
+static double
+load_all (SL3XamlLoader *loader, GPtrArray *texts, bool precompile)
+{
+	XamlPrecompiler *precompiler = precompile ? new XamlPrecompiler () : NULL;
+	GTimer *timer = g_timer_new ();
+	GByteArray *binary;
+	Type::Kind kind;
+	Value *v;
+	guint i;
+
+	if (precompiler) {
+		for (i = 0; i < texts->len; i++)
+			precompiler->Queue ("", texts->pdata [i], strlen ((const char *) texts->pdata [i]));
+	}
+
+	for (i = 0; i < texts->len; i++) {
+		const char *text = (const char *) texts->pdata [i];
+
+		if (precompiler && (binary = precompiler->Take (text, strlen (text)))) {
+			v = loader->HydrateFromBinary (binary->data, binary->len, NULL, true, &kind, XamlLoader::IMPORT_DEFAULT_XMLNS, NULL);
+			g_byte_array_free (binary, true);
+		} else {
+			v = loader->HydrateFromString (text, NULL, true, &kind, XamlLoader::IMPORT_DEFAULT_XMLNS);
+		}
+
+		if (!v) {
+			fprintf (stderr, "mxamlc: could not load file #%u\n", i + 1);
+			g_timer_destroy (timer);
+			delete precompiler;
+			return -1;
+		}
+
+		delete v;
+	}
+
+	double elapsed = g_timer_elapsed (timer, NULL);
+	g_timer_destroy (timer);
+	delete precompiler;
+
+	return elapsed * 1000.0;
+}
+
+static int
+benchmark_parallel (char **filenames, int count, int iterations)
+{
+	GPtrArray *texts = g_ptr_array_new ();
+	SL3XamlLoader *loader;
+	double text_time = 0, parallel_time = 0, t;
+	GError *err = NULL;
+	gchar *text;
+	int i, result = 0;
+
+	for (i = 0; i < count; i++) {
+		if (!g_file_get_contents (filenames [i], &text, NULL, &err)) {
+			fprintf (stderr, "mxamlc: %s\n", err->message);
+			g_error_free (err);
+			result = 1;
+			goto done;
+		}
+
+		g_ptr_array_add (texts, text);
+	}
+
+	Deployment::SetCurrent (new Deployment ());
+	loader = new SL3XamlLoader (NULL, NULL);
+
+	// warm up the type tables and the caches
+	if (load_all (loader, texts, false) < 0) {
+		result = 1;
+	} else {
+		for (i = 0; i < iterations && result == 0; i++) {
+			if ((t = load_all (loader, texts, false)) < 0)
+				result = 1;
+			text_time += t;
+
+			if ((t = load_all (loader, texts, true)) < 0)
+				result = 1;
+			parallel_time += t;
+		}
+	}
+
+	if (result == 0) {
+		printf ("%i documents\n", count);
+		printf ("  text:     %8.3f ms per load of all documents\n", text_time / iterations);
+		printf ("  parallel: %8.3f ms per load of all documents (%.1f%%)\n", parallel_time / iterations,
+			parallel_time * 100.0 / text_time);
+	}
+
+	delete loader;
+
+ done:
+	for (i = 0; i < (int) texts->len; i++)
+		g_free (texts->pdata [i]);
+	g_ptr_array_free (texts, true);
+
+	return result;
+}
+
+int
+main (int argc, char **argv)
+{
+	const char *input = NULL;
+	const char *output = NULL;
+	bool run_benchmark = false;
+	bool parallel = false;
+	char **inputs = g_new0 (char *, argc);
+	int input_count = 0;
+	int iterations = 20;
+	GByteArray *binary;
+	GError *err = NULL;
+	char *filename;
+	gchar *text;
+	gsize length;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp (argv [i], "--benchmark")) {
+			run_benchmark = true;
+		} else if (!strcmp (argv [i], "--parallel")) {
+			parallel = true;
+		} else if (!strcmp (argv [i], "--iterations") && i + 1 < argc) {
+			iterations = MAX (atoi (argv [++i]), 1);
+		} else if (!strcmp (argv [i], "--help")) {
+			usage ();
+			return 0;
+		} else if (argv [i][0] == '-') {
+			usage ();
+			return 1;
+		} else if (!input) {
+			input = argv [i];
+			inputs [input_count++] = argv [i];
+		} else if (parallel) {
+			inputs [input_count++] = argv [i];
+		} else if (!output) {
+			output = argv [i];
+		} else {
+			usage ();
+			return 1;
+		}
+	}
+
+	if (!input) {
+		usage ();
+		return 1;
+	}
+
+	if (run_benchmark) {
+		gtk_init (&argc, &argv);
+		Runtime::InitDesktop ();
+
+		if (parallel)
+			return benchmark_parallel (inputs, input_count, iterations);
+
+		return benchmark (input, iterations);
+	}
+
+	if (!(binary = tokenize (input, &text, &length)))
+		return 1;
+
+	filename = output ? g_strdup (output) : g_strdup_printf ("%s.mxb", input);
+
+	if (!g_file_set_contents (filename, (const gchar *) binary->data, binary->len, &err)) {
+		fprintf (stderr, "mxamlc: %s\n", err->message);
+		g_error_free (err);
+	}
+
+	g_free (filename);
+	g_byte_array_free (binary, true);
+	g_free (text);
+
+	return err ? 1 : 0;
+}